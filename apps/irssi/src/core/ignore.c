@@ -35,7 +35,32 @@
 
 GSList *ignores;
 
+#define IGNORE_CACHE_MAX 512
+
+/* ignores that apply to one server tag, in the same order as `ignores' */
+typedef struct {
+	GSList *ignores;
+	int levels; /* all levels ignored by `ignores' */
+
+	/* nick!host@channel -> list of matching ignores */
+	GHashTable *cache;
+	int cache_size;
+} IGNORE_BUCKET_REC;
+
+typedef struct {
+	char *channel;
+	char *nick;
+	char *host;
+} IGNORE_CACHE_KEY;
+
+typedef struct {
+	GHashTable *servers; /* servertag -> IGNORE_BUCKET_REC */
+	IGNORE_BUCKET_REC any_server; /* ignores without servertag */
+	int replies; /* TRUE if there's reply ignores */
+} IGNORE_TABLE_REC;
+
 static NICKMATCH_REC *nickmatch;
+static IGNORE_TABLE_REC *ignore_table;
 static int time_tag;
 
 /* check if `text' contains ignored nick at the start of the line. */
@@ -117,14 +142,204 @@ static int ignore_match_pattern(IGNORE_REC *rec, const char *text)
 	((rec)->servertag == NULL || \
 	g_strcasecmp((server)->tag, (rec)->servertag) == 0)
 
+static unsigned int ignore_cache_hash(IGNORE_CACHE_KEY *key)
+{
+	return g_str_hash(key->nick) ^ (g_str_hash(key->host) << 1) ^
+		g_str_hash(key->channel);
+}
+
+static int ignore_cache_equal(IGNORE_CACHE_KEY *key1, IGNORE_CACHE_KEY *key2)
+{
+	return strcmp(key1->nick, key2->nick) == 0 &&
+		strcmp(key1->host, key2->host) == 0 &&
+		strcmp(key1->channel, key2->channel) == 0;
+}
+
+static int ignore_cache_remove(IGNORE_CACHE_KEY *key, GSList *list)
+{
+	g_slist_free(list);
+	g_free(key);
+	return TRUE;
+}
+
+static IGNORE_BUCKET_REC *ignore_bucket_create(void)
+{
+	IGNORE_BUCKET_REC *bucket;
+
+	bucket = g_new0(IGNORE_BUCKET_REC, 1);
+	bucket->cache = g_hash_table_new((GHashFunc) ignore_cache_hash,
+					 (GCompareFunc) ignore_cache_equal);
+	return bucket;
+}
+
+static void ignore_bucket_destroy(IGNORE_BUCKET_REC *bucket)
+{
+	g_hash_table_foreach_remove(bucket->cache,
+				    (GHRFunc) ignore_cache_remove, NULL);
+	g_hash_table_destroy(bucket->cache);
+	g_slist_free(bucket->ignores);
+}
+
+static void ignore_bucket_add(void *key, IGNORE_BUCKET_REC *bucket,
+			      IGNORE_REC *rec)
+{
+	bucket->ignores = g_slist_prepend(bucket->ignores, rec);
+	bucket->levels |= rec->level;
+}
+
+static void ignore_bucket_finish(void *key, IGNORE_BUCKET_REC *bucket)
+{
+	bucket->ignores = g_slist_reverse(bucket->ignores);
+}
+
+static void ignore_table_free_bucket(void *key, IGNORE_BUCKET_REC *bucket)
+{
+	ignore_bucket_destroy(bucket);
+	g_free(bucket);
+}
+
+/* Split the ignores by server tag. Ignores without a server tag are
+   added to every bucket so each bucket keeps the original list order. */
+static IGNORE_TABLE_REC *ignore_table_create(void)
+{
+	IGNORE_TABLE_REC *table;
+	IGNORE_BUCKET_REC *bucket;
+	GSList *tmp;
+
+	table = g_new0(IGNORE_TABLE_REC, 1);
+	table->servers = g_hash_table_new((GHashFunc) g_istr_hash,
+					  (GCompareFunc) g_istr_equal);
+	table->any_server.cache =
+		g_hash_table_new((GHashFunc) ignore_cache_hash,
+				 (GCompareFunc) ignore_cache_equal);
+
+	for (tmp = ignores; tmp != NULL; tmp = tmp->next) {
+		IGNORE_REC *rec = tmp->data;
+
+		if (rec->servertag != NULL &&
+		    g_hash_table_lookup(table->servers, rec->servertag) == NULL) {
+			g_hash_table_insert(table->servers, rec->servertag,
+					    ignore_bucket_create());
+		}
+	}
+
+	for (tmp = ignores; tmp != NULL; tmp = tmp->next) {
+		IGNORE_REC *rec = tmp->data;
+
+		if (rec->mask != NULL && rec->replies)
+			table->replies = TRUE;
+
+		if (rec->servertag != NULL) {
+			bucket = g_hash_table_lookup(table->servers,
+						     rec->servertag);
+			ignore_bucket_add(NULL, bucket, rec);
+		} else {
+			ignore_bucket_add(NULL, &table->any_server, rec);
+			g_hash_table_foreach(table->servers,
+					     (GHFunc) ignore_bucket_add, rec);
+		}
+	}
+
+	ignore_bucket_finish(NULL, &table->any_server);
+	g_hash_table_foreach(table->servers,
+			     (GHFunc) ignore_bucket_finish, NULL);
+	return table;
+}
+
+static void ignore_table_destroy(IGNORE_TABLE_REC *table)
+{
+	g_hash_table_foreach(table->servers,
+			     (GHFunc) ignore_table_free_bucket, NULL);
+	g_hash_table_destroy(table->servers);
+	ignore_bucket_destroy(&table->any_server);
+	g_free(table);
+}
+
+/* ignore list changed - drop all cached matches */
+static void ignores_changed(void)
+{
+	if (ignore_table != NULL) {
+		ignore_table_destroy(ignore_table);
+		ignore_table = NULL;
+	}
+	nickmatch_rebuild(nickmatch);
+}
+
+static IGNORE_BUCKET_REC *ignore_get_bucket(SERVER_REC *server)
+{
+	IGNORE_BUCKET_REC *bucket;
+
+	if (ignore_table == NULL)
+		ignore_table = ignore_table_create();
+
+	bucket = g_hash_table_lookup(ignore_table->servers, server->tag);
+	return bucket != NULL ? bucket : &ignore_table->any_server;
+}
+
+/* Return the ignores whose mask and channels match nick!host in channel.
+   The results are cached until the ignore list changes. */
+static GSList *ignore_get_nick_matches(IGNORE_BUCKET_REC *bucket,
+				       const char *channel, const char *nick,
+				       const char *host)
+{
+	IGNORE_CACHE_KEY key, *newkey;
+	GSList *tmp, *matches;
+	void *origkey, *value;
+	char *nickmask;
+	int channel_len, nick_len, host_len;
+
+	key.channel = (char *) (channel == NULL ? "" : channel);
+	key.nick = (char *) nick;
+	key.host = (char *) (host == NULL ? "" : host);
+
+	if (g_hash_table_lookup_extended(bucket->cache, &key,
+					 &origkey, &value))
+		return value;
+
+	matches = NULL;
+	nickmask = g_strconcat(key.nick, "!", key.host, NULL);
+	for (tmp = bucket->ignores; tmp != NULL; tmp = tmp->next) {
+		IGNORE_REC *rec = tmp->data;
+
+		if (ignore_match_channel(rec, channel) &&
+		    ignore_match_nickmask(rec, nick, nickmask))
+			matches = g_slist_append(matches, rec);
+	}
+	g_free(nickmask);
+
+	if (bucket->cache_size >= IGNORE_CACHE_MAX) {
+		g_hash_table_foreach_remove(bucket->cache,
+					    (GHRFunc) ignore_cache_remove,
+					    NULL);
+		bucket->cache_size = 0;
+	}
+
+	/* key and its strings in one allocation */
+	channel_len = strlen(key.channel)+1;
+	nick_len = strlen(key.nick)+1;
+	host_len = strlen(key.host)+1;
+	newkey = g_malloc(sizeof(IGNORE_CACHE_KEY) +
+			  channel_len + nick_len + host_len);
+	newkey->channel = (char *) (newkey+1);
+	newkey->nick = newkey->channel + channel_len;
+	newkey->host = newkey->nick + nick_len;
+	memcpy(newkey->channel, key.channel, channel_len);
+	memcpy(newkey->nick, key.nick, nick_len);
+	memcpy(newkey->host, key.host, host_len);
+
+	g_hash_table_insert(bucket->cache, newkey, matches);
+	bucket->cache_size++;
+	return matches;
+}
+
 int ignore_check(SERVER_REC *server, const char *nick, const char *host,
 		 const char *channel, const char *text, int level)
 {
+	IGNORE_BUCKET_REC *bucket;
 	CHANNEL_REC *chanrec;
 	NICK_REC *nickrec;
         IGNORE_REC *rec;
 	GSList *tmp;
-        char *nickmask;
         int len, best_mask, best_match, best_patt;
 
 	g_return_val_if_fail(server != NULL, 0);
@@ -132,6 +347,8 @@ int ignore_check(SERVER_REC *server, const char *nick, const char *host,
 
 	chanrec = server == NULL || channel == NULL ? NULL :
 		channel_find(server, channel);
+
+	bucket = ignore_get_bucket(server);
 	if (chanrec != NULL && nick != NULL &&
 	    (nickrec = nicklist_find(chanrec, nick)) != NULL) {
                 /* nick found - check only ignores in nickmatch cache */
@@ -139,23 +356,18 @@ int ignore_check(SERVER_REC *server, const char *nick, const char *host,
 			nicklist_set_host(chanrec, nickrec, host);
 
 		tmp = nickmatch_find(nickmatch, nickrec);
-		nickmask = NULL;
+	} else if ((level & bucket->levels) != 0) {
+		tmp = ignore_get_nick_matches(bucket, channel, nick, host);
 	} else {
-		tmp = ignores;
-		nickmask = g_strconcat(nick, "!", host, NULL);
+		/* nothing ignores this level in this server */
+		tmp = NULL;
 	}
 
         best_mask = best_patt = -1; best_match = FALSE;
 	for (; tmp != NULL; tmp = tmp->next) {
-		int match = 1;
 		rec = tmp->data;
 
-		if (nickmask != NULL)
-			match = ignore_match_server(rec, server) &&
-				ignore_match_channel(rec, channel) &&
-				ignore_match_nickmask(rec, nick, nickmask);
-		if (match &&
-		    ignore_match_level(rec, level) &&
+		if (ignore_match_level(rec, level) &&
 		    ignore_match_pattern(rec, text)) {
 			len = rec->mask == NULL ? 0 : strlen(rec->mask);
 			if (len > best_mask) {
@@ -171,9 +383,9 @@ int ignore_check(SERVER_REC *server, const char *nick, const char *host,
 			}
 		}
 	}
-        g_free(nickmask);
 
-	if (best_match || (level & MSGLEVEL_PUBLIC) == 0)
+	if (best_match || (level & MSGLEVEL_PUBLIC) == 0 ||
+	    !ignore_table->replies)
 		return best_match;
 
         return ignore_check_replies(chanrec, text);
@@ -308,7 +520,7 @@ void ignore_add_rec(IGNORE_REC *rec)
 	ignore_set_config(rec);
 
 	signal_emit("ignore created", 1, rec);
-	nickmatch_rebuild(nickmatch);
+	ignores_changed();
 }
 
 static void ignore_destroy(IGNORE_REC *rec, int send_signal)
@@ -326,7 +538,7 @@ static void ignore_destroy(IGNORE_REC *rec, int send_signal)
 	g_free_not_null(rec->pattern);
 	g_free(rec);
 
-	nickmatch_rebuild(nickmatch);
+	ignores_changed();
 }
 
 void ignore_update_rec(IGNORE_REC *rec)
@@ -345,7 +557,7 @@ void ignore_update_rec(IGNORE_REC *rec)
 
                 ignore_init_rec(rec);
 		signal_emit("ignore changed", 1, rec);
-		nickmatch_rebuild(nickmatch);
+		ignores_changed();
 	}
 }
 
@@ -379,7 +591,7 @@ static void read_ignores(void)
 
 	node = iconfig_node_traverse("ignores", FALSE);
 	if (node == NULL) {
-		nickmatch_rebuild(nickmatch);
+		ignores_changed();
 		return;
 	}
 
@@ -409,7 +621,7 @@ static void read_ignores(void)
 		ignore_init_rec(rec);
 	}
 
-	nickmatch_rebuild(nickmatch);
+	ignores_changed();
 }
 
 static void ignore_nick_cache(GHashTable *list, CHANNEL_REC *channel,
@@ -85,6 +85,12 @@ void nicklist_insert(CHANNEL_REC *channel, NICK_REC *nick)
 	signal_emit("nicklist new", 2, channel, nick);
 }
 
+void nicklist_insert_many(CHANNEL_REC *channel, GSList *nicks)
+{
+	for (; nicks != NULL; nicks = nicks->next)
+		nicklist_insert(channel, nicks->data);
+}
+
 /* Set host address for nick */
 void nicklist_set_host(CHANNEL_REC *channel, NICK_REC *nick, const char *host)
 {
@@ -122,6 +128,16 @@ void nicklist_remove(CHANNEL_REC *channel, NICK_REC *nick)
 	nicklist_destroy(channel, nick);
 }
 
+void nicklist_remove_many(CHANNEL_REC *channel, GSList *nicks)
+{
+	g_return_if_fail(IS_CHANNEL(channel));
+
+	for (; nicks != NULL; nicks = nicks->next) {
+		nick_hash_remove(channel, nicks->data);
+		nicklist_destroy(channel, nicks->data);
+	}
+}
+
 static void nicklist_rename_list(SERVER_REC *server, void *new_nick_id,
 				 const char *old_nick, const char *new_nick,
 				 GSList *nicks)
@@ -20,6 +20,10 @@ void nicklist_insert(CHANNEL_REC *channel, NICK_REC *nick);
 void nicklist_set_host(CHANNEL_REC *channel, NICK_REC *nick, const char *host);
 /* Remove nick from list */
 void nicklist_remove(CHANNEL_REC *channel, NICK_REC *nick);
+/* Add/remove many nicks at once, "nicklist new"/"nicklist remove" is
+   sent for each of them */
+void nicklist_insert_many(CHANNEL_REC *channel, GSList *nicks);
+void nicklist_remove_many(CHANNEL_REC *channel, GSList *nicks);
 /* Change nick */
 void nicklist_rename(SERVER_REC *server, const char *old_nick,
 		     const char *new_nick);
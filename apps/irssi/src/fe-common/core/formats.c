@@ -44,6 +44,12 @@ static int hide_text_style, hide_server_tags, hide_colors;
 static int timestamp_level;
 static int timestamp_timeout;
 
+/* the last timestamp created, and what it was created from */
+static char *timestamp_str, *timestamp_format, *timestamp_target;
+static void *timestamp_server;
+static time_t timestamp_time;
+static int timestamp_flags;
+
 int format_find_tag(const char *module, const char *tag)
 {
 	FORMAT_REC *formats;
@@ -409,48 +415,124 @@ char *format_string_expand(const char *text, int *flags)
 	return ret;
 }
 
-static char *format_get_text_args(TEXT_DEST_REC *dest,
-				  const char *text, char **arglist)
+enum {
+	FORMAT_OP_TEXT,
+	FORMAT_OP_FLAGS,
+	FORMAT_OP_ARG
+};
+
+typedef struct {
+	int type;
+	int value; /* TEXT: length, FLAGS: print flags to set */
+	const char *start; /* TEXT: the text, ARG: the argument after '$' */
+	const char *end; /* ARG: where parse_special() stopped */
+} FORMAT_OP_REC;
+
+/* A theme format compiled for printing. Style codes are expanded
+   and the plain text is joined together, so only the $arguments are
+   left to be parsed for each printed line. */
+struct _FORMAT_COMPILED_REC {
+	int count;
+	FORMAT_OP_REC *ops;
+	char *text; /* TEXT ops point here */
+};
+
+static void format_append_arg(TEXT_DEST_REC *dest, GString *out,
+			      const char **text, char **arglist)
 {
-	GString *out;
-	char code, *ret;
+	char *ret;
 	int need_free;
 
-	out = g_string_new(NULL);
+	ret = parse_special((char **) text, dest->server,
+			    dest->target == NULL ? NULL :
+			    window_item_find(dest->server, dest->target),
+			    arglist, &need_free, NULL, 0);
+
+	if (ret != NULL) {
+		/* string shouldn't end with \003 or it could
+		   mess up the next one or two characters */
+		int diff;
+		int len = strlen(ret);
+		while (len > 0 && ret[len-1] == 3) len--;
+		diff = strlen(ret)-len;
+
+		g_string_append(out, ret);
+		if (diff > 0)
+			g_string_truncate(out, out->len-diff);
+		if (need_free) g_free(ret);
+	}
+}
+
+/* Move the text added to `out' since `*lit_start' into a TEXT op */
+static void format_record_text(GArray *ops, GString *lits,
+			       GString *out, gsize *lit_start)
+{
+	FORMAT_OP_REC op;
+
+	if (out->len > *lit_start) {
+		op.type = FORMAT_OP_TEXT;
+		op.value = out->len - *lit_start;
+		op.start = GINT_TO_POINTER(lits->len);
+		op.end = NULL;
+		g_string_append_len(lits, out->str + *lit_start, op.value);
+		g_array_append_val(ops, op);
+	}
+}
+
+/* Expand `text' into `out'. If `ops' isn't NULL, the expansion is also
+   recorded there with the plain text in `lits'. */
+static void format_expand_args(TEXT_DEST_REC *dest, GString *out,
+			       const char *text, char **arglist,
+			       GArray *ops, GString *lits)
+{
+	FORMAT_OP_REC op;
+	gsize lit_start;
+	char code;
+	int flags;
 
+	lit_start = out->len;
 	code = 0;
 	while (*text != '\0') {
 		if (code == '%') {
 			/* color code */
-			if (!format_expand_styles(out, &text, &dest->flags)) {
+			flags = 0;
+			if (!format_expand_styles(out, &text, &flags)) {
 				g_string_append_c(out, '%');
 				g_string_append_c(out, '%');
 				g_string_append_c(out, *text);
 			}
+			if (flags != 0) {
+				dest->flags |= flags;
+				if (ops != NULL) {
+					format_record_text(ops, lits, out,
+							   &lit_start);
+					op.type = FORMAT_OP_FLAGS;
+					op.value = flags;
+					op.start = op.end = NULL;
+					g_array_append_val(ops, op);
+					lit_start = out->len;
+				}
+			}
 			code = 0;
 		} else if (code == '$') {
 			/* argument */
-			char *ret;
-
-			ret = parse_special((char **) &text, dest->server,
-					    dest->target == NULL ? NULL :
-					    window_item_find(dest->server, dest->target),
-					    arglist, &need_free, NULL, 0);
-
-			if (ret != NULL) {
-				/* string shouldn't end with \003 or it could
-				   mess up the next one or two characters */
-				int diff;
-				int len = strlen(ret);
-				while (len > 0 && ret[len-1] == 3) len--;
-				diff = strlen(ret)-len;
-
-				g_string_append(out, ret);
-				if (diff > 0)
-					g_string_truncate(out, out->len-diff);
-				if (need_free) g_free(ret);
+			if (ops != NULL) {
+				format_record_text(ops, lits, out, &lit_start);
+				op.type = FORMAT_OP_ARG;
+				op.value = 0;
+				op.start = text;
+			}
+
+			format_append_arg(dest, out, &text, arglist);
+
+			if (ops != NULL) {
+				op.end = text;
+				g_array_append_val(ops, op);
+				lit_start = out->len;
 			}
 			code = 0;
+			if (*text == '\0')
+				break;
 		} else {
 			if (*text == '%' || *text == '$')
 				code = *text;
@@ -461,6 +543,74 @@ static char *format_get_text_args(TEXT_DEST_REC *dest,
 		text++;
 	}
 
+	if (ops != NULL)
+		format_record_text(ops, lits, out, &lit_start);
+}
+
+static FORMAT_COMPILED_REC *format_compiled_create(GArray *ops, GString *lits)
+{
+	FORMAT_COMPILED_REC *rec;
+	int n;
+
+	rec = g_new0(FORMAT_COMPILED_REC, 1);
+	rec->count = ops->len;
+	rec->ops = (FORMAT_OP_REC *) g_array_free(ops, FALSE);
+	rec->text = g_string_free(lits, FALSE);
+
+	for (n = 0; n < rec->count; n++) {
+		if (rec->ops[n].type == FORMAT_OP_TEXT) {
+			rec->ops[n].start = rec->text +
+				GPOINTER_TO_INT(rec->ops[n].start);
+		}
+	}
+	return rec;
+}
+
+void format_compiled_destroy(FORMAT_COMPILED_REC *rec)
+{
+	if (rec == NULL)
+		return;
+
+	g_free(rec->ops);
+	g_free(rec->text);
+	g_free(rec);
+}
+
+static char *format_compiled_run(TEXT_DEST_REC *dest, FORMAT_COMPILED_REC *rec,
+				 char **arglist)
+{
+	FORMAT_OP_REC *op;
+	const char *text;
+	GString *out;
+	char *ret;
+	int n;
+
+	out = g_string_sized_new(64);
+	for (n = 0; n < rec->count; n++) {
+		op = &rec->ops[n];
+		switch (op->type) {
+		case FORMAT_OP_TEXT:
+			g_string_append_len(out, op->start, op->value);
+			break;
+		case FORMAT_OP_FLAGS:
+			dest->flags |= op->value;
+			break;
+		case FORMAT_OP_ARG:
+			text = op->start;
+			format_append_arg(dest, out, &text, arglist);
+			if (text != op->end) {
+				/* argument ended somewhere else than when
+				   compiled, expand the rest the slow way */
+				if (*text != '\0') {
+					format_expand_args(dest, out, text+1,
+							   arglist, NULL, NULL);
+				}
+				n = rec->count;
+			}
+			break;
+		}
+	}
+
 	ret = out->str;
 	g_string_free(out, FALSE);
 	return ret;
@@ -510,8 +660,28 @@ char *format_get_text_theme_charargs(THEME_REC *theme, const char *module,
 	if (module_theme == NULL)
 		return NULL;
 
-	text = module_theme->expanded_formats[formatnum];
-	return format_get_text_args(dest, text, args);
+	if (module_theme->compiled_formats[formatnum] == NULL) {
+		/* compile while expanding it the first time */
+		GArray *ops;
+		GString *out, *lits;
+		char *ret;
+
+		ops = g_array_new(FALSE, FALSE, sizeof(FORMAT_OP_REC));
+		lits = g_string_new(NULL);
+		out = g_string_new(NULL);
+
+		text = module_theme->expanded_formats[formatnum];
+		format_expand_args(dest, out, text, args, ops, lits);
+		module_theme->compiled_formats[formatnum] =
+			format_compiled_create(ops, lits);
+
+		ret = out->str;
+		g_string_free(out, FALSE);
+		return ret;
+	}
+
+	return format_compiled_run(dest, module_theme->compiled_formats[formatnum],
+				   args);
 }
 
 char *format_get_text(const char *module, WINDOW_REC *window,
@@ -620,9 +790,10 @@ char *format_get_level_tag(THEME_REC *theme, TEXT_DEST_REC *dest)
 
 static char *get_timestamp(THEME_REC *theme, TEXT_DEST_REC *dest, time_t t)
 {
-	char *format, str[256];
+	MODULE_THEME_REC *module_theme;
+	char *format, *text, str[256];
 	struct tm *tm;
-	int diff;
+	int diff, flags;
 
 	if ((timestamp_level & dest->level) == 0)
 		return NULL;
@@ -643,12 +814,41 @@ static char *get_timestamp(THEME_REC *theme, TEXT_DEST_REC *dest, time_t t)
 			return NULL;
 	}
 
+	/* lines printed in the same second usually get the same
+	   timestamp, reuse it if the format and its arguments match */
+	module_theme = g_hash_table_lookup(theme->modules, MODULE_NAME);
+	if (module_theme == NULL)
+		return NULL;
+	text = module_theme->expanded_formats[TXT_TIMESTAMP];
+
+	if (timestamp_str != NULL && t == timestamp_time &&
+	    dest->server == timestamp_server &&
+	    strcmp(text, timestamp_format) == 0 &&
+	    (dest->target == NULL ? timestamp_target == NULL :
+	     timestamp_target != NULL &&
+	     strcmp(dest->target, timestamp_target) == 0)) {
+		dest->flags |= timestamp_flags;
+		return g_strdup(timestamp_str);
+	}
+
+	flags = dest->flags;
 	tm = localtime(&t);
 	format = format_get_text_theme(theme, MODULE_NAME, dest,
 				       TXT_TIMESTAMP);
 	if (strftime(str, sizeof(str), format, tm) <= 0)
 		str[0] = '\0';
 	g_free(format);
+
+	g_free_not_null(timestamp_str);
+	g_free_not_null(timestamp_format);
+	g_free_not_null(timestamp_target);
+	timestamp_str = g_strdup(str);
+	timestamp_format = g_strdup(text);
+	timestamp_target = g_strdup(dest->target);
+	timestamp_server = dest->server;
+	timestamp_time = t;
+	timestamp_flags = dest->flags & ~flags;
+
 	return g_strdup(str);
 }
 
@@ -1093,5 +1293,10 @@ void formats_init(void)
 
 void formats_deinit(void)
 {
+	g_free_not_null(timestamp_str);
+	g_free_not_null(timestamp_format);
+	g_free_not_null(timestamp_target);
+	timestamp_str = timestamp_format = timestamp_target = NULL;
+
 	signal_remove("setup changed", (SIGNAL_FUNC) read_settings);
 }
@@ -86,6 +86,9 @@ char *format_get_text_theme_charargs(THEME_REC *theme, const char *module,
 				     TEXT_DEST_REC *dest, int formatnum,
 				     char **args);
 
+/* free a compiled format of MODULE_THEME_REC */
+void format_compiled_destroy(FORMAT_COMPILED_REC *rec);
+
 /* add `linestart' to start/end of each line in `text'. `text' may contain
    multiple lines separated with \n. */
 char *format_add_linestart(const char *text, const char *linestart);
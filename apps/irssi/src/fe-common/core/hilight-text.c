@@ -40,6 +40,8 @@ static NICKMATCH_REC *nickmatch;
 static int never_hilight_level, default_hilight_level;
 GSList *hilights;
 
+static void hilight_matcher_reset(void);
+
 static void reset_level_cache(void)
 {
 	GSList *tmp;
@@ -57,6 +59,7 @@ static void reset_cache(void)
 {
 	reset_level_cache();
 	nickmatch_rebuild(nickmatch);
+	hilight_matcher_reset();
 }
 
 static void hilight_add_config(HILIGHT_REC *rec)
@@ -114,6 +117,7 @@ static void hilights_destroy_all(void)
 	g_slist_foreach(hilights, (GFunc) hilight_destroy, NULL);
 	g_slist_free(hilights);
 	hilights = NULL;
+	hilight_matcher_reset();
 }
 
 static void hilight_init_rec(HILIGHT_REC *rec)
@@ -136,6 +140,7 @@ void hilight_create(HILIGHT_REC *rec)
 	hilight_add_config(rec);
 
 	hilight_init_rec(rec);
+	hilight_matcher_reset();
 
 	signal_emit("hilight created", 1, rec);
 }
@@ -146,6 +151,7 @@ void hilight_remove(HILIGHT_REC *rec)
 
 	hilight_remove_config(rec);
 	hilights = g_slist_remove(hilights, rec);
+	hilight_matcher_reset();
 
 	signal_emit("hilight destroyed", 1, rec);
 	hilight_destroy(rec);
@@ -224,6 +230,333 @@ static int hilight_match_text(HILIGHT_REC *rec, const char *text,
         return FALSE;
 }
 
+/* All non-mask hilights are matched with a single Aho-Corasick automaton.
+   Plain texts are added as they are, regexps are added by their longest
+   required literal so that regexec() only needs to be run for the lines
+   that contain it. The automaton is rebuilt lazily after hilights change. */
+enum {
+	HILIGHT_MATCH_TEXT, /* the automaton finds the match */
+	HILIGHT_MATCH_FILTER, /* run regexec() if the literal was found */
+	HILIGHT_MATCH_ALWAYS /* nothing to prefilter with */
+};
+
+typedef struct {
+	HILIGHT_REC *rec;
+	int type;
+	int len; /* pattern length */
+	int next; /* next pattern ending in the same state, -1 = none */
+} HILIGHT_PATTERN_REC;
+
+typedef struct {
+	int count;
+	HILIGHT_PATTERN_REC *patterns; /* in the same order as hilights */
+	int *match_pos; /* first match position for each pattern, or -1 */
+
+	int classes, states;
+	int class_map[256]; /* character -> case folded character class */
+	int *next_state; /* states*classes transition table */
+	int *output; /* first pattern ending in state, -1 = none */
+	int *dict; /* nearest suffix state with output, -1 = none */
+} HILIGHT_MATCHER_REC;
+
+static HILIGHT_MATCHER_REC *matcher;
+
+#define isbound(c) \
+	((unsigned char) (c) < 128 && \
+	(i_isspace(c) || i_ispunct(c)))
+
+static void hilight_literal_end(GString *run, GString *best)
+{
+	if (run->len > best->len)
+		g_string_assign(best, run->str);
+	g_string_truncate(run, 0);
+}
+
+/* Return the longest literal string that every match of the extended
+   regexp must contain, or NULL if none could be found. */
+static char *hilight_regexp_literal(const char *regexp)
+{
+	GString *run, *best;
+	const char *p;
+	char *ret;
+	int depth, lit;
+
+	run = g_string_new(NULL);
+	best = g_string_new(NULL);
+
+	depth = 0;
+	for (p = regexp; *p != '\0'; p++) {
+		lit = -1;
+		switch (*p) {
+		case '|':
+			if (depth == 0) {
+				/* alternation - nothing is required */
+				g_string_truncate(run, 0);
+				g_string_truncate(best, 0);
+				p += strlen(p)-1;
+			}
+			break;
+		case '(':
+			depth++;
+			break;
+		case ')':
+			if (depth > 0) depth--;
+			break;
+		case '[':
+			/* skip the bracket expression */
+			p++;
+			if (*p == '^') p++;
+			if (*p == ']') p++;
+			while (*p != '\0' && *p != ']') {
+				if (*p == '[' && (p[1] == ':' || p[1] == '.' ||
+						  p[1] == '=')) {
+					char end = p[1];
+
+					for (p += 2; *p != '\0'; p++) {
+						if (p[0] == end && p[1] == ']') {
+							p++;
+							break;
+						}
+					}
+					if (*p == '\0')
+						break;
+				}
+				p++;
+			}
+			if (*p == '\0') p--;
+			break;
+		case '{':
+			/* skip the interval */
+			if (i_isdigit(p[1])) {
+				const char *end = p+1;
+
+				while (i_isdigit(*end) || *end == ',')
+					end++;
+				if (*end == '}')
+					p = end;
+			}
+			break;
+		case '\\':
+			if (p[1] == '\0' || (unsigned char) p[1] >= 128)
+				break;
+			p++;
+			/* \w, \<, \` etc. are not literals in GNU regex */
+			if (!i_isalnum(*p) && strchr("<>`'", *p) == NULL)
+				lit = *p;
+			break;
+		case '.': case '^': case '$':
+		case '*': case '+': case '?':
+			break;
+		default:
+			if ((unsigned char) *p < 128)
+				lit = *p;
+			break;
+		}
+
+		if (lit == -1 || depth > 0 ||
+		    p[1] == '*' || p[1] == '?' || p[1] == '{') {
+			/* not a literal, or the literal is optional */
+			hilight_literal_end(run, best);
+			continue;
+		}
+
+		g_string_append_c(run, lit);
+		if (p[1] == '+')
+			hilight_literal_end(run, best);
+	}
+	hilight_literal_end(run, best);
+
+	ret = best->len == 0 ? NULL : g_strdup(best->str);
+	g_string_free(run, TRUE);
+	g_string_free(best, TRUE);
+	return ret;
+}
+
+static void hilight_matcher_destroy(HILIGHT_MATCHER_REC *rec)
+{
+	g_free(rec->patterns);
+	g_free(rec->match_pos);
+	g_free(rec->next_state);
+	g_free(rec->output);
+	g_free(rec->dict);
+	g_free(rec);
+}
+
+static void hilight_matcher_reset(void)
+{
+	if (matcher != NULL) {
+		hilight_matcher_destroy(matcher);
+		matcher = NULL;
+	}
+}
+
+static HILIGHT_MATCHER_REC *hilight_matcher_create(void)
+{
+	HILIGHT_MATCHER_REC *rec;
+	GSList *tmp;
+	char **texts;
+	int folded[256], *fail, *queue;
+	int n, i, c, state, child, max_states, head, tail;
+
+	rec = g_new0(HILIGHT_MATCHER_REC, 1);
+	rec->count = g_slist_length(hilights);
+	rec->patterns = g_new0(HILIGHT_PATTERN_REC, rec->count+1);
+	rec->match_pos = g_new(int, rec->count+1);
+	texts = g_new0(char *, rec->count+1);
+
+	/* collect the patterns and the character classes they use */
+	rec->classes = 1; n = 0; max_states = 1;
+	for (tmp = hilights; tmp != NULL; tmp = tmp->next) {
+		HILIGHT_REC *hilight = tmp->data;
+		HILIGHT_PATTERN_REC *pattern;
+		char *text;
+
+		if (hilight->nickmask)
+			continue;
+
+		pattern = &rec->patterns[n];
+		pattern->rec = hilight;
+		pattern->next = -1;
+
+		text = hilight->regexp ? hilight_regexp_literal(hilight->text) :
+			g_strdup(hilight->text);
+		if (text == NULL || *text == '\0') {
+			pattern->type = HILIGHT_MATCH_ALWAYS;
+			g_free(text);
+			n++;
+			continue;
+		}
+
+		pattern->type = hilight->regexp ?
+			HILIGHT_MATCH_FILTER : HILIGHT_MATCH_TEXT;
+		pattern->len = strlen(text);
+		max_states += pattern->len;
+		texts[n++] = text;
+
+		for (; *text != '\0'; text++) {
+			c = i_toupper(*text);
+			if (rec->class_map[c] == 0)
+				rec->class_map[c] = rec->classes++;
+		}
+	}
+	rec->count = n;
+
+	for (c = 0; c < 256; c++)
+		folded[c] = rec->class_map[i_toupper(c)];
+	memcpy(rec->class_map, folded, sizeof(folded));
+
+	/* build the trie */
+	rec->next_state = g_new(int, max_states * rec->classes);
+	for (i = 0; i < max_states * rec->classes; i++)
+		rec->next_state[i] = -1;
+	rec->output = g_new(int, max_states);
+	rec->dict = g_new(int, max_states);
+	rec->output[0] = -1;
+	rec->states = 1;
+
+	for (n = rec->count-1; n >= 0; n--) {
+		const char *text = texts[n];
+
+		if (text == NULL)
+			continue;
+
+		state = 0;
+		for (; *text != '\0'; text++) {
+			i = state * rec->classes +
+				rec->class_map[(unsigned char) *text];
+			if (rec->next_state[i] == -1) {
+				rec->output[rec->states] = -1;
+				rec->next_state[i] = rec->states++;
+			}
+			state = rec->next_state[i];
+		}
+
+		/* walking backwards keeps the chain in hilight order */
+		rec->patterns[n].next = rec->output[state];
+		rec->output[state] = n;
+		g_free(texts[n]);
+	}
+	g_free(texts);
+
+	/* add the failure transitions breadth first */
+	fail = g_new(int, rec->states);
+	queue = g_new(int, rec->states);
+	head = tail = 0;
+
+	fail[0] = 0; rec->dict[0] = -1;
+	for (c = 0; c < rec->classes; c++) {
+		child = rec->next_state[c];
+		if (child == -1)
+			rec->next_state[c] = 0;
+		else {
+			fail[child] = 0;
+			rec->dict[child] = -1;
+			queue[tail++] = child;
+		}
+	}
+
+	while (head < tail) {
+		state = queue[head++];
+		for (c = 0; c < rec->classes; c++) {
+			i = state * rec->classes + c;
+			child = rec->next_state[i];
+			if (child == -1) {
+				rec->next_state[i] =
+					rec->next_state[fail[state] * rec->classes + c];
+				continue;
+			}
+
+			fail[child] = rec->next_state[fail[state] * rec->classes + c];
+			rec->dict[child] = rec->output[fail[child]] != -1 ?
+				fail[child] : rec->dict[fail[child]];
+			queue[tail++] = child;
+		}
+	}
+
+	g_free(fail);
+	g_free(queue);
+	return rec;
+}
+
+/* Find the first match position of every pattern in a single pass */
+static void hilight_matcher_scan(HILIGHT_MATCHER_REC *rec, const char *text)
+{
+	HILIGHT_PATTERN_REC *pattern;
+	int i, n, state, pos;
+
+	for (n = 0; n < rec->count; n++)
+		rec->match_pos[n] = -1;
+
+	if (rec->states == 1)
+		return;
+
+	state = 0;
+	for (i = 0; text[i] != '\0'; i++) {
+		state = rec->next_state[state * rec->classes +
+					rec->class_map[(unsigned char) text[i]]];
+
+		n = rec->output[state] != -1 ? state : rec->dict[state];
+		for (; n != -1; n = rec->dict[n]) {
+			int p;
+
+			for (p = rec->output[n]; p != -1; p = pattern->next) {
+				pattern = &rec->patterns[p];
+				if (rec->match_pos[p] != -1)
+					continue;
+
+				pos = i+1 - pattern->len;
+				if (pattern->type == HILIGHT_MATCH_TEXT &&
+				    pattern->rec->fullword &&
+				    ((pos > 0 && !isbound(text[pos-1])) ||
+				     (text[i+1] != '\0' && !isbound(text[i+1]))))
+					continue;
+
+				rec->match_pos[p] = pos;
+			}
+		}
+	}
+}
+
 #define hilight_match_level(rec, level) \
 	(level & (((rec)->level != 0 ? rec->level : default_hilight_level)))
 
@@ -236,9 +569,9 @@ HILIGHT_REC *hilight_match(SERVER_REC *server, const char *channel,
 			   int level, const char *str,
                            int *match_beg, int *match_end)
 {
-	GSList *tmp;
         CHANNEL_REC *chanrec;
 	NICK_REC *nickrec;
+	int n;
 
 	g_return_val_if_fail(str != NULL, NULL);
 
@@ -262,12 +595,32 @@ HILIGHT_REC *hilight_match(SERVER_REC *server, const char *channel,
 		}
 	}
 
-	for (tmp = hilights; tmp != NULL; tmp = tmp->next) {
-		HILIGHT_REC *rec = tmp->data;
+	if (matcher == NULL)
+		matcher = hilight_matcher_create();
+	hilight_matcher_scan(matcher, str);
+
+	/* first matching hilight in the list wins */
+	for (n = 0; n < matcher->count; n++) {
+		HILIGHT_PATTERN_REC *pattern = &matcher->patterns[n];
+		HILIGHT_REC *rec = pattern->rec;
+
+		if (pattern->type != HILIGHT_MATCH_ALWAYS &&
+		    matcher->match_pos[n] == -1)
+			continue;
+
+		if (!hilight_match_level(rec, level) ||
+		    !hilight_match_channel(rec, channel))
+			continue;
+
+		if (pattern->type == HILIGHT_MATCH_TEXT) {
+			if (match_beg != NULL && match_end != NULL) {
+				*match_beg = matcher->match_pos[n];
+				*match_end = *match_beg + pattern->len;
+			}
+			return rec;
+		}
 
-		if (!rec->nickmask && hilight_match_level(rec, level) &&
-		    hilight_match_channel(rec, channel) &&
-		    hilight_match_text(rec, str, match_beg, match_end))
+		if (hilight_match_text(rec, str, match_beg, match_end))
 			return rec;
 	}
 
@@ -703,6 +1056,7 @@ void hilight_text_deinit(void)
 {
 	hilights_destroy_all();
         nickmatch_deinit(nickmatch);
+	hilight_matcher_reset();
 
 	signal_remove("print text", (SIGNAL_FUNC) sig_print_text);
         signal_remove("setup reread", (SIGNAL_FUNC) read_hilight_config);
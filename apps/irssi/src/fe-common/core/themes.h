@@ -1,6 +1,8 @@
 #ifndef __THEMES_H
 #define __THEMES_H
 
+typedef struct _FORMAT_COMPILED_REC FORMAT_COMPILED_REC;
+
 typedef struct {
 	char *name;
 
@@ -8,6 +10,9 @@ typedef struct {
 	char **formats; /* in same order as in module's default formats */
 	char **expanded_formats; /* this contains the formats after
 				    expanding {templates} */
+	FORMAT_COMPILED_REC **compiled_formats; /* expanded_formats compiled
+						   for printing when first
+						   used */
 } MODULE_THEME_REC;
 
 typedef struct {
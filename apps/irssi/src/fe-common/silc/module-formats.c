@@ -164,6 +164,7 @@ FORMAT_REC fecommon_silc_formats[] = {
 	{ "pubkey_verified", "Verified successfully server {hilight $0} cached public key", 1, { 0 } },
 	{ "pubkey_verified_client", "Verified successfully user {hilight $0}'s ($1 $2) cached public key", 3, { 0, 0, 0 } },
 	{ "pubkey_notverified", "Could not verify $0 {hilight $1}'s public key", 2, { 0, 0 } },
+	{ "msg_signature_failed", "Signature of the message from {nick $0} failed verification", 1, { 0 } },
 
 	/* Misc messages */
 	{ NULL, "Misc", 0 },
@@ -158,6 +158,7 @@ enum {
   SILCTXT_PUBKEY_VERIFIED,
   SILCTXT_PUBKEY_VERIFIED_CLIENT,
   SILCTXT_PUBKEY_NOTVERIFIED,
+  SILCTXT_MSG_SIGNATURE_FAILED,
 
   SILCTXT_FILL_4,
 
@@ -45,6 +45,10 @@ static GUI_WINDOW_REC *gui_window_init(WINDOW_REC *window,
 					   window->width, window->height,
 					   settings_get_bool("scroll"),
 					   term_type == TERM_TYPE_UTF8);
+	textbuffer_set_search_cache(gui->view->buffer,
+				    settings_get_bool("scrollback_search_cache"));
+	textbuffer_set_compact(gui->view->buffer,
+			       settings_get_bool("scrollback_compress"));
 	textbuffer_view_set_default_indent(gui->view,
 					   settings_get_int("indent"),
 					   !settings_get_bool("indent_always"),
@@ -211,6 +215,10 @@ void gui_windows_reset_settings(void)
 		textbuffer_view_set_scroll(gui->view,
 					   gui->use_scroll ? gui->scroll :
 					   settings_get_bool("scroll"));
+		textbuffer_set_search_cache(gui->view->buffer,
+					    settings_get_bool("scrollback_search_cache"));
+		textbuffer_set_compact(gui->view->buffer,
+				       settings_get_bool("scrollback_compress"));
 	}
 }
 
@@ -282,6 +290,8 @@ void gui_windows_init(void)
 	settings_add_int("lookandfeel", "indent", 10);
 	settings_add_bool("lookandfeel", "indent_always", FALSE);
 	settings_add_bool("lookandfeel", "scroll", TRUE);
+	settings_add_bool("history", "scrollback_search_cache", FALSE);
+	settings_add_bool("history", "scrollback_compress", FALSE);
 
 	window_create_override = -1;
 
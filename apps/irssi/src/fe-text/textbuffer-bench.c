@@ -0,0 +1,286 @@
+/*
+ textbuffer-bench.c : Scrollback search benchmark
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Fills a text buffer with 500000 lines formatted the way gui-printtext
+   adds them, and times textbuffer_find_text() on it. Before that it
+   fills a buffer with scrollback_compress on, times loading its lines
+   and reports the memory used before and after its chunks are
+   compressed. It's not part of the build, compile it in this directory
+   after irssi is built:
+
+   cc -O2 -DHAVE_CONFIG_H -I../.. -I.. -I../core -I../fe-common/core \
+      `pkg-config --cflags glib-2.0` textbuffer-bench.c ../core/misc.c \
+      `pkg-config --libs glib-2.0` -o textbuffer-bench */
+
+#include "module.h"
+#include "levels.h"
+
+/* textbuffer.c is compiled in, with a clock that can be moved forward to
+   make the chunks cold */
+static time_t bench_time(time_t *t);
+#define time(t) bench_time(t)
+#include "textbuffer.c"
+#undef time
+
+#define BENCH_LINES 500000
+#define BENCH_ROUNDS 6
+
+/* textbuffer.c doesn't use these */
+int quitting;
+void irssi_redraw(void) {}
+void irssi_set_dirty(void) {}
+
+static char words[2000][12];
+static time_t bench_clock;
+
+static time_t bench_time(time_t *t)
+{
+	time_t now;
+
+	now = time(NULL) + bench_clock;
+	if (t != NULL)
+		*t = now;
+	return now;
+}
+
+static double cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Resident memory in kB, 0 if it's not known */
+static long rss_kb(void)
+{
+	FILE *f;
+	long size, rss;
+
+	f = fopen("/proc/self/statm", "r");
+	if (f == NULL)
+		return 0;
+	if (fscanf(f, "%ld %ld", &size, &rss) != 2)
+		rss = 0;
+	fclose(f);
+	return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* The first 20 words are common and make half of the text, the rest are
+   random syllables */
+static void make_words(void)
+{
+	static const char *syl[] = {
+		"ka", "lo", "mi", "ne", "ru", "sa", "ti", "po", "ve", "ja",
+		"ho", "ku", "an", "er", "is", "ol", "un", "ta", "ri", "me"
+	};
+	static const char *common[] = {
+		"the", "and", "is", "it", "to", "of", "that", "you", "in",
+		"for", "what", "this", "was", "not", "but", "on", "have",
+		"are", "with", "lol"
+	};
+	int i, j, n;
+
+	for (i = 0; i < 2000; i++) {
+		if (i < 20) {
+			strcpy(words[i], common[i]);
+			continue;
+		}
+
+		words[i][0] = '\0';
+		n = 2 + rand() % 3;
+		for (j = 0; j < n; j++)
+			strcat(words[i], syl[rand() % 20]);
+	}
+}
+
+/* Text of the messages, made before timing */
+static char *make_text(int lines)
+{
+	char *text, *p;
+	const char *word;
+	int i, k, n;
+
+	text = p = g_malloc(lines * 256);
+	for (i = 0; i < lines; i++) {
+		n = 3 + rand() % 12;
+		for (k = 0; k < n; k++) {
+			word = rand() % 2 ? words[rand() % 20] :
+				words[20 + rand() % 1980];
+			p += sprintf(p, "%s%s", k > 0 ? " " : "", word);
+		}
+		if (i % 50000 == 1234)
+			p += sprintf(p, " see silcnet.org");
+		*p++ = '\0';
+	}
+
+	return text;
+}
+
+/* Timestamp, coloured nick and 3-14 words, like a public message */
+static TEXT_BUFFER_REC *fill(int lines, int compact)
+{
+	static const char *nicks[] = {
+		"priikone", "tomi", "Jari", "mika", "sami", "juha", "ville",
+		"anna", "laura", "kati", "alice", "bob", "carol", "dave"
+	};
+	static const unsigned char eol[] = { 0, LINE_CMD_EOL };
+	TEXT_BUFFER_REC *buffer;
+	LINE_INFO_REC info;
+	LINE_REC *line;
+	char *text, *p, msg[32];
+	double t;
+	int i, len;
+
+	p = text = make_text(lines);
+
+	t = cpu_time();
+	buffer = textbuffer_create();
+	textbuffer_set_compact(buffer, compact);
+	line = NULL;
+	for (i = 0; i < lines; i++) {
+		/* some joins */
+		info.level = i % 50 == 0 ? MSGLEVEL_JOINS : MSGLEVEL_PUBLIC;
+		info.time = i;
+
+		len = sprintf(msg, "%02d:%02d ", (i / 60) % 24, i % 60);
+		line = textbuffer_insert(buffer, line, (unsigned char *) msg,
+					 len, &info);
+		textbuffer_line_add_colors(buffer, &line, 4, -1,
+					   GUI_PRINT_FLAG_BOLD);
+		len = sprintf(msg, "<%s> ", nicks[i % 14]);
+		line = textbuffer_insert(buffer, line, (unsigned char *) msg,
+					 len, &info);
+		textbuffer_line_add_colors(buffer, &line, -1, -1, 0);
+
+		len = strlen(p);
+		line = textbuffer_insert(buffer, line, (unsigned char *) p,
+					 len, &info);
+		line = textbuffer_insert(buffer, line, eol, 2, &info);
+		p += len + 1;
+	}
+
+	printf("%d lines added in %.1f ms\n", buffer->lines_count,
+	       (cpu_time() - t) * 1000);
+	g_free(text);
+	return buffer;
+}
+
+/* Print the time of the first search and the best of the later ones */
+static void search(TEXT_BUFFER_REC *buffer, const char *name,
+		   const char *text, int level, int regexp)
+{
+	GList *matches;
+	double t, first, best;
+	int i, count;
+
+	first = best = 0; count = 0;
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		t = cpu_time();
+		matches = textbuffer_find_text(buffer, NULL, level, 0, text,
+					       0, 0, regexp, FALSE, FALSE);
+		t = cpu_time() - t;
+
+		if (i == 0)
+			first = t;
+		else if (i == 1 || t < best)
+			best = t;
+		count = g_list_length(matches);
+		g_list_free(matches);
+	}
+
+	printf("%-26s %6d matches  first %7.1f ms  repeated %7.1f ms\n",
+	       name, count, first * 1000, best * 1000);
+}
+
+/* Time loading the lines of a compacted buffer, and report the memory
+   before and after its chunks are compressed */
+static void compact(int lines)
+{
+	TEXT_BUFFER_REC *buffer;
+	LINE_REC *line;
+	GString *str;
+	double t;
+	long rss;
+	int i;
+
+	rss = rss_kb();
+	buffer = fill(lines, TRUE);
+	printf("%-26s %d chunks, RSS +%ld kB\n", "compacted buffer",
+	       (int) (textbuffer_get_text_memory(buffer) /
+		      sizeof(TEXT_CHUNK_REC)), rss_kb() - rss);
+
+	/* before the line cache or a search reads a line */
+	t = cpu_time();
+	for (line = buffer->first_line; line != NULL; line = line->next)
+		textbuffer_line_load(buffer, line);
+	printf("%-26s %.1f ms\n", "load every line", (cpu_time() - t) * 1000);
+
+	bench_clock += TEXT_CHUNK_COLD_TIME;
+	t = cpu_time();
+	sig_compress_cold();
+	printf("%-26s %.1f ms, %d compressed, RSS +%ld kB, text %ld kB\n",
+	       "compress", (cpu_time() - t) * 1000, buffer->cold_chunks,
+	       rss_kb() - rss,
+	       (long) textbuffer_get_text_memory(buffer) / 1024);
+
+	/* scripts read lines without knowing their buffer */
+	str = g_string_new(NULL);
+	t = cpu_time();
+	for (line = buffer->first_line, i = 0; line != NULL;
+	     line = line->next, i++) {
+		if (i % 100 == 0)
+			textbuffer_line2text(line, FALSE, str);
+	}
+	printf("%-26s %.1f ms, %d compressed, RSS +%ld kB\n",
+	       "line2text every 100th", (cpu_time() - t) * 1000,
+	       buffer->cold_chunks, rss_kb() - rss);
+	g_string_free(str, TRUE);
+
+	textbuffer_destroy(buffer);
+}
+
+int main(void)
+{
+	TEXT_BUFFER_REC *buffer;
+
+	srand(1);
+	make_words();
+	textbuffer_init();
+
+	/* first, so that the memory isn't reused from the other buffers */
+	compact(BENCH_LINES);
+
+	buffer = fill(BENCH_LINES, FALSE);
+
+	search(buffer, "rare word 'silcnet'", "silcnet", MSGLEVEL_ALL, FALSE);
+	search(buffer, "absent 'xyzzy'", "xyzzy", MSGLEVEL_ALL, FALSE);
+	search(buffer, "nick 'priikone'", "priikone", MSGLEVEL_ALL, FALSE);
+	search(buffer, "joins only, 'the'", "the", MSGLEVEL_JOINS, FALSE);
+	search(buffer, "regexp 'sil.net'", "sil.net", MSGLEVEL_ALL, TRUE);
+	textbuffer_destroy(buffer);
+
+	/* most lines match these */
+	buffer = fill(20000, FALSE);
+	search(buffer, "common 'that'", "that", MSGLEVEL_ALL, FALSE);
+	search(buffer, "short 'is'", "is", MSGLEVEL_ALL, FALSE);
+	textbuffer_destroy(buffer);
+
+	textbuffer_deinit();
+	return 0;
+}
@@ -323,8 +323,7 @@ static void cmd_scrollback_status(void)
 		view = WINDOW_GUI(window)->view;
 
 		window_mem = sizeof(TEXT_BUFFER_REC);
-		window_mem += g_slist_length(view->buffer->text_chunks) *
-			sizeof(TEXT_CHUNK_REC);
+		window_mem += textbuffer_get_text_memory(view->buffer);
 		window_mem += view->buffer->lines_count * sizeof(LINE_REC);
 		total_lines += view->buffer->lines_count;
                 total_mem += window_mem;
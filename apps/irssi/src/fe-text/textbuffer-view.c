@@ -175,6 +175,7 @@ view_update_line_cache(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line)
 
 	g_return_val_if_fail(line->text != NULL, NULL);
 
+	textbuffer_line_load(view->buffer, line);
 	color = ATTR_RESETFG | ATTR_RESETBG;
 	xpos = 0; indent_pos = view->default_indent;
 	last_space = last_color = 0; last_space_ptr = NULL; sub = NULL;
@@ -351,6 +352,7 @@ static int view_line_draw(TEXT_BUFFER_VIEW_REC *view, LINE_REC *line,
 	if (subline >= cache->count)
                 return 0;
 
+	textbuffer_line_load(view->buffer, line);
         color = ATTR_RESET;
         need_move = TRUE; need_clrtoeol = FALSE;
 	xpos = drawcount = 0; first = TRUE;
@@ -30,8 +30,29 @@
 #  include <regex.h>
 #endif
 
+#include <sys/mman.h>
+#if defined (MADV_DONTNEED) && (defined (MAP_ANONYMOUS) || defined (MAP_ANON))
+#  define HAVE_TEXT_COMPACT
+#  ifndef MAP_ANONYMOUS
+#    define MAP_ANONYMOUS MAP_ANON
+#  endif
+#endif
+
 #define TEXT_CHUNK_USABLE_SIZE (LINE_TEXT_CHUNK_SIZE-2-(int)sizeof(char*))
 
+/* how often to look for chunks to compress */
+#define TEXT_CHUNK_COLD_CHECK_TIME (60*1000)
+/* compress chunks that haven't been accessed in this many seconds.
+   This is longer than the line cache is kept in textbuffer-view.c */
+#define TEXT_CHUNK_COLD_TIME (15*60)
+
+static GSList *compact_buffers;
+#ifdef HAVE_TEXT_COMPACT
+static int compact_tag;
+#endif
+static int cold_size; /* bytes from start of chunk that can be released */
+static unsigned char search_upper[256]; /* i_toupper() of each byte */
+
 TEXT_BUFFER_REC *textbuffer_create(void)
 {
 	TEXT_BUFFER_REC *buffer;
@@ -48,23 +69,387 @@ void textbuffer_destroy(TEXT_BUFFER_REC *buffer)
 	g_return_if_fail(buffer != NULL);
 
 	textbuffer_remove_all_lines(buffer);
+	textbuffer_set_search_cache(buffer, FALSE);
+	compact_buffers = g_slist_remove(compact_buffers, buffer);
         g_slice_free(TEXT_BUFFER_REC, buffer);
 }
 
+static int search_text_remove(LINE_REC *line, char *text)
+{
+	g_free(text);
+	return TRUE;
+}
+
+void textbuffer_set_search_cache(TEXT_BUFFER_REC *buffer, int enabled)
+{
+	g_return_if_fail(buffer != NULL);
+
+	if (enabled && buffer->search_text == NULL) {
+		buffer->search_text =
+			g_hash_table_new((GHashFunc) g_direct_hash,
+					 (GCompareFunc) g_direct_equal);
+	} else if (!enabled && buffer->search_text != NULL) {
+		g_hash_table_foreach_remove(buffer->search_text,
+					    (GHRFunc) search_text_remove, NULL);
+		g_hash_table_destroy(buffer->search_text);
+		buffer->search_text = NULL;
+	}
+}
+
+/* forget the cached text of a line whose text changed or was removed */
+static void textbuffer_line_search_reset(TEXT_BUFFER_REC *buffer,
+					 LINE_REC *line)
+{
+	char *text;
+
+	if (buffer->search_text != NULL) {
+		text = g_hash_table_lookup(buffer->search_text, line);
+		if (text != NULL) {
+			g_hash_table_remove(buffer->search_text, line);
+			g_free(text);
+		}
+	}
+}
+
+/* Set a bit for each case-insensitive trigram of the plain text in data.
+   trigram has the last characters before data, and is updated so the
+   text can be added in pieces. Color and command bytes are skipped the
+   same way as textbuffer_line2text() skips them. */
+static void search_mask_add(guint32 *mask, guint32 *trigram,
+			    const unsigned char *data, int len)
+{
+	const unsigned char *end;
+	guint32 tri, bit, m[4];
+
+	memcpy(m, mask, sizeof(m));
+	tri = *trigram;
+	for (end = data + len; data < end; data++) {
+		if (*data == '\0') {
+			data++;
+			continue;
+		}
+
+		tri = ((tri << 8) | search_upper[*data]) & 0xffffff;
+		if (tri > 0xffff) {
+			/* 3 characters, none of them \0 */
+			bit = (tri * 2654435761U) >> 25;
+			m[bit / 32] |= 1U << (bit % 32);
+		}
+	}
+	*trigram = tri;
+	memcpy(mask, m, sizeof(m));
+}
+
+/* Returns the position of the last chunk starting at or before data,
+   -1 if there's none */
+static int text_chunk_pos(TEXT_BUFFER_REC *buffer, const unsigned char *data)
+{
+	int low, high, mid;
+
+	low = 0; high = buffer->text_chunks_count;
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (buffer->text_chunks[mid]->buffer <= data)
+			low = mid+1;
+		else
+			high = mid;
+	}
+
+	return low-1;
+}
+
 static TEXT_CHUNK_REC *text_chunk_find(TEXT_BUFFER_REC *buffer,
 				       const unsigned char *data)
+{
+	TEXT_CHUNK_REC *rec;
+	int pos;
+
+	pos = text_chunk_pos(buffer, data);
+	if (pos < 0)
+		return NULL;
+
+	rec = buffer->text_chunks[pos];
+	return data < rec->buffer+sizeof(rec->buffer) ? rec : NULL;
+}
+
+/* Compression of cold text chunks. This is a small LZF style byte
+   oriented LZ77 coder: a control byte below 32 starts a run of 1-32
+   literal bytes, otherwise its top 3 bits are the match length (7 means
+   that a length byte follows) and the low 5 bits with the next byte are
+   the offset of the match. */
+#define TEXT_LZ_HASH_BITS 12
+#define TEXT_LZ_MAX_OFF (1 << 13)
+#define TEXT_LZ_MAX_REF ((1 << 8) + (1 << 3))
+#define TEXT_LZ_MAX_LIT (1 << 5)
+
+#define text_lz_hash(p) \
+	((((unsigned int) (p)[0] << 16 | (p)[1] << 8 | (p)[2]) * \
+	  2654435761U) >> (32 - TEXT_LZ_HASH_BITS))
+
+#ifdef HAVE_TEXT_COMPACT
+/* Returns the compressed length, or 0 if the data doesn't fit in out */
+static int text_lz_compress(const unsigned char *in, int in_len,
+			    unsigned char *out, int out_max)
+{
+	const unsigned char *htab[1 << TEXT_LZ_HASH_BITS];
+	const unsigned char *ip, *ref, *in_end;
+	unsigned char *op, *out_end, *lit;
+	unsigned int hash;
+	int len, maxlen, off;
+
+	memset(htab, 0, sizeof(htab));
+	ip = in; in_end = in + in_len;
+	op = out; out_end = out + out_max;
+
+	lit = NULL;
+	while (ip < in_end) {
+		if (ip + 2 < in_end) {
+			hash = text_lz_hash(ip) & ((1 << TEXT_LZ_HASH_BITS)-1);
+			ref = htab[hash];
+			htab[hash] = ip;
+
+			off = ref == NULL ? 0 : (int) (ip - ref);
+			if (off > 0 && off <= TEXT_LZ_MAX_OFF &&
+			    ref[0] == ip[0] && ref[1] == ip[1] &&
+			    ref[2] == ip[2]) {
+				maxlen = in_end - ip;
+				if (maxlen > TEXT_LZ_MAX_REF)
+					maxlen = TEXT_LZ_MAX_REF;
+				for (len = 3; len < maxlen; len++) {
+					if (ref[len] != ip[len])
+						break;
+				}
+
+				if (op + 3 > out_end)
+					return 0;
+
+				off--; len -= 2;
+				if (len < 7)
+					*op++ = (len << 5) | (off >> 8);
+				else {
+					*op++ = (7 << 5) | (off >> 8);
+					*op++ = len - 7;
+				}
+				*op++ = off & 0xff;
+
+				ip += len + 2;
+				lit = NULL;
+				continue;
+			}
+		}
+
+		/* literal byte */
+		if (lit == NULL || *lit == TEXT_LZ_MAX_LIT-1) {
+			if (op + 2 > out_end)
+				return 0;
+			lit = op++;
+			*lit = 0;
+		} else {
+			if (op + 1 > out_end)
+				return 0;
+			(*lit)++;
+		}
+		*op++ = *ip++;
+	}
+
+	return op - out;
+}
+#endif
+
+static void text_lz_decompress(const unsigned char *in, int in_len,
+			       unsigned char *out)
+{
+	const unsigned char *ip, *in_end;
+	unsigned char *op, *ref;
+	int ctrl, len;
+
+	ip = in; in_end = in + in_len;
+	op = out;
+	while (ip < in_end) {
+		ctrl = *ip++;
+		if (ctrl < TEXT_LZ_MAX_LIT) {
+			for (len = ctrl+1; len > 0; len--)
+				*op++ = *ip++;
+			continue;
+		}
+
+		len = ctrl >> 5;
+		if (len == 7)
+			len += *ip++;
+		ref = op - (((ctrl & 0x1f) << 8) | *ip++) - 1;
+		for (len += 2; len > 0; len--)
+			*op++ = *ref++;
+	}
+}
+
+static TEXT_CHUNK_REC *text_chunk_alloc(TEXT_BUFFER_REC *buffer)
+{
+	TEXT_CHUNK_REC *rec;
+
+#ifdef HAVE_TEXT_COMPACT
+	if (buffer->compact && cold_size > 0) {
+		/* the pages need to be our own to be able to release them */
+		rec = mmap(NULL, sizeof(TEXT_CHUNK_REC), PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (rec != MAP_FAILED) {
+			rec->mapped = TRUE;
+			rec->cold = NULL;
+			rec->last_access = time(NULL);
+			return rec;
+		}
+	}
+#endif
+	rec = g_slice_new(TEXT_CHUNK_REC);
+	rec->mapped = FALSE;
+	rec->cold = NULL;
+	return rec;
+}
+
+static void text_chunk_free(TEXT_CHUNK_REC *chunk)
+{
+	g_free_not_null(chunk->cold);
+#ifdef HAVE_TEXT_COMPACT
+	if (chunk->mapped) {
+		munmap((void *) chunk, sizeof(TEXT_CHUNK_REC));
+		return;
+	}
+#endif
+	g_slice_free(TEXT_CHUNK_REC, chunk);
+}
+
+static void text_chunk_load(TEXT_BUFFER_REC *buffer, TEXT_CHUNK_REC *chunk)
+{
+	chunk->last_access = time(NULL);
+	if (chunk->cold == NULL)
+		return;
+
+	text_lz_decompress(chunk->cold, chunk->cold_len, chunk->buffer);
+	g_free(chunk->cold);
+	chunk->cold = NULL;
+	buffer->cold_chunks--;
+}
+
+#ifdef HAVE_TEXT_COMPACT
+static void text_chunk_compress(TEXT_BUFFER_REC *buffer, TEXT_CHUNK_REC *chunk)
+{
+	unsigned char *data;
+	int len;
+
+	/* not worth it unless at least a quarter is saved */
+	data = g_malloc(cold_size);
+	len = text_lz_compress(chunk->buffer, cold_size, data,
+			       cold_size - cold_size/4);
+	if (len == 0) {
+		g_free(data);
+		chunk->last_access = time(NULL);
+		return;
+	}
+
+	chunk->cold = g_realloc(data, len);
+	chunk->cold_len = len;
+	buffer->cold_chunks++;
+
+	/* release the pages - they're zero filled or left as they were
+	   when accessed next time, either way they're overwritten */
+	madvise((void *) chunk->buffer, cold_size, MADV_DONTNEED);
+}
+
+static int sig_compress_cold(void)
 {
 	GSList *tmp;
+	time_t now;
+	int i;
+
+	now = time(NULL);
+	for (tmp = compact_buffers; tmp != NULL; tmp = tmp->next) {
+		TEXT_BUFFER_REC *buffer = tmp->data;
 
-	for (tmp = buffer->text_chunks; tmp != NULL; tmp = tmp->next) {
-		TEXT_CHUNK_REC *rec = tmp->data;
+		for (i = 0; i < buffer->text_chunks_count; i++) {
+			TEXT_CHUNK_REC *chunk = buffer->text_chunks[i];
 
-		if (data >= rec->buffer &&
-		    data < rec->buffer+sizeof(rec->buffer))
-                        return rec;
+			if (chunk->mapped && chunk->cold == NULL &&
+			    chunk != buffer->cur_text &&
+			    now - chunk->last_access >= TEXT_CHUNK_COLD_TIME)
+				text_chunk_compress(buffer, chunk);
+		}
 	}
 
-	return NULL;
+	return 1;
+}
+#endif
+
+void textbuffer_set_compact(TEXT_BUFFER_REC *buffer, int enabled)
+{
+#ifdef HAVE_TEXT_COMPACT
+	int i;
+#endif
+
+	g_return_if_fail(buffer != NULL);
+
+#ifdef HAVE_TEXT_COMPACT
+	if (buffer->compact == (enabled ? 1 : 0))
+		return;
+
+	buffer->compact = enabled ? 1 : 0;
+	if (enabled) {
+		compact_buffers = g_slist_prepend(compact_buffers, buffer);
+		return;
+	}
+
+	compact_buffers = g_slist_remove(compact_buffers, buffer);
+	for (i = 0; i < buffer->text_chunks_count; i++)
+		text_chunk_load(buffer, buffer->text_chunks[i]);
+#endif
+}
+
+size_t textbuffer_get_text_memory(TEXT_BUFFER_REC *buffer)
+{
+	size_t size;
+	int i;
+
+	g_return_val_if_fail(buffer != NULL, 0);
+
+	size = 0;
+	for (i = 0; i < buffer->text_chunks_count; i++) {
+		TEXT_CHUNK_REC *chunk = buffer->text_chunks[i];
+
+		size += sizeof(TEXT_CHUNK_REC);
+		if (chunk->cold != NULL)
+			size += chunk->cold_len - cold_size;
+	}
+	return size;
+}
+
+void textbuffer_line_load(TEXT_BUFFER_REC *buffer, LINE_REC *line)
+{
+	const unsigned char *ptr;
+	unsigned char *tmp;
+
+	g_return_if_fail(buffer != NULL);
+	g_return_if_fail(line != NULL);
+
+	/* chunks of buffers that aren't compacted are never compressed */
+	if (!buffer->compact)
+		return;
+
+	/* load the line's chunk and the chunks it continues to. this also
+	   marks them accessed so they don't get compressed while in use. */
+	ptr = line->text;
+	text_chunk_load(buffer, text_chunk_find(buffer, ptr));
+	for (;;) {
+		ptr += strlen((const char *) ptr);
+		if (ptr[1] == LINE_CMD_EOL)
+			break;
+
+		if (ptr[1] != LINE_CMD_CONTINUE) {
+			ptr += 2;
+			continue;
+		}
+
+		memcpy(&tmp, ptr+2, sizeof(unsigned char *));
+		ptr = tmp;
+		text_chunk_load(buffer, text_chunk_find(buffer, ptr));
+	}
 }
 
 #define mark_temp_eol(chunk) G_STMT_START { \
@@ -76,11 +461,15 @@ static TEXT_CHUNK_REC *text_chunk_create(TEXT_BUFFER_REC *buffer)
 {
 	TEXT_CHUNK_REC *rec;
 	unsigned char *buf, *ptr, **pptr;
+	int pos;
 
-	rec = g_slice_new(TEXT_CHUNK_REC);
+	rec = text_chunk_alloc(buffer);
 	rec->pos = 0;
 	rec->refcount = 0;
 
+	if (buffer->cur_text != NULL)
+		buffer->cur_text->last_access = time(NULL);
+
 	if (buffer->cur_line != NULL && buffer->cur_line->text != NULL) {
 		/* create a link to new block from the old block */
 		buf = buffer->cur_text->buffer + buffer->cur_text->pos;
@@ -99,14 +488,33 @@ static TEXT_CHUNK_REC *text_chunk_create(TEXT_BUFFER_REC *buffer)
 	}
 
 	buffer->cur_text = rec;
-	buffer->text_chunks = g_slist_append(buffer->text_chunks, rec);
+
+	if (buffer->text_chunks_count == buffer->text_chunks_size) {
+		buffer->text_chunks_size += buffer->text_chunks_size/2 + 16;
+		buffer->text_chunks = g_renew(TEXT_CHUNK_REC *,
+					      buffer->text_chunks,
+					      buffer->text_chunks_size);
+	}
+	pos = text_chunk_pos(buffer, rec->buffer)+1;
+	memmove(buffer->text_chunks+pos+1, buffer->text_chunks+pos,
+		(buffer->text_chunks_count-pos) * sizeof(TEXT_CHUNK_REC *));
+	buffer->text_chunks[pos] = rec;
+	buffer->text_chunks_count++;
 	return rec;
 }
 
 static void text_chunk_destroy(TEXT_BUFFER_REC *buffer, TEXT_CHUNK_REC *chunk)
 {
-	buffer->text_chunks = g_slist_remove(buffer->text_chunks, chunk);
-	g_slice_free(TEXT_CHUNK_REC, chunk);
+	int pos;
+
+	pos = text_chunk_pos(buffer, chunk->buffer);
+	buffer->text_chunks_count--;
+	memmove(buffer->text_chunks+pos, buffer->text_chunks+pos+1,
+		(buffer->text_chunks_count-pos) * sizeof(TEXT_CHUNK_REC *));
+
+	if (chunk->cold != NULL)
+		buffer->cold_chunks--;
+	text_chunk_free(chunk);
 }
 
 static void text_chunk_line_free(TEXT_BUFFER_REC *buffer, LINE_REC *line)
@@ -115,6 +523,7 @@ static void text_chunk_line_free(TEXT_BUFFER_REC *buffer, LINE_REC *line)
 	const unsigned char *text;
         unsigned char cmd, *tmp = NULL;
 
+	textbuffer_line_load(buffer, line);
 	for (text = line->text;; text++) {
 		if (*text != '\0')
                         continue;
@@ -180,6 +589,8 @@ static LINE_REC *textbuffer_line_create(TEXT_BUFFER_REC *buffer)
 
 	rec = g_slice_new(LINE_REC);
 	rec->text = buffer->cur_text->buffer + buffer->cur_text->pos;
+	memset(rec->search_mask, 0, sizeof(rec->search_mask));
+	buffer->search_trigram = 0;
 
 	buffer->cur_text->refcount++;
         return rec;
@@ -294,13 +705,19 @@ LINE_REC *textbuffer_insert(TEXT_BUFFER_REC *buffer, LINE_REC *insert_after,
 	if (len == 0)
                 return insert_after;
 
-	line = !buffer->last_eol ? insert_after :
-		textbuffer_line_insert(buffer, insert_after);
+	if (!buffer->last_eol) {
+		/* appending to an unfinished line */
+		line = insert_after;
+		textbuffer_line_search_reset(buffer, line);
+	} else {
+		line = textbuffer_line_insert(buffer, insert_after);
+	}
 
 	if (info != NULL)
 		memcpy(&line->info, info, sizeof(line->info));
 
 	text_chunk_append(buffer, data, len);
+	search_mask_add(line->search_mask, &buffer->search_trigram, data, len);
 
 	buffer->last_eol = len >= 2 &&
 		data[len-2] == 0 && data[len-1] == LINE_CMD_EOL;
@@ -333,6 +750,7 @@ void textbuffer_remove(TEXT_BUFFER_REC *buffer, LINE_REC *line)
         line->prev = line->next = NULL;
 
 	buffer->lines_count--;
+	textbuffer_line_search_reset(buffer, line);
         text_chunk_line_free(buffer, line);
 	g_slice_free(LINE_REC, line);
 }
@@ -340,15 +758,17 @@ void textbuffer_remove(TEXT_BUFFER_REC *buffer, LINE_REC *line)
 /* Removes all lines from buffer */
 void textbuffer_remove_all_lines(TEXT_BUFFER_REC *buffer)
 {
-	GSList *tmp;
         LINE_REC *line;
+	int i;
 
 	g_return_if_fail(buffer != NULL);
 
-	for (tmp = buffer->text_chunks; tmp != NULL; tmp = tmp->next)
-                g_slice_free(TEXT_CHUNK_REC, tmp->data);
-	g_slist_free(buffer->text_chunks);
+	for (i = 0; i < buffer->text_chunks_count; i++)
+                text_chunk_free(buffer->text_chunks[i]);
+	g_free(buffer->text_chunks);
 	buffer->text_chunks = NULL;
+	buffer->text_chunks_count = buffer->text_chunks_size = 0;
+	buffer->cold_chunks = 0;
 
 	while (buffer->first_line != NULL) {
 		line = buffer->first_line->next;
@@ -357,6 +777,11 @@ void textbuffer_remove_all_lines(TEXT_BUFFER_REC *buffer)
 	}
 	buffer->lines_count = 0;
 
+	if (buffer->search_text != NULL) {
+		g_hash_table_foreach_remove(buffer->search_text,
+					    (GHRFunc) search_text_remove, NULL);
+	}
+
         buffer->cur_line = NULL;
         buffer->cur_text = NULL;
 
@@ -381,12 +806,25 @@ static void set_color(GString *str, int cmd)
 	}
 }
 
-void textbuffer_line2text(LINE_REC *line, int coloring, GString *str)
+/* load the line when the buffer it belongs to isn't known. only the
+   compacted buffers can have compressed chunks. */
+static void text_line_load_any(LINE_REC *line)
 {
-        unsigned char cmd, *ptr, *tmp;
+	GSList *tmp;
 
-	g_return_if_fail(line != NULL);
-	g_return_if_fail(str != NULL);
+	for (tmp = compact_buffers; tmp != NULL; tmp = tmp->next) {
+		TEXT_BUFFER_REC *buffer = tmp->data;
+
+		if (text_chunk_find(buffer, line->text) != NULL) {
+			textbuffer_line_load(buffer, line);
+			break;
+		}
+	}
+}
+
+static void text_line2text(LINE_REC *line, int coloring, GString *str)
+{
+        unsigned char cmd, *ptr, *tmp;
 
         g_string_truncate(str, 0);
 
@@ -448,6 +886,44 @@ void textbuffer_line2text(LINE_REC *line, int coloring, GString *str)
 	}
 }
 
+void textbuffer_line2text(LINE_REC *line, int coloring, GString *str)
+{
+	g_return_if_fail(line != NULL);
+	g_return_if_fail(str != NULL);
+
+	text_line_load_any(line);
+	text_line2text(line, coloring, str);
+}
+
+#define search_mask_match(line_mask, mask) \
+	(((line_mask)[0] & (mask)[0]) == (mask)[0] && \
+	 ((line_mask)[1] & (mask)[1]) == (mask)[1] && \
+	 ((line_mask)[2] & (mask)[2]) == (mask)[2] && \
+	 ((line_mask)[3] & (mask)[3]) == (mask)[3])
+
+/* Return the plain text of the line, from the search cache if possible */
+static const char *textbuffer_line_search_text(TEXT_BUFFER_REC *buffer,
+					       LINE_REC *line, GString *str)
+{
+	char *text;
+
+	if (buffer->search_text != NULL) {
+		text = g_hash_table_lookup(buffer->search_text, line);
+		if (text != NULL)
+			return text;
+	}
+
+	textbuffer_line_load(buffer, line);
+	text_line2text(line, FALSE, str);
+
+	if (buffer->search_text == NULL)
+		return str->str;
+
+	text = g_strdup(str->str);
+	g_hash_table_insert(buffer->search_text, line, text);
+	return text;
+}
+
 GList *textbuffer_find_text(TEXT_BUFFER_REC *buffer, LINE_REC *startline,
 			    int level, int nolevel, const char *text,
 			    int before, int after,
@@ -456,9 +932,11 @@ GList *textbuffer_find_text(TEXT_BUFFER_REC *buffer, LINE_REC *startline,
 #ifdef HAVE_REGEX_H
 	regex_t preg;
 #endif
-        LINE_REC *line, *pre_line;
+        LINE_REC *line, *pre_line, *last_line;
 	GList *matches;
 	GString *str;
+	const char *line_text;
+	guint32 mask[4], trigram;
         int i, match_after, line_matched;
 	char * (*match_func)(const char *, const char *);
 
@@ -476,7 +954,15 @@ GList *textbuffer_find_text(TEXT_BUFFER_REC *buffer, LINE_REC *startline,
 #endif
 	}
 
-	matches = NULL; match_after = 0;
+	/* every line containing the text has at least the same trigrams */
+	memset(mask, 0, sizeof(mask));
+	if (!regexp) {
+		trigram = 0;
+		search_mask_add(mask, &trigram, (const unsigned char *) text,
+				strlen(text));
+	}
+
+	matches = NULL; match_after = 0; last_line = NULL;
         str = g_string_new(NULL);
 
 	line = startline != NULL ? startline : buffer->first_line;
@@ -490,53 +976,79 @@ GList *textbuffer_find_text(TEXT_BUFFER_REC *buffer, LINE_REC *startline,
 		line_matched = (line->info.level & level) != 0 &&
 			(line->info.level & nolevel) == 0;
 
-		if (*text != '\0') {
-			textbuffer_line2text(line, FALSE, str);
-
-			if (line_matched)
-			line_matched =
+		if (*text != '\0' && line_matched) {
+			if (!search_mask_match(line->search_mask, mask))
+				line_matched = FALSE;
+			else {
+				line_text = textbuffer_line_search_text(buffer,
+									line, str);
+				line_matched =
 #ifdef HAVE_REGEX_H
-			regexp ? regexec(&preg, str->str, 0, NULL, 0) == 0 :
+				regexp ? regexec(&preg, line_text, 0, NULL, 0) == 0 :
 #endif
-			match_func(str->str, text) != NULL;
+				match_func(line_text, text) != NULL;
+			}
 		}
 
 		if (line_matched) {
-                        /* add the -before lines */
+                        /* add the -before lines, stopping at the
+			   last line that's already in the list */
 			pre_line = line;
 			for (i = 0; i < before; i++) {
 				if (pre_line->prev == NULL ||
-				    g_list_find(matches, pre_line->prev) != NULL)
+				    pre_line->prev == last_line)
 					break;
                                 pre_line = pre_line->prev;
 			}
 
 			for (; pre_line != line; pre_line = pre_line->next)
-				matches = g_list_append(matches, pre_line);
+				matches = g_list_prepend(matches, pre_line);
 
 			match_after = after;
 		}
 
 		if (line_matched || match_after > 0) {
 			/* matched */
-			matches = g_list_append(matches, line);
+			matches = g_list_prepend(matches, line);
+			last_line = line;
 
 			if ((!line_matched && --match_after == 0) ||
 			    (line_matched && match_after == 0 && before > 0))
-				matches = g_list_append(matches, NULL);
+				matches = g_list_prepend(matches, NULL);
 		}
 	}
 #ifdef HAVE_REGEX_H
 	if (regexp) regfree(&preg);
 #endif
         g_string_free(str, TRUE);
-	return matches;
+	return g_list_reverse(matches);
 }
 
 void textbuffer_init(void)
 {
+#ifdef HAVE_TEXT_COMPACT
+	long page_size;
+#endif
+	int i;
+
+	for (i = 0; i < 256; i++)
+		search_upper[i] = i_toupper(i);
+
+#ifdef HAVE_TEXT_COMPACT
+
+	/* only whole pages of the buffer can be released */
+	page_size = sysconf(_SC_PAGESIZE);
+	if (page_size > 0)
+		cold_size = LINE_TEXT_CHUNK_SIZE / page_size * page_size;
+
+	compact_tag = g_timeout_add(TEXT_CHUNK_COLD_CHECK_TIME,
+				    (GSourceFunc) sig_compress_cold, NULL);
+#endif
 }
 
 void textbuffer_deinit(void)
 {
+#ifdef HAVE_TEXT_COMPACT
+	g_source_remove(compact_tag);
+#endif
 }
@@ -3,7 +3,7 @@
 
 /* Make sure TEXT_CHUNK_REC is not slightly more than a page, as that
    wastes a lot of memory. */
-#define LINE_TEXT_CHUNK_SIZE (16384 - 16)
+#define LINE_TEXT_CHUNK_SIZE (16384 - 40)
 
 #define LINE_COLOR_BG		0x20
 #define LINE_COLOR_DEFAULT	0x10
@@ -42,16 +42,29 @@ typedef struct _LINE_REC {
 
 	unsigned char *text;
         LINE_INFO_REC info;
+
+	/* Trigram signature of the line's plain text, used to skip lines
+	   quickly when searching. Calculated when the text is added. */
+	guint32 search_mask[4];
 } LINE_REC;
 
 typedef struct {
 	unsigned char buffer[LINE_TEXT_CHUNK_SIZE];
 	int pos;
 	int refcount;
+
+	unsigned int mapped:1; /* allocated with mmap(), can be compressed */
+	int cold_len;
+	unsigned char *cold; /* compressed start of buffer, NULL if loaded */
+	time_t last_access;
 } TEXT_CHUNK_REC;
 
 typedef struct {
-	GSList *text_chunks;
+	/* text chunks sorted by address, for finding the chunk of a
+	   text pointer */
+	TEXT_CHUNK_REC **text_chunks;
+	int text_chunks_count, text_chunks_size;
+
         LINE_REC *first_line;
         int lines_count;
 
@@ -59,9 +72,17 @@ typedef struct {
 	TEXT_CHUNK_REC *cur_text;
 
 	unsigned int last_eol:1;
+	unsigned int compact:1; /* compress chunks that haven't been used */
+	int cold_chunks; /* number of compressed chunks */
 	int last_fg;
 	int last_bg;
 	int last_flags;
+
+	/* last characters of cur_line's plain text, for its signature */
+	guint32 search_trigram;
+
+	/* LINE_REC -> plain text of the line, NULL if not cached */
+	GHashTable *search_text;
 } TEXT_BUFFER_REC;
 
 /* Create new buffer */
@@ -89,7 +110,20 @@ void textbuffer_remove(TEXT_BUFFER_REC *buffer, LINE_REC *line);
 /* Removes all lines from buffer, ignoring reference counters */
 void textbuffer_remove_all_lines(TEXT_BUFFER_REC *buffer);
 
+/* Make sure the line's text is uncompressed. This must be called before
+   accessing line->text directly. */
+void textbuffer_line_load(TEXT_BUFFER_REC *buffer, LINE_REC *line);
+/* Compress text chunks that haven't been accessed for a while */
+void textbuffer_set_compact(TEXT_BUFFER_REC *buffer, int enabled);
+/* Return the memory used by text chunks, compressed chunks counted by
+   the memory they actually use */
+size_t textbuffer_get_text_memory(TEXT_BUFFER_REC *buffer);
+
+/* Compressed text of the line is loaded first, if needed */
 void textbuffer_line2text(LINE_REC *line, int coloring, GString *str);
+/* Keep a plain text copy of the lines that have been searched, so that
+   later searches don't need to convert them again */
+void textbuffer_set_search_cache(TEXT_BUFFER_REC *buffer, int enabled);
 GList *textbuffer_find_text(TEXT_BUFFER_REC *buffer, LINE_REC *startline,
 			    int level, int nolevel, const char *text,
 			    int before, int after,
@@ -249,17 +249,252 @@ void silc_say_error(char *msg, ...)
   va_end(va);
 }
 
-/* Try to verify a message using locally stored public key data */
+/* Verified public key cache.  Client keys from the clientkeys directory
+   are kept parsed in memory, keyed by fingerprint, and reloaded when the
+   key file changes.  Results of already verified signatures are
+   remembered per key so that the same message is not verified twice. */
+
+#define SILC_VERIFY_CACHE_KEYS 256
+#define SILC_VERIFY_CACHE_RESULTS 128
+
+/* When more signed messages than this arrive within a second the rest
+   are displayed right away and verified in the background. */
+#define SILC_VERIFY_BURST 8
+
+typedef struct {
+  SilcPublicKey public_key;	/* Key from key file, NULL if none */
+  GHashTable *results;		/* Message digest -> verification result */
+  time_t mtime;			/* Key file state when loaded */
+  off_t size;
+  ino_t ino;
+  SilcUInt32 generation;	/* Changes when key file changes */
+  unsigned int exists : 1;	/* Key file existed when checked */
+} *SilcVerifyKey;
+
+/* Message signature being verified in the background */
+typedef struct {
+  SilcAsyncOperation op;
+  char *server_tag;
+  char *target;			/* Channel, NULL for private message */
+  char *nick;
+  char *fingerprint;		/* Key cache entry */
+  char *digest;			/* Message digest */
+  SilcUInt32 generation;	/* Key cache entry generation */
+  int ret;			/* Level of trust if signature is valid */
+} *SilcVerifyMessage;
+
+static GHashTable *verify_keys = NULL;
+static GSList *verify_pending = NULL;
+static SilcUInt32 verify_generation = 0;
+
+static gboolean silc_verify_remove(void *key, void *value, void *context)
+{
+  return TRUE;
+}
+
+static void silc_verify_key_reset(SilcVerifyKey key)
+{
+  if (key->public_key)
+    silc_pkcs_public_key_free(key->public_key);
+  key->public_key = NULL;
+  key->exists = FALSE;
+  key->generation = ++verify_generation;
+  g_hash_table_foreach_remove(key->results, silc_verify_remove, NULL);
+}
+
+static void silc_verify_key_free(void *data)
+{
+  SilcVerifyKey key = data;
+
+  silc_verify_key_reset(key);
+  g_hash_table_destroy(key->results);
+  silc_free(key);
+}
+
+/* Returns cache entry for the key `fingerprint'.  The key file `filename'
+   is loaded if it was created or changed since last time. */
+
+static SilcVerifyKey silc_verify_key_get(const char *fingerprint,
+					 const char *filename)
+{
+  SilcVerifyKey key;
+  struct stat st;
+
+  if (!verify_keys)
+    verify_keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+					silc_verify_key_free);
+
+  key = g_hash_table_lookup(verify_keys, fingerprint);
+  if (!key) {
+    key = silc_calloc(1, sizeof(*key));
+    if (!key)
+      return NULL;
+    key->results = g_hash_table_new_full(g_str_hash, g_str_equal,
+					 g_free, NULL);
+    key->generation = ++verify_generation;
+
+    if (g_hash_table_size(verify_keys) >= SILC_VERIFY_CACHE_KEYS)
+      g_hash_table_foreach_remove(verify_keys, silc_verify_remove, NULL);
+    g_hash_table_insert(verify_keys, g_strdup(fingerprint), key);
+  }
+
+  if (stat(filename, &st) < 0) {
+    /* we don't have the public key cached */
+    if (key->exists)
+      silc_verify_key_reset(key);
+    return key;
+  }
+
+  if (key->exists && key->mtime == st.st_mtime &&
+      key->size == st.st_size && key->ino == st.st_ino)
+    return key;
+
+  /* key file is new or it has changed, (re)load it */
+  silc_verify_key_reset(key);
+  key->exists = TRUE;
+  key->mtime = st.st_mtime;
+  key->size = st.st_size;
+  key->ino = st.st_ino;
+
+  if (!silc_pkcs_load_public_key(filename, &key->public_key)) {
+    printformat_module("fe-common/silc", NULL, NULL, MSGLEVEL_CRAP,
+		       SILCTXT_PUBKEY_COULD_NOT_LOAD, "client");
+    key->public_key = NULL;
+  }
+
+  return key;
+}
+
+/* Returns digest identifying the signed message.  It covers all of the
+   data the signature was computed over, and the signature. */
+
+static char *silc_verify_digest(SilcMessagePayload message)
+{
+  unsigned char hash[SILC_HASH_MAXLEN];
+  const unsigned char *sign;
+  SilcUInt32 sign_len;
+  SilcBuffer data;
+
+  sign = silc_message_signed_get_signature(message, &sign_len);
+  if (!sign)
+    return NULL;
+  data = silc_message_signed_get_data(message);
+  if (!data)
+    return NULL;
+
+  silc_hash_init(sha1hash);
+  silc_hash_update(sha1hash, silc_buffer_data(data), silc_buffer_len(data));
+  silc_hash_update(sha1hash, sign, sign_len);
+  silc_hash_final(sha1hash, hash);
+  silc_buffer_free(data);
+
+  return silc_hash_fingerprint(NULL, hash, silc_hash_len(sha1hash));
+}
+
+/* Remember verification result of the message `digest' */
+
+static void silc_verify_key_result(SilcVerifyKey key, const char *digest,
+				   int ret)
+{
+  if (g_hash_table_size(key->results) >= SILC_VERIFY_CACHE_RESULTS)
+    g_hash_table_foreach_remove(key->results, silc_verify_remove, NULL);
+  g_hash_table_insert(key->results, g_strdup(digest), GINT_TO_POINTER(ret));
+}
+
+/* Returns TRUE if signed messages are arriving faster than we should
+   verify them while the user waits. */
+
+static gboolean silc_verify_burst(void)
+{
+  static time_t when = 0;
+  static int count = 0;
+  time_t now = time(NULL);
+
+  if (now != when) {
+    when = now;
+    count = 0;
+  }
+
+  return ++count > SILC_VERIFY_BURST || verify_pending != NULL;
+}
+
+static void silc_verify_message_free(SilcVerifyMessage verify)
+{
+  verify_pending = g_slist_remove(verify_pending, verify);
+  g_free(verify->server_tag);
+  g_free(verify->target);
+  g_free(verify->nick);
+  g_free(verify->fingerprint);
+  silc_free(verify->digest);
+  silc_free(verify);
+}
+
+/* Background signature verification completion.  The message has been
+   displayed already, so only a failure is reported. */
+
+static void silc_verify_message_done(SilcAuthResult result, void *context)
+{
+  SilcVerifyMessage verify = context;
+  SilcVerifyKey key;
+  SERVER_REC *server;
+  int ret;
+
+  ret = result == SILC_AUTH_OK ? verify->ret : SILC_MSG_SIGNED_FAILED;
+
+  key = verify_keys ? g_hash_table_lookup(verify_keys,
+					  verify->fingerprint) : NULL;
+  if (key && key->generation == verify->generation)
+    silc_verify_key_result(key, verify->digest, ret);
+
+  if (ret == SILC_MSG_SIGNED_FAILED) {
+    server = server_find_tag(verify->server_tag);
+    if (server)
+      printformat_module("fe-common/silc", server,
+			 verify->target ? verify->target : verify->nick,
+			 MSGLEVEL_CRAP, SILCTXT_MSG_SIGNATURE_FAILED,
+			 verify->nick);
+  }
+
+  silc_verify_message_free(verify);
+}
+
+/* Free the verified public key cache */
+
+void silc_verify_cache_free(void)
+{
+  SilcVerifyMessage verify;
+
+  while (verify_pending) {
+    verify = verify_pending->data;
+    if (verify->op)
+      silc_async_abort(verify->op, NULL, NULL);
+    silc_verify_message_free(verify);
+  }
+
+  if (verify_keys)
+    g_hash_table_destroy(verify_keys);
+  verify_keys = NULL;
+}
+
+/* Try to verify a message using locally stored public key data.  When
+   signed messages arrive in a burst, the signature is verified in the
+   background and the message is reported unknown for now.  The `target'
+   is the channel the message was sent to, NULL for private message. */
 
 int verify_message_signature(SilcClientEntry sender,
-			     SilcMessagePayload message)
+			     SilcMessagePayload message,
+			     SILC_SERVER_REC *server,
+			     const char *target)
 {
-  SilcPublicKey pk;
+  SilcPublicKey pk, vpk;
+  SilcVerifyKey key;
+  SilcVerifyMessage verify;
+  SilcAsyncOperation op;
   char file[256], filename[256];
-  char *fingerprint, *fingerprint2;
+  char *fingerprint, *fingerprint2, *digest;
   const unsigned char *pk_data;
   SilcUInt32 pk_datalen;
-  struct stat st;
+  gpointer result;
   int ret = SILC_MSG_SIGNED_VERIFIED, i;
 
   /* get public key from the signature payload and compare it with the
@@ -297,36 +532,70 @@ int verify_message_signature(SilcClientEntry sender,
   snprintf(file, sizeof(file) - 1, "clientkey_%s.pub", fingerprint);
   snprintf(filename, sizeof(filename) - 1, "%s/clientkeys/%s",
 	   get_irssi_dir(), file);
-  silc_free(fingerprint);
+  key = silc_verify_key_get(fingerprint, filename);
 
-  if (stat(filename, &st) < 0)
+  if (key && key->public_key) {
+    vpk = key->public_key;
+  } else {
     /* we don't have the public key cached ... use the one from the sig */
     ret = SILC_MSG_SIGNED_UNKNOWN;
-  else {
-    SilcPublicKey cached_pk=NULL;
+    vpk = pk;
+  }
 
-    /* try to load the file */
-    if (!silc_pkcs_load_public_key(filename, &cached_pk)) {
-      printformat_module("fe-common/silc", NULL, NULL, MSGLEVEL_CRAP,
-			 SILCTXT_PUBKEY_COULD_NOT_LOAD, "client");
-      if (pk == NULL)
-	return SILC_MSG_SIGNED_UNKNOWN;
-      else
+  if (!vpk) {
+    silc_free(fingerprint);
+    return ret;
+  }
+
+  /* the public key is now in vpk, our "level of trust" in ret.  Check
+     if this message has been verified already. */
+  digest = key ? silc_verify_digest(message) : NULL;
+  if (digest && g_hash_table_lookup_extended(key->results, digest,
+					     NULL, &result)) {
+    ret = GPOINTER_TO_INT(result);
+    goto out;
+  }
+
+  if (digest && server && silc_verify_burst()) {
+    /* verify in the background */
+    verify = silc_calloc(1, sizeof(*verify));
+    if (verify) {
+      verify->server_tag = g_strdup(SERVER(server)->tag);
+      verify->target = g_strdup(target);
+      verify->nick = g_strdup(sender->nickname);
+      verify->fingerprint = g_strdup(fingerprint);
+      verify->digest = digest;
+      verify->generation = key->generation;
+      verify->ret = ret;
+      digest = NULL;
+      verify_pending = g_slist_prepend(verify_pending, verify);
+
+      op = silc_client_verify_message_signature(silc_client, message, vpk,
+						sha1hash,
+						silc_verify_message_done,
+						verify);
+      if (op) {
+	verify->op = op;
 	ret = SILC_MSG_SIGNED_UNKNOWN;
-    }
+	goto out;
+      }
 
-    if (cached_pk) {
-      if (pk)
-        silc_pkcs_public_key_free(pk);
-      pk = cached_pk;
+      /* couldn't verify in the background, verify now */
+      digest = verify->digest;
+      verify->digest = NULL;
+      silc_verify_message_free(verify);
     }
   }
 
-  /* the public key is now in pk, our "level of trust" in ret */
-  if ((pk) && silc_message_signed_verify(message, pk,
-			  		 sha1hash) != SILC_AUTH_OK)
+  if (silc_message_signed_verify(message, vpk, sha1hash) != SILC_AUTH_OK)
     ret = SILC_MSG_SIGNED_FAILED;
 
+  if (digest)
+    silc_verify_key_result(key, digest, ret);
+
+ out:
+  silc_free(digest);
+  silc_free(fingerprint);
   if (pk)
     silc_pkcs_public_key_free(pk);
 
@@ -442,7 +711,8 @@ void silc_channel_message(SilcClient client, SilcClientConnection conn,
   /* If the messages is digitally signed, verify it, if possible. */
   if (flags & SILC_MESSAGE_FLAG_SIGNED) {
     if (!settings_get_bool("ignore_message_signatures")) {
-      verified = verify_message_signature(sender, payload);
+      verified = verify_message_signature(sender, payload, server,
+					  channel->channel_name);
     } else {
       flags &= ~SILC_MESSAGE_FLAG_SIGNED;
     }
@@ -574,7 +844,7 @@ void silc_private_message(SilcClient client, SilcClientConnection conn,
   /* If the messages is digitally signed, verify it, if possible. */
   if (flags & SILC_MESSAGE_FLAG_SIGNED) {
     if (!settings_get_bool("ignore_message_signatures")) {
-      verified = verify_message_signature(sender, payload);
+      verified = verify_message_signature(sender, payload, server, NULL);
     } else {
       flags &= ~SILC_MESSAGE_FLAG_SIGNED;
     }
@@ -694,6 +964,65 @@ void silc_private_message(SilcClient client, SilcClientConnection conn,
   }
 }
 
+/* Prints that `client_entry' joined `channel', and whether there are now
+   many clients with the same nickname on the channel. */
+
+static void silc_notify_join_print(SilcClient client,
+				   SilcClientConnection conn,
+				   SILC_SERVER_REC *server,
+				   SilcChannelEntry channel,
+				   SilcClientEntry client_entry)
+{
+  SilcClientEntry client_entry2;
+  SilcDList clients;
+  char buf[512], *nick, tmp[32];
+  int count = 0;
+
+  memset(buf, 0, sizeof(buf));
+  if (client_entry->username[0])
+    snprintf(buf, sizeof(buf) - 1, "%s@%s",
+	     client_entry->username, client_entry->hostname);
+  signal_emit("message join", 4, server, channel->channel_name,
+	      client_entry->nickname,
+	      !client_entry->username[0] ? "" : buf);
+
+  /* If there are multiple same nicknames on channel now, tell it to user. */
+  if (client_entry == server->conn->local_entry)
+    return;
+
+  silc_client_nickname_parse(client, conn, client_entry->nickname, &nick);
+  clients = silc_client_get_clients_local(client, conn, nick, TRUE);
+  if (!clients || silc_dlist_count(clients) < 2) {
+    silc_free(nick);
+    silc_client_list_free(client, conn, clients);
+    return;
+  }
+  silc_dlist_start(clients);
+  while ((client_entry2 = silc_dlist_get(clients)))
+    if (silc_client_on_channel(channel, client_entry2))
+      count++;
+  if (count > 1) {
+    silc_snprintf(tmp, sizeof(tmp), "%d", silc_dlist_count(clients));
+    printformat_module("fe-common/silc", server, channel->channel_name,
+		       MSGLEVEL_CRAP, SILCTXT_CHANNEL_MANY_NICKS,
+		       tmp, nick);
+    printformat_module("fe-common/silc", server, channel->channel_name,
+		       MSGLEVEL_CRAP, SILCTXT_CHANNEL_USER_APPEARS,
+		       buf, client_entry->nickname);
+  }
+  silc_client_list_free(client, conn, clients);
+  silc_free(nick);
+}
+
+/* Removes the nicks collected for `channel' from its nicklist */
+
+static void silc_notify_remove_nicks(CHANNEL_REC *channel, GSList *nicks)
+{
+  nicks = g_slist_reverse(nicks);
+  nicklist_remove_many(channel, nicks);
+  g_slist_free(nicks);
+}
+
 /* Notify message to the client. The notify arguments are sent in the
    same order as servers sends them. The arguments are same as received
    from the server except for ID's.  If ID is received application receives
@@ -776,42 +1105,26 @@ void silc_notify(SilcClient client, SilcClientConnection conn,
       }
     }
 
-    memset(buf, 0, sizeof(buf));
-    if (client_entry->username[0])
-      snprintf(buf, sizeof(buf) - 1, "%s@%s",
-	       client_entry->username, client_entry->hostname);
-    signal_emit("message join", 4, server, channel->channel_name,
-		client_entry->nickname,
-		!client_entry->username[0] ? "" : buf);
+    silc_notify_join_print(client, conn, server, channel, client_entry);
+    break;
 
-    /* If there are multiple same nicknames on channel now, tell it to user. */
-    if (client_entry != server->conn->local_entry) {
-      char *nick, tmp[32];
-      int count = 0;
+  case SILC_NOTIFY_TYPE_JOIN_MANY:
+    /*
+     * Many clients joined channel, delivered in batch notify mode.
+     */
 
-      silc_client_nickname_parse(client, conn, client_entry->nickname, &nick);
-      clients = silc_client_get_clients_local(client, conn, nick, TRUE);
-      if (!clients || silc_dlist_count(clients) < 2) {
-	silc_free(nick);
-	silc_client_list_free(client, conn, clients);
-	break;
-      }
-      silc_dlist_start(clients);
-      while ((client_entry2 = silc_dlist_get(clients)))
-	if (silc_client_on_channel(channel, client_entry2))
-	  count++;
-      if (count > 1) {
-	silc_snprintf(tmp, sizeof(tmp), "%d", silc_dlist_count(clients));
-	printformat_module("fe-common/silc", server, channel->channel_name,
-			   MSGLEVEL_CRAP, SILCTXT_CHANNEL_MANY_NICKS,
-			   tmp, nick);
-	printformat_module("fe-common/silc", server, channel->channel_name,
-			   MSGLEVEL_CRAP, SILCTXT_CHANNEL_USER_APPEARS,
-			   buf, client_entry->nickname);
-      }
-      silc_client_list_free(client, conn, clients);
-      silc_free(nick);
-    }
+    SILC_LOG_DEBUG(("Notify: JOIN_MANY"));
+
+    channel = va_arg(va, SilcChannelEntry);
+    clients = va_arg(va, SilcDList);
+
+    chanrec = silc_channel_find_entry(server, channel);
+    if (chanrec != NULL)
+      silc_nicklist_insert_many(chanrec, channel, clients, TRUE);
+
+    silc_dlist_start(clients);
+    while ((client_entry = silc_dlist_get(clients)))
+      silc_notify_join_print(client, conn, server, channel, client_entry);
     break;
 
   case SILC_NOTIFY_TYPE_LEAVE:
@@ -1248,11 +1561,13 @@ void silc_notify(SilcClient client, SilcClientConnection conn,
        * Server has quit the network.
        */
       SilcDList clients;
+      GHashTable *removed;
 
       SILC_LOG_DEBUG(("Notify: SERVER_SIGNOFF"));
 
       (void)va_arg(va, void *);
       clients = va_arg(va, SilcDList);
+      removed = g_hash_table_new(NULL, NULL);
 
       silc_dlist_start(clients);
       while ((client_entry = silc_dlist_get(clients))) {
@@ -1272,14 +1587,20 @@ void silc_notify(SilcClient client, SilcClientConnection conn,
 
 	silc_server_free_ftp(server, client_entry);
 
+	/* Collect the nicks per channel to remove them in one go */
 	list1 = nicklist_get_same_unique(SERVER(server), client_entry);
 	for (list_tmp = list1; list_tmp != NULL; list_tmp =
 	       list_tmp->next->next) {
 	  CHANNEL_REC *channel = list_tmp->data;
-	  NICK_REC *nickrec = list_tmp->next->data;
-	  nicklist_remove(channel, nickrec);
+	  GSList *nicks = g_hash_table_lookup(removed, channel);
+	  g_hash_table_insert(removed, channel,
+			      g_slist_prepend(nicks, list_tmp->next->data));
 	}
+	g_slist_free(list1);
       }
+
+      g_hash_table_foreach(removed, (GHFunc) silc_notify_remove_nicks, NULL);
+      g_hash_table_destroy(removed);
     }
     break;
 
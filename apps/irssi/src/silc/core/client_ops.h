@@ -71,5 +71,6 @@ silc_escape_data(const char *data, SilcUInt32 len);
 
 char *
 silc_get_session_filename(SILC_SERVER_REC *server);
+void silc_verify_cache_free(void);
 
 #endif
@@ -74,22 +74,99 @@ void silc_lag_deinit(void);
 void silc_core_deinit(void);
 #endif
 
-static gboolean my_silc_scheduler(gpointer data)
+/* The SILC scheduler is run from the glib main loop through one GSource.
+   The source polls the file descriptors the scheduler has registered and
+   uses the scheduler's earliest timeout as its poll timeout, so glib
+   never needs a source per SILC task. */
+
+typedef struct {
+  GPollFD pollfd;
+  SilcTask task;
+} SilcSourceFd;
+
+typedef struct {
+  GSource source;
+  GHashTable *fds;		/* fd -> SilcSourceFd */
+} SilcSource;
+
+static SilcSource *silc_source = NULL;
+
+static gboolean silc_source_prepare(GSource *source, gint *timeout)
 {
-  SILC_LOG_DEBUG(("Timeout"));
-  silc_client_run_one(silc_client);
+  long seconds, useconds;
+
+  if (!silc_schedule_get_timeout(silc_client->schedule,
+				 &seconds, &useconds)) {
+    *timeout = -1;
+    return FALSE;
+  }
+
+  if (!seconds && !useconds) {
+    *timeout = 0;
+    return TRUE;
+  }
+
+  /* Round up so that we don't wake up just before the deadline */
+  if (seconds >= G_MAXINT / 1000 - 1)
+    *timeout = G_MAXINT;
+  else
+    *timeout = (seconds * 1000) + ((useconds + 999) / 1000);
   return FALSE;
 }
 
-static gboolean my_silc_scheduler_fd(GIOChannel *source,
-                                     GIOCondition condition,
-                                     gpointer data)
+static gboolean silc_source_check_fd(gpointer key, gpointer value,
+				     gpointer user_data)
+{
+  SilcSourceFd *rec = value;
+  return rec->pollfd.revents != 0;
+}
+
+static gboolean silc_source_check(GSource *source)
 {
-  SILC_LOG_DEBUG(("I/O event, %d", SILC_PTR_TO_32(data)));
+  SilcSource *s = (SilcSource *)source;
+  long seconds, useconds;
+
+  if (g_hash_table_find(s->fds, silc_source_check_fd, NULL))
+    return TRUE;
+
+  return (silc_schedule_get_timeout(silc_client->schedule,
+				    &seconds, &useconds) &&
+	  !seconds && !useconds);
+}
+
+static gboolean silc_source_dispatch(GSource *source, GSourceFunc callback,
+				     gpointer user_data)
+{
+  SILC_LOG_DEBUG(("Running scheduler"));
   silc_client_run_one(silc_client);
   return TRUE;
 }
 
+static void silc_source_finalize(GSource *source)
+{
+  g_hash_table_destroy(((SilcSource *)source)->fds);
+}
+
+static GSourceFuncs silc_source_funcs = {
+  silc_source_prepare,
+  silc_source_check,
+  silc_source_dispatch,
+  silc_source_finalize
+};
+
+static void silc_source_remove_fd(SilcSourceFd *rec)
+{
+  g_source_remove_poll(&silc_source->source, &rec->pollfd);
+  g_hash_table_remove(silc_source->fds, GINT_TO_POINTER(rec->pollfd.fd));
+}
+
+static gboolean silc_source_find_task(gpointer key, gpointer value,
+				      gpointer user_data)
+{
+  SilcSourceFd *rec = value;
+  return rec->task == user_data;
+}
+
 static void scheduler_notify_cb(SilcSchedule schedule,
 				SilcBool added, SilcTask task,
 				SilcBool fd_task, SilcUInt32 fd,
@@ -97,39 +174,63 @@ static void scheduler_notify_cb(SilcSchedule schedule,
 				long seconds, long useconds,
 				void *context)
 {
+  SilcSourceFd *rec;
+  gushort e = 0;
+
+  /* Timeouts are picked up by silc_source_prepare */
+  if (!fd_task || !silc_source)
+    return;
+
   if (added) {
-    if (fd_task) {
-      /* Add fd */
-      GIOChannel *ch;
-      guint e = 0;
-
-      SILC_LOG_DEBUG(("Add fd %d, events %d", fd, event));
-      g_source_remove_by_user_data(SILC_32_TO_PTR(fd));
-
-      if (event & SILC_TASK_READ)
-        e |= (G_IO_IN | G_IO_PRI | G_IO_HUP | G_IO_ERR);
-      if (event & SILC_TASK_WRITE)
-        e |= (G_IO_OUT | G_IO_HUP | G_IO_ERR | G_IO_NVAL);
-
-      if (e) {
-	ch = g_io_channel_unix_new(fd);
-	g_io_add_watch(ch, e, my_silc_scheduler_fd, SILC_32_TO_PTR(fd));
-	g_io_channel_unref(ch);
-      }
-    } else {
-      /* Add timeout */
-      guint t;
+    SILC_LOG_DEBUG(("Set fd %d, events %d", fd, event));
 
-      t = (seconds * 1000) + (useconds / 1000);
-      SILC_LOG_DEBUG(("interval %d msec", t));
-      g_timeout_add(t, my_silc_scheduler, NULL);
-    }
-  } else {
-    if (fd_task) {
-      /* Remove fd */
-      g_source_remove_by_user_data(SILC_32_TO_PTR(fd));
-    }
+    if (event & SILC_TASK_READ)
+      e |= (G_IO_IN | G_IO_PRI | G_IO_HUP | G_IO_ERR);
+    if (event & SILC_TASK_WRITE)
+      e |= (G_IO_OUT | G_IO_HUP | G_IO_ERR | G_IO_NVAL);
+  }
+
+  /* Task deletion may not tell the fd, only the task */
+  if (!added && !fd)
+    rec = g_hash_table_find(silc_source->fds, silc_source_find_task, task);
+  else
+    rec = g_hash_table_lookup(silc_source->fds, GINT_TO_POINTER(fd));
+
+  if (!e) {
+    /* Remove fd */
+    if (rec)
+      silc_source_remove_fd(rec);
+    return;
+  }
+
+  if (!rec) {
+    rec = g_new0(SilcSourceFd, 1);
+    rec->pollfd.fd = fd;
+    g_hash_table_insert(silc_source->fds, GINT_TO_POINTER(fd), rec);
+    g_source_add_poll(&silc_source->source, &rec->pollfd);
   }
+  rec->pollfd.events = e;
+  rec->task = task;
+}
+
+static void silc_source_init(void)
+{
+  silc_source = (SilcSource *)g_source_new(&silc_source_funcs,
+					   sizeof(SilcSource));
+  silc_source->fds = g_hash_table_new_full(NULL, NULL, NULL,
+					   (GDestroyNotify) g_free);
+  g_source_attach(&silc_source->source, NULL);
+}
+
+static void silc_source_deinit(void)
+{
+  if (!silc_source)
+    return;
+
+  silc_schedule_set_notify(silc_client->schedule, NULL, NULL);
+  g_source_destroy(&silc_source->source);
+  g_source_unref(&silc_source->source);
+  silc_source = NULL;
 }
 
 static CHATNET_REC *create_chatnet(void)
@@ -556,6 +657,7 @@ static void sig_init_finished(void)
     return;
   }
 
+  silc_source_init();
   silc_schedule_set_notify(silc_client->schedule, scheduler_notify_cb, NULL);
 
   silc_log_set_callback(SILC_LOG_INFO, silc_log_misc, NULL);
@@ -566,7 +668,7 @@ static void sig_init_finished(void)
   silc_hash_alloc("sha1", &sha1hash);
 
   /* Run SILC scheduler */
-  my_silc_scheduler(NULL);
+  silc_client_run_one(silc_client);
 }
 
 #ifndef SILC_PLUGIN
@@ -859,6 +961,7 @@ void silc_core_deinit(void)
 
   signal_emit("chat protocol deinit", 1, chat_protocol_find("SILC"));
 
+  silc_verify_cache_free();
   silc_hash_free(sha1hash);
 
   silc_queue_deinit();
@@ -875,5 +978,6 @@ void silc_core_deinit(void)
     silc_pkcs_public_key_free(irssi_pubkey);
   if (irssi_privkey)
     silc_pkcs_private_key_free(irssi_privkey);
+  silc_source_deinit();
   silc_client_free(silc_client);
 }
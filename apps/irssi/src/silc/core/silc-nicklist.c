@@ -26,12 +26,11 @@
 #include "silc-channels.h"
 #include "silc-nicklist.h"
 
-SILC_NICK_REC *silc_nicklist_insert(SILC_CHANNEL_REC *channel,
-				    SilcChannelUser user, int send_massjoin)
+static SILC_NICK_REC *silc_nicklist_new(SilcChannelUser user,
+					int send_massjoin)
 {
   SILC_NICK_REC *rec;
 
-  g_return_val_if_fail(IS_SILC_CHANNEL(channel), NULL);
   if (!user)
     return NULL;
   if (!user->client)
@@ -53,10 +52,47 @@ SILC_NICK_REC *silc_nicklist_insert(SILC_CHANNEL_REC *channel,
     rec->founder = TRUE;
   rec->send_massjoin = send_massjoin;
 
-  nicklist_insert(CHANNEL(channel), (NICK_REC *) rec);
   return rec;
 }
 
+SILC_NICK_REC *silc_nicklist_insert(SILC_CHANNEL_REC *channel,
+				    SilcChannelUser user, int send_massjoin)
+{
+  SILC_NICK_REC *rec;
+
+  g_return_val_if_fail(IS_SILC_CHANNEL(channel), NULL);
+
+  rec = silc_nicklist_new(user, send_massjoin);
+  if (rec)
+    nicklist_insert(CHANNEL(channel), (NICK_REC *) rec);
+  return rec;
+}
+
+/* Insert all `clients' that are on `entry' to nicklist at once */
+
+void silc_nicklist_insert_many(SILC_CHANNEL_REC *channel,
+			       SilcChannelEntry entry, SilcDList clients,
+			       int send_massjoin)
+{
+  SilcClientEntry client_entry;
+  SILC_NICK_REC *rec;
+  GSList *nicks = NULL;
+
+  g_return_if_fail(IS_SILC_CHANNEL(channel));
+
+  silc_dlist_start(clients);
+  while ((client_entry = silc_dlist_get(clients))) {
+    rec = silc_nicklist_new(silc_client_on_channel(entry, client_entry),
+			    send_massjoin);
+    if (rec)
+      nicks = g_slist_prepend(nicks, rec);
+  }
+
+  nicks = g_slist_reverse(nicks);
+  nicklist_insert_many(CHANNEL(channel), nicks);
+  g_slist_free(nicks);
+}
+
 SILC_NICK_REC *silc_nicklist_find(SILC_CHANNEL_REC *channel,
 				  SilcClientEntry client)
 {
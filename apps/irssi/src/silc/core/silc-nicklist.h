@@ -11,6 +11,9 @@ typedef struct {
 
 SILC_NICK_REC *silc_nicklist_insert(SILC_CHANNEL_REC *channel,
 				    SilcChannelUser user, int send_massjoin);
+void silc_nicklist_insert_many(SILC_CHANNEL_REC *channel,
+			       SilcChannelEntry entry, SilcDList clients,
+			       int send_massjoin);
 
 SILC_NICK_REC *silc_nicklist_find(SILC_CHANNEL_REC *channel,
                                   SilcClientEntry client);
@@ -424,6 +424,62 @@ SilcBool silc_change_private_key_passphrase(const char *prv_filename,
   return TRUE;
 }
 
+/* Fast path for pure ASCII identifiers.  For ASCII characters the
+   identifier profiles only fold the case and prohibit control characters,
+   space and, in other than channel names, the characters in Appendix C
+   of the protocol.  Returns 1 if the identifier is valid, 0 if it is
+   prohibited and -1 if it is not pure ASCII and must be prepared with
+   silc_stringprep.  If `out' is non-NULL the prepared identifier is
+   allocated into it. */
+
+static int silc_identifier_ascii(const unsigned char *identifier,
+				 SilcUInt32 identifier_len,
+				 SilcStringEncoding identifier_encoding,
+				 SilcBool channel, unsigned char **out)
+{
+  unsigned char *s = NULL;
+  int i;
+
+  if (identifier_encoding != SILC_STRING_ASCII &&
+      identifier_encoding != SILC_STRING_UTF8)
+    return -1;
+
+  for (i = 0; i < identifier_len; i++)
+    if (identifier[i] & 0x80)
+      return -1;
+
+  if (out) {
+    s = silc_malloc(identifier_len + 1);
+    if (!s)
+      return 0;
+  }
+
+  for (i = 0; i < identifier_len; i++) {
+    unsigned char c = identifier[i];
+
+    if (c <= 0x20 || c == 0x7f)
+      goto err;
+    if (!channel && (c == '!' || c == '*' || c == ',' || c == '?' ||
+		     c == '@'))
+      goto err;
+
+    if (s)
+      s[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+  }
+
+  if (out) {
+    s[identifier_len] = '\0';
+    *out = s;
+  }
+
+  return 1;
+
+ err:
+  SILC_LOG_DEBUG(("Prohibited character in identifier"));
+  silc_free(s);
+  return 0;
+}
+
 /* Checks that the 'identifier' string is valid identifier string
    and does not contain any unassigned or prohibited character.  This
    function is used to check for valid nicknames, channel names,
@@ -446,6 +502,16 @@ unsigned char *silc_identifier_check(const unsigned char *identifier,
   if (max_allowed_length && identifier_len > max_allowed_length)
     return NULL;
 
+  switch (silc_identifier_ascii(identifier, identifier_len,
+				identifier_encoding, FALSE, &utf8s)) {
+  case 1:
+    if (out_len)
+      *out_len = identifier_len;
+    return utf8s;
+  case 0:
+    return NULL;
+  }
+
   status = silc_stringprep(identifier, identifier_len,
 			   identifier_encoding, SILC_IDENTIFIER_PREP, 0,
 			   &utf8s, &utf8s_len, SILC_STRING_UTF8);
@@ -476,6 +542,14 @@ SilcBool silc_identifier_verify(const unsigned char *identifier,
   if (max_allowed_length && identifier_len > max_allowed_length)
     return FALSE;
 
+  switch (silc_identifier_ascii(identifier, identifier_len,
+				identifier_encoding, FALSE, NULL)) {
+  case 1:
+    return TRUE;
+  case 0:
+    return FALSE;
+  }
+
   status = silc_stringprep(identifier, identifier_len,
 			   identifier_encoding, SILC_IDENTIFIER_PREP, 0,
 			   NULL, NULL, SILC_STRING_UTF8);
@@ -503,6 +577,16 @@ unsigned char *silc_channel_name_check(const unsigned char *identifier,
   if (max_allowed_length && identifier_len > max_allowed_length)
     return NULL;
 
+  switch (silc_identifier_ascii(identifier, identifier_len,
+				identifier_encoding, TRUE, &utf8s)) {
+  case 1:
+    if (out_len)
+      *out_len = identifier_len;
+    return utf8s;
+  case 0:
+    return NULL;
+  }
+
   status = silc_stringprep(identifier, identifier_len,
 			   identifier_encoding, SILC_IDENTIFIER_CH_PREP, 0,
 			   &utf8s, &utf8s_len, SILC_STRING_UTF8);
@@ -533,6 +617,14 @@ SilcBool silc_channel_name_verify(const unsigned char *identifier,
   if (max_allowed_length && identifier_len > max_allowed_length)
     return FALSE;
 
+  switch (silc_identifier_ascii(identifier, identifier_len,
+				identifier_encoding, TRUE, NULL)) {
+  case 1:
+    return TRUE;
+  case 0:
+    return FALSE;
+  }
+
   status = silc_stringprep(identifier, identifier_len,
 			   identifier_encoding, SILC_IDENTIFIER_CH_PREP, 0,
 			   NULL, NULL, SILC_STRING_UTF8);
@@ -544,6 +636,271 @@ SilcBool silc_channel_name_verify(const unsigned char *identifier,
   return TRUE;
 }
 
+/* Identifier normalization cache entry */
+typedef struct SilcIdentifierCacheEntryStruct {
+  struct SilcIdentifierCacheEntryStruct *next;	/* Less recently used */
+  struct SilcIdentifierCacheEntryStruct *prev;	/* More recently used */
+  unsigned char *identifier;			/* Original identifier */
+  unsigned char *normalized;			/* Normalized, NULL if invalid */
+  SilcUInt32 identifier_len;
+  SilcUInt32 normalized_len;
+  SilcStringEncoding encoding;
+  SilcBool channel;
+} *SilcIdentifierCacheEntry;
+
+/* Identifier normalization cache */
+struct SilcIdentifierCacheStruct {
+  SilcHashTable entries;			/* Cached identifiers */
+  SilcIdentifierCacheEntry head;		/* Most recently used */
+  SilcIdentifierCacheEntry tail;		/* Least recently used */
+  SilcMutex lock;
+  SilcUInt32 max_entries;
+};
+
+/* Longest identifier that is cached */
+#define SILC_IDENTIFIER_CACHE_MAX_LEN 256
+
+static SilcUInt32 silc_identifier_cache_hash(void *key, void *user_context)
+{
+  SilcIdentifierCacheEntry entry = key;
+  SilcUInt32 h = (entry->encoding << 1) | entry->channel;
+  int i;
+
+  for (i = 0; i < entry->identifier_len; i++)
+    h = (h << 5) + h + entry->identifier[i];
+
+  return h;
+}
+
+static SilcBool silc_identifier_cache_compare(void *key1, void *key2,
+					      void *user_context)
+{
+  SilcIdentifierCacheEntry e1 = key1, e2 = key2;
+  return (e1->identifier_len == e2->identifier_len &&
+	  e1->encoding == e2->encoding && e1->channel == e2->channel &&
+	  !memcmp(e1->identifier, e2->identifier, e1->identifier_len));
+}
+
+static void silc_identifier_cache_destructor(void *key, void *context,
+					     void *user_context)
+{
+  SilcIdentifierCacheEntry entry = key;
+  silc_free(entry->identifier);
+  silc_free(entry->normalized);
+  silc_free(entry);
+}
+
+/* Unlinks `entry' from the LRU list */
+
+static void silc_identifier_cache_unlink(SilcIdentifierCache cache,
+					 SilcIdentifierCacheEntry entry)
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    cache->head = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    cache->tail = entry->prev;
+  entry->next = entry->prev = NULL;
+}
+
+/* Links `entry' as most recently used */
+
+static void silc_identifier_cache_link(SilcIdentifierCache cache,
+				       SilcIdentifierCacheEntry entry)
+{
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head)
+    cache->head->prev = entry;
+  cache->head = entry;
+  if (!cache->tail)
+    cache->tail = entry;
+}
+
+/* Allocate identifier cache */
+
+SilcIdentifierCache silc_identifier_cache_alloc(SilcUInt32 max_entries)
+{
+  SilcIdentifierCache cache;
+
+  cache = silc_calloc(1, sizeof(*cache));
+  if (!cache)
+    return NULL;
+
+  cache->max_entries = max_entries ? max_entries :
+    SILC_IDENTIFIER_CACHE_DEFAULT_SIZE;
+  cache->entries = silc_hash_table_alloc(0, silc_identifier_cache_hash, NULL,
+					 silc_identifier_cache_compare, NULL,
+					 silc_identifier_cache_destructor,
+					 NULL, TRUE);
+  if (!cache->entries) {
+    silc_free(cache);
+    return NULL;
+  }
+
+  silc_mutex_alloc(&cache->lock);
+
+  return cache;
+}
+
+/* Free identifier cache */
+
+void silc_identifier_cache_free(SilcIdentifierCache cache)
+{
+  if (!cache)
+    return;
+
+  silc_hash_table_free(cache->entries);
+  silc_mutex_free(cache->lock);
+  silc_free(cache);
+}
+
+/* Checks identifier using the cache */
+
+static unsigned char *
+silc_identifier_cache_get(SilcIdentifierCache cache,
+			  const unsigned char *identifier,
+			  SilcUInt32 identifier_len,
+			  SilcStringEncoding identifier_encoding,
+			  SilcUInt32 max_allowed_length,
+			  SilcBool channel, SilcUInt32 *out_len)
+{
+  struct SilcIdentifierCacheEntryStruct find;
+  SilcIdentifierCacheEntry entry;
+  unsigned char *normalized;
+  SilcUInt32 normalized_len = 0;
+
+  if (!identifier || !identifier_len)
+    return NULL;
+
+  if (max_allowed_length && identifier_len > max_allowed_length)
+    return NULL;
+
+  /* ASCII identifiers are prepared faster than they are looked up */
+  switch (silc_identifier_ascii(identifier, identifier_len,
+				identifier_encoding, channel, &normalized)) {
+  case 1:
+    if (out_len)
+      *out_len = identifier_len;
+    return normalized;
+  case 0:
+    return NULL;
+  }
+
+  if (!cache || identifier_len > SILC_IDENTIFIER_CACHE_MAX_LEN)
+    goto nocache;
+
+  find.identifier = (unsigned char *)identifier;
+  find.identifier_len = identifier_len;
+  find.encoding = identifier_encoding;
+  find.channel = channel;
+
+  silc_mutex_lock(cache->lock);
+
+  if (silc_hash_table_find(cache->entries, &find, (void *)&entry, NULL)) {
+    /* Found, move to the front of LRU list */
+    silc_identifier_cache_unlink(cache, entry);
+    silc_identifier_cache_link(cache, entry);
+
+    normalized = NULL;
+    if (entry->normalized) {
+      normalized = silc_memdup(entry->normalized, entry->normalized_len);
+      if (normalized && out_len)
+	*out_len = entry->normalized_len;
+    }
+
+    silc_mutex_unlock(cache->lock);
+    return normalized;
+  }
+
+  silc_mutex_unlock(cache->lock);
+
+  if (channel)
+    normalized = silc_channel_name_check(identifier, identifier_len,
+					 identifier_encoding, 0,
+					 &normalized_len);
+  else
+    normalized = silc_identifier_check(identifier, identifier_len,
+				       identifier_encoding, 0,
+				       &normalized_len);
+
+  /* Add to cache.  Invalid identifiers are cached too. */
+  entry = silc_calloc(1, sizeof(*entry));
+  if (!entry)
+    goto out;
+  entry->identifier = silc_memdup(identifier, identifier_len);
+  if (normalized)
+    entry->normalized = silc_memdup(normalized, normalized_len);
+  if (!entry->identifier || (normalized && !entry->normalized)) {
+    silc_free(entry->identifier);
+    silc_free(entry);
+    goto out;
+  }
+  entry->identifier_len = identifier_len;
+  entry->normalized_len = normalized_len;
+  entry->encoding = identifier_encoding;
+  entry->channel = channel;
+
+  silc_mutex_lock(cache->lock);
+
+  if (!silc_hash_table_add(cache->entries, entry, entry)) {
+    silc_mutex_unlock(cache->lock);
+    silc_identifier_cache_destructor(entry, NULL, NULL);
+    goto out;
+  }
+  silc_identifier_cache_link(cache, entry);
+
+  /* Evict least recently used */
+  while (silc_hash_table_count(cache->entries) > cache->max_entries) {
+    entry = cache->tail;
+    silc_identifier_cache_unlink(cache, entry);
+    silc_hash_table_del(cache->entries, entry);
+  }
+
+  silc_mutex_unlock(cache->lock);
+
+ out:
+  if (normalized && out_len)
+    *out_len = normalized_len;
+  return normalized;
+
+ nocache:
+  if (channel)
+    return silc_channel_name_check(identifier, identifier_len,
+				   identifier_encoding, 0, out_len);
+  return silc_identifier_check(identifier, identifier_len,
+			       identifier_encoding, 0, out_len);
+}
+
+unsigned char *
+silc_identifier_cache_check(SilcIdentifierCache cache,
+			    const unsigned char *identifier,
+			    SilcUInt32 identifier_len,
+			    SilcStringEncoding identifier_encoding,
+			    SilcUInt32 max_allowed_length,
+			    SilcUInt32 *out_len)
+{
+  return silc_identifier_cache_get(cache, identifier, identifier_len,
+				   identifier_encoding, max_allowed_length,
+				   FALSE, out_len);
+}
+
+unsigned char *
+silc_identifier_cache_channel_check(SilcIdentifierCache cache,
+				    const unsigned char *identifier,
+				    SilcUInt32 identifier_len,
+				    SilcStringEncoding identifier_encoding,
+				    SilcUInt32 max_allowed_length,
+				    SilcUInt32 *out_len)
+{
+  return silc_identifier_cache_get(cache, identifier, identifier_len,
+				   identifier_encoding, max_allowed_length,
+				   TRUE, out_len);
+}
+
 /* Return mode list */
 
 SilcBool silc_get_mode_list(SilcBuffer mode_list, SilcUInt32 mode_list_count,
@@ -312,6 +312,126 @@ SilcBool silc_channel_name_verify(const unsigned char *identifier,
 				  SilcStringEncoding identifier_encoding,
 				  SilcUInt32 max_allowed_length);
 
+/****s* silcapputil/SilcAppUtil/SilcIdentifierCache
+ *
+ * NAME
+ *
+ *    typedef struct SilcIdentifierCacheStruct *SilcIdentifierCache;
+ *
+ * DESCRIPTION
+ *
+ *    Identifier normalization cache.  Caches the results of
+ *    silc_identifier_check and silc_channel_name_check for recently
+ *    used identifiers so that the same nicknames and channel names need
+ *    not be prepared again.  Allocated with silc_identifier_cache_alloc.
+ *    The cache is thread safe.
+ *
+ ***/
+typedef struct SilcIdentifierCacheStruct *SilcIdentifierCache;
+
+/****d* silcapputil/SilcAppUtil/SILC_IDENTIFIER_CACHE_DEFAULT_SIZE
+ *
+ * NAME
+ *
+ *    #define SILC_IDENTIFIER_CACHE_DEFAULT_SIZE 8192
+ *
+ * DESCRIPTION
+ *
+ *    Default maximum number of entries in SilcIdentifierCache.  Only
+ *    identifiers with non-ASCII characters are cached, so this is enough
+ *    for the nicknames of several large channels.
+ *
+ ***/
+#define SILC_IDENTIFIER_CACHE_DEFAULT_SIZE 8192
+
+/****f* silcapputil/SilcAppUtil/silc_identifier_cache_alloc
+ *
+ * SYNOPSIS
+ *
+ *    SilcIdentifierCache silc_identifier_cache_alloc(SilcUInt32 max_entries);
+ *
+ * DESCRIPTION
+ *
+ *    Allocates identifier normalization cache that holds at most
+ *    `max_entries' identifiers.  The least recently used identifier is
+ *    removed when the cache is full.  If `max_entries' is zero the
+ *    SILC_IDENTIFIER_CACHE_DEFAULT_SIZE is used.  Returns NULL on error.
+ *
+ ***/
+SilcIdentifierCache silc_identifier_cache_alloc(SilcUInt32 max_entries);
+
+/****f* silcapputil/SilcAppUtil/silc_identifier_cache_free
+ *
+ * SYNOPSIS
+ *
+ *    void silc_identifier_cache_free(SilcIdentifierCache cache);
+ *
+ * DESCRIPTION
+ *
+ *    Frees the identifier cache.
+ *
+ ***/
+void silc_identifier_cache_free(SilcIdentifierCache cache);
+
+/****f* silcapputil/SilcAppUtil/silc_identifier_cache_check
+ *
+ * SYNOPSIS
+ *
+ *    unsigned char *
+ *    silc_identifier_cache_check(SilcIdentifierCache cache,
+ *                                const unsigned char *identifier,
+ *                                SilcUInt32 identifier_len,
+ *                                SilcStringEncoding identifier_encoding,
+ *                                SilcUInt32 max_allowed_length,
+ *                                SilcUInt32 *out_len);
+ *
+ * DESCRIPTION
+ *
+ *    Same as silc_identifier_check but the result is taken from the
+ *    `cache' if the identifier has been checked before.  Invalid
+ *    identifiers are cached as well.  Pure ASCII identifiers are never
+ *    cached as they are prepared faster than looked up.  If `cache' is
+ *    NULL this is equivalent to silc_identifier_check.
+ *
+ *    Returns the allocated identifier which the caller must free, or
+ *    NULL if the identifier is not valid.
+ *
+ ***/
+unsigned char *
+silc_identifier_cache_check(SilcIdentifierCache cache,
+			    const unsigned char *identifier,
+			    SilcUInt32 identifier_len,
+			    SilcStringEncoding identifier_encoding,
+			    SilcUInt32 max_allowed_length,
+			    SilcUInt32 *out_len);
+
+/****f* silcapputil/SilcAppUtil/silc_identifier_cache_channel_check
+ *
+ * SYNOPSIS
+ *
+ *    unsigned char *
+ *    silc_identifier_cache_channel_check(SilcIdentifierCache cache,
+ *                                        const unsigned char *identifier,
+ *                                        SilcUInt32 identifier_len,
+ *                                        SilcStringEncoding
+ *                                          identifier_encoding,
+ *                                        SilcUInt32 max_allowed_length,
+ *                                        SilcUInt32 *out_len);
+ *
+ * DESCRIPTION
+ *
+ *    Same as silc_identifier_cache_check but checks channel names like
+ *    silc_channel_name_check.
+ *
+ ***/
+unsigned char *
+silc_identifier_cache_channel_check(SilcIdentifierCache cache,
+				    const unsigned char *identifier,
+				    SilcUInt32 identifier_len,
+				    SilcStringEncoding identifier_encoding,
+				    SilcUInt32 max_allowed_length,
+				    SilcUInt32 *out_len);
+
 /****f* silcapputil/SilcAppUtil/silc_get_mode_list
  *
  * SYNOPSIS
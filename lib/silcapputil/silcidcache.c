@@ -28,9 +28,13 @@ struct SilcIDCacheStruct {
   SilcHashTable id_table;	     /* ID hash table */
   SilcHashTable name_table;	     /* Name hash table */
   SilcHashTable context_table;	     /* Context hash table */
+  SilcIDCacheEntry *name_index;	     /* Entries sorted by name */
+  SilcUInt32 name_index_count;	     /* Number of entries in name index */
+  SilcUInt32 name_index_size;	     /* Allocated size of name index */
   SilcIDCacheDestructor destructor;  /* Entry destructor */
   void *context;		     /* Destructor context */
   SilcIdType id_type;		     /* Type of ID cache */
+  unsigned int indexed : 1;	     /* Name index is in use */
 };
 
 
@@ -48,6 +52,126 @@ static void silc_idcache_get_all_foreach(void *key, void *context,
   silc_list_add(*list, context);
 }
 
+/* Returns the position of the first entry in the name index whose name
+   is not less than `name'.  If `len' is non-zero only first `len'
+   characters of the names are compared. */
+
+static SilcUInt32 silc_idcache_index_lower(SilcIDCache cache,
+					   const char *name, SilcUInt32 len)
+{
+  SilcUInt32 low = 0, high = cache->name_index_count, mid;
+  int ret;
+
+  while (low < high) {
+    mid = low + ((high - low) >> 1);
+    if (len)
+      ret = strncmp(cache->name_index[mid]->name, name, len);
+    else
+      ret = strcmp(cache->name_index[mid]->name, name);
+    if (ret < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low;
+}
+
+/* Adds entry to name index */
+
+static SilcBool silc_idcache_index_add(SilcIDCache cache,
+				       SilcIDCacheEntry entry)
+{
+  SilcIDCacheEntry *index;
+  SilcUInt32 i;
+
+  if (!cache->indexed || !entry->name)
+    return TRUE;
+
+  if (cache->name_index_count == cache->name_index_size) {
+    index = silc_realloc(cache->name_index, sizeof(*index) *
+			 (cache->name_index_size + 32 +
+			  (cache->name_index_size >> 1)));
+    if (!index)
+      return FALSE;
+    cache->name_index = index;
+    cache->name_index_size += 32 + (cache->name_index_size >> 1);
+  }
+
+  i = silc_idcache_index_lower(cache, entry->name, 0);
+  memmove(cache->name_index + i + 1, cache->name_index + i,
+	  (cache->name_index_count - i) * sizeof(*cache->name_index));
+  cache->name_index[i] = entry;
+  cache->name_index_count++;
+
+  return TRUE;
+}
+
+/* Deletes entry from name index */
+
+static void silc_idcache_index_del(SilcIDCache cache, SilcIDCacheEntry entry)
+{
+  SilcUInt32 i;
+
+  if (!cache->indexed || !entry->name)
+    return;
+
+  /* Find the entry among the entries with the same name */
+  for (i = silc_idcache_index_lower(cache, entry->name, 0);
+       i < cache->name_index_count; i++) {
+    if (cache->name_index[i] == entry)
+      break;
+    if (strcmp(cache->name_index[i]->name, entry->name))
+      return;
+  }
+  if (i == cache->name_index_count)
+    return;
+
+  cache->name_index_count--;
+  memmove(cache->name_index + i, cache->name_index + i + 1,
+	  (cache->name_index_count - i) * sizeof(*cache->name_index));
+}
+
+/* Builds the name index from the name hash table */
+
+static void silc_idcache_index_build_foreach(void *key, void *context,
+					     void *user_context)
+{
+  SilcIDCache cache = user_context;
+  if (context)
+    cache->name_index[cache->name_index_count++] = context;
+}
+
+static int silc_idcache_index_compare(const void *a, const void *b)
+{
+  return strcmp((*(SilcIDCacheEntry *)a)->name,
+		(*(SilcIDCacheEntry *)b)->name);
+}
+
+static SilcBool silc_idcache_index_build(SilcIDCache cache)
+{
+  SilcUInt32 count = silc_hash_table_count(cache->name_table);
+
+  SILC_LOG_DEBUG(("Building name index for %d entries", count));
+
+  cache->name_index_size = count + 32;
+  cache->name_index = silc_calloc(cache->name_index_size,
+				  sizeof(*cache->name_index));
+  if (!cache->name_index) {
+    cache->name_index_size = 0;
+    return FALSE;
+  }
+
+  cache->name_index_count = 0;
+  silc_hash_table_foreach(cache->name_table,
+			  silc_idcache_index_build_foreach, cache);
+  qsort(cache->name_index, cache->name_index_count,
+	sizeof(*cache->name_index), silc_idcache_index_compare);
+  cache->indexed = TRUE;
+
+  return TRUE;
+}
+
 /* Cache entry destructor */
 
 static void silc_idcache_destructor(SilcIDCache cache,
@@ -113,6 +237,7 @@ void silc_idcache_free(SilcIDCache cache)
   silc_hash_table_free(cache->id_table);
   silc_hash_table_free(cache->name_table);
   silc_hash_table_free(cache->context_table);
+  silc_free(cache->name_index);
   silc_free(cache);
 }
 
@@ -158,10 +283,13 @@ silc_idcache_add(SilcIDCache cache, char *name, void *id, void *context)
   if (context)
     if (!silc_hash_table_add(cache->context_table, context, c))
       goto err;
+  if (!silc_idcache_index_add(cache, c))
+    goto err;
 
   return c;
 
  err:
+  silc_idcache_index_del(cache, c);
   if (c->name)
     silc_hash_table_del_by_context(cache->name_table, c->name, c);
   if (c->context)
@@ -185,6 +313,7 @@ SilcBool silc_idcache_del(SilcIDCache cache, SilcIDCacheEntry entry,
 
   SILC_LOG_DEBUG(("Deleting cache entry %p", entry));
 
+  silc_idcache_index_del(cache, entry);
   if (entry->name)
     ret = silc_hash_table_del_by_context(cache->name_table, entry->name,
 					 entry);
@@ -266,6 +395,7 @@ SilcBool silc_idcache_update(SilcIDCache cache, SilcIDCacheEntry entry,
       if (!silc_hash_table_del_by_context(cache->name_table, entry->name,
 					  entry))
 	return FALSE;
+    silc_idcache_index_del(cache, entry);
 
     if (free_old_name)
       silc_free(entry->name);
@@ -273,6 +403,8 @@ SilcBool silc_idcache_update(SilcIDCache cache, SilcIDCacheEntry entry,
 
     if (!silc_hash_table_add(cache->name_table, entry->name, entry))
       return FALSE;
+    if (!silc_idcache_index_add(cache, entry))
+      return FALSE;
   }
 
   return TRUE;
@@ -341,6 +473,7 @@ SilcBool silc_idcache_move(SilcIDCache from_cache, SilcIDCache to_cache,
   }
 
   /* Remove from original cache */
+  silc_idcache_index_del(from_cache, c);
   if (c->name)
     silc_hash_table_del_by_context(from_cache->name_table, c->name, c);
   if (c->context)
@@ -355,6 +488,7 @@ SilcBool silc_idcache_move(SilcIDCache from_cache, SilcIDCache to_cache,
     silc_hash_table_add(to_cache->name_table, c->name, c);
   if (c->context)
     silc_hash_table_add(to_cache->context_table, c->context, c);
+  silc_idcache_index_add(to_cache, c);
 
   return TRUE;
 }
@@ -454,3 +588,37 @@ SilcBool silc_idcache_find_by_name_one(SilcIDCache cache, char *name,
     return FALSE;
   return silc_hash_table_find(cache->name_table, name, NULL, (void *)ret);
 }
+
+/* Find ID Cache entries whose name begins with `prefix'.  The name index
+   is built on first call and maintained after that. */
+
+SilcBool silc_idcache_find_by_prefix(SilcIDCache cache, const char *prefix,
+				     SilcList *ret_list)
+{
+  SilcUInt32 i, len;
+
+  if (!cache || !prefix || !ret_list)
+    return FALSE;
+
+  if (!silc_hash_table_count(cache->name_table))
+    return FALSE;
+
+  if (!cache->indexed && !silc_idcache_index_build(cache))
+    return FALSE;
+
+  silc_list_init(*ret_list, struct SilcIDCacheEntryStruct, next);
+
+  len = strlen(prefix);
+  if (!len)
+    return FALSE;
+
+  for (i = silc_idcache_index_lower(cache, prefix, len);
+       i < cache->name_index_count &&
+	 !strncmp(cache->name_index[i]->name, prefix, len); i++)
+    silc_list_add(*ret_list, cache->name_index[i]);
+
+  if (!silc_list_count(*ret_list))
+    return FALSE;
+
+  return TRUE;
+}
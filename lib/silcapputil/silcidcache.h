@@ -369,4 +369,27 @@ SilcBool silc_idcache_find_by_name(SilcIDCache cache, char *name,
 SilcBool silc_idcache_find_by_name_one(SilcIDCache cache, char *name,
 				       SilcIDCacheEntry *ret);
 
+/****f* silcapputil/SilcIDCacheAPI/silc_idcache_find_by_prefix
+ *
+ * SYNOPSIS
+ *
+ *    SilcBool silc_idcache_find_by_prefix(SilcIDCache cache,
+ *                                         const char *prefix,
+ *                                         SilcList *ret_list);
+ *
+ * DESCRIPTION
+ *
+ *    Find cache entries whose name begins with `prefix'.  The `prefix'
+ *    is compared as is, so it must be normalized the same way as the
+ *    names in the cache.  The entries are returned to the `ret_list'
+ *    sorted by name.  Returns TRUE if any entry was found.
+ *
+ *    A sorted name index is built on the first call, and it is kept up to
+ *    date by the other silc_idcache_* functions after that.  The search
+ *    is O(log n + k) where k is the number of entries found.
+ *
+ ***/
+SilcBool silc_idcache_find_by_prefix(SilcIDCache cache, const char *prefix,
+				     SilcList *ret_list);
+
 #endif /* SILCIDCACHE_H */
@@ -0,0 +1,141 @@
+/* Identifier normalization tests and benchmark on a 5000 user channel */
+
+#include "silc.h"
+
+/* Number of users on the channel and passes over them */
+#define USERS 5000
+#define PASSES 50
+
+static char *nicks[USERS];
+static unsigned char *normalized[USERS];
+
+/* Creates the channel's nicknames.  Every `utf8'th nickname has non-ASCII
+   characters, the rest are ASCII with mixed case and common prefixes. */
+
+static void make_nicks(int utf8)
+{
+  static const char *prefix[] = { "", "Foo", "bar_", "[away]", "Nick", "x" };
+  static const char *latin[] = { "J\xc3\xa4rvi", "\xc3\x86r\xc3\xb8",
+				 "M\xc3\xbcller", "Se\xc3\xb1or" };
+  char tmp[64];
+  int i;
+
+  for (i = 0; i < USERS; i++) {
+    if (utf8 && i % utf8 == 0)
+      silc_snprintf(tmp, sizeof(tmp), "%s%d", latin[i % 4], i);
+    else
+      silc_snprintf(tmp, sizeof(tmp), "%sUser%d", prefix[i % 6], i);
+    silc_free(nicks[i]);
+    nicks[i] = strdup(tmp);
+  }
+}
+
+/* Normalizes the nicknames without cache for the cached results to be
+   compared with */
+
+static SilcBool normalize_nicks(void)
+{
+  int i;
+
+  for (i = 0; i < USERS; i++) {
+    silc_free(normalized[i]);
+    normalized[i] = silc_identifier_check(nicks[i], strlen(nicks[i]),
+					  SILC_STRING_UTF8, 128, NULL);
+    if (!normalized[i])
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Normalizes every nickname on the channel PASSES times, like nickname
+   completion and highlighting do, and prints the rate.  Uses `cache' if
+   it is non-NULL.  Every result must be the same as without cache. */
+
+static SilcBool bench(const char *name, SilcIdentifierCache cache)
+{
+  unsigned char *nick;
+  SilcInt64 usec;
+  int i, k;
+
+  usec = silc_time_usec();
+  for (k = 0; k < PASSES; k++) {
+    for (i = 0; i < USERS; i++) {
+      if (cache)
+	nick = silc_identifier_cache_check(cache, nicks[i], strlen(nicks[i]),
+					   SILC_STRING_UTF8, 128, NULL);
+      else
+	nick = silc_identifier_check(nicks[i], strlen(nicks[i]),
+				     SILC_STRING_UTF8, 128, NULL);
+      if (!nick || strcmp((char *)nick, (char *)normalized[i])) {
+	fprintf(stderr, "%s: `%s' normalized to `%s', not `%s'\n", name,
+		nicks[i], nick ? (char *)nick : "(error)", normalized[i]);
+	silc_free(nick);
+	return FALSE;
+      }
+      silc_free(nick);
+    }
+  }
+  usec = silc_time_usec() - usec;
+
+  fprintf(stdout, "%-40s %9.0f nicks/sec\n", name,
+	  PASSES * USERS * 1000000.0 / (usec ? usec : 1));
+  return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  SilcIdentifierCache cache;
+  static const int utf8[] = { 0, 10, 1 };
+  char name[64];
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*apputil*");
+  }
+
+  for (i = 0; i < 3; i++) {
+    make_nicks(utf8[i]);
+    if (!normalize_nicks())
+      goto err;
+    fprintf(stdout, "%d users, %s:\n", USERS,
+	    !utf8[i] ? "all ASCII" : utf8[i] == 1 ? "all non-ASCII" :
+	    "every 10th non-ASCII");
+
+    if (!bench("  silc_identifier_check", NULL))
+      goto err;
+
+    cache = silc_identifier_cache_alloc(0);
+    if (!cache)
+      goto err;
+    silc_snprintf(name, sizeof(name), "  cache of %d (default)",
+		  SILC_IDENTIFIER_CACHE_DEFAULT_SIZE);
+    if (!bench(name, cache))
+      goto err;
+    silc_identifier_cache_free(cache);
+
+    /* Smaller than the channel, so every pass evicts all entries */
+    cache = silc_identifier_cache_alloc(USERS / 10);
+    if (!cache)
+      goto err;
+    silc_snprintf(name, sizeof(name), "  cache of %d", USERS / 10);
+    if (!bench(name, cache))
+      goto err;
+    silc_identifier_cache_free(cache);
+  }
+
+  success = TRUE;
+
+ err:
+  for (i = 0; i < USERS; i++) {
+    silc_free(nicks[i]);
+    silc_free(normalized[i]);
+  }
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
@@ -0,0 +1,278 @@
+/* ID Cache name prefix index tests.  Entries are added, deleted, renamed
+   and moved between two caches in random order, and after each change
+   the prefix search of both caches is compared to the entries the test
+   knows to be in them.  The cache is compiled in here to check the
+   index itself too. */
+
+#include "../silcidcache.c"
+
+/* Number of entries, and changes before and after the index is built */
+#define ENTRIES 300
+#define ROUNDS 4000
+
+/* Test entry.  `cache' is the cache it is in, NULL if it is not added. */
+typedef struct {
+  SilcIDCache cache;
+  SilcIDCacheEntry entry;
+  int num;
+} TestEntry;
+
+static TestEntry entries[ENTRIES];
+static SilcIDCache caches[2];
+
+static const char *prefixes[] = {
+  "a", "ab", "abc", "abcd", "b", "ba", "bab", "c", "Ab", "x", "[",
+  "ab_", "abc1", "b1",
+};
+
+static void destructor(SilcIDCache cache, const SilcIDCacheEntry entry,
+		       void *destructor_context, void *app_context)
+{
+  silc_free(entry->name);
+  silc_free(entry->id);
+}
+
+/* Returns new random name.  The names share prefixes and some of them
+   are same, so that the index has runs of equal names. */
+
+static char *random_name(void)
+{
+  static const char *stems[] = { "a", "ab", "abc", "b", "ba", "Ab", "[x]" };
+  char tmp[32];
+
+  silc_snprintf(tmp, sizeof(tmp), "%s%s%d", stems[rand() % 7],
+		rand() % 2 ? "_" : "", rand() % 20);
+  return strdup(tmp);
+}
+
+/* Sets Client ID of entry `num'.  Client IDs are compared by their
+   hash only. */
+
+static void set_id(SilcClientID *id, int num)
+{
+  memset(id, 0, sizeof(*id));
+  id->ip.data_len = 4;
+  SILC_PUT32_MSB(num, id->ip.data);
+  SILC_PUT32_MSB(num, id->hash);
+}
+
+static SilcClientID *make_id(int num)
+{
+  SilcClientID *id = silc_calloc(1, sizeof(*id));
+
+  if (id)
+    set_id(id, num);
+  return id;
+}
+
+/* Checks that the name index of `cache' is sorted and has all named
+   entries of the cache */
+
+static SilcBool check_index(SilcIDCache cache)
+{
+  SilcUInt32 i;
+
+  if (!cache->indexed)
+    return TRUE;
+
+  if (cache->name_index_count != silc_hash_table_count(cache->name_table)) {
+    fprintf(stderr, "Name index has %d entries, cache has %d names\n",
+	    cache->name_index_count, silc_hash_table_count(cache->name_table));
+    return FALSE;
+  }
+
+  for (i = 1; i < cache->name_index_count; i++)
+    if (strcmp(cache->name_index[i - 1]->name,
+	       cache->name_index[i]->name) > 0) {
+      fprintf(stderr, "Name index is not sorted at %d: %s > %s\n", i,
+	      cache->name_index[i - 1]->name, cache->name_index[i]->name);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Checks prefix search of `cache' against the test entries */
+
+static SilcBool check_prefix(SilcIDCache cache, const char *prefix)
+{
+  SilcIDCacheEntry entry;
+  SilcList list;
+  char found[ENTRIES];
+  int i, count = 0, expected = 0;
+
+  memset(found, 0, sizeof(found));
+  for (i = 0; i < ENTRIES; i++)
+    if (entries[i].cache == cache &&
+	!strncmp(entries[i].entry->name, prefix, strlen(prefix)))
+      expected++;
+
+  if (silc_idcache_find_by_prefix(cache, prefix, &list)) {
+    silc_list_start(list);
+    while ((entry = silc_list_get(list))) {
+      TestEntry *e = entry->context;
+
+      if (e->cache != cache || e->entry != entry ||
+	  strncmp(entry->name, prefix, strlen(prefix)) || found[e->num]) {
+	fprintf(stderr, "Prefix %s found wrong entry %s\n", prefix,
+		entry->name);
+	return FALSE;
+      }
+      found[e->num] = 1;
+      count++;
+    }
+  }
+
+  if (count != expected) {
+    fprintf(stderr, "Prefix %s found %d entries, expected %d\n", prefix,
+	    count, expected);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static SilcBool check(void)
+{
+  int i, k;
+
+  for (k = 0; k < 2; k++) {
+    if (!check_index(caches[k]))
+      return FALSE;
+    for (i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++)
+      if (!check_prefix(caches[k], prefixes[i]))
+	return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Makes random change to random entry */
+
+static SilcBool change(void)
+{
+  TestEntry *e = &entries[rand() % ENTRIES];
+  SilcIDCache other;
+  SilcClientID id;
+
+  if (!e->cache) {
+    e->cache = caches[rand() % 2];
+    e->entry = silc_idcache_add(e->cache, random_name(), make_id(e->num), e);
+    if (!e->entry) {
+      fprintf(stderr, "Could not add entry %d\n", e->num);
+      return FALSE;
+    }
+    return TRUE;
+  }
+
+  switch (rand() % 5) {
+  case 0:
+    if (!silc_idcache_del(e->cache, e->entry, NULL))
+      return FALSE;
+    e->cache = NULL;
+    break;
+
+  case 1:
+    set_id(&id, e->num);
+    if (!silc_idcache_del_by_id(e->cache, &id, NULL))
+      return FALSE;
+    e->cache = NULL;
+    break;
+
+  case 2:
+    if (!silc_idcache_del_by_context(e->cache, e, NULL))
+      return FALSE;
+    e->cache = NULL;
+    break;
+
+  case 3:
+    /* Nickname change */
+    if (rand() % 2) {
+      if (!silc_idcache_update(e->cache, e->entry, NULL, random_name(),
+			       TRUE))
+	return FALSE;
+    } else {
+      if (!silc_idcache_update_by_context(e->cache, e, NULL, random_name(),
+					  TRUE))
+	return FALSE;
+    }
+    break;
+
+  case 4:
+    other = e->cache == caches[0] ? caches[1] : caches[0];
+    if (!silc_idcache_move(e->cache, other, e->entry))
+      return FALSE;
+    e->cache = other;
+    break;
+  }
+
+  return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*idcache*");
+  }
+
+  srand(1);
+  for (i = 0; i < ENTRIES; i++)
+    entries[i].num = i;
+
+  for (i = 0; i < 2; i++) {
+    caches[i] = silc_idcache_alloc(0, SILC_ID_CLIENT, destructor, NULL);
+    if (!caches[i])
+      goto err;
+  }
+
+  /* Changes before the index is built */
+  SILC_LOG_DEBUG(("Changes without index"));
+  for (i = 0; i < ROUNDS; i++)
+    if (!change())
+      goto err;
+
+  /* The first search builds the index */
+  SILC_LOG_DEBUG(("Changes with index"));
+  if (!check())
+    goto err;
+  if (!caches[0]->indexed || !caches[1]->indexed) {
+    fprintf(stderr, "Name index was not built\n");
+    goto err;
+  }
+  for (i = 0; i < ROUNDS; i++)
+    if (!change() || !check())
+      goto err;
+
+  /* Index of cache emptied by deletes and filled again */
+  SILC_LOG_DEBUG(("Emptying the caches"));
+  for (i = 0; i < ENTRIES; i++) {
+    if (entries[i].cache && !silc_idcache_del(entries[i].cache,
+					      entries[i].entry, NULL))
+      goto err;
+    entries[i].cache = NULL;
+  }
+  if (!check())
+    goto err;
+  for (i = 0; i < ROUNDS; i++)
+    if (!change() || !check())
+      goto err;
+
+  success = TRUE;
+
+ err:
+  for (i = 0; i < ENTRIES; i++)
+    if (entries[i].cache)
+      silc_idcache_del(entries[i].cache, entries[i].entry, NULL);
+  for (i = 0; i < 2; i++)
+    if (caches[i])
+      silc_idcache_free(caches[i]);
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
@@ -168,7 +168,7 @@ static SilcBool silc_asn1_decoder_sof(SilcAsn1 asn1, SilcBuffer src)
    set then the argument is a pointer to the type pointer.  The `type'
    must be a non-pointer type, eg. int, SilcBufferStruct. */
 #define SILC_ASN1_VAD(asn1, opts, type, name)			\
-  type **name;							\
+  type **name, *name ## tmp;					\
   if ((opts) & SILC_ASN1_OPTIONAL && !choice) {			\
     name = va_arg(asn1->ap, type **);				\
     if (!found) {						\
@@ -182,7 +182,7 @@ static SilcBool silc_asn1_decoder_sof(SilcAsn1 asn1, SilcBuffer src)
     if (*name == NULL)						\
       break;							\
   } else {							\
-    type *name ## tmp = va_arg(asn1->ap, type *);		\
+    name ## tmp = va_arg(asn1->ap, type *);			\
     if (choice && found && !len)				\
       break;							\
     if (name ## tmp == NULL)					\
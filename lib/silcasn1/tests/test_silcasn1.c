@@ -0,0 +1,139 @@
+/* SILC ASN.1 decoding tests and benchmark */
+
+#include "silc.h"
+
+/* Decodes the record encoded by encode_record and checks that the
+   fields are what were encoded */
+
+static SilcBool decode_record(SilcAsn1 asn1, SilcBuffer node,
+			      SilcMPInt *expected)
+{
+  SilcMPInt serial;
+  SilcBool critical, ret;
+  unsigned char *id, *name;
+  SilcUInt32 id_len, name_len;
+
+  memset(&serial, 0, sizeof(serial));
+  if (!silc_asn1_decode(asn1, node,
+			SILC_ASN1_SEQUENCE,
+			  SILC_ASN1_INT(&serial),
+			  SILC_ASN1_OCTET_STRING(&id, &id_len),
+			  SILC_ASN1_UTF8_STRING(&name, &name_len),
+			  SILC_ASN1_BOOLEAN(&critical),
+			SILC_ASN1_END, SILC_ASN1_END)) {
+    fprintf(stderr, "Could not decode record\n");
+    return FALSE;
+  }
+
+  ret = (!silc_mp_cmp(&serial, expected) &&
+	 id_len == 32 && id[0] == 0xa5 && id[31] == 0xa5 &&
+	 name_len == 16 && !memcmp(name, "test@silcnet.org", 16) &&
+	 critical == TRUE);
+  if (!ret)
+    fprintf(stderr, "Decoded record differs from the encoded\n");
+
+  silc_mp_uninit(&serial);
+  return ret;
+}
+
+/* Decodes `node' `rounds' times, allocating new ASN.1 context for every
+   decoding if `per_call' is TRUE, and prints the rate */
+
+static SilcBool bench(const char *name, SilcBuffer node, SilcMPInt *serial,
+		      int rounds, SilcBool per_call)
+{
+  SilcAsn1 asn1 = NULL;
+  SilcInt64 usec;
+  int i;
+
+  usec = silc_time_usec();
+  for (i = 0; i < rounds; i++) {
+    if (per_call || !asn1)
+      asn1 = silc_asn1_alloc();
+    if (!asn1 || !decode_record(asn1, node, serial))
+      return FALSE;
+    if (per_call) {
+      silc_asn1_free(asn1);
+      asn1 = NULL;
+    }
+  }
+  usec = silc_time_usec() - usec;
+  if (asn1)
+    silc_asn1_free(asn1);
+
+  fprintf(stdout, "%s, %s: %.0f decodes/sec\n", name,
+	  per_call ? "context per call" : "shared context",
+	  rounds * 1000000.0 / (usec ? usec : 1));
+  return TRUE;
+}
+
+/* Encodes the test record with `serial' into `node' */
+
+static SilcBool encode_record(SilcBuffer node, SilcMPInt *serial)
+{
+  SilcAsn1 asn1;
+  unsigned char id[32];
+  SilcBool ret;
+
+  asn1 = silc_asn1_alloc();
+  if (!asn1)
+    return FALSE;
+
+  memset(id, 0xa5, sizeof(id));
+  memset(node, 0, sizeof(*node));
+  ret = silc_asn1_encode(asn1, node,
+			 SILC_ASN1_OPTS(SILC_ASN1_ALLOC),
+			 SILC_ASN1_SEQUENCE,
+			   SILC_ASN1_INT(serial),
+			   SILC_ASN1_OCTET_STRING(id, sizeof(id)),
+			   SILC_ASN1_UTF8_STRING("test@silcnet.org", 16),
+			   SILC_ASN1_BOOLEAN(TRUE),
+			 SILC_ASN1_END, SILC_ASN1_END);
+  silc_asn1_free(asn1);
+
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  SilcBufferStruct node;
+  SilcMPInt serial;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*asn1*,*ber*");
+  }
+
+  silc_mp_init(&serial);
+  silc_mp_set_ui(&serial, 0x7f4a7c15);
+  if (!encode_record(&node, &serial))
+    goto err;
+
+  /* Most callers allocate ASN.1 context for every decoding */
+  if (!bench("record", &node, &serial, 200000, TRUE))
+    goto err;
+  if (!bench("record", &node, &serial, 200000, FALSE))
+    goto err;
+  silc_free(node.head);
+
+  /* Same with 2048 bit integer, where the bignum conversion dominates */
+  silc_mp_mul_2exp(&serial, &serial, 2016);
+  if (!encode_record(&node, &serial))
+    goto err;
+  if (!bench("2048 bit integer", &node, &serial, 20000, TRUE))
+    goto err;
+  if (!bench("2048 bit integer", &node, &serial, 20000, FALSE))
+    goto err;
+  silc_free(node.head);
+
+  success = TRUE;
+
+ err:
+  silc_mp_uninit(&serial);
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
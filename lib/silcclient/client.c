@@ -296,6 +296,10 @@ SILC_FSM_STATE(silc_client_connection_st_packet)
 
   SILC_LOG_DEBUG(("Parsing %s packet", silc_get_packet_name(packet->type)));
 
+  /* Deliver batched JOIN notifies before processing anything else */
+  if (packet->type != SILC_PACKET_NOTIFY)
+    silc_client_notify_flush(conn->client, conn);
+
   switch (packet->type) {
 
   case SILC_PACKET_PRIVATE_MESSAGE:
@@ -402,7 +406,8 @@ SILC_FSM_STATE(silc_client_connection_st_close)
     SILC_LOG_DEBUG(("Finish pending commands"));
     silc_list_start(conn->internal->pending_commands);
     while ((cmd = silc_list_get(conn->internal->pending_commands))) {
-      if (silc_fsm_is_started(&cmd->thread)) {
+      /* Command processing reply in steps finishes by itself */
+      if (silc_fsm_is_started(&cmd->thread) && !cmd->processing) {
         cmd->verbose = FALSE;
         silc_fsm_continue_sync(&cmd->thread);
       }
@@ -709,6 +714,12 @@ void silc_client_del_connection(SilcClient client, SilcClientConnection conn)
 
   silc_schedule_task_del_by_context(conn->internal->schedule, conn);
 
+  /* Free undelivered batched notifies */
+  silc_client_list_free(client, conn, conn->internal->join_batch);
+  silc_client_unref_channel(client, conn, conn->internal->join_batch_channel);
+  if (conn->internal->resolving)
+    silc_hash_table_free(conn->internal->resolving);
+
   /* Free all cache entries */
   if (conn->internal->server_cache) {
     if (silc_idcache_get_all(conn->internal->server_cache, &list)) {
@@ -964,6 +975,8 @@ SilcClient silc_client_alloc(SilcClientOperations *ops,
 
 void silc_client_free(SilcClient client)
 {
+  silc_message_verifier_free(client->internal->verifier);
+
   if (client->schedule)
     silc_schedule_uninit(client->schedule);
 
@@ -983,6 +996,7 @@ void silc_client_free(SilcClient client)
     silc_dlist_uninit(client->internal->ftp_sessions);
   if (client->internal->lock)
     silc_mutex_free(client->internal->lock);
+  silc_identifier_cache_free(client->internal->idcache);
   silc_atomic_uninit32(&client->internal->conns);
   silc_free(client->username);
   silc_free(client->hostname);
@@ -1044,6 +1058,11 @@ SilcBool silc_client_init(SilcClient client, const char *username,
   if (!client->internal->ftp_sessions)
     return FALSE;
 
+  /* Allocate identifier normalization cache */
+  client->internal->idcache = silc_identifier_cache_alloc(0);
+  if (!client->internal->idcache)
+    return FALSE;
+
   if (!client->internal->params->dont_register_crypto_library) {
     /* Initialize the crypto library.  If application has done this already
        this has no effect.  Also, we will not be overriding something
@@ -1069,6 +1088,12 @@ SilcBool silc_client_init(SilcClient client, const char *username,
   /* Allocate client lock */
   silc_mutex_alloc(&client->internal->lock);
 
+  /* Allocate message signature verifier */
+  client->internal->verifier = silc_message_verifier_alloc(client->schedule,
+							   0);
+  if (!client->internal->verifier)
+    return FALSE;
+
   /* Register commands */
   silc_client_commands_register(client);
 
@@ -1093,6 +1118,21 @@ SilcBool silc_client_init(SilcClient client, const char *username,
   return TRUE;
 }
 
+/* Verifies message signature asynchronously */
+
+SilcAsyncOperation
+silc_client_verify_message_signature(SilcClient client,
+				     SilcMessagePayload payload,
+				     SilcPublicKey public_key,
+				     SilcHash hash,
+				     SilcMessageVerifyCb callback,
+				     void *context)
+{
+  return silc_message_signed_verify_async(client->internal->verifier,
+					  payload, public_key, hash,
+					  callback, context);
+}
+
 /* Starts the SILC client FSM machine and blocks here.  When this returns
    the client has ended. */
 
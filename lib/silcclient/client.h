@@ -55,6 +55,8 @@ typedef struct SilcClientEntryInternalStruct {
   SilcClientKeyAgreement ke;	/* Current key agreement context or NULL */
   SilcAsyncOperation op;	/* Asynchronous operation with this client */
 
+  SilcChannelPrivateKey channel_key; /* Channel private key of the last
+				       channel message from this client */
   SilcClientAutonegMessageKey ake; /* Current auto-negotiation context */
   SilcInt64 ake_rekey;		/* Next private message key auto-negotation */
   SilcUInt32 ake_generation;	/* current AKE rekey generation */
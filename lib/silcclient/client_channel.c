@@ -153,6 +153,49 @@ static void silc_client_channel_message_resolved(SilcClient client,
   SILC_FSM_CALL_CONTINUE(context);
 }
 
+/* Checks the MAC of the channel message with `hmac' without decrypting
+   the message.  Old style MAC is accepted too if `old_mac' is TRUE. */
+
+static SilcBool
+silc_client_channel_message_mac(SilcPacket packet, SilcCipher cipher,
+				SilcHmac hmac, SilcBool old_mac)
+{
+  /* Message is not encrypted if there is no key */
+  if (!cipher)
+    return TRUE;
+  if (silc_unlikely(!hmac))
+    return FALSE;
+
+  return silc_message_payload_check_mac(silc_buffer_data(&packet->buffer),
+					silc_buffer_len(&packet->buffer),
+					hmac, packet->src_id,
+					packet->src_id_len, packet->dst_id,
+					packet->dst_id_len, old_mac);
+}
+
+/* Decrypts and parses the channel message.  Decryption is done in place,
+   so if it fails the message is restored from `encrypted', if given, for
+   trying another key. */
+
+static SilcMessagePayload
+silc_client_channel_message_parse(SilcPacket packet, SilcCipher cipher,
+				  SilcHmac hmac, unsigned char *encrypted)
+{
+  SilcBuffer buffer = &packet->buffer;
+  SilcMessagePayload payload;
+
+  payload = silc_message_payload_parse_ext(silc_buffer_data(buffer),
+					   silc_buffer_len(buffer), FALSE,
+					   FALSE, cipher, hmac,
+					   packet->src_id, packet->src_id_len,
+					   packet->dst_id, packet->dst_id_len,
+					   NULL, FALSE, NULL, FALSE);
+  if (!payload && encrypted)
+    memcpy(silc_buffer_data(buffer), encrypted, silc_buffer_len(buffer));
+
+  return payload;
+}
+
 /* Process received channel message */
 
 SILC_FSM_STATE(silc_client_channel_message)
@@ -166,9 +209,12 @@ SILC_FSM_STATE(silc_client_channel_message)
   SilcClientEntry client_entry;
   SilcClientID remote_id;
   SilcChannelID channel_id;
-  unsigned char *message;
+  unsigned char *message, *encrypted = NULL;
   SilcUInt32 message_len;
-  SilcChannelPrivateKey key = NULL;
+  SilcChannelPrivateKey key = NULL, hint;
+  SilcCipher cipher;
+  SilcHmac hmac;
+  SilcBool old_mac = conn->internal->params.old_message_mac;
 
   SILC_LOG_DEBUG(("Received channel message"));
 
@@ -227,25 +273,19 @@ SILC_FSM_STATE(silc_client_channel_message)
   }
 
   /* If there is no channel private key then just decrypt the message
-     with the channel key. If private keys are set then just go through
-     all private keys and check what decrypts correctly. */
+     with the channel key. If private keys are set then find the key whose
+     MAC matches.  Only the MAC is computed for each key, the message is
+     decrypted once with the correct key.  Old style MAC is always accepted
+     with the channel key, with private keys only if requested, since it
+     must be computed for each key that does not match. */
+  cipher = channel->internal.receive_key;
+  hmac = channel->internal.hmac;
   if (!channel->internal.private_keys) {
-    /* Parse the channel message payload. This also decrypts the payload */
-    payload = silc_message_payload_parse(silc_buffer_data(buffer),
-					 silc_buffer_len(buffer), FALSE,
-					 FALSE, channel->internal.receive_key,
-					 channel->internal.hmac,
-					 packet->src_id, packet->src_id_len,
-					 packet->dst_id, packet->dst_id_len,
-					 NULL, FALSE, NULL);
-
-    /* If decryption failed and we have just performed channel key rekey
+    /* If MAC check failed and we have just performed channel key rekey
        we will use the old key in decryption. If that fails too then we
        cannot do more and will drop the packet. */
-    if (silc_unlikely(!payload)) {
-      SilcCipher cipher;
-      SilcHmac hmac;
-
+    if (silc_unlikely(!silc_client_channel_message_mac(packet, cipher,
+							hmac, TRUE))) {
       if (!channel->internal.old_channel_keys ||
 	  !silc_dlist_count(channel->internal.old_channel_keys))
 	goto out;
@@ -256,56 +296,64 @@ SILC_FSM_STATE(silc_client_channel_message)
       silc_dlist_end(channel->internal.old_hmacs);
       while ((cipher = silc_dlist_get(channel->internal.old_channel_keys))) {
 	hmac = silc_dlist_get(channel->internal.old_hmacs);
-	if (!hmac)
+	if (!hmac) {
+	  cipher = NULL;
 	  break;
-
-	payload = silc_message_payload_parse(silc_buffer_data(buffer),
-					     silc_buffer_len(buffer),
-					     FALSE, FALSE, cipher, hmac,
-					     packet->src_id,
-					     packet->src_id_len,
-					     packet->dst_id,
-					     packet->dst_id_len,
-					     NULL, FALSE, NULL);
-	if (payload)
+	}
+	if (silc_client_channel_message_mac(packet, cipher, hmac, TRUE))
 	  break;
       }
-      if (!payload)
+      if (!cipher)
 	goto out;
     }
-  } else {
-    /* If the private key mode is not set on the channel then try the actual
-       channel key first before trying private keys. */
-    if (!(channel->mode & SILC_CHANNEL_MODE_PRIVKEY))
-      payload = silc_message_payload_parse(silc_buffer_data(buffer),
-					   silc_buffer_len(buffer),
-					   FALSE, FALSE,
-					   channel->internal.receive_key,
-					   channel->internal.hmac,
-					   packet->src_id,
-					   packet->src_id_len,
-					   packet->dst_id,
-					   packet->dst_id_len,
-					   NULL, FALSE, NULL);
+  } else if ((channel->mode & SILC_CHANNEL_MODE_PRIVKEY) ||
+	     !silc_client_channel_message_mac(packet, cipher, hmac, TRUE)) {
+    /* If the private key mode is not set on the channel then the actual
+       channel key was tried first.  Next try the key that last matched a
+       message from this sender, and then rest of the keys.  If the message
+       cannot be decrypted with the key whose MAC matches, the search goes
+       on from the encrypted message kept here. */
+    encrypted = silc_memdup(silc_buffer_data(buffer),
+			    silc_buffer_len(buffer));
+    if (silc_unlikely(!encrypted))
+      goto out;
+
+    hint = client_entry->internal.channel_key;
+    if (hint) {
+      silc_dlist_start(channel->internal.private_keys);
+      while ((key = silc_dlist_get(channel->internal.private_keys)))
+	if (key == hint)
+	  break;
+      if (key && silc_client_channel_message_mac(packet, key->receive_key,
+						 key->hmac, old_mac))
+	payload = silc_client_channel_message_parse(packet, key->receive_key,
+						    key->hmac, encrypted);
+    }
 
     if (!payload) {
       silc_dlist_start(channel->internal.private_keys);
       while ((key = silc_dlist_get(channel->internal.private_keys))) {
-	/* Parse the message payload. This also decrypts the payload */
-	payload = silc_message_payload_parse(silc_buffer_data(buffer),
-					     silc_buffer_len(buffer),
-					     FALSE, FALSE, key->receive_key,
-					     key->hmac, packet->src_id,
-					     packet->src_id_len,
-					     packet->dst_id,
-					     packet->dst_id_len,
-					     NULL, FALSE, NULL);
+	if (key == hint ||
+	    !silc_client_channel_message_mac(packet, key->receive_key,
+					     key->hmac, old_mac))
+	  continue;
+	payload = silc_client_channel_message_parse(packet, key->receive_key,
+						    key->hmac, encrypted);
 	if (payload)
 	  break;
       }
-      if (key == SILC_LIST_END)
+      if (!payload)
 	goto out;
     }
+
+    client_entry->internal.channel_key = key;
+  }
+
+  /* Parse the channel message payload. This also decrypts the payload */
+  if (!payload) {
+    payload = silc_client_channel_message_parse(packet, cipher, hmac, NULL);
+    if (silc_unlikely(!payload))
+      goto out;
   }
 
   message = silc_message_get_data(payload, &message_len);
@@ -321,6 +369,7 @@ SILC_FSM_STATE(silc_client_channel_message)
   silc_client_unref_channel(client, conn, channel);
   if (payload)
     silc_message_payload_free(payload);
+  silc_free(encrypted);
   return SILC_FSM_FINISH;
 }
 
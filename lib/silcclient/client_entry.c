@@ -96,8 +96,9 @@ SilcDList silc_client_get_clients_local_ext(SilcClient client,
   SILC_LOG_DEBUG(("Find clients by nickname %s", parsed));
 
   /* Normalize nickname for search */
-  nicknamec = silc_identifier_check(parsed, strlen(parsed),
-				    SILC_STRING_UTF8, 128, NULL);
+  nicknamec = silc_identifier_cache_check(client->internal->idcache,
+					  parsed, strlen(parsed),
+					  SILC_STRING_UTF8, 128, NULL);
   if (!nicknamec) {
     silc_free(parsed);
     return NULL;
@@ -190,6 +191,65 @@ SilcDList silc_client_get_clients_local(SilcClient client,
 					   TRUE);
 }
 
+/* Finds clients by nickname prefix from local cache. */
+
+SilcDList silc_client_get_clients_local_by_prefix(SilcClient client,
+						  SilcClientConnection conn,
+						  const char *prefix)
+{
+  SilcIDCacheEntry id_cache;
+  SilcList list;
+  SilcDList clients;
+  SilcClientEntry entry;
+  char *prefixc;
+
+  if (!client || !conn || !prefix)
+    return NULL;
+
+  SILC_LOG_DEBUG(("Find clients by nickname prefix %s", prefix));
+
+  /* Normalize prefix for search */
+  prefixc = silc_identifier_cache_check(client->internal->idcache,
+					prefix, strlen(prefix),
+					SILC_STRING_UTF8, 128, NULL);
+  if (!prefixc)
+    return NULL;
+
+  clients = silc_dlist_init();
+  if (!clients) {
+    silc_free(prefixc);
+    return NULL;
+  }
+
+  silc_mutex_lock(conn->internal->lock);
+
+  if (silc_idcache_find_by_prefix(conn->internal->client_cache, prefixc,
+				  &list)) {
+    silc_list_start(list);
+    while ((id_cache = silc_list_get(list))) {
+      entry = id_cache->context;
+      if (!entry || !entry->internal.valid)
+	continue;
+      silc_client_ref_client(client, conn, entry);
+      silc_dlist_add(clients, entry);
+    }
+  }
+
+  silc_mutex_unlock(conn->internal->lock);
+
+  silc_free(prefixc);
+
+  if (!silc_dlist_count(clients)) {
+    silc_dlist_uninit(clients);
+    return NULL;
+  }
+
+  SILC_LOG_DEBUG(("Found %d clients", silc_dlist_count(clients)));
+
+  silc_dlist_start(clients);
+  return clients;
+}
+
 /********************** Client Resolving from Server ************************/
 
 /* Resolving context */
@@ -198,6 +258,8 @@ typedef struct {
   SilcGetClientCallback completion;
   void *context;
   SilcClientEntry client_entry;
+  SilcClientID client_id;		/* Resolved ID when `by_id' is set */
+  unsigned int by_id : 1;
 } *SilcClientGetClientInternal;
 
 /* Resolving command callback */
@@ -212,36 +274,54 @@ static SilcBool silc_client_get_clients_cb(SilcClient client,
 {
   SilcClientGetClientInternal i = context;
   SilcClientEntry client_entry;
+  SilcBool last = (status == SILC_STATUS_OK ||
+		   status == SILC_STATUS_LIST_END ||
+		   SILC_STATUS_IS_ERROR(status));
 
   if (error != SILC_STATUS_OK) {
-    SILC_LOG_DEBUG(("Resolving failed: %s", silc_get_status_message(error)));
+    /* When resolving by ID the query may have resolved other clients too.
+       Their errors are not ours, wait for the last reply. */
+    if (i->by_id && !last)
+      return TRUE;
 
-    if (i->client_entry) {
-      i->client_entry->internal.resolve_cmd_ident = 0;
-      silc_client_unref_client(client, conn, i->client_entry);
-    }
+    if (!i->by_id || !silc_dlist_count(i->clients)) {
+      SILC_LOG_DEBUG(("Resolving failed: %s",
+		      silc_get_status_message(error)));
 
-    if (i->completion)
-      i->completion(client, conn, error, NULL, i->context);
-    goto out;
-  }
+      if (i->client_entry) {
+	i->client_entry->internal.resolve_cmd_ident = 0;
+	silc_client_unref_client(client, conn, i->client_entry);
+      }
 
-  /* Add the returned client to list */
-  if (i->completion) {
+      if (i->completion)
+	i->completion(client, conn, error, NULL, i->context);
+      goto out;
+    }
+  } else if (i->completion) {
+    /* Add the returned client to list */
     client_entry = va_arg(ap, SilcClientEntry);
-    silc_client_ref_client(client, conn, client_entry);
-    silc_dlist_add(i->clients, client_entry);
+    if (!i->by_id || SILC_ID_CLIENT_COMPARE(&client_entry->id,
+					    &i->client_id)) {
+      silc_client_ref_client(client, conn, client_entry);
+      silc_dlist_add(i->clients, client_entry);
+    }
     client_entry->internal.resolve_cmd_ident = 0;
   }
 
-  if (status == SILC_STATUS_OK || status == SILC_STATUS_LIST_END) {
+  if (last) {
+    if (i->client_entry) {
+      i->client_entry->internal.resolve_cmd_ident = 0;
+      silc_client_unref_client(client, conn, i->client_entry);
+    }
+
     /* Deliver the clients to the caller */
     if (i->completion) {
       SILC_LOG_DEBUG(("Resolved %d clients", silc_dlist_count(i->clients)));
 
-      if (i->client_entry) {
-	i->client_entry->internal.resolve_cmd_ident = 0;
-	silc_client_unref_client(client, conn, i->client_entry);
+      if (i->by_id && !silc_dlist_count(i->clients)) {
+	i->completion(client, conn, SILC_STATUS_ERR_NO_SUCH_CLIENT_ID,
+		      NULL, i->context);
+	goto out;
       }
 
       silc_dlist_start(i->clients);
@@ -258,6 +338,139 @@ static SilcBool silc_client_get_clients_cb(SilcClient client,
   return FALSE;
 }
 
+/* Client resolving batch.  Client IDs resolved with
+   silc_client_get_client_by_id_resolve during one scheduler round, like
+   senders of the messages received in one read, are queried with one
+   WHOIS.  The IDs being resolved are kept in conn->internal->resolving
+   so that concurrent requests for the same ID share the query. */
+
+#define SILC_CLIENT_RESOLVE_BATCH 64
+
+struct SilcClientResolveBatchStruct {
+  SilcUInt16 cmd_ident;			/* Reserved WHOIS identifier */
+  SilcUInt32 count;			/* Number of IDs */
+  SilcClientCommandContext cmd;		/* WHOIS, valid until sent */
+  SilcClientID ids[SILC_CLIENT_RESOLVE_BATCH];
+};
+
+/* The batch is done after the last reply to the WHOIS */
+
+static SilcBool silc_client_resolve_batch_cb(SilcClient client,
+					     SilcClientConnection conn,
+					     SilcCommand command,
+					     SilcStatus status,
+					     SilcStatus error,
+					     void *context,
+					     va_list ap)
+{
+  SilcClientResolveBatch batch = context;
+  int i;
+
+  if (status != SILC_STATUS_OK && status != SILC_STATUS_LIST_END &&
+      !SILC_STATUS_IS_ERROR(status))
+    return TRUE;
+
+  SILC_LOG_DEBUG(("Resolved batch of %d clients", batch->count));
+
+  for (i = 0; i < batch->count; i++)
+    silc_hash_table_del_by_context(conn->internal->resolving,
+				   &batch->ids[i], batch);
+
+  /* Not sent yet if the command was canceled */
+  if (conn->internal->resolve_batch == batch)
+    conn->internal->resolve_batch = NULL;
+
+  silc_free(batch);
+  return FALSE;
+}
+
+/* Sends the WHOIS of the current batch */
+
+SILC_TASK_CALLBACK(silc_client_resolve_batch_send)
+{
+  SilcClientConnection conn = context;
+  SilcClientResolveBatch batch = conn->internal->resolve_batch;
+  SilcClientCommandContext cmd;
+  SilcBuffer idp[SILC_CLIENT_RESOLVE_BATCH];
+  unsigned char *argv[SILC_CLIENT_RESOLVE_BATCH];
+  SilcUInt32 argv_lens[SILC_CLIENT_RESOLVE_BATCH];
+  SilcUInt32 argv_types[SILC_CLIENT_RESOLVE_BATCH];
+  int i, argc = 0;
+
+  if (!batch)
+    return;
+
+  conn->internal->resolve_batch = NULL;
+  silc_schedule_task_del_by_all(conn->internal->schedule, 0,
+				silc_client_resolve_batch_send, conn);
+
+  SILC_LOG_DEBUG(("Resolve %d clients", batch->count));
+
+  for (i = 0; i < batch->count; i++) {
+    idp[argc] = silc_id_payload_encode(&batch->ids[i], SILC_ID_CLIENT);
+    if (!idp[argc])
+      continue;
+    argv[argc] = silc_buffer_data(idp[argc]);
+    argv_lens[argc] = silc_buffer_len(idp[argc]);
+    argv_types[argc] = argc + 4;
+    argc++;
+  }
+
+  /* If sending fails the batch completes with error */
+  cmd = batch->cmd;
+  batch->cmd = NULL;
+  silc_client_command_send_arg_array(conn->client, conn, cmd,
+				     SILC_COMMAND_WHOIS, NULL, NULL, argc,
+				     argv, argv_lens, argv_types);
+
+  for (i = 0; i < argc; i++)
+    silc_buffer_free(idp[i]);
+}
+
+/* Adds `client_id' to the resolving batch.  Returns the command identifier
+   of the batch WHOIS, or 0 on error.  The caller sends full batch after it
+   has attached to it. */
+
+static SilcUInt16 silc_client_resolve_batch_add(SilcClient client,
+						SilcClientConnection conn,
+						SilcClientID *client_id)
+{
+  SilcClientResolveBatch batch = conn->internal->resolve_batch;
+
+  if (!conn->internal->resolving) {
+    conn->internal->resolving =
+      silc_hash_table_alloc(0, silc_hash_id, SILC_32_TO_PTR(SILC_ID_CLIENT),
+			    silc_hash_id_compare,
+			    SILC_32_TO_PTR(SILC_ID_CLIENT), NULL, NULL, TRUE);
+    if (!conn->internal->resolving)
+      return 0;
+  }
+
+  if (!batch) {
+    batch = silc_calloc(1, sizeof(*batch));
+    if (!batch)
+      return 0;
+    batch->cmd = silc_client_command_reserve(client, conn, SILC_COMMAND_WHOIS,
+					     silc_client_resolve_batch_cb,
+					     batch);
+    if (!batch->cmd) {
+      silc_free(batch);
+      return 0;
+    }
+    batch->cmd_ident = batch->cmd->cmd_ident;
+    conn->internal->resolve_batch = batch;
+    silc_schedule_task_add_timeout(conn->internal->schedule,
+				   silc_client_resolve_batch_send, conn, 0, 0);
+  }
+
+  batch->ids[batch->count] = *client_id;
+  silc_hash_table_add(conn->internal->resolving, &batch->ids[batch->count],
+		      batch);
+  batch->count++;
+
+  return batch->cmd_ident;
+}
+
 /* Resolves client information from server by the client ID. */
 
 SilcUInt16
@@ -270,8 +483,9 @@ silc_client_get_client_by_id_resolve(SilcClient client,
 {
   SilcClientGetClientInternal i;
   SilcClientEntry client_entry;
+  SilcClientResolveBatch batch;
   SilcBuffer idp;
-  SilcUInt16 cmd_ident;
+  SilcUInt16 cmd_ident = 0;
 
   if (!client || !conn | !client_id) {
     SILC_LOG_ERROR(("Missing arguments to "
@@ -287,6 +501,8 @@ silc_client_get_client_by_id_resolve(SilcClient client,
     return 0;
   i->completion = completion;
   i->context = context;
+  i->client_id = *client_id;
+  i->by_id = TRUE;
   i->clients = silc_dlist_init();
   if (!i->clients) {
     silc_free(i);
@@ -303,15 +519,35 @@ silc_client_get_client_by_id_resolve(SilcClient client,
 				silc_client_get_clients_cb, i);
     return client_entry->internal.resolve_cmd_ident;
   }
+  if (conn->internal->resolving &&
+      silc_hash_table_find(conn->internal->resolving, client_id, NULL,
+			   (void *)&batch)) {
+    SILC_LOG_DEBUG(("Attach to existing resolving"));
+    silc_client_unref_client(client, conn, client_entry);
+    silc_client_command_pending(conn, SILC_COMMAND_NONE, batch->cmd_ident,
+				silc_client_get_clients_cb, i);
+    return batch->cmd_ident;
+  }
 
-  /* Send the command */
-  idp = silc_id_payload_encode(client_id, SILC_ID_CLIENT);
-  cmd_ident = silc_client_command_send(client, conn, SILC_COMMAND_WHOIS,
-				       silc_client_get_clients_cb, i,
-				       2, 3, silc_buffer_datalen(attributes),
-				       4, silc_buffer_datalen(idp));
-  if (!cmd_ident && completion)
-    completion(client, conn, SILC_STATUS_ERR_RESOURCE_LIMIT, NULL, context);
+  /* Resolve with other clients, unless attributes are requested */
+  if (!attributes) {
+    cmd_ident = silc_client_resolve_batch_add(client, conn, client_id);
+    if (cmd_ident)
+      silc_client_command_pending(conn, SILC_COMMAND_NONE, cmd_ident,
+				  silc_client_get_clients_cb, i);
+  }
+
+  if (!cmd_ident) {
+    /* Send the command */
+    idp = silc_id_payload_encode(client_id, SILC_ID_CLIENT);
+    cmd_ident = silc_client_command_send(client, conn, SILC_COMMAND_WHOIS,
+					 silc_client_get_clients_cb, i,
+					 2, 3, silc_buffer_datalen(attributes),
+					 4, silc_buffer_datalen(idp));
+    if (!cmd_ident && completion)
+      completion(client, conn, SILC_STATUS_ERR_RESOURCE_LIMIT, NULL, context);
+    silc_buffer_free(idp);
+  }
 
   if (client_entry && cmd_ident) {
     client_entry->internal.resolve_cmd_ident = cmd_ident;
@@ -320,7 +556,12 @@ silc_client_get_client_by_id_resolve(SilcClient client,
     silc_client_unref_client(client, conn, client_entry);
   }
 
-  silc_buffer_free(idp);
+  /* Send full batch right away.  If sending fails the callbacks are called
+     already here. */
+  batch = conn->internal->resolve_batch;
+  if (batch && batch->count == SILC_CLIENT_RESOLVE_BATCH)
+    silc_client_resolve_batch_send(conn->internal->schedule, client, 0, 0,
+				   conn);
 
   return cmd_ident;
 }
@@ -828,8 +1069,9 @@ SilcClientEntry silc_client_add_client(SilcClient client,
 
   /* Normalize nickname */
   if (client_entry->nickname[0]) {
-    nick = silc_identifier_check(parsed, strlen(parsed),
-				 SILC_STRING_UTF8, 128, NULL);
+    nick = silc_identifier_cache_check(client->internal->idcache,
+				       parsed, strlen(parsed),
+				       SILC_STRING_UTF8, 128, NULL);
     if (!nick) {
       silc_hash_table_free(client_entry->channels);
       silc_free(client_entry->realname);
@@ -910,8 +1152,9 @@ void silc_client_update_client(SilcClient client,
 		    "%s", parsed);
 
     /* Normalize nickname */
-    nick = silc_identifier_check(parsed, strlen(parsed),
-				 SILC_STRING_UTF8, 128, NULL);
+    nick = silc_identifier_cache_check(client->internal->idcache,
+				       parsed, strlen(parsed),
+				       SILC_STRING_UTF8, 128, NULL);
     if (!nick) {
       silc_rwlock_unlock(client_entry->internal.lock);
       return;
@@ -950,8 +1193,9 @@ SilcBool silc_client_change_nickname(SilcClient client,
 		  new_nick));
 
   /* Normalize nickname */
-  tmp = silc_identifier_check(new_nick, strlen(new_nick),
-			      SILC_STRING_UTF8, 128, NULL);
+  tmp = silc_identifier_cache_check(client->internal->idcache,
+				    new_nick, strlen(new_nick),
+				    SILC_STRING_UTF8, 128, NULL);
   if (!tmp)
     return FALSE;
 
@@ -1418,8 +1662,9 @@ SilcChannelEntry silc_client_get_channel(SilcClient client,
   silc_parse_userfqdn(channel, chname, sizeof(chname), server, sizeof(server));
 
   /* Normalize name for search */
-  channel = silc_channel_name_check(chname, strlen(chname), SILC_STRING_UTF8,
-				    256, NULL);
+  channel = silc_identifier_cache_channel_check(client->internal->idcache,
+						chname, strlen(chname),
+						SILC_STRING_UTF8, 256, NULL);
   if (!channel)
     return NULL;
 
@@ -1693,8 +1938,10 @@ SilcChannelEntry silc_client_add_channel(SilcClient client,
   }
 
   /* Normalize channel name */
-  channel_namec = silc_channel_name_check(name, strlen(name),
-					  SILC_STRING_UTF8, 256, NULL);
+  channel_namec =
+    silc_identifier_cache_channel_check(client->internal->idcache,
+					name, strlen(name),
+					SILC_STRING_UTF8, 256, NULL);
   if (!channel_namec) {
     silc_rwlock_free(channel->internal.lock);
     silc_atomic_uninit32(&channel->internal.refcnt);
@@ -24,6 +24,68 @@
 
 /************************** Types and definitions ***************************/
 
+/* Length of one read request.  This is the most the SILC memory filesystem
+   returns in one reply. */
+#define SILC_CLIENT_FTP_READ_LEN 63488
+
+/* Default maximum number of outstanding read requests */
+#define SILC_CLIENT_FTP_READ_WINDOW 16
+
+/* Maximum number of parallel connections in one session */
+#define SILC_CLIENT_FTP_MAX_STREAMS 8
+
+/* Length of one record in the `.silcpart' resume file.  The first record
+   identifies the remote file with magic, modification time and size. */
+#define SILC_CLIENT_FTP_PART_REC_LEN 16
+#define SILC_CLIENT_FTP_PART_MAGIC 0x53505254
+
+/* Number of records buffered before the file data is synced and the
+   records are written to the resume file */
+#define SILC_CLIENT_FTP_PART_FLUSH 64
+
+/* Transfer connection.  The session has always the primary connection,
+   and when receiving a file in parallel, the additional connections. */
+typedef struct SilcClientFtpStreamStruct {
+  struct SilcClientFtpStreamStruct *next;
+  SilcClientFtpSession session;	      /* Session */
+  SilcClientConnection conn;	      /* Connection to remote host */
+  SilcAsyncOperation op;	      /* Operation for connecting */
+  SilcStream stream;		      /* Wrapped SilcPacketStream */
+  SilcSFTP sftp;		      /* SFTP server/client */
+  SilcSFTPHandle read_handle;	      /* SFTP file handle */
+  SilcUInt32 read_pending;	      /* Outstanding read requests */
+  unsigned int connecting : 1;	      /* Inside connect call */
+  unsigned int failed     : 1;	      /* Connecting failed */
+} *SilcClientFtpStream;
+
+/* Outstanding read request */
+typedef struct SilcClientFtpReadStruct {
+  struct SilcClientFtpReadStruct *next;
+  SilcClientFtpSession session;	      /* Session */
+  SilcClientFtpStream stream;	      /* Connection the request was sent */
+  SilcUInt64 offset;		      /* Requested offset */
+  SilcUInt32 len;		      /* Requested length */
+  SilcInt64 sent;		      /* Time when sent, microseconds */
+  unsigned int in_use : 1;	      /* Request is outstanding */
+} *SilcClientFtpRead;
+
+/* Number of times corrupted chunks are received again before giving up */
+#define SILC_CLIENT_FTP_TREE_RETRIES 16
+
+/* Tree hash state of one chunk, SILC_CLIENT_FTP_READ_LEN bytes */
+typedef struct {
+  unsigned char leaf[SILC_SFTP_TREE_HASH_LEN]; /* Computed leaf hash */
+  SilcUInt32 received;		      /* Bytes received in pieces */
+  unsigned int hashed   : 1;	      /* Leaf hash computed */
+  unsigned int verified : 1;	      /* Leaf hash verified */
+} *SilcClientFtpChunk, SilcClientFtpChunkStruct;
+
+/* Received range of the file, [start, end) */
+typedef struct {
+  SilcUInt64 start;
+  SilcUInt64 end;
+} *SilcClientFtpRange, SilcClientFtpRangeStruct;
+
 /* File transmission session */
 struct SilcClientFtpSessionStruct {
   SilcClient client;		      /* Client */
@@ -34,6 +96,7 @@ struct SilcClientFtpSessionStruct {
   SilcAsyncOperation op;	      /* Operation for connecting */
   SilcClientConnectionParams params;  /* Connection params */
   SilcPublicKey public_key;	      /* Public key used in key exchange */
+  SilcPublicKey remote_key;	      /* Remote public key, when sending */
   SilcPrivateKey private_key;	      /* Private key used in key exchange */
   SilcUInt32 session_id;	      /* File transfer ID */
 
@@ -48,15 +111,45 @@ struct SilcClientFtpSessionStruct {
   SilcSFTP sftp;		      /* SFTP server/client */
   SilcSFTPFilesystem fs;	      /* SFTP memory file system */
   SilcSFTPHandle dir_handle;	      /* SFTP session directory handle */
-  SilcSFTPHandle read_handle;	      /* SFTP session file handles */
+  struct SilcClientFtpStreamStruct main; /* Primary transfer connection */
+  SilcList streams;		      /* Transfer connections */
+  char *remote_file;		      /* Remote file being read */
 
   char *hostname;		      /* Remote host */
   SilcUInt16 port;		      /* Remote port */
   SilcUInt64 filesize;		      /* File size */
-  SilcUInt64 read_offset;	      /* Current read offset */
+  SilcUInt32 filemtime;		      /* Remote file modification time */
+  SilcUInt64 read_offset;	      /* Next offset to request */
+  SilcUInt64 received;		      /* Bytes received */
+  SilcUInt64 reported;		      /* Bytes reported to application */
+  SilcClientFtpRead reads;	      /* Read request contexts */
+  SilcList read_free;		      /* Free read request contexts */
+  SilcInt64 read_rtt;		      /* Lowest measured read RTT */
+  SilcUInt32 read_window;	      /* Current read window */
+  SilcUInt32 read_window_max;	      /* Maximum read window */
+  SilcUInt32 read_pending;	      /* Outstanding read requests */
+  SilcUInt32 reads_count;	      /* Number of read request contexts */
+  SilcClientFtpRange ranges;	      /* Received ranges, when resuming */
+  SilcUInt32 ranges_count;
+  SilcUInt32 ranges_size;
+  char *part_path;		      /* Resume file path */
+  int part_fd;			      /* Resume file descriptor */
+  unsigned char *part_recs;	      /* Records not yet written */
+  SilcUInt32 part_recs_count;
+  SilcHash tree_hash;		      /* SHA-256 for tree hash */
+  SilcClientFtpChunk chunks;	      /* Tree hash state of chunks */
+  SilcUInt32 chunks_count;
+  unsigned char *tree_leaves;	      /* Leaf hashes from sender */
+  unsigned char tree_root[SILC_SFTP_TREE_HASH_LEN]; /* Root from sender */
+  SilcUInt32 tree_fetched;	      /* Number of leaf hashes received */
+  SilcUInt32 tree_retries;	      /* Chunks received again */
   int fd;			      /* File descriptor */
   unsigned int initiator : 1;	      /* File sender sets this to TRUE */
   unsigned int closed    : 1;	      /* silc_client_file_close called */
+  unsigned int read_eof  : 1;	      /* EOF received */
+  unsigned int read_error: 1;	      /* Read error received */
+  unsigned int read_done : 1;	      /* Reading finished */
+  unsigned int tree_pending : 1;      /* Tree hash request outstanding */
 };
 
 /************************* SFTP Server Callbacks ****************************/
@@ -86,74 +179,760 @@ static void silc_client_ftp_monitor(SilcSFTP sftp,
 
 /************************* SFTP Client Callbacks ****************************/
 
-/* Returns the read data. This is the downloader's function (client side)
-   to receive the read data and read more until EOF is received from
-   the other side. This will also monitor the transmission and notify
-   the application. */
+/* Adds received range [start, end) to the sorted list of received ranges,
+   merging it with the adjacent ranges. */
+
+static SilcBool silc_client_ftp_range_add(SilcClientFtpSession session,
+					  SilcUInt64 start, SilcUInt64 end)
+{
+  SilcClientFtpRange r;
+  SilcUInt32 i, j, low, high;
+
+  if (start >= end)
+    return TRUE;
+
+  /* Find first range that ends at or after `start' */
+  low = 0;
+  high = session->ranges_count;
+  while (low < high) {
+    i = (low + high) / 2;
+    if (session->ranges[i].end < start)
+      low = i + 1;
+    else
+      high = i;
+  }
+
+  /* Merge all ranges overlapping or touching the new range */
+  for (i = j = low; j < session->ranges_count &&
+	 session->ranges[j].start <= end; j++) {
+    if (session->ranges[j].start < start)
+      start = session->ranges[j].start;
+    if (session->ranges[j].end > end)
+      end = session->ranges[j].end;
+  }
+
+  if (i == j) {
+    /* Insert new range */
+    if (session->ranges_count == session->ranges_size) {
+      r = silc_realloc(session->ranges, sizeof(*r) *
+		       (session->ranges_size + 16));
+      if (!r)
+	return FALSE;
+      session->ranges = r;
+      session->ranges_size += 16;
+    }
+    memmove(&session->ranges[i + 1], &session->ranges[i],
+	    sizeof(*r) * (session->ranges_count - i));
+    session->ranges_count++;
+  } else if (j > i + 1) {
+    /* Remove the merged ranges */
+    memmove(&session->ranges[i + 1], &session->ranges[j],
+	    sizeof(*r) * (session->ranges_count - j));
+    session->ranges_count -= j - i - 1;
+  }
+
+  session->ranges[i].start = start;
+  session->ranges[i].end = end;
+  return TRUE;
+}
+
+/* Moves `offset' past already received data and limits `len' so that the
+   request does not overlap data received earlier. */
+
+static void silc_client_ftp_range_next(SilcClientFtpSession session,
+				       SilcUInt64 *offset, SilcUInt32 *len)
+{
+  SilcUInt32 i, low = 0, high = session->ranges_count;
+
+  /* Find first range that ends after `offset' */
+  while (low < high) {
+    i = (low + high) / 2;
+    if (session->ranges[i].end <= *offset)
+      low = i + 1;
+    else
+      high = i;
+  }
+  if (low == session->ranges_count)
+    return;
+
+  if (session->ranges[low].start <= *offset) {
+    *offset = session->ranges[low].end;
+    if (++low == session->ranges_count)
+      return;
+  }
+
+  if (session->ranges[low].start - *offset < *len)
+    *len = session->ranges[low].start - *offset;
+}
+
+/* Loads the received ranges from the resume file.  Ranges past the end
+   of the partially received file, `local_size' bytes, are ignored.
+   Returns -1 if the resume file does not exist, 0 if it belongs to
+   another version of the remote file and 1 if ranges were loaded. */
+
+static int silc_client_ftp_part_load(SilcClientFtpSession session,
+				     SilcUInt64 local_size)
+{
+  unsigned char *data;
+  SilcUInt32 data_len, i, magic, mtime;
+  SilcUInt64 offset, len;
+
+  data = (unsigned char *)silc_file_readfile(session->part_path, &data_len);
+  if (!data)
+    return -1;
+
+  /* Check that the remote file is the same */
+  if (data_len < SILC_CLIENT_FTP_PART_REC_LEN) {
+    silc_free(data);
+    return 0;
+  }
+  SILC_GET32_MSB(magic, data);
+  SILC_GET32_MSB(mtime, data + 4);
+  SILC_GET64_MSB(len, data + 8);
+  if (magic != SILC_CLIENT_FTP_PART_MAGIC || mtime != session->filemtime ||
+      len != session->filesize) {
+    SILC_LOG_DEBUG(("Resume file is for another version of the file"));
+    silc_free(data);
+    return 0;
+  }
+
+  if (local_size > session->filesize)
+    local_size = session->filesize;
+
+  /* A record cut short by a crash is ignored */
+  for (i = SILC_CLIENT_FTP_PART_REC_LEN;
+       i + SILC_CLIENT_FTP_PART_REC_LEN <= data_len;
+       i += SILC_CLIENT_FTP_PART_REC_LEN) {
+    SILC_GET64_MSB(offset, data + i);
+    SILC_GET64_MSB(len, data + i + 8);
+    if (offset + len < offset || offset >= local_size)
+      continue;
+    if (offset + len > local_size)
+      len = local_size - offset;
+    silc_client_ftp_range_add(session, offset, offset + len);
+  }
+  silc_free(data);
+
+  for (i = 0; i < session->ranges_count; i++)
+    session->received += (session->ranges[i].end -
+			  session->ranges[i].start);
+
+  SILC_LOG_DEBUG(("Resuming, %d ranges, %llu bytes received",
+		  session->ranges_count, session->received));
+
+  return 1;
+}
+
+/* Writes the buffered records to the resume file.  The received data is
+   synced to disk first, so that the resume file never claims data that
+   a crash could lose. */
+
+static void silc_client_ftp_part_flush(SilcClientFtpSession session)
+{
+  if (!session->part_recs_count)
+    return;
+
+  if (fsync(session->fd) == 0)
+    silc_file_write(session->part_fd, (const char *)session->part_recs,
+		    session->part_recs_count * SILC_CLIENT_FTP_PART_REC_LEN);
+  session->part_recs_count = 0;
+}
+
+/* Records received range to the resume file */
+
+static void silc_client_ftp_part_add(SilcClientFtpSession session,
+				     SilcUInt64 offset, SilcUInt32 len)
+{
+  unsigned char *rec;
+
+  silc_client_ftp_range_add(session, offset, offset + len);
+
+  if (!session->part_recs) {
+    session->part_recs = silc_malloc(SILC_CLIENT_FTP_PART_FLUSH *
+				     SILC_CLIENT_FTP_PART_REC_LEN);
+    if (!session->part_recs)
+      return;
+  }
+
+  rec = session->part_recs + (session->part_recs_count *
+			       SILC_CLIENT_FTP_PART_REC_LEN);
+  SILC_PUT64_MSB(offset, rec);
+  SILC_PUT64_MSB((SilcUInt64)len, rec + 8);
+  if (++session->part_recs_count == SILC_CLIENT_FTP_PART_FLUSH)
+    silc_client_ftp_part_flush(session);
+}
 
 static void silc_client_ftp_data(SilcSFTP sftp,
 				 SilcSFTPStatus status,
 				 const unsigned char *data,
 				 SilcUInt32 data_len,
-				 void *context)
+				 void *context);
+
+/* Sends read request for `len' bytes at `offset'.  The request is sent
+   to the connection with least outstanding requests. */
+
+static SilcBool silc_client_ftp_read(SilcClientFtpSession session,
+				     SilcUInt64 offset, SilcUInt32 len)
 {
-  SilcClientFtpSession session = (SilcClientFtpSession)context;
+  SilcClientFtpStream stream, s;
+  SilcClientFtpRead req;
+
+  stream = NULL;
+  silc_list_start(session->streams);
+  while ((s = silc_list_get(session->streams)))
+    if (s->read_handle && (!stream || s->read_pending < stream->read_pending))
+      stream = s;
+  if (!stream)
+    return FALSE;
+
+  silc_list_start(session->read_free);
+  req = silc_list_get(session->read_free);
+  if (!req)
+    return FALSE;
+  silc_list_del(session->read_free, req);
+
+  req->session = session;
+  req->stream = stream;
+  req->offset = offset;
+  req->len = len;
+  req->sent = silc_time_usec();
+  req->in_use = TRUE;
+  session->read_pending++;
+  stream->read_pending++;
+
+  silc_sftp_read(stream->sftp, stream->read_handle, offset, len,
+		 silc_client_ftp_data, req);
+  return TRUE;
+}
 
-  SILC_LOG_DEBUG(("Start"));
+/* Fills the read window with requests at increasing offsets.  Each
+   connection gets its own window, so the chunks are striped across the
+   connections. */
 
-  if (status == SILC_SFTP_STATUS_EOF) {
-    /* EOF received */
+static void silc_client_ftp_read_more(SilcClientFtpSession session)
+{
+  SilcClientFtpStream stream;
+  SilcUInt32 count = 0, len;
+  SilcUInt64 offset;
 
-    /* Close the handle */
-    silc_sftp_close(sftp, session->read_handle, NULL, NULL);
-    session->read_handle = NULL;
+  silc_list_start(session->streams);
+  while ((stream = silc_list_get(session->streams)))
+    if (stream->read_handle)
+      count++;
 
-    /* Close the real file descriptor */
-    silc_file_close(session->fd);
-    return;
-  }
+  while (!session->read_eof && !session->read_error &&
+	 session->read_pending < session->read_window * count) {
+    offset = session->read_offset;
+    len = SILC_CLIENT_FTP_READ_LEN;
 
-  if (status != SILC_SFTP_STATUS_OK) {
-    /* Call monitor callback */
-    if (session->monitor)
-      (*session->monitor)(session->client, session->conn,
-			  SILC_CLIENT_FILE_MONITOR_ERROR,
-			  (status == SILC_SFTP_STATUS_NO_SUCH_FILE ?
-			   SILC_CLIENT_FILE_NO_SUCH_FILE :
-			   status == SILC_SFTP_STATUS_PERMISSION_DENIED ?
-			   SILC_CLIENT_FILE_PERMISSION_DENIED :
-			   SILC_CLIENT_FILE_ERROR), 0, 0,
-			  session->client_entry, session->session_id,
-			  session->filepath, session->monitor_context);
+    /* Skip data received earlier */
+    if (session->ranges_count)
+      silc_client_ftp_range_next(session, &offset, &len);
+
+    if (!silc_client_ftp_read(session, offset, len))
+      break;
+    session->read_offset = offset + len;
+  }
+}
 
-    /* Close the handle */
-    silc_sftp_close(sftp, session->read_handle, NULL, NULL);
-    session->read_handle = NULL;
+/* Adapts the read window to the measured round trip time.  As long as the
+   RTT stays near the lowest measured RTT the path is not yet full and the
+   window can grow.  When replies start to queue up the window shrinks. */
 
-    /* Close the real file descriptor */
-    silc_file_close(session->fd);
-    return;
+static void silc_client_ftp_read_adapt(SilcClientFtpSession session,
+				       SilcInt64 rtt)
+{
+  if (rtt < 1)
+    rtt = 1;
+  if (!session->read_rtt || rtt < session->read_rtt)
+    session->read_rtt = rtt;
+
+  if (rtt <= session->read_rtt * 2) {
+    if (session->read_window < session->read_window_max)
+      session->read_window++;
+  } else if (rtt > session->read_rtt * 4) {
+    if (session->read_window > 1)
+      session->read_window--;
   }
+}
+
+/* Reports the received bytes to application.  While the file is being
+   verified with tree hash the whole file is not reported as received
+   until the last chunk has been verified, as application considers the
+   transfer complete when all bytes have been received. */
 
-  /* Read more, until EOF is received */
-  session->read_offset += data_len;
-  silc_sftp_read(sftp, session->read_handle, session->read_offset,
-                 SILC_PACKET_MAX_LEN - 1024,
-		 silc_client_ftp_data, session);
+static void silc_client_ftp_progress(SilcClientFtpSession session)
+{
+  SilcUInt64 received = session->received;
 
-  /* Write the read data to the real file */
-  silc_file_write(session->fd, data, data_len);
+  if (session->chunks && !session->read_done && session->filesize &&
+      received >= session->filesize)
+    received = session->filesize - 1;
+  session->reported = received;
 
   /* Call monitor callback */
   if (session->monitor)
     (*session->monitor)(session->client, session->conn,
 			SILC_CLIENT_FILE_MONITOR_RECEIVE,
 			SILC_CLIENT_FILE_OK,
-			session->read_offset, session->filesize,
+			received, session->filesize,
+			session->client_entry, session->session_id,
+			session->filepath, session->monitor_context);
+}
+
+/* Finishes reading after all outstanding requests have completed.  Closes
+   the file handles and the local file.  The resume file is removed if the
+   whole file was received. */
+
+static void silc_client_ftp_read_finish(SilcClientFtpSession session)
+{
+  SilcClientFtpStream stream;
+
+  if (session->read_done)
+    return;
+  session->read_done = TRUE;
+
+  /* Close the handles */
+  silc_list_start(session->streams);
+  while ((stream = silc_list_get(session->streams))) {
+    if (stream->read_handle)
+      silc_sftp_close(stream->sftp, stream->read_handle, NULL, NULL);
+    stream->read_handle = NULL;
+  }
+
+  /* Save what was received, for resuming later */
+  if (session->part_path && session->read_error)
+    silc_client_ftp_part_flush(session);
+
+  /* Close the real file descriptor */
+  silc_file_close(session->fd);
+
+  if (session->part_path) {
+    silc_file_close(session->part_fd);
+    if (!session->read_error)
+      unlink(session->part_path);
+    silc_free(session->part_path);
+    session->part_path = NULL;
+  }
+}
+
+/* Reading failed.  No more reads are sent, and `error' is reported to
+   application.  Only the first error is reported. */
+
+static void silc_client_ftp_read_failed(SilcClientFtpSession session,
+					SilcClientFileError error)
+{
+  if (session->read_error)
+    return;
+  session->read_error = TRUE;
+
+  /* Call monitor callback */
+  if (session->monitor)
+    (*session->monitor)(session->client, session->conn,
+			SILC_CLIENT_FILE_MONITOR_ERROR, error, 0, 0,
 			session->client_entry, session->session_id,
 			session->filepath, session->monitor_context);
 }
 
+/* Tree hash verification failed */
+
+static void silc_client_ftp_tree_failed(SilcClientFtpSession session)
+{
+  SILC_LOG_DEBUG(("Tree hash verification failed"));
+  silc_client_ftp_read_failed(session, SILC_CLIENT_FILE_INTEGRITY_FAILED);
+}
+
+/* Returns the length of chunk `i' */
+
+static SilcUInt32 silc_client_ftp_tree_chunk_len(SilcClientFtpSession session,
+						 SilcUInt32 i)
+{
+  SilcUInt64 offset = (SilcUInt64)i * SILC_CLIENT_FTP_READ_LEN;
+
+  if (offset >= session->filesize)
+    return 0;
+  if (session->filesize - offset < SILC_CLIENT_FTP_READ_LEN)
+    return session->filesize - offset;
+  return SILC_CLIENT_FTP_READ_LEN;
+}
+
+/* Compares leaf hash of chunk `i' to the leaf hash received from the
+   sender.  Corrupted chunk is requested again. */
+
+static void silc_client_ftp_tree_verify(SilcClientFtpSession session,
+					SilcUInt32 i)
+{
+  SilcClientFtpChunk chunk = &session->chunks[i];
+
+  if (!chunk->hashed || chunk->verified || i >= session->tree_fetched)
+    return;
+
+  if (!memcmp(chunk->leaf, session->tree_leaves +
+	      (i * SILC_SFTP_TREE_HASH_LEN), SILC_SFTP_TREE_HASH_LEN)) {
+    chunk->verified = TRUE;
+    return;
+  }
+
+  SILC_LOG_DEBUG(("Chunk %d is corrupted, receiving it again", i));
+
+  /* The chunk is counted again when it is received again */
+  session->received -= silc_client_ftp_tree_chunk_len(session, i);
+  chunk->hashed = FALSE;
+  chunk->received = 0;
+  if (++session->tree_retries > SILC_CLIENT_FTP_TREE_RETRIES ||
+      !silc_client_ftp_read(session, (SilcUInt64)i * SILC_CLIENT_FTP_READ_LEN,
+			    silc_client_ftp_tree_chunk_len(session, i)))
+    silc_client_ftp_tree_failed(session);
+}
+
+/* Computes the leaf hash of chunk `i'.  If `data' is NULL the chunk is
+   read from the file. */
+
+static void silc_client_ftp_tree_hash_chunk(SilcClientFtpSession session,
+					    SilcUInt32 i,
+					    const unsigned char *data)
+{
+  SilcClientFtpChunk chunk = &session->chunks[i];
+  SilcUInt32 len = silc_client_ftp_tree_chunk_len(session, i);
+  unsigned char *buf = NULL;
+
+  if (!data) {
+    buf = silc_malloc(len + 1);
+    if (!buf || silc_file_pread(session->fd, buf, len,
+				(SilcUInt64)i * SILC_CLIENT_FTP_READ_LEN) !=
+	len) {
+      silc_free(buf);
+      silc_client_ftp_tree_failed(session);
+      return;
+    }
+    data = buf;
+  }
+
+  silc_sftp_tree_hash_leaf(session->tree_hash, data, len, chunk->leaf);
+  chunk->hashed = TRUE;
+  silc_free(buf);
+
+  silc_client_ftp_tree_verify(session, i);
+}
+
+/* Computes leaf hashes of the chunks the received data completes.  Chunk
+   received in one piece is hashed directly from the received data.  This
+   way the file need not be read again after it has been received. */
+
+static void silc_client_ftp_tree_data(SilcClientFtpSession session,
+				      SilcUInt64 offset,
+				      const unsigned char *data,
+				      SilcUInt32 data_len)
+{
+  SilcClientFtpChunk chunk;
+  SilcUInt64 start;
+  SilcUInt32 i, len, n;
+
+  while (data_len) {
+    i = offset / SILC_CLIENT_FTP_READ_LEN;
+    if (i >= session->chunks_count)
+      break;
+    chunk = &session->chunks[i];
+    start = (SilcUInt64)i * SILC_CLIENT_FTP_READ_LEN;
+    len = silc_client_ftp_tree_chunk_len(session, i);
+
+    n = start + len - offset;
+    if (n > data_len)
+      n = data_len;
+
+    if (!chunk->hashed) {
+      if (offset == start && n == len) {
+	silc_client_ftp_tree_hash_chunk(session, i, data);
+      } else {
+	chunk->received += n;
+	if (chunk->received >= len)
+	  silc_client_ftp_tree_hash_chunk(session, i, NULL);
+      }
+    }
+
+    offset += n;
+    data += n;
+    data_len -= n;
+    if (!n)
+      break;
+  }
+}
+
+/* Verifies the whole file after all data has been received.  Chunks
+   received earlier, when resuming, are read from the file and hashed
+   here.  Returns FALSE if some chunks had to be requested again. */
+
+static SilcBool silc_client_ftp_tree_check(SilcClientFtpSession session)
+{
+  unsigned char *leaves, root[SILC_SFTP_TREE_HASH_LEN];
+  SilcUInt32 i, pending = session->read_pending;
+
+  for (i = 0; i < session->chunks_count && !session->read_error; i++)
+    if (!session->chunks[i].hashed)
+      silc_client_ftp_tree_hash_chunk(session, i, NULL);
+  if (session->read_error)
+    return TRUE;
+  if (session->read_pending != pending)
+    return FALSE;
+
+  leaves = silc_malloc(session->chunks_count * SILC_SFTP_TREE_HASH_LEN);
+  if (!leaves) {
+    silc_client_ftp_tree_failed(session);
+    return TRUE;
+  }
+  for (i = 0; i < session->chunks_count; i++)
+    memcpy(leaves + (i * SILC_SFTP_TREE_HASH_LEN), session->chunks[i].leaf,
+	   SILC_SFTP_TREE_HASH_LEN);
+
+  if (!silc_sftp_tree_hash_root(session->tree_hash, leaves,
+				session->chunks_count, root) ||
+      memcmp(root, session->tree_root, sizeof(root)))
+    silc_client_ftp_tree_failed(session);
+  else
+    SILC_LOG_DEBUG(("Tree hash verified"));
+
+  silc_free(leaves);
+  return TRUE;
+}
+
+/* Finishes reading once all data and the tree hash have been received
+   and the file has been verified. */
+
+static void silc_client_ftp_read_done(SilcClientFtpSession session)
+{
+  if (session->read_done || session->read_pending || session->tree_pending ||
+      (!session->read_eof && !session->read_error))
+    return;
+
+  if (!session->read_error && session->chunks &&
+      !silc_client_ftp_tree_check(session))
+    return;
+
+  silc_client_ftp_read_finish(session);
+
+  /* Report the completion held back during verification */
+  if (!session->read_error && session->reported != session->received)
+    silc_client_ftp_progress(session);
+}
+
+/* Free tree hash state.  Verification is not done. */
+
+static void silc_client_ftp_tree_free(SilcClientFtpSession session)
+{
+  if (session->tree_hash)
+    silc_hash_free(session->tree_hash);
+  session->tree_hash = NULL;
+  silc_free(session->chunks);
+  session->chunks = NULL;
+  session->chunks_count = 0;
+  silc_free(session->tree_leaves);
+  session->tree_leaves = NULL;
+}
+
+static void silc_client_ftp_tree_reply(SilcSFTP sftp,
+				       SilcSFTPStatus status,
+				       const unsigned char *data,
+				       SilcUInt32 data_len,
+				       void *context);
+
+/* Requests next set of leaf hashes from the sender */
+
+static void silc_client_ftp_tree_request(SilcClientFtpSession session)
+{
+  SilcBuffer buffer;
+
+  buffer = silc_buffer_alloc_size(16 + strlen(session->remote_file));
+  if (!buffer ||
+      silc_buffer_format(buffer,
+			 SILC_STR_UI_INT(strlen(session->remote_file)),
+			 SILC_STR_UI32_STRING(session->remote_file),
+			 SILC_STR_UI_INT(SILC_CLIENT_FTP_READ_LEN),
+			 SILC_STR_UI_INT(session->tree_fetched),
+			 SILC_STR_UI_INT(SILC_SFTP_TREE_HASH_MAX_LEAVES),
+			 SILC_STR_END) < 0) {
+    silc_buffer_free(buffer);
+    silc_client_ftp_tree_free(session);
+    return;
+  }
+
+  session->tree_pending = TRUE;
+  silc_sftp_extended(session->sftp, SILC_SFTP_EXTENDED_TREE_HASH,
+		     silc_buffer_data(buffer), silc_buffer_len(buffer),
+		     silc_client_ftp_tree_reply, session);
+  silc_buffer_free(buffer);
+}
+
+/* Tree hash reply from the sender.  The chunks received so far are
+   verified against the leaf hashes. */
+
+static void silc_client_ftp_tree_reply(SilcSFTP sftp,
+				       SilcSFTPStatus status,
+				       const unsigned char *data,
+				       SilcUInt32 data_len,
+				       void *context)
+{
+  SilcClientFtpSession session = context;
+  SilcBufferStruct buf;
+  unsigned char *root, *leaves;
+  SilcUInt64 size;
+  SilcUInt32 total, count, i;
+
+  session->tree_pending = FALSE;
+
+  if (status != SILC_SFTP_STATUS_OK) {
+    /* Sender does not provide tree hash, the file cannot be verified */
+    SILC_LOG_DEBUG(("Tree hash not available, status %d", status));
+    silc_client_ftp_tree_free(session);
+    silc_client_ftp_read_done(session);
+    return;
+  }
+
+  silc_buffer_set(&buf, (unsigned char *)data, data_len);
+  if (silc_buffer_unformat(&buf,
+			   SILC_STR_UI_INT64(&size),
+			   SILC_STR_UI_INT(&total),
+			   SILC_STR_DATA(&root, SILC_SFTP_TREE_HASH_LEN),
+			   SILC_STR_UI_INT(&count),
+			   SILC_STR_END) < 0 ||
+      size != session->filesize || total != session->chunks_count ||
+      !count || count > total - session->tree_fetched) {
+    silc_client_ftp_tree_failed(session);
+    silc_client_ftp_read_done(session);
+    return;
+  }
+  silc_buffer_pull(&buf, 16 + SILC_SFTP_TREE_HASH_LEN);
+  if (silc_buffer_unformat(&buf,
+			   SILC_STR_DATA(&leaves,
+					 count * SILC_SFTP_TREE_HASH_LEN),
+			   SILC_STR_END) < 0) {
+    silc_client_ftp_tree_failed(session);
+    silc_client_ftp_read_done(session);
+    return;
+  }
+
+  if (!session->tree_leaves) {
+    session->tree_leaves = silc_malloc(total * SILC_SFTP_TREE_HASH_LEN);
+    if (!session->tree_leaves) {
+      silc_client_ftp_tree_failed(session);
+      silc_client_ftp_read_done(session);
+      return;
+    }
+    memcpy(session->tree_root, root, SILC_SFTP_TREE_HASH_LEN);
+  }
+
+  memcpy(session->tree_leaves + (session->tree_fetched *
+				 SILC_SFTP_TREE_HASH_LEN),
+	 leaves, count * SILC_SFTP_TREE_HASH_LEN);
+  session->tree_fetched += count;
+
+  /* Verify chunks already received */
+  for (i = session->tree_fetched - count; i < session->tree_fetched; i++)
+    silc_client_ftp_tree_verify(session, i);
+
+  if (session->tree_fetched < total && !session->read_error)
+    silc_client_ftp_tree_request(session);
+
+  silc_client_ftp_read_done(session);
+}
+
+/* Starts verifying the received file with tree hash */
+
+static void silc_client_ftp_tree_start(SilcClientFtpSession session)
+{
+  SilcUInt64 count;
+
+  /* The sender provides trees up to SILC_SFTP_TREE_HASH_MAX_TOTAL leaves.
+     Larger files are not verified. */
+  count = (session->filesize + SILC_CLIENT_FTP_READ_LEN - 1) /
+    SILC_CLIENT_FTP_READ_LEN;
+  if (!session->remote_file || count > SILC_SFTP_TREE_HASH_MAX_TOTAL ||
+      !silc_hash_alloc("sha256", &session->tree_hash))
+    return;
+
+  session->chunks_count = count ? count : 1;
+  session->chunks = silc_calloc(session->chunks_count,
+				sizeof(*session->chunks));
+  if (!session->chunks) {
+    silc_client_ftp_tree_free(session);
+    return;
+  }
+
+  silc_client_ftp_tree_request(session);
+}
+
+/* Returns the read data. This is the downloader's function (client side)
+   to receive the read data and read more until EOF is received from
+   the other side.  Multiple read requests are kept outstanding, and the
+   data is written to the file at the offset it was requested from.  This
+   will also monitor the transmission and notify the application. */
+
+static void silc_client_ftp_data(SilcSFTP sftp,
+				 SilcSFTPStatus status,
+				 const unsigned char *data,
+				 SilcUInt32 data_len,
+				 void *context)
+{
+  SilcClientFtpRead req = context;
+  SilcClientFtpSession session = req->session;
+
+  SILC_LOG_DEBUG(("Start"));
+
+  session->read_pending--;
+  req->stream->read_pending--;
+  req->in_use = FALSE;
+  silc_list_add(session->read_free, req);
+
+  if (status == SILC_SFTP_STATUS_OK && !session->read_error) {
+    silc_client_ftp_read_adapt(session, silc_time_usec() - req->sent);
+
+    if (data_len > req->len)
+      data_len = req->len;
+
+    /* Write the read data to the real file.  If it cannot be written the
+       file would have holes, so the transfer fails. */
+    if (silc_file_pwrite(session->fd, (const char *)data, data_len,
+			 req->offset) != data_len) {
+      SILC_LOG_DEBUG(("Could not write to file: %s", strerror(errno)));
+      silc_client_ftp_read_failed(session, SILC_CLIENT_FILE_ERROR);
+      silc_client_ftp_read_done(session);
+      return;
+    }
+    session->received += data_len;
+    if (session->part_path)
+      silc_client_ftp_part_add(session, req->offset, data_len);
+    if (session->chunks)
+      silc_client_ftp_tree_data(session, req->offset, data, data_len);
+
+    /* If we got less than requested, request the rest separately */
+    if (data_len < req->len)
+      silc_client_ftp_read(session, req->offset + data_len,
+			   req->len - data_len);
+
+    /* Read more, until EOF is received */
+    silc_client_ftp_read_more(session);
+
+    silc_client_ftp_progress(session);
+    return;
+  }
+
+  if (status == SILC_SFTP_STATUS_EOF) {
+    /* EOF received */
+    session->read_eof = TRUE;
+  } else if (status != SILC_SFTP_STATUS_OK) {
+    silc_client_ftp_read_failed(session,
+				(status == SILC_SFTP_STATUS_NO_SUCH_FILE ?
+				 SILC_CLIENT_FILE_NO_SUCH_FILE :
+				 status == SILC_SFTP_STATUS_PERMISSION_DENIED ?
+				 SILC_CLIENT_FILE_PERMISSION_DENIED :
+				 SILC_CLIENT_FILE_ERROR));
+  }
+
+  /* Finish after all outstanding requests have completed */
+  silc_client_ftp_read_done(session);
+}
+
+static void silc_client_ftp_streams_start(SilcClientFtpSession session);
+
 /* Returns handle for the opened file. This is the downloader's function.
    This will begin reading the data from the file. */
 
@@ -163,7 +942,9 @@ static void silc_client_ftp_open_handle(SilcSFTP sftp,
 					void *context)
 {
   SilcClientFtpSession session = (SilcClientFtpSession)context;
+  SilcUInt32 streams;
   char path[512];
+  int i;
 
   SILC_LOG_DEBUG(("Start"));
 
@@ -182,11 +963,57 @@ static void silc_client_ftp_open_handle(SilcSFTP sftp,
     return;
   }
 
-  /* Open the actual local file */
+  /* Open the actual local file.  When resuming, the earlier partially
+     received file is opened if its resume file exists. */
   memset(path, 0, sizeof(path));
   silc_snprintf(path, sizeof(path) - 1, "%s%s", session->path ?
 		session->path : "", session->filepath);
-  session->fd = silc_file_open(path, O_RDWR | O_CREAT | O_EXCL);
+  session->fd = -1;
+  if (session->params.ftp_resume &&
+      silc_asprintf(&session->part_path, "%s.silcpart", path) > 0) {
+    switch (silc_client_ftp_part_load(session, silc_file_size(path))) {
+    case 1:
+      session->fd = silc_file_open(path, O_RDWR | O_CREAT);
+      break;
+    case 0:
+      /* Partial file of another version of the file, receive it again */
+      session->fd = silc_file_open(path, O_RDWR | O_CREAT | O_TRUNC);
+      break;
+    default:
+      session->fd = silc_file_open(path, O_RDWR | O_CREAT | O_EXCL);
+      break;
+    }
+    if (session->fd >= 0) {
+      /* Data past the last received range is not trusted */
+      if (session->ranges_count &&
+	  ftruncate(session->fd,
+		    session->ranges[session->ranges_count - 1].end) < 0)
+	SILC_LOG_DEBUG(("Could not truncate `%s'", path));
+
+      session->part_fd = silc_file_open(session->part_path, O_RDWR |
+					O_CREAT | O_APPEND |
+					(session->ranges_count ? 0 : O_TRUNC));
+      if (session->part_fd >= 0 && !session->ranges_count) {
+	unsigned char rec[SILC_CLIENT_FTP_PART_REC_LEN];
+
+	SILC_PUT32_MSB(SILC_CLIENT_FTP_PART_MAGIC, rec);
+	SILC_PUT32_MSB(session->filemtime, rec + 4);
+	SILC_PUT64_MSB(session->filesize, rec + 8);
+	if (ftruncate(session->fd, 0) < 0 ||
+	    silc_file_write(session->part_fd, (const char *)rec,
+			    sizeof(rec)) != sizeof(rec)) {
+	  silc_file_close(session->part_fd);
+	  session->part_fd = -1;
+	}
+      }
+      if (session->part_fd < 0) {
+	silc_free(session->part_path);
+	session->part_path = NULL;
+      }
+    }
+  } else {
+    session->fd = silc_file_open(path, O_RDWR | O_CREAT | O_EXCL);
+  }
   if (session->fd < 0) {
     /* Call monitor callback */
     session->conn->context_type = SILC_ID_CLIENT;
@@ -198,6 +1025,9 @@ static void silc_client_ftp_open_handle(SilcSFTP sftp,
 					strerror(errno));
     session->conn->context_type = SILC_ID_NONE;
 
+    silc_free(session->part_path);
+    session->part_path = NULL;
+
     if (session->monitor)
       (*session->monitor)(session->client, session->conn,
 			  SILC_CLIENT_FILE_MONITOR_ERROR,
@@ -207,21 +1037,55 @@ static void silc_client_ftp_open_handle(SilcSFTP sftp,
     return;
   }
 
-  session->read_handle = handle;
-
-  /* Now, start reading the file */
-  silc_sftp_read(sftp, session->read_handle, session->read_offset,
-                 SILC_PACKET_MAX_LEN - 1024,
-		 silc_client_ftp_data, session);
-
-  /* Call monitor callback */
-  if (session->monitor)
-    (*session->monitor)(session->client, session->conn,
-			SILC_CLIENT_FILE_MONITOR_RECEIVE,
-			SILC_CLIENT_FILE_OK,
-			session->read_offset, session->filesize,
-			session->client_entry, session->session_id,
-			session->filepath, session->monitor_context);
+  /* Allocate read request contexts, a window for each connection */
+  streams = session->params.ftp_streams;
+  if (streams < 1 || session->listener)
+    streams = 1;
+  if (streams > SILC_CLIENT_FTP_MAX_STREAMS)
+    streams = SILC_CLIENT_FTP_MAX_STREAMS;
+  session->reads = silc_calloc(session->read_window_max * streams,
+			       sizeof(*session->reads));
+  if (!session->reads) {
+    silc_sftp_close(sftp, handle, NULL, NULL);
+    silc_file_close(session->fd);
+    if (session->part_path) {
+      silc_file_close(session->part_fd);
+      silc_free(session->part_path);
+      session->part_path = NULL;
+    }
+    if (session->monitor)
+      (*session->monitor)(session->client, session->conn,
+			  SILC_CLIENT_FILE_MONITOR_ERROR,
+			  SILC_CLIENT_FILE_NO_MEMORY, 0, 0,
+			  session->client_entry, session->session_id,
+			  session->filepath, session->monitor_context);
+    return;
+  }
+  session->reads_count = session->read_window_max * streams;
+  silc_list_init(session->read_free, struct SilcClientFtpReadStruct, next);
+  for (i = 0; i < session->reads_count; i++)
+    silc_list_add(session->read_free, &session->reads[i]);
+
+  /* The primary connection reads first */
+  session->main.session = session;
+  session->main.conn = session->conn;
+  session->main.sftp = sftp;
+  session->main.read_handle = handle;
+  silc_list_add(session->streams, &session->main);
+
+  /* Now, start reading the file.  Start with small window and let it
+     grow as the RTT allows. */
+  session->read_window = session->read_window_max < 2 ? 1 : 2;
+  silc_client_ftp_read_more(session);
+
+  /* Verify the file with tree hash, if the sender provides it */
+  silc_client_ftp_tree_start(session);
+
+  /* Open rest of the connections.  They join reading when ready. */
+  if (streams > 1)
+    silc_client_ftp_streams_start(session);
+
+  silc_client_ftp_progress(session);
 }
 
 /* Ask filename completion callback.  Delivers the filepath selected by
@@ -255,7 +1119,9 @@ static void silc_client_ftp_ask_name(const char *filepath,
   silc_sftp_close(session->sftp, session->dir_handle, NULL, NULL);
   session->dir_handle = NULL;
 
-  silc_free(remote_file);
+  /* Saved for opening the file in additional connections */
+  silc_free(session->remote_file);
+  session->remote_file = remote_file;
 }
 
 /* Returns the file name available for download. This is the downloader's
@@ -288,6 +1154,7 @@ static void silc_client_ftp_readdir_name(SilcSFTP sftp,
   /* Save the important attributes like filename and file size */
   session->filepath = strdup(name->filename[0]);
   session->filesize = name->attrs[0]->size;
+  session->filemtime = name->attrs[0]->mtime;
 
   /* If the path was not provided, ask from application where to save the
      downloaded file. */
@@ -376,11 +1243,15 @@ static void silc_client_ftp_error(SilcSFTP sftp, SilcSFTPStatus status,
 
 /************************ Static utility functions **************************/
 
+static void silc_client_ftp_stream_close(SilcClientFtpStream stream);
+
 /* Free session resources.   Connection must be closed before getting
    here. */
 
 static void silc_client_ftp_session_free(SilcClientFtpSession session)
 {
+  SilcClientFtpStream stream;
+
   SILC_LOG_DEBUG(("Free session %d", session->session_id));
 
   silc_schedule_task_del_by_context(session->client->schedule, session);
@@ -391,6 +1262,19 @@ static void silc_client_ftp_session_free(SilcClientFtpSession session)
   if (session->op)
     silc_async_abort(session->op, NULL, NULL);
 
+  /* Close additional transfer connections.  Reading stops here. */
+  session->read_error = TRUE;
+  silc_list_start(session->streams);
+  while ((stream = silc_list_get(session->streams)))
+    stream->read_handle = NULL;
+  silc_list_start(session->streams);
+  while ((stream = silc_list_get(session->streams)))
+    if (stream != &session->main)
+      silc_client_ftp_stream_close(stream);
+  if (session->reads)
+    silc_client_ftp_read_finish(session);
+  silc_client_ftp_tree_free(session);
+
   /* Destroy SFTP */
   if (session->sftp) {
     if (session->initiator)
@@ -414,6 +1298,12 @@ static void silc_client_ftp_session_free(SilcClientFtpSession session)
   silc_free(session->hostname);
   silc_free(session->filepath);
   silc_free(session->path);
+  silc_free(session->reads);
+  silc_free(session->remote_file);
+  silc_free(session->ranges);
+  silc_free(session->part_recs);
+  if (session->remote_key)
+    silc_pkcs_public_key_free(session->remote_key);
   silc_free(session);
 }
 
@@ -509,6 +1399,306 @@ silc_client_ftp_coder(SilcStream stream, SilcStreamStatus status,
   return FALSE;
 }
 
+/*************************** Transfer Connections ***************************/
+
+/* Closes additional transfer connection.  Read requests outstanding in the
+   connection are sent again to the other connections. */
+
+static void silc_client_ftp_stream_close(SilcClientFtpStream stream)
+{
+  SilcClientFtpSession session = stream->session;
+  SilcClient client = session->client;
+  SilcClientFtpRead req;
+  SilcUInt64 offset;
+  SilcUInt32 i, len;
+
+  SILC_LOG_DEBUG(("Close transfer connection %p", stream));
+
+  silc_schedule_task_del_by_context(client->schedule, stream);
+  silc_list_del(session->streams, stream);
+
+  /* Destroy SFTP.  No callbacks are called after this. */
+  if (stream->sftp) {
+    if (session->initiator)
+      silc_sftp_server_shutdown(stream->sftp);
+    else
+      silc_sftp_client_shutdown(stream->sftp);
+  }
+
+  /* Request the data again from other connections */
+  if (stream->read_pending) {
+    for (i = 0; i < session->reads_count; i++) {
+      req = &session->reads[i];
+      if (!req->in_use || req->stream != stream)
+	continue;
+
+      offset = req->offset;
+      len = req->len;
+      req->in_use = FALSE;
+      session->read_pending--;
+      silc_list_add(session->read_free, req);
+
+      if (!silc_client_ftp_read(session, offset, len))
+	silc_client_ftp_read_failed(session, SILC_CLIENT_FILE_ERROR);
+    }
+
+    silc_client_ftp_read_done(session);
+  }
+
+  if (stream->stream)
+    silc_stream_destroy(stream->stream);
+  if (stream->op)
+    silc_async_abort(stream->op, NULL, NULL);
+  if (stream->conn) {
+    stream->conn->callback = NULL;
+    silc_client_close_connection(client, stream->conn);
+  }
+  silc_free(stream);
+}
+
+/* Transfer connection closing task callback */
+
+SILC_TASK_CALLBACK(silc_client_ftp_stream_close_task)
+{
+  silc_client_ftp_stream_close(context);
+}
+
+/* Returns handle for the opened file in additional transfer connection.
+   The connection joins reading the file. */
+
+static void silc_client_ftp_stream_open_handle(SilcSFTP sftp,
+					       SilcSFTPStatus status,
+					       SilcSFTPHandle handle,
+					       void *context)
+{
+  SilcClientFtpStream stream = context;
+  SilcClientFtpSession session = stream->session;
+
+  if (status != SILC_SFTP_STATUS_OK) {
+    SILC_LOG_DEBUG(("Could not open file in transfer connection %p",
+		    stream));
+    silc_schedule_task_add_timeout(session->client->schedule,
+				   silc_client_ftp_stream_close_task,
+				   stream, 0, 1);
+    return;
+  }
+
+  /* The file may have been received already */
+  if (session->read_eof || session->read_error) {
+    silc_sftp_close(sftp, handle, NULL, NULL);
+    return;
+  }
+
+  stream->read_handle = handle;
+  silc_client_ftp_read_more(session);
+}
+
+/* SFTP version callback for additional transfer connection */
+
+static void silc_client_ftp_stream_version(SilcSFTP sftp,
+					   SilcSFTPStatus status,
+					   SilcSFTPVersion version,
+					   void *context)
+{
+  SilcClientFtpStream stream = context;
+  SilcClientFtpSession session = stream->session;
+  SilcSFTPAttributesStruct attr;
+
+  if (status != SILC_SFTP_STATUS_OK) {
+    silc_schedule_task_add_timeout(session->client->schedule,
+				   silc_client_ftp_stream_close_task,
+				   stream, 0, 1);
+    return;
+  }
+
+  memset(&attr, 0, sizeof(attr));
+  silc_sftp_open(sftp, session->remote_file, SILC_SFTP_FXF_READ, &attr,
+		 silc_client_ftp_stream_open_handle, stream);
+}
+
+/* Connection callback for additional transfer connection.  This is the
+   downloader's function. */
+
+static void
+silc_client_ftp_stream_completion(SilcClient client,
+				  SilcClientConnection conn,
+				  SilcClientConnectionStatus status,
+				  SilcStatus error,
+				  const char *message,
+				  void *context)
+{
+  SilcClientFtpStream stream = context;
+
+  stream->op = NULL;
+
+  switch (status) {
+  case SILC_CLIENT_CONN_SUCCESS:
+    SILC_LOG_DEBUG(("Transfer connection %p connected, conn %p",
+		    stream, conn));
+    stream->conn = conn;
+
+    /* Wrap the connection packet stream and start SFTP client */
+    stream->stream = silc_packet_stream_wrap(conn->stream, SILC_PACKET_FTP,
+					     0, FALSE, 0, NULL, 0, NULL,
+					     silc_client_ftp_coder, stream);
+    if (stream->stream)
+      stream->sftp = silc_sftp_client_start(stream->stream,
+					    conn->internal->schedule,
+					    silc_client_ftp_stream_version,
+					    silc_client_ftp_error, stream);
+    if (!stream->sftp)
+      silc_client_ftp_stream_close(stream);
+    break;
+
+  default:
+    /* Connecting failed inside silc_client_connect_to_client */
+    if (stream->connecting) {
+      stream->failed = TRUE;
+      break;
+    }
+
+    SILC_LOG_DEBUG(("Transfer connection %p closed, status %d",
+		    stream, status));
+
+    /* Connection already closed */
+    stream->conn = NULL;
+    silc_client_ftp_stream_close(stream);
+    break;
+  }
+}
+
+/* Connects additional transfer connections to the sender.  This is the
+   downloader's function. */
+
+static void silc_client_ftp_streams_start(SilcClientFtpSession session)
+{
+  SilcClientFtpStream stream;
+  SilcUInt32 i, streams = session->params.ftp_streams;
+
+  if (session->listener || !session->hostname || !session->port ||
+      !session->remote_file)
+    return;
+  if (streams > SILC_CLIENT_FTP_MAX_STREAMS)
+    streams = SILC_CLIENT_FTP_MAX_STREAMS;
+
+  SILC_LOG_DEBUG(("Opening %d additional transfer connections",
+		  streams - 1));
+
+  for (i = 1; i < streams; i++) {
+    stream = silc_calloc(1, sizeof(*stream));
+    if (!stream)
+      break;
+    stream->session = session;
+
+    stream->connecting = TRUE;
+    stream->op =
+      silc_client_connect_to_client(session->client, &session->params,
+				    session->public_key, session->private_key,
+				    session->hostname, session->port,
+				    silc_client_ftp_stream_completion, stream);
+    stream->connecting = FALSE;
+    if (!stream->op || stream->failed) {
+      silc_free(stream);
+      break;
+    }
+
+    silc_list_add(session->streams, stream);
+  }
+}
+
+/* Returns the public key the remote host used in the key exchange of
+   connection `conn', or NULL if it is not available anymore. */
+
+static SilcPublicKey silc_client_ftp_remote_key(SilcClientConnection conn)
+{
+  SilcSKESecurityProperties prop;
+
+  if (!conn->internal->ske)
+    return NULL;
+  prop = silc_ske_get_security_properties(conn->internal->ske);
+  return prop ? prop->public_key : NULL;
+}
+
+/* Handles additional transfer connection made to the sender.  Returns
+   FALSE if `conn' is the primary connection of the session.  The
+   additional connection must be made with the same public key as the
+   primary connection.  This is the uploader's function. */
+
+static SilcBool
+silc_client_ftp_stream_accept(SilcClientFtpSession session,
+			      SilcClientConnection conn,
+			      SilcClientConnectionStatus status)
+{
+  SilcClientFtpStream stream;
+  SilcPublicKey remote_key;
+
+  silc_list_start(session->streams);
+  while ((stream = silc_list_get(session->streams)))
+    if (stream != &session->main && stream->conn == conn)
+      break;
+
+  if (stream) {
+    if (status == SILC_CLIENT_CONN_DISCONNECTED) {
+      /* Connection already closed */
+      stream->conn = NULL;
+      silc_client_ftp_stream_close(stream);
+    }
+    return TRUE;
+  }
+
+  if (status != SILC_CLIENT_CONN_SUCCESS || !session->initiator ||
+      !session->sftp || conn == session->conn)
+    return FALSE;
+
+  SILC_LOG_DEBUG(("Additional transfer connection, conn %p", conn));
+
+  if (session->closed ||
+      silc_list_count(session->streams) >= SILC_CLIENT_FTP_MAX_STREAMS - 1)
+    goto err;
+
+  /* Must be the same remote host as in the primary connection */
+  remote_key = silc_client_ftp_remote_key(conn);
+  if (!session->remote_key || !remote_key ||
+      !silc_pkcs_public_key_compare(session->remote_key, remote_key)) {
+    SILC_LOG_DEBUG(("Additional transfer connection with wrong public key"));
+    goto err;
+  }
+
+  stream = silc_calloc(1, sizeof(*stream));
+  if (!stream)
+    goto err;
+  stream->session = session;
+
+  /* Wrap the connection packet stream and start SFTP server */
+  stream->stream = silc_packet_stream_wrap(conn->stream, SILC_PACKET_FTP,
+					   0, FALSE, 0, NULL, 0, NULL,
+					   silc_client_ftp_coder, stream);
+  if (stream->stream)
+    stream->sftp = silc_sftp_server_start(stream->stream,
+					  conn->internal->schedule,
+					  silc_client_ftp_error, stream,
+					  session->fs);
+  if (!stream->sftp) {
+    if (stream->stream)
+      silc_stream_destroy(stream->stream);
+    silc_free(stream);
+    goto err;
+  }
+
+  /* Monitor transmission */
+  silc_sftp_server_set_monitor(stream->sftp, SILC_SFTP_MONITOR_READ,
+			       silc_client_ftp_monitor, session);
+
+  stream->conn = conn;
+  silc_list_add(session->streams, stream);
+  return TRUE;
+
+ err:
+  conn->callback = NULL;
+  silc_client_close_connection(session->client, conn);
+  return TRUE;
+}
+
 /* FTP Connection callback.  The SFTP session is started here. */
 
 static void
@@ -520,6 +1710,11 @@ silc_client_ftp_connect_completion(SilcClient client,
 				   void *context)
 {
   SilcClientFtpSession session = context;
+  SilcPublicKey remote_key;
+
+  /* Additional transfer connections are handled separately */
+  if (silc_client_ftp_stream_accept(session, conn, status))
+    return;
 
   session->conn = conn;
   session->op = NULL;
@@ -555,6 +1750,12 @@ silc_client_ftp_connect_completion(SilcClient client,
 					     silc_client_ftp_version,
 					     silc_client_ftp_error, session);
     } else {
+      /* Additional transfer connections are accepted only with the same
+	 public key */
+      remote_key = silc_client_ftp_remote_key(conn);
+      if (remote_key)
+	session->remote_key = silc_pkcs_public_key_copy(remote_key);
+
       /* Start SFTP server */
       session->sftp = silc_sftp_server_start(session->stream,
 					     conn->internal->schedule,
@@ -710,6 +1911,7 @@ silc_client_file_send(SilcClient client,
   session->monitor = monitor;
   session->monitor_context = monitor_context;
   session->filepath = strdup(filepath);
+  silc_list_init(session->streams, struct SilcClientFtpStreamStruct, next);
   session->params = *params;
   session->public_key = public_key;
   session->private_key = private_key;
@@ -842,6 +2044,13 @@ silc_client_file_receive(SilcClient client,
   session->ask_name = ask_name;
   session->ask_name_context = ask_name_context;
   session->path = path ? strdup(path) : NULL;
+  session->read_window_max = (params && params->ftp_read_window ?
+			      params->ftp_read_window :
+			      SILC_CLIENT_FTP_READ_WINDOW);
+  if (params)
+    session->params = *params;
+  session->public_key = public_key;
+  session->private_key = private_key;
 
   /* If the hostname and port already exists then the remote client did
      provide the connection point to us and we won't create listener, but
@@ -1062,6 +2271,7 @@ SILC_FSM_STATE(silc_client_ftp)
     session->server_conn = conn;
     session->client_entry = silc_client_ref_client(client, conn,
 						   remote_client);
+    silc_list_init(session->streams, struct SilcClientFtpStreamStruct, next);
     if (hostname && port) {
       session->hostname = strdup(hostname);
       session->port = port;
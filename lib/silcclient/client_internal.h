@@ -73,6 +73,9 @@ typedef struct SilcClientCommandReplyCallbackStruct  {
   unsigned int do_not_call     : 1;   /* Set to not call the callback */
 } *SilcClientCommandReplyCallback;
 
+/* Client resolving batch, see client_entry.c */
+typedef struct SilcClientResolveBatchStruct *SilcClientResolveBatch;
+
 /* Command context given as argument to command state functions.  This same
    context is used when calling, sending and procesing command and command
    reply. */
@@ -96,6 +99,8 @@ typedef struct SilcClientCommandContextStruct {
   unsigned int called        : 1;     /* Set when called by application */
   unsigned int verbose       : 1;     /* Verbose with 'say' client operation */
   unsigned int resolved      : 1;     /* Set when resolving something */
+  unsigned int processing    : 1;     /* Set when processing reply in steps */
+  unsigned int reserved      : 1;     /* Set when pending before sent */
 } *SilcClientCommandContext;
 
 /* Internal context for the client->internal pointer in the SilcClient. */
@@ -113,6 +118,8 @@ struct SilcClientInternalStruct {
   void *running_context;		 /* Context for runnign callback */
   SilcAtomic32 conns;			 /* Number of connections in client */
   SilcUInt16 next_session_id;		 /* Next FTP session ID */
+  SilcIdentifierCache idcache;		 /* Normalized identifier cache */
+  SilcMessageVerifier verifier;		 /* Message signature verifier */
 
   /* Events */
   unsigned int stop              : 1;	 /* Stop client */
@@ -142,6 +149,10 @@ struct SilcClientConnectionInternalStruct {
   SilcStream user_stream;		 /* Low level stream in connecting */
   char *disconnect_message;		 /* Disconnection message */
   char *away_message;		         /* Away message */
+  SilcChannelEntry join_batch_channel;	 /* Channel of batched JOINs */
+  SilcDList join_batch;			 /* Batched JOIN clients */
+  SilcHashTable resolving;		 /* Client IDs being resolved */
+  SilcClientResolveBatch resolve_batch;	 /* Client resolving batch */
 
   SilcIDCache client_cache;		 /* Client entry cache */
   SilcIDCache channel_cache;		 /* Channel entry cache */
@@ -179,6 +190,21 @@ void silc_client_del_connection(SilcClient client, SilcClientConnection conn);
 void silc_client_fsm_destructor(SilcFSM fsm, void *fsm_context,
 				void *destructor_context);
 void silc_client_command_free(SilcClientCommandContext cmd);
+SilcClientCommandContext
+silc_client_command_reserve(SilcClient client, SilcClientConnection conn,
+			    SilcCommand command, SilcClientCommandReply reply,
+			    void *reply_context);
+SilcUInt16
+silc_client_command_send_arg_array(SilcClient client,
+				   SilcClientConnection conn,
+				   SilcClientCommandContext cmd,
+				   SilcCommand command,
+				   SilcClientCommandReply reply,
+				   void *reply_context,
+				   SilcUInt32 argc,
+				   unsigned char **argv,
+				   SilcUInt32 *argv_lens,
+				   SilcUInt32 *argv_types);
 SilcClientConnection
 silc_client_add_connection(SilcClient client,
 			   SilcConnectionType conn_type,
@@ -100,12 +100,82 @@ static SilcBool silc_client_notify_wait_continue(SilcClient client,
   return TRUE;
 }
 
+/* Batched JOIN notifies are delivered from timeout after all packets
+   received at the same time have been processed. */
+
+SILC_TASK_CALLBACK(silc_client_notify_flush_timeout)
+{
+  SilcClientConnection conn = context;
+  silc_client_notify_flush(conn->client, conn);
+}
+
+/* Delivers the batched JOIN notifies to application.  After application
+   has closed the connection they are not delivered anymore, and the batch
+   is freed with the connection. */
+
+void silc_client_notify_flush(SilcClient client, SilcClientConnection conn)
+{
+  SilcChannelEntry channel = conn->internal->join_batch_channel;
+  SilcDList clients = conn->internal->join_batch;
+
+  if (!clients || conn->internal->disconnected)
+    return;
+
+  SILC_LOG_DEBUG(("Deliver %d batched JOINs to %s", silc_dlist_count(clients),
+		  channel->channel_name));
+
+  conn->internal->join_batch_channel = NULL;
+  conn->internal->join_batch = NULL;
+  silc_schedule_task_del_by_all(conn->internal->schedule, 0,
+				silc_client_notify_flush_timeout, conn);
+
+  /* Notify application */
+  NOTIFY(client, conn, SILC_NOTIFY_TYPE_JOIN_MANY, channel, clients);
+
+  silc_client_list_free(client, conn, clients);
+  silc_client_unref_channel(client, conn, channel);
+}
+
+/* Adds JOIN of `client_entry' to `channel' to the JOIN batch.  Takes
+   the reference of `client_entry'. */
+
+static SilcBool silc_client_notify_batch_join(SilcClient client,
+					      SilcClientConnection conn,
+					      SilcChannelEntry channel,
+					      SilcClientEntry client_entry)
+{
+  /* Batch holds JOINs to one channel only.  JOINs to other channels are
+     dropped if the batch is not delivered because connection is closed. */
+  if (conn->internal->join_batch_channel != channel) {
+    silc_client_notify_flush(client, conn);
+    if (conn->internal->join_batch) {
+      silc_client_unref_client(client, conn, client_entry);
+      return TRUE;
+    }
+  }
+
+  if (!conn->internal->join_batch) {
+    conn->internal->join_batch = silc_dlist_init();
+    if (!conn->internal->join_batch)
+      return FALSE;
+    conn->internal->join_batch_channel = silc_client_ref_channel(client, conn,
+								 channel);
+    silc_schedule_task_add_timeout(conn->internal->schedule,
+				   silc_client_notify_flush_timeout, conn,
+				   0, 0);
+  }
+
+  silc_dlist_add(conn->internal->join_batch, client_entry);
+  return TRUE;
+}
+
 /********************************* Notify ***********************************/
 
 /* Process received notify packet */
 
 SILC_FSM_STATE(silc_client_notify)
 {
+  SilcClientConnection conn = fsm_context;
   SilcPacket packet = state_context;
   SilcClientNotify notify;
   SilcNotifyPayload payload;
@@ -137,6 +207,10 @@ SILC_FSM_STATE(silc_client_notify)
   notify->fsm = fsm;
   silc_fsm_set_state_context(fsm, notify);
 
+  /* Deliver batched JOINs before anything else about the channel */
+  if (silc_notify_get_type(payload) != SILC_NOTIFY_TYPE_JOIN)
+    silc_client_notify_flush(conn->client, conn);
+
   /* Process the notify */
   switch (silc_notify_get_type(payload)) {
 
@@ -425,6 +499,15 @@ SILC_FSM_STATE(silc_client_notify_join)
   silc_rwlock_unlock(channel->internal.lock);
   silc_rwlock_unlock(client_entry->internal.lock);
 
+  /* In batch notify mode application gets the JOINs of other clients
+     later in one SILC_NOTIFY_TYPE_JOIN_MANY */
+  if (conn->internal->params.batch_notify &&
+      client_entry != conn->local_entry &&
+      silc_client_notify_batch_join(client, conn, channel, client_entry))
+    goto out;
+
+  silc_client_notify_flush(client, conn);
+
   /* Notify application. */
   NOTIFY(client, conn, type, client_entry, channel);
 
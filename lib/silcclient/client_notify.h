@@ -40,4 +40,6 @@ SILC_FSM_STATE(silc_client_notify_server_signoff);
 SILC_FSM_STATE(silc_client_notify_error);
 SILC_FSM_STATE(silc_client_notify_watch);
 
+void silc_client_notify_flush(SilcClient client, SilcClientConnection conn);
+
 #endif /* CLIENT_NOTIFY_H */
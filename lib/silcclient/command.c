@@ -312,9 +312,11 @@ static SilcUInt16 silc_client_command_send_vap(SilcClient client,
 
 /* Generic function to send any command. The arguments must be sent already
    encoded into correct format and in correct order.  Arguments come from
-   arrays. */
+   arrays.  Command reserved with silc_client_command_reserve is pending
+   already, and if it cannot be sent it fails, calling its callbacks with
+   error.  Used internally by the library. */
 
-static SilcUInt16
+SilcUInt16
 silc_client_command_send_arg_array(SilcClient client,
 				   SilcClientConnection conn,
 				   SilcClientCommandContext cmd,
@@ -326,12 +328,12 @@ silc_client_command_send_arg_array(SilcClient client,
 				   SilcUInt32 *argv_lens,
 				   SilcUInt32 *argv_types)
 {
-  SilcBuffer packet;
+  SilcBuffer packet = NULL;
 
   SILC_LOG_DEBUG(("Send command %s", silc_get_command_name(command)));
 
   if (conn->internal->disconnected)
-    return 0;
+    goto err;
 
   if (!cmd->cmd_ident)
     cmd->cmd_ident = silc_client_cmd_ident(conn);
@@ -340,21 +342,30 @@ silc_client_command_send_arg_array(SilcClient client,
   packet = silc_command_payload_encode(command, argc, argv, argv_lens,
 				       argv_types, cmd->cmd_ident);
   if (!packet)
-    return 0;
+    goto err;
 
   /* Send the command */
   if (!silc_packet_send(conn->stream, SILC_PACKET_COMMAND, 0,
-			silc_buffer_datalen(packet))) {
-    silc_buffer_free(packet);
-    return 0;
-  }
+			silc_buffer_datalen(packet)))
+    goto err;
 
   /* Add the command pending command reply */
-  silc_client_command_add_pending(conn, cmd, reply, reply_context);
+  if (!cmd->reserved)
+    silc_client_command_add_pending(conn, cmd, reply, reply_context);
 
   silc_buffer_free(packet);
 
   return cmd->cmd_ident;
+
+ err:
+  silc_buffer_free(packet);
+
+  /* Reserved command has callers waiting for it already */
+  if (cmd->reserved) {
+    silc_fsm_next(&cmd->thread, silc_client_command_reply_not_sent);
+    silc_fsm_continue_sync(&cmd->thread);
+  }
+  return 0;
 }
 
 /* Generic function to send any command. The arguments must be sent already
@@ -585,6 +596,42 @@ SilcUInt16 silc_client_command_send_argv(SilcClient client,
   return cmd->cmd_ident;
 }
 
+/* Reserves command identifier for `command' that is sent later with
+   silc_client_command_send_arg_array.  The command is pending a reply
+   already, so callers may attach to it with silc_client_command_pending
+   before it is sent.  Used internally by the library. */
+
+SilcClientCommandContext
+silc_client_command_reserve(SilcClient client, SilcClientConnection conn,
+			    SilcCommand command, SilcClientCommandReply reply,
+			    void *reply_context)
+{
+  SilcClientCommandContext cmd;
+
+  if (conn->internal->disconnected)
+    return NULL;
+
+  cmd = silc_calloc(1, sizeof(*cmd));
+  if (!cmd)
+    return NULL;
+  cmd->conn = conn;
+  cmd->cmd = command;
+  cmd->cmd_ident = silc_client_cmd_ident(conn);
+  cmd->reserved = TRUE;
+
+  if (!silc_client_command_add_pending(conn, cmd, reply, reply_context)) {
+    silc_client_command_free(cmd);
+    return NULL;
+  }
+
+  /*** Wait for command reply */
+  silc_fsm_thread_init(&cmd->thread, &conn->internal->fsm, cmd,
+		       silc_client_command_destructor, NULL, FALSE);
+  silc_fsm_start_sync(&cmd->thread, silc_client_command_reply_wait);
+
+  return cmd;
+}
+
 /* Attach to a command and command identifier to receive command reply. */
 
 SilcBool silc_client_command_pending(SilcClientConnection conn,
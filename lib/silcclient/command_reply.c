@@ -186,7 +186,7 @@ SILC_FSM_STATE(silc_client_command_reply)
   silc_list_start(conn->internal->pending_commands);
   while ((cmd = silc_list_get(conn->internal->pending_commands))) {
     if ((cmd->cmd == command || cmd->cmd == SILC_COMMAND_NONE)
-	&& cmd->cmd_ident == cmd_ident) {
+	&& cmd->cmd_ident == cmd_ident && !cmd->processing) {
       silc_list_del(conn->internal->pending_commands, cmd);
       break;
     }
@@ -251,6 +251,25 @@ SILC_FSM_STATE(silc_client_command_reply_timeout)
   return SILC_FSM_FINISH;
 }
 
+/* Reserved command could not be sent.  Its callers get the error that
+   callers of other commands get when sending fails. */
+
+SILC_FSM_STATE(silc_client_command_reply_not_sent)
+{
+  SilcClientCommandContext cmd = fsm_context;
+  SilcClientConnection conn = cmd->conn;
+  SilcArgumentPayload args = NULL;
+
+  SILC_LOG_DEBUG(("Command %s not sent", silc_get_command_name(cmd->cmd)));
+
+  silc_mutex_lock(conn->internal->lock);
+  silc_list_del(conn->internal->pending_commands, cmd);
+  silc_mutex_unlock(conn->internal->lock);
+  cmd->status = SILC_STATUS_OK;
+  ERROR_CALLBACK(SILC_STATUS_ERR_RESOURCE_LIMIT);
+  return SILC_FSM_FINISH;
+}
+
 /* Process received command reply payload */
 
 SILC_FSM_STATE(silc_client_command_reply_process)
@@ -1849,6 +1868,22 @@ SILC_FSM_STATE(silc_client_command_reply_leave)
 
 /********************************* USERS ************************************/
 
+/* The users in USERS reply are resolved and added to the channel this many
+   at a time, so that joining a very large channel does not send one huge
+   WHOIS or keep the channel locked for long.  Command can have at most 255
+   arguments. */
+#define SILC_CLIENT_USERS_CHUNK 255
+
+/* USERS reply processing context */
+typedef struct {
+  SilcChannelEntry channel;
+  SilcBufferStruct client_id_list;	/* Client IDs not yet added */
+  SilcBufferStruct client_mode_list;	/* Client modes not yet added */
+  SilcUInt32 list_count;		/* Number of users not yet added */
+  SilcUInt32 pending;			/* Number of chunks being resolved */
+  SilcUInt32 resolved;			/* Number of chunks resolved */
+} *SilcClientCommandReplyUsers;
+
 /* Continue USERS command reply processing after resolving unknown users */
 
 static void
@@ -1859,9 +1894,60 @@ silc_client_command_reply_users_resolved(SilcClient client,
 					 void *context)
 {
   SilcClientCommandContext cmd = context;
-  SILC_FSM_CALL_CONTINUE(&cmd->thread);
+  SilcClientCommandReplyUsers u = cmd->context;
+
+  u->resolved++;
+  if (!--u->pending)
+    SILC_FSM_CALL_CONTINUE(&cmd->thread);
 }
 
+/* Resolves the users we do not know about.  Each chunk of the list is
+   resolved with its own WHOIS, all sent at once. */
+
+static void
+silc_client_command_reply_users_resolve(SilcClient client,
+					SilcClientConnection conn,
+					SilcClientCommandContext cmd)
+{
+  SilcClientCommandReplyUsers u = cmd->context;
+  SilcBufferStruct chunk;
+  unsigned char *data = silc_buffer_data(&u->client_id_list);
+  SilcUInt32 len = silc_buffer_len(&u->client_id_list);
+  SilcUInt32 i, count, resolved;
+  SilcUInt16 idp_len;
+
+  u->pending = 1;
+
+  for (i = 0; i < u->list_count; i += count) {
+    silc_buffer_set(&chunk, data, 0);
+    for (count = 0; count < SILC_CLIENT_USERS_CHUNK &&
+	   i + count < u->list_count; count++) {
+      if (len < 4)
+	break;
+      SILC_GET16_MSB(idp_len, data + 2);
+      idp_len += 4;
+      if (idp_len > len)
+	break;
+      data += idp_len;
+      len -= idp_len;
+    }
+    if (!count)
+      break;
+    silc_buffer_set(&chunk, silc_buffer_data(&chunk),
+		    data - silc_buffer_data(&chunk));
+
+    /* The completion is not called if resolving could not be started */
+    u->pending++;
+    resolved = u->resolved;
+    if (!silc_client_get_clients_by_list(client, conn, count, &chunk,
+				silc_client_command_reply_users_resolved,
+				cmd) && u->resolved == resolved)
+      u->pending--;
+  }
+
+  if (!--u->pending)
+    SILC_FSM_CALL_CONTINUE(&cmd->thread);
+}
 
 /* Continue USERS command after resolving unknown channel */
 
@@ -1896,15 +1982,12 @@ SILC_FSM_STATE(silc_client_command_reply_users)
   SilcClient client = conn->client;
   SilcCommandPayload payload = state_context;
   SilcArgumentPayload args = silc_command_get_args(payload);
+  SilcClientCommandReplyUsers u;
   unsigned char *tmp;
-  SilcUInt32 tmp_len, list_count, mode;
-  SilcUInt16 idp_len;
-  SilcHashTableList htl;
+  SilcUInt32 tmp_len, list_count;
   SilcBufferStruct client_id_list, client_mode_list;
   SilcChannelEntry channel = NULL;
-  SilcClientEntry client_entry;
   SilcID id;
-  int i;
 
   /* Sanity checks */
   CHECK_STATUS("Cannot get users: ");
@@ -1942,16 +2025,6 @@ SILC_FSM_STATE(silc_client_command_reply_users)
   }
   silc_buffer_set(&client_id_list, tmp, tmp_len);
 
-  /* Resolve users we do not know about */
-  if (!cmd->resolved) {
-    cmd->resolved = TRUE;
-    silc_client_unref_channel(client, conn, channel);
-    SILC_FSM_CALL(silc_client_get_clients_by_list(
-			  client, conn, list_count, &client_id_list,
-			  silc_client_command_reply_users_resolved, cmd));
-    /* NOT REACHED */
-  }
-
   /* Get client mode list */
   tmp = silc_argument_get_arg_type(args, 5, &tmp_len);
   if (!tmp) {
@@ -1962,17 +2035,91 @@ SILC_FSM_STATE(silc_client_command_reply_users)
 
   SILC_LOG_DEBUG(("channel %s, %d users", channel->channel_name, list_count));
 
+  u = silc_calloc(1, sizeof(*u));
+  if (!u) {
+    ERROR_CALLBACK(SILC_STATUS_ERR_RESOURCE_LIMIT);
+    goto out;
+  }
+  u->channel = channel;
+  u->client_id_list = client_id_list;
+  u->client_mode_list = client_mode_list;
+  u->list_count = list_count;
+  cmd->context = u;
+
+  /* The command stays in pending commands until the users have been added,
+     so that notifies for the channel wait for it.  Replies are not given to
+     it anymore. */
+  silc_mutex_lock(conn->internal->lock);
+  cmd->processing = TRUE;
+  silc_list_add(conn->internal->pending_commands, cmd);
+  silc_mutex_unlock(conn->internal->lock);
+  channel->internal.resolve_cmd_ident = cmd->cmd_ident;
+
+  /* Make room for all users at once */
+  silc_rwlock_wrlock(channel->internal.lock);
+  silc_hash_table_rehash(channel->user_list,
+			 silc_hash_table_count(channel->user_list) +
+			 list_count);
+  silc_rwlock_unlock(channel->internal.lock);
+
+  /** Resolve users we do not know about */
+  silc_fsm_next(fsm, silc_client_command_reply_users_add);
+  SILC_FSM_CALL(silc_client_command_reply_users_resolve(client, conn, cmd));
+  /* NOT REACHED */
+
+ out:
+  silc_client_unref_channel(client, conn, channel);
+  silc_fsm_next(fsm, silc_client_command_reply_processed);
+  return SILC_FSM_CONTINUE;
+}
+
+/* Adds the users of USERS reply to the channel, a chunk at a time.  The
+   channel is unlocked and other threads run between the chunks.  LEAVE
+   and KICK notifies for the channel wait until all users have been added,
+   so a stale list cannot undo them. */
+
+SILC_FSM_STATE(silc_client_command_reply_users_add)
+{
+  SilcClientCommandContext cmd = fsm_context;
+  SilcClientConnection conn = cmd->conn;
+  SilcClient client = conn->client;
+  SilcCommandPayload payload = state_context;
+  SilcArgumentPayload args = silc_command_get_args(payload);
+  SilcClientCommandReplyUsers u = cmd->context;
+  SilcChannelEntry channel = u->channel;
+  SilcClientEntry client_entry;
+  SilcHashTableList htl;
+  SilcUInt32 mode;
+  SilcUInt16 idp_len;
+  SilcStatus error = SILC_STATUS_OK;
+  SilcID id;
+  int i;
+
+  /* Connection was closed while resolving or between chunks */
+  if (conn->internal->disconnected) {
+    error = SILC_STATUS_ERR_TIMEDOUT;
+    goto out;
+  }
+
   silc_rwlock_wrlock(channel->internal.lock);
 
   /* Cache the received Client ID's and modes. */
-  for (i = 0; i < list_count; i++) {
-    SILC_GET16_MSB(idp_len, client_id_list.data + 2);
+  for (i = 0; i < SILC_CLIENT_USERS_CHUNK && u->list_count; i++) {
+    if (silc_buffer_len(&u->client_id_list) < 4 ||
+	silc_buffer_len(&u->client_mode_list) < 4) {
+      error = SILC_STATUS_ERR_NOT_ENOUGH_PARAMS;
+      break;
+    }
+
+    SILC_GET16_MSB(idp_len, u->client_id_list.data + 2);
     idp_len += 4;
-    if (!silc_id_payload_parse_id(client_id_list.data, idp_len, &id))
-      goto out;
+    if (!silc_id_payload_parse_id(u->client_id_list.data, idp_len, &id)) {
+      error = SILC_STATUS_ERR_NOT_ENOUGH_PARAMS;
+      break;
+    }
 
     /* Mode */
-    SILC_GET32_MSB(mode, client_mode_list.data);
+    SILC_GET32_MSB(mode, u->client_mode_list.data);
 
     /* Save the client on this channel.  Unknown clients are ignored as they
        clearly do not exist since the resolving didn't find them. */
@@ -1984,24 +2131,42 @@ SILC_FSM_STATE(silc_client_command_reply_users)
     }
     silc_client_unref_client(client, conn, client_entry);
 
-    if (!silc_buffer_pull(&client_id_list, idp_len)) {
-      silc_rwlock_unlock(channel->internal.lock);
-      goto out;
-    }
-    if (!silc_buffer_pull(&client_mode_list, 4)) {
-      silc_rwlock_unlock(channel->internal.lock);
-      goto out;
+    if (!silc_buffer_pull(&u->client_id_list, idp_len) ||
+	!silc_buffer_pull(&u->client_mode_list, 4)) {
+      error = SILC_STATUS_ERR_NOT_ENOUGH_PARAMS;
+      break;
     }
+    u->list_count--;
   }
 
   silc_rwlock_unlock(channel->internal.lock);
 
-  /* Notify application */
-  silc_hash_table_list(channel->user_list, &htl);
-  silc_client_command_callback(cmd, channel, &htl);
-  silc_hash_table_list_reset(&htl);
+  /** Add next chunk */
+  if (!error && u->list_count) {
+    silc_fsm_next(fsm, silc_client_command_reply_users_add);
+    return SILC_FSM_YIELD;
+  }
 
  out:
+  /* Done with the list, let the waiting notifies continue */
+  silc_mutex_lock(conn->internal->lock);
+  silc_list_del(conn->internal->pending_commands, cmd);
+  cmd->processing = FALSE;
+  silc_mutex_unlock(conn->internal->lock);
+  if (channel->internal.resolve_cmd_ident == cmd->cmd_ident)
+    channel->internal.resolve_cmd_ident = 0;
+
+  /* Notify application */
+  if (!error) {
+    silc_hash_table_list(channel->user_list, &htl);
+    silc_client_command_callback(cmd, channel, &htl);
+    silc_hash_table_list_reset(&htl);
+  } else {
+    ERROR_CALLBACK(error);
+  }
+
+  cmd->context = NULL;
+  silc_free(u);
   silc_client_unref_channel(client, conn, channel);
   silc_fsm_next(fsm, silc_client_command_reply_processed);
   return SILC_FSM_CONTINUE;
@@ -23,6 +23,7 @@
 SILC_FSM_STATE(silc_client_command_reply);
 SILC_FSM_STATE(silc_client_command_reply_wait);
 SILC_FSM_STATE(silc_client_command_reply_timeout);
+SILC_FSM_STATE(silc_client_command_reply_not_sent);
 SILC_FSM_STATE(silc_client_command_reply_process);
 SILC_FSM_STATE(silc_client_command_reply_processed);
 SILC_FSM_STATE(silc_client_command_reply_whois);
@@ -49,6 +50,7 @@ SILC_FSM_STATE(silc_client_command_reply_watch);
 SILC_FSM_STATE(silc_client_command_reply_silcoper);
 SILC_FSM_STATE(silc_client_command_reply_leave);
 SILC_FSM_STATE(silc_client_command_reply_users);
+SILC_FSM_STATE(silc_client_command_reply_users_add);
 SILC_FSM_STATE(silc_client_command_reply_getkey);
 SILC_FSM_STATE(silc_client_command_reply_service);
 SILC_FSM_STATE(silc_client_command_reply_quit);
@@ -497,6 +497,29 @@ typedef enum {
 } SilcClientMessageType;
 /***/
 
+/****d* silcclient/SilcClientAPI/SILC_NOTIFY_TYPE_JOIN_MANY
+ *
+ * NAME
+ *
+ *    #define SILC_NOTIFY_TYPE_JOIN_MANY
+ *
+ * DESCRIPTION
+ *
+ *    Notify type delivered by the client library with the `notify' client
+ *    operation when the `batch_notify' connection parameter is set.  It
+ *    is never sent by server.  The arguments are:
+ *
+ *    (SilcChannelEntry) channel, (SilcDList) clients
+ *
+ *    The `clients' is a list of SilcClientEntry that have joined the
+ *    `channel', in the order they joined.  The list and the entries are
+ *    valid only for the duration of the callback.
+ *
+ * SOURCE
+ */
+#define SILC_NOTIFY_TYPE_JOIN_MANY       0x8001
+/***/
+
 /****s* silcclient/SilcClientAPI/SilcClientOperations
  *
  * NAME
@@ -964,6 +987,50 @@ typedef struct SilcClientConnectionParamsStruct {
      silc_client_attribute_add for more information on attributes. */
   SilcBool ignore_requested_attributes;
 
+  /* If this is set to TRUE then channel messages with the old style
+     message MAC, used by SILC Toolkit versions older than 1.1, are
+     accepted also when they are encrypted with channel private keys.
+     This requires computing the MAC twice for every private key that does
+     not match the message.  Set this only if the channel has clients that
+     use the old style MAC with private keys.  With the channel key the
+     old style MAC is always accepted. */
+  SilcBool old_message_mac;
+
+  /* Maximum number of outstanding read requests when receiving a file with
+     silc_client_file_receive.  The client adapts the number of requests
+     to the measured round trip time, up to this limit.  If zero, the
+     default value 16 is used.  Set to 1 to read one chunk at a time. */
+  SilcUInt32 ftp_read_window;
+
+  /* Number of parallel connections used when receiving a file with
+     silc_client_file_receive.  The file is read in chunks striped across
+     the connections.  Additional connections are made only when we
+     connect to the sender, ie. the sender provided the connection point.
+     The sender accepts them only with the same public key that was used
+     in the first connection.  If zero or one, only one connection is
+     used. */
+  SilcUInt32 ftp_streams;
+
+  /* If TRUE, silc_client_file_receive records the received chunks into
+     a `<file>.silcpart' file next to the received file.  If the transfer
+     is interrupted, receiving the same file again to the same path
+     continues from where it was left, requesting only the missing chunks.
+     The chunks are resumed only if the sender's file has the same size and
+     modification time, and the received file is truncated to the last
+     recorded chunk.  The `.silcpart' file is removed once the file has
+     been received. */
+  SilcBool ftp_resume;
+
+  /* If TRUE, SILC_NOTIFY_TYPE_JOIN notifies of other clients are delivered
+     in batches.  JOINs to the same channel received back to back, like
+     when servers join after a netsplit, are delivered to the application
+     in one SILC_NOTIFY_TYPE_JOIN_MANY notify.  The batch is delivered
+     before any other packet is processed, so the order of notifies and
+     messages is not changed.  JOINs not yet delivered when the connection
+     is closed are not delivered at all.  Own JOINs are always delivered
+     as SILC_NOTIFY_TYPE_JOIN. */
+  SilcBool batch_notify;
+
   /* User context for SilcClientConnection.  If non-NULL this context is
      set to the 'context' field in SilcClientConnection when the connection
      context is created. */
@@ -1312,6 +1379,40 @@ SilcBool silc_client_private_message_wait(SilcClient client,
 					  SilcClientEntry client_entry,
 					  SilcMessagePayload *payload);
 
+/****f* silcclient/SilcClientAPI/silc_client_verify_message_signature
+ *
+ * SYNOPSIS
+ *
+ *    SilcAsyncOperation
+ *    silc_client_verify_message_signature(SilcClient client,
+ *                                         SilcMessagePayload payload,
+ *                                         SilcPublicKey public_key,
+ *                                         SilcHash hash,
+ *                                         SilcMessageVerifyCb callback,
+ *                                         void *context);
+ *
+ * DESCRIPTION
+ *
+ *    Verifies the digital signature of a signed channel or private message
+ *    `payload' with the `public_key' asynchronously.  The signature is
+ *    verified in a worker thread, and the `callback' is called from the
+ *    client's scheduler with the result.  Application can use this to
+ *    display signed messages immediately and to mark them verified later,
+ *    for example when lots of signed messages are received at once.  The
+ *    `payload', `public_key' and `hash' may be freed after this function
+ *    returns.  If this returns NULL the `callback' is not called, and the
+ *    message should be verified with silc_message_signed_verify.  See
+ *    silc_message_signed_verify_async for details.
+ *
+ ***/
+SilcAsyncOperation
+silc_client_verify_message_signature(SilcClient client,
+				     SilcMessagePayload payload,
+				     SilcPublicKey public_key,
+				     SilcHash hash,
+				     SilcMessageVerifyCb callback,
+				     void *context);
+
 /****f* silcclient/SilcClientAPI/silc_client_on_channel
  *
  * SYNOPSIS
@@ -2095,6 +2196,7 @@ typedef enum {
   SILC_CLIENT_FILE_CONNECT_FAILED,	     /* Error during connecting */
   SILC_CLIENT_FILE_TIMEOUT,	             /* Connecting timedout */
   SILC_CLIENT_FILE_NO_MEMORY,		     /* System out of memory */
+  SILC_CLIENT_FILE_INTEGRITY_FAILED,	     /* Received file is corrupted */
 } SilcClientFileError;
 /***/
 
@@ -2282,6 +2384,11 @@ silc_client_file_send(SilcClient client,
  *
  *    The `public_key' and `private_key' is our identity in the key agreement.
  *
+ *    If the sender provides the tree hash of the file, each received chunk
+ *    is verified against it and corrupted chunks are received again.  If
+ *    the file cannot be verified the SILC_CLIENT_FILE_INTEGRITY_FAILED
+ *    error is returned in the monitor callback.
+ *
  *    If error will occur during the file transfer process the error status
  *    will be returned in the monitor callback.  In this case the application
  *    must call silc_client_file_close to close the session.
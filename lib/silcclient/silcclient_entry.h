@@ -443,6 +443,37 @@ SilcDList silc_client_get_clients_local(SilcClient client,
 					const char *nickname,
 					SilcBool return_all);
 
+/****f* silcclient/SilcClientAPI/silc_client_get_clients_local_by_prefix
+ *
+ * SYNOPSIS
+ *
+ *    SilcDList
+ *    silc_client_get_clients_local_by_prefix(SilcClient client,
+ *                                            SilcClientConnection conn,
+ *                                            const char *prefix);
+ *
+ * DESCRIPTION
+ *
+ *    Returns all valid clients from the local cache whose nickname begins
+ *    with `prefix'.  This does not resolve anything from the server.  The
+ *    clients are returned sorted by the normalized nickname.  This can be
+ *    used for example in nickname completion.  If none was found this
+ *    returns NULL.
+ *
+ * NOTES
+ *
+ *    If the application stores any of the SilcClientEntry pointers from
+ *    the returned list it must reference it with silc_client_ref_client
+ *    function.
+ *
+ *    Application must free the returned list with silc_client_list_free
+ *    function.
+ *
+ ***/
+SilcDList silc_client_get_clients_local_by_prefix(SilcClient client,
+						  SilcClientConnection conn,
+						  const char *prefix);
+
 /****f* silcclient/SilcClientAPI/silc_client_get_client_by_id
  *
  * SYNOPSIS
@@ -0,0 +1,1246 @@
+/* Command reply and notify processing tests.  The client is connected to
+   a fake server over a local socket pair, without key exchange and
+   registering.  The server runs in its own thread and answers the commands
+   the client sends, including the WHOIS queries sent to resolve unknown
+   users. */
+
+#include "silc.h"
+#include "silcclient.h"
+#include "../client_internal.h"
+#include <sys/socket.h>
+#include <signal.h>
+
+/* Number of users in USERS reply, about as many as fit in one packet */
+#define USERS 2500
+
+/* Users from this on do not exist */
+#define NO_SUCH_USER (USERS + 1)
+
+/* Users resolved by ID at the same time.  Most are resolved twice. */
+static const SilcUInt32 resolve_users[] =
+  { 1, 2, 3, NO_SUCH_USER, 1, 2, NO_SUCH_USER + 1, 3 };
+#define RESOLVES (sizeof(resolve_users) / sizeof(resolve_users[0]))
+#define RESOLVE_IDS 5
+
+/* Users joining and leaving the channel in the notify test, 1 - JOINERS */
+#define JOINERS 5
+
+/* Notifies sent in the notify test, in this order.  The client closes the
+   connection when user 3 leaves, and the JOINs after that are not
+   delivered. */
+static const struct {
+  SilcNotifyType type;
+  SilcUInt32 user;
+} joins[] = {
+  { SILC_NOTIFY_TYPE_JOIN, 1 },
+  { SILC_NOTIFY_TYPE_JOIN, 2 },
+  { SILC_NOTIFY_TYPE_JOIN, 3 },
+  { SILC_NOTIFY_TYPE_LEAVE, 2 },
+  { SILC_NOTIFY_TYPE_JOIN, 4 },
+  { SILC_NOTIFY_TYPE_LEAVE, 3 },
+  { SILC_NOTIFY_TYPE_JOIN, 2 },
+  { SILC_NOTIFY_TYPE_JOIN, 5 },
+};
+#define JOINS (sizeof(joins) / sizeof(joins[0]))
+
+/* Notifies the application gets, J for JOIN_MANY with the users joined */
+#define JOINS_RECEIVED "J123 L2 J4 L3"
+
+/* Channel messages sent in the message test, in this order */
+enum {
+  MESSAGE_KEY,			/* With channel key */
+  MESSAGE_KEY_OLD_MAC,		/* With channel key and old style MAC */
+  MESSAGE_KEY_LAST,		/* With channel key */
+  MESSAGE_PRIVATE,		/* With private key */
+  MESSAGE_PRIVATE_OLD_MAC,	/* With private key and old style MAC */
+  MESSAGE_LAST,			/* With private key */
+  MESSAGES
+};
+
+/* Result of resolving one user */
+typedef struct {
+  struct TestStruct *t;
+  SilcUInt32 user;
+  SilcStatus status;
+  SilcUInt32 clients;		/* Clients given to the caller */
+  SilcBool own;			/* The client given is the one resolved */
+} TestResolve;
+
+typedef struct TestStruct {
+  SilcClient client;
+  SilcClientConnection conn;
+  SilcSchedule schedule;	/* Server's scheduler */
+  SilcRng rng;
+  SilcPacketEngine engine;	/* Server's packet engine */
+  SilcPacketStream stream;	/* Server's end of the connection */
+  int fd;			/* Client's end of the connection */
+  SilcChannelID channel_id;
+  SilcChannelEntry channel;
+
+  /* Test parameters */
+  SilcBool leave;		/* Last user leaves after resolving */
+  SilcBool close_resolving;	/* Close connection while resolving */
+  SilcBool close_adding;	/* Close connection while adding users */
+  SilcBool resolve;		/* Resolve users by ID instead of USERS */
+  SilcBool send_fail;		/* Sending the WHOIS fails */
+  SilcBool messages;		/* Send channel messages instead of USERS */
+  SilcBool joins;		/* Send JOINs, in batch notify mode */
+
+  /* Results */
+  SilcUInt32 whois;		/* WHOIS commands received */
+  SilcUInt32 whois_ids;		/* Client IDs queried with WHOIS */
+  SilcUInt32 resolved;		/* Users resolved with WHOIS */
+  SilcUInt32 replies;		/* Command replies received */
+  SilcStatus status;		/* Status of the last reply */
+  SilcUInt32 users;		/* Users on channel after reply */
+  SilcBool server_running;
+  SilcBool done;
+  SilcBool disconnected;
+  SilcInt64 start;		/* When the command was sent */
+  SilcInt64 latency;		/* Time until reply, microseconds */
+  SilcInt64 tick;		/* Last scheduler round */
+  SilcInt64 stall;		/* Longest scheduler round */
+  TestResolve resolves[RESOLVES];
+  SilcUInt32 resolves_done;
+  SilcChannelPrivateKey key;	/* Private key of the messages */
+  SilcUInt32 received;		/* Messages received, bit for each */
+  SilcChannelPrivateKey keys[MESSAGES]; /* Keys of received messages */
+  SilcBool joins_wanted;	/* Client waits for the notifies */
+  SilcBool joins_sent;		/* Server has sent the notifies */
+  char notifies[64];		/* Notifies received */
+  SilcBool joined_wrong;	/* JOIN_MANY user was not on channel */
+  SilcClientEntry joiners[JOINERS + 1]; /* Users, referenced by the test */
+} *Test;
+
+/* Returns Client ID of `i'th user on the test channel */
+
+static void test_client_id(SilcUInt32 i, SilcClientID *id)
+{
+  memset(id, 0, sizeof(*id));
+  id->ip.data_len = 4;
+  id->ip.data[0] = 10;
+  id->rnd = 1;
+  SILC_PUT32_MSB(i, id->hash);
+}
+
+/* Fake server */
+
+/* Sends command reply with `argc' arguments */
+
+static void server_reply(Test t, SilcCommand command, SilcStatus status,
+			 SilcStatus error, SilcUInt16 ident,
+			 SilcUInt32 argc, ...)
+{
+  SilcBuffer reply;
+  va_list ap;
+
+  va_start(ap, argc);
+  reply = silc_command_reply_payload_encode_vap(command, status, error,
+						ident, argc, ap);
+  va_end(ap);
+  if (!reply)
+    return;
+  silc_packet_send(t->stream, SILC_PACKET_COMMAND_REPLY, 0,
+		   silc_buffer_datalen(reply));
+  silc_buffer_free(reply);
+}
+
+/* Sends notify to the test channel */
+
+static void server_notify(Test t, SilcNotifyType type, SilcUInt32 argc, ...)
+{
+  SilcBuffer notify;
+  va_list ap;
+
+  va_start(ap, argc);
+  notify = silc_notify_payload_encode(type, argc, ap);
+  va_end(ap);
+  if (!notify)
+    return;
+  silc_packet_send_ext(t->stream, SILC_PACKET_NOTIFY, 0, 0, NULL,
+		       SILC_ID_CHANNEL, &t->channel_id,
+		       silc_buffer_datalen(notify), NULL, NULL);
+  silc_buffer_free(notify);
+}
+
+/* Sends the notifies of the notify test when the client waits for them,
+   so that they are received at once */
+
+SILC_TASK_CALLBACK(server_joins)
+{
+  Test t = context;
+  SilcBuffer chidp, idp;
+  SilcClientID id;
+  int i;
+
+  if (!t->joins_wanted) {
+    silc_schedule_task_add_timeout(schedule, server_joins, t, 0, 1000);
+    return;
+  }
+
+  chidp = silc_id_payload_encode(&t->channel_id, SILC_ID_CHANNEL);
+  if (!chidp)
+    return;
+
+  for (i = 0; i < JOINS; i++) {
+    test_client_id(joins[i].user, &id);
+    idp = silc_id_payload_encode(&id, SILC_ID_CLIENT);
+    if (!idp)
+      break;
+    if (joins[i].type == SILC_NOTIFY_TYPE_JOIN)
+      server_notify(t, SILC_NOTIFY_TYPE_JOIN, 2, silc_buffer_datalen(idp),
+		    silc_buffer_datalen(chidp));
+    else
+      server_notify(t, SILC_NOTIFY_TYPE_LEAVE, 1, silc_buffer_datalen(idp));
+    silc_buffer_free(idp);
+  }
+
+  silc_buffer_free(chidp);
+  t->joins_sent = TRUE;
+}
+
+/* Replies with all users of the test channel */
+
+static void server_users(Test t, SilcUInt16 ident)
+{
+  SilcBuffer chidp, idp, list, modes;
+  SilcClientID id;
+  unsigned char count[4];
+  int i;
+
+  chidp = silc_id_payload_encode(&t->channel_id, SILC_ID_CHANNEL);
+  list = silc_buffer_alloc(0);
+  modes = silc_buffer_alloc_size(USERS * 4);
+  if (!chidp || !list || !modes)
+    goto out;
+
+  for (i = 0; i < USERS; i++) {
+    test_client_id(i, &id);
+    idp = silc_id_payload_encode(&id, SILC_ID_CLIENT);
+    if (!idp)
+      goto out;
+    if (silc_buffer_format(list, SILC_STR_ADVANCE,
+			   SILC_STR_DATA(silc_buffer_data(idp),
+					 silc_buffer_len(idp)),
+			   SILC_STR_END) < 0) {
+      silc_buffer_free(idp);
+      goto out;
+    }
+    silc_buffer_free(idp);
+    SILC_PUT32_MSB(i == 0 ? SILC_CHANNEL_UMODE_CHANFO : 0,
+		   modes->data + i * 4);
+  }
+  silc_buffer_start(list);
+  SILC_PUT32_MSB(USERS, count);
+
+  server_reply(t, SILC_COMMAND_USERS, SILC_STATUS_OK, SILC_STATUS_OK, ident,
+	       4, 2, silc_buffer_datalen(chidp), 3, count, 4,
+	       4, silc_buffer_datalen(list), 5, silc_buffer_datalen(modes));
+
+ out:
+  silc_buffer_free(chidp);
+  silc_buffer_free(list);
+  silc_buffer_free(modes);
+}
+
+/* Replies with the users queried in WHOIS.  Users that do not exist get
+   error. */
+
+static void server_whois(Test t, SilcUInt16 ident, SilcArgumentPayload args)
+{
+  SilcStatus status;
+  SilcUInt32 argc, type, len, i = 0;
+  unsigned char *tmp;
+  char nick[32];
+  SilcUInt32 n;
+  SilcID id;
+
+  argc = silc_argument_get_arg_num(args);
+  tmp = silc_argument_get_first_arg(args, &type, &len);
+  for (; tmp; tmp = silc_argument_get_next_arg(args, &type, &len), i++) {
+    if (!silc_id_payload_parse_id(tmp, len, &id))
+      continue;
+
+    if (argc == 1)
+      status = SILC_STATUS_OK;
+    else if (i == 0)
+      status = SILC_STATUS_LIST_START;
+    else if (i == argc - 1)
+      status = SILC_STATUS_LIST_END;
+    else
+      status = SILC_STATUS_LIST_ITEM;
+
+    SILC_GET32_MSB(n, id.u.client_id.hash);
+    if (n >= NO_SUCH_USER) {
+      server_reply(t, SILC_COMMAND_WHOIS,
+		   argc == 1 ? SILC_STATUS_ERR_NO_SUCH_CLIENT_ID : status,
+		   SILC_STATUS_ERR_NO_SUCH_CLIENT_ID, ident, 1, 2, tmp, len);
+      continue;
+    }
+
+    t->resolved++;
+    silc_snprintf(nick, sizeof(nick), "user%d", n);
+    server_reply(t, SILC_COMMAND_WHOIS, status, SILC_STATUS_OK, ident,
+		 4, 2, tmp, len, 3, nick, strlen(nick), 4, "user", 4,
+		 5, "User", 4);
+  }
+}
+
+static SilcBool server_receive(SilcPacketEngine engine,
+			       SilcPacketStream stream,
+			       SilcPacket packet,
+			       void *callback_context,
+			       void *stream_context)
+{
+  Test t = stream_context;
+  SilcCommandPayload payload;
+  SilcBuffer idp;
+  SilcClientID id;
+
+  if (packet->type != SILC_PACKET_COMMAND) {
+    silc_packet_free(packet);
+    return TRUE;
+  }
+
+  payload = silc_command_payload_parse(silc_buffer_datalen(&packet->buffer));
+  silc_packet_free(packet);
+  if (!payload)
+    return TRUE;
+
+  switch (silc_command_get(payload)) {
+  case SILC_COMMAND_USERS:
+    server_users(t, silc_command_get_ident(payload));
+    break;
+
+  case SILC_COMMAND_WHOIS:
+    t->whois++;
+    t->whois_ids += silc_argument_get_arg_num(silc_command_get_args(payload));
+    if (t->close_resolving) {
+      /* Do not answer, client closes the connection instead */
+      break;
+    }
+    server_whois(t, silc_command_get_ident(payload),
+		 silc_command_get_args(payload));
+
+    /* Leaves right after the users have been resolved */
+    if (t->leave && t->resolved == USERS) {
+      test_client_id(USERS - 1, &id);
+      idp = silc_id_payload_encode(&id, SILC_ID_CLIENT);
+      if (idp)
+	server_notify(t, SILC_NOTIFY_TYPE_LEAVE, 1,
+		      silc_buffer_datalen(idp));
+      silc_buffer_free(idp);
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  silc_command_payload_free(payload);
+  return TRUE;
+}
+
+static void server_eos(SilcPacketEngine engine, SilcPacketStream stream,
+		       void *callback_context, void *stream_context)
+{
+}
+
+static void server_error(SilcPacketEngine engine, SilcPacketStream stream,
+			 SilcPacketError error, void *callback_context,
+			 void *stream_context)
+{
+}
+
+static SilcPacketCallbacks server_cbs =
+{
+  server_receive, server_eos, server_error
+};
+
+/* Client */
+
+/* Measures how long the client runs without returning to scheduler, and
+   closes the connection while resolving or adding users, if requested. */
+
+SILC_TASK_CALLBACK(test_tick)
+{
+  Test t = context;
+  SilcInt64 now = silc_time_usec();
+
+  if (t->tick && now - t->tick > t->stall)
+    t->stall = now - t->tick;
+  t->tick = now;
+
+  if (t->disconnected)
+    return;
+
+  if (t->close_resolving && t->whois) {
+    t->close_resolving = FALSE;
+    silc_client_close_connection(t->client, t->conn);
+  }
+
+  if (t->close_adding && !t->replies &&
+      silc_hash_table_count(t->channel->user_list)) {
+    t->close_adding = FALSE;
+    silc_client_close_connection(t->client, t->conn);
+  }
+
+  silc_schedule_task_add_timeout(schedule, test_tick, t, 0, 1);
+}
+
+/* Done, close the connection */
+
+SILC_TASK_CALLBACK(test_done)
+{
+  Test t = context;
+
+  if (t->disconnected || t->done)
+    return;
+  t->done = TRUE;
+  t->users = silc_hash_table_count(t->channel->user_list);
+  silc_client_close_connection(t->client, t->conn);
+}
+
+static SilcBool test_users_reply(SilcClient client,
+				 SilcClientConnection conn,
+				 SilcCommand command,
+				 SilcStatus status,
+				 SilcStatus error,
+				 void *context,
+				 va_list ap)
+{
+  Test t = context;
+
+  t->latency = silc_time_usec() - t->start;
+  t->replies++;
+  t->status = error;
+
+  /* Notifies waiting for the reply are processed after this */
+  silc_schedule_task_add_timeout(client->schedule, test_done, t, 0, 1);
+  return FALSE;
+}
+
+/* Each caller must get only the client it resolved */
+
+static void test_resolved(SilcClient client, SilcClientConnection conn,
+			  SilcStatus status, SilcDList clients, void *context)
+{
+  TestResolve *r = context;
+  Test t = r->t;
+  SilcClientEntry entry;
+  SilcClientID id;
+
+  r->status = status;
+  if (clients) {
+    r->clients = silc_dlist_count(clients);
+    test_client_id(r->user, &id);
+    silc_dlist_start(clients);
+    entry = silc_dlist_get(clients);
+    r->own = entry != SILC_LIST_END && SILC_ID_CLIENT_COMPARE(&entry->id, &id);
+  }
+
+  if (++t->resolves_done == RESOLVES)
+    silc_schedule_task_add_timeout(client->schedule, test_done, t, 0, 1);
+}
+
+/* Resolves the users at the same time */
+
+static void test_resolve(Test t)
+{
+  SilcClientID id;
+  int i;
+
+  /* Sending fails when the connection cannot be written */
+  if (t->send_fail)
+    shutdown(t->fd, SHUT_WR);
+
+  for (i = 0; i < RESOLVES; i++) {
+    t->resolves[i].t = t;
+    t->resolves[i].user = resolve_users[i];
+    test_client_id(resolve_users[i], &id);
+    silc_client_get_client_by_id_resolve(t->client, t->conn, &id, NULL,
+					 test_resolved, &t->resolves[i]);
+  }
+}
+
+/* Returns TRUE if `message' can be decrypted with `cipher' */
+
+static SilcBool test_decrypts(SilcBuffer message, SilcCipher cipher,
+			      SilcHmac hmac)
+{
+  SilcMessagePayload payload;
+  unsigned char *data;
+
+  data = silc_memdup(silc_buffer_data(message), silc_buffer_len(message));
+  if (!data)
+    return TRUE;
+  payload = silc_message_payload_parse_ext(data, silc_buffer_len(message),
+					   FALSE, FALSE, cipher, hmac, NULL,
+					   0, NULL, 0, NULL, FALSE, NULL,
+					   FALSE);
+  silc_free(data);
+  if (!payload)
+    return FALSE;
+  silc_message_payload_free(payload);
+  return TRUE;
+}
+
+/* Sends channel message `n' from user 1 through the server.  Old style
+   MAC, computed without the IDs, is used if `old_mac' is TRUE.  If `bad'
+   is given the message is encrypted again until it cannot be decrypted
+   with it; with a wrong key that almost always fails the first time. */
+
+static SilcBool test_message(Test t, int n, SilcCipher cipher, SilcHmac hmac,
+			     SilcBool old_mac, SilcCipher bad)
+{
+  SilcBuffer message = NULL;
+  SilcID sender, receiver;
+  unsigned char mac[SILC_HASH_MAXLEN];
+  SilcUInt32 mac_len;
+  char text[32];
+
+  sender.type = SILC_ID_CLIENT;
+  test_client_id(1, &sender.u.client_id);
+  receiver.type = SILC_ID_CHANNEL;
+  receiver.u.channel_id = t->channel_id;
+  silc_snprintf(text, sizeof(text), "message %d", n);
+
+  do {
+    silc_buffer_free(message);
+    message = silc_message_payload_encode(0, text, strlen(text), TRUE,
+					  FALSE, cipher, hmac,
+					  t->client->rng, NULL, NULL, NULL,
+					  &sender, &receiver, NULL);
+    if (!message)
+      return FALSE;
+  } while (bad && test_decrypts(message, bad, hmac));
+
+  if (old_mac) {
+    mac_len = silc_hmac_len(hmac);
+    silc_hmac_init(hmac);
+    silc_hmac_update(hmac, silc_buffer_data(message),
+		     silc_buffer_len(message) - mac_len);
+    silc_hmac_final(hmac, mac, NULL);
+    memcpy(silc_buffer_data(message) + silc_buffer_len(message) - mac_len,
+	   mac, mac_len);
+  }
+
+  silc_packet_send_ext(t->stream, SILC_PACKET_CHANNEL_MESSAGE, 0,
+		       SILC_ID_CLIENT, &sender.u.client_id,
+		       SILC_ID_CHANNEL, &t->channel_id,
+		       silc_buffer_datalen(message), NULL, NULL);
+  silc_buffer_free(message);
+  return TRUE;
+}
+
+/* Sets channel key and sends messages with it */
+
+static void test_messages(Test t)
+{
+  SilcClient client = t->client;
+  SilcClientConnection conn = t->conn;
+  SilcChannelEntry channel = t->channel;
+  SilcClientEntry sender;
+  SilcBuffer payload;
+  SilcClientID id;
+  unsigned char chid[32], ckey[32];
+  SilcUInt32 chid_len;
+
+  test_client_id(1, &id);
+  sender = silc_client_add_client(client, conn, "user1", "user", "User",
+				  &id, 0);
+  if (!sender || !silc_client_add_to_channel(client, conn, channel,
+					      sender, 0))
+    goto err;
+
+  memset(ckey, 0x11, sizeof(ckey));
+  silc_id_id2str(&t->channel_id, SILC_ID_CHANNEL, chid, sizeof(chid),
+		 &chid_len);
+  payload = silc_channel_key_payload_encode(chid_len, chid, 11,
+					    "aes-256-cbc", sizeof(ckey),
+					    ckey);
+  if (!payload)
+    goto err;
+  if (!silc_client_save_channel_key(client, conn, payload, channel)) {
+    silc_buffer_free(payload);
+    goto err;
+  }
+  silc_buffer_free(payload);
+
+  if (!test_message(t, MESSAGE_KEY, channel->internal.send_key,
+		    channel->internal.hmac, FALSE, NULL) ||
+      !test_message(t, MESSAGE_KEY_OLD_MAC, channel->internal.send_key,
+		    channel->internal.hmac, TRUE, NULL) ||
+      !test_message(t, MESSAGE_KEY_LAST, channel->internal.send_key,
+		    channel->internal.hmac, FALSE, NULL))
+    goto err;
+
+  /* Give up if messages are lost */
+  silc_schedule_task_add_timeout(client->schedule, test_done, t, 10, 0);
+  return;
+
+ err:
+  fprintf(stderr, "Could not send channel messages\n");
+  silc_client_close_connection(client, conn);
+}
+
+/* Sets private keys, after the channel key messages have been received,
+   and sends messages with them.  The first private key has the same MAC
+   key as the second, but different cipher key, so its MAC matches the
+   messages but it cannot decrypt them.  Private key mode is set, so the
+   channel key is not tried for them. */
+
+SILC_TASK_CALLBACK(test_private_messages)
+{
+  Test t = context;
+  SilcClient client = t->client;
+  SilcClientConnection conn = t->conn;
+  SilcChannelEntry channel = t->channel;
+  SilcChannelPrivateKey bad, key;
+  unsigned char ckey[32];
+
+  if (t->disconnected)
+    return;
+
+  memset(ckey, 0x22, sizeof(ckey));
+  if (!silc_client_add_channel_private_key(client, conn, channel, "bad",
+					   NULL, NULL, ckey, sizeof(ckey),
+					   &bad) ||
+      !silc_client_add_channel_private_key(client, conn, channel, "key",
+					   NULL, NULL, ckey, sizeof(ckey),
+					   &key))
+    goto err;
+  silc_cipher_free(bad->receive_key);
+  if (!silc_cipher_alloc("aes-256-cbc", &bad->receive_key))
+    goto err;
+  memset(ckey, 0x33, sizeof(ckey));
+  silc_cipher_set_key(bad->receive_key, ckey, sizeof(ckey) * 8, FALSE);
+  channel->mode |= SILC_CHANNEL_MODE_PRIVKEY;
+  t->key = key;
+
+  if (!test_message(t, MESSAGE_PRIVATE, key->send_key, key->hmac, FALSE,
+		    bad->receive_key) ||
+      !test_message(t, MESSAGE_PRIVATE_OLD_MAC, key->send_key, key->hmac,
+		    TRUE, bad->receive_key) ||
+      !test_message(t, MESSAGE_LAST, key->send_key, key->hmac, FALSE,
+		    bad->receive_key))
+    goto err;
+  return;
+
+ err:
+  fprintf(stderr, "Could not send channel messages\n");
+  silc_client_close_connection(client, conn);
+}
+
+/* Waits until the server has sent all notifies */
+
+static void test_joins(Test t)
+{
+  t->joins_wanted = TRUE;
+  while (!t->joins_sent)
+    usleep(1000);
+
+  /* Give up if notifies are lost */
+  silc_schedule_task_add_timeout(t->client->schedule, test_done, t, 10, 0);
+}
+
+SILC_TASK_CALLBACK(test_start)
+{
+  Test t = context;
+
+  /* Wait for the connection machine and the server to start */
+  if (!t->conn->internal->schedule || !t->server_running) {
+    silc_schedule_task_add_timeout(schedule, test_start, t, 0, 1000);
+    return;
+  }
+
+  t->start = silc_time_usec();
+  if (t->resolve)
+    test_resolve(t);
+  else if (t->messages)
+    test_messages(t);
+  else if (t->joins)
+    test_joins(t);
+  else
+    silc_client_command_send(t->client, t->conn, SILC_COMMAND_USERS,
+			     test_users_reply, t, 1, 1, "test", 4);
+  test_tick(schedule, app_context, type, fd, context);
+}
+
+static void test_stopped(SilcClient client, void *context)
+{
+}
+
+static void test_connection(SilcClient client, SilcClientConnection conn,
+			    SilcClientConnectionStatus status,
+			    SilcStatus error, const char *message,
+			    void *context)
+{
+  Test t = context;
+
+  if (status != SILC_CLIENT_CONN_DISCONNECTED)
+    return;
+
+  t->disconnected = TRUE;
+  silc_client_unref_channel(client, conn, t->channel);
+  t->channel = NULL;
+  silc_client_stop(client, test_stopped, t);
+}
+
+/* Connects the client to the fake server, as if the client had
+   registered to the network and joined the test channel */
+
+static void test_running(SilcClient client, void *context)
+{
+  Test t = context;
+  SilcClientConnectionParams params;
+  SilcClientConnection conn;
+  SilcClientEntry entry;
+  SilcClientID id;
+  char nick[32];
+  int i;
+
+  memset(&params, 0, sizeof(params));
+  params.batch_notify = t->joins;
+  conn = silc_client_add_connection(client, SILC_CONN_SERVER, FALSE, &params,
+				    NULL, NULL, "server", 706,
+				    test_connection, t);
+  if (!conn)
+    goto err;
+  t->conn = conn;
+  conn->stream = silc_packet_stream_create(client->internal->packet_engine,
+					   client->schedule,
+					   silc_fd_stream_create(t->fd));
+  if (!conn->stream)
+    goto err;
+  silc_packet_set_context(conn->stream, conn);
+
+  test_client_id(USERS, &id);
+  conn->local_entry = silc_client_add_client(client, conn, "test", "test",
+					     "Test", &id, 0);
+  if (!conn->local_entry)
+    goto err;
+  conn->local_id = &conn->local_entry->id;
+
+  t->channel_id.ip.data_len = 4;
+  t->channel_id.ip.data[0] = 10;
+  t->channel = silc_client_add_channel(client, conn, "test", 0,
+				       &t->channel_id);
+  if (!t->channel)
+    goto err;
+  silc_client_ref_channel(client, conn, t->channel);
+
+  /* Users of the notify test are known, so they are not resolved.  The
+     test keeps a reference to them to see that the library releases its
+     own. */
+  for (i = 1; t->joins && i <= JOINERS; i++) {
+    test_client_id(i, &id);
+    silc_snprintf(nick, sizeof(nick), "user%d", i);
+    entry = silc_client_add_client(client, conn, nick, "user", "User", &id, 0);
+    if (!entry)
+      goto err;
+    t->joiners[i] = silc_client_ref_client(client, conn, entry);
+  }
+
+  silc_schedule_task_add_timeout(client->schedule, test_start, t, 0, 1000);
+  return;
+
+ err:
+  fprintf(stderr, "Could not set up connection\n");
+  silc_client_stop(client, test_stopped, t);
+}
+
+static void test_say(SilcClient client, SilcClientConnection conn,
+		     SilcClientMessageType type, char *msg, ...)
+{
+}
+
+static void test_channel_message(SilcClient client, SilcClientConnection conn,
+				 SilcClientEntry sender,
+				 SilcChannelEntry channel,
+				 SilcMessagePayload payload,
+				 SilcChannelPrivateKey key,
+				 SilcMessageFlags flags,
+				 const unsigned char *message,
+				 SilcUInt32 message_len)
+{
+  Test t = client->application;
+  int n;
+
+  if (message_len != 9 || memcmp(message, "message ", 8))
+    return;
+  n = message[8] - '0';
+  if (n < 0 || n >= MESSAGES)
+    return;
+
+  t->received |= 1 << n;
+  t->keys[n] = key;
+  if (n == MESSAGE_KEY_LAST)
+    silc_schedule_task_add_timeout(client->schedule, test_private_messages,
+				   t, 0, 1);
+  if (n == MESSAGE_LAST)
+    silc_schedule_task_add_timeout(client->schedule, test_done, t, 0, 1);
+}
+
+static void test_private_message(SilcClient client, SilcClientConnection conn,
+				 SilcClientEntry sender,
+				 SilcMessagePayload payload,
+				 SilcMessageFlags flags,
+				 const unsigned char *message,
+				 SilcUInt32 message_len)
+{
+}
+
+/* Returns the number of test user `entry' */
+
+static SilcUInt32 test_user(SilcClientEntry entry)
+{
+  SilcUInt32 n;
+
+  SILC_GET32_MSB(n, entry->id.hash);
+  return n;
+}
+
+/* Records the notifies of the notify test, and closes the connection when
+   user 3 leaves */
+
+static void test_notify(SilcClient client, SilcClientConnection conn,
+			SilcNotifyType type, ...)
+{
+  Test t = client->application;
+  SilcChannelEntry channel;
+  SilcClientEntry entry;
+  SilcDList clients;
+  SilcUInt32 len;
+  va_list va;
+
+  if (!t->joins)
+    return;
+
+  len = strlen(t->notifies);
+  if (len)
+    t->notifies[len++] = ' ';
+
+  va_start(va, type);
+  switch (type) {
+  case SILC_NOTIFY_TYPE_JOIN_MANY:
+    channel = va_arg(va, SilcChannelEntry);
+    clients = va_arg(va, SilcDList);
+
+    t->notifies[len++] = 'J';
+    silc_dlist_start(clients);
+    while ((entry = silc_dlist_get(clients))) {
+      silc_snprintf(t->notifies + len, sizeof(t->notifies) - len, "%d",
+		    test_user(entry));
+      len = strlen(t->notifies);
+
+      /* Delivered before the LEAVEs that follow the JOINs */
+      if (!silc_client_on_channel(channel, entry))
+	t->joined_wrong = TRUE;
+    }
+    break;
+
+  case SILC_NOTIFY_TYPE_JOIN:
+    entry = va_arg(va, SilcClientEntry);
+    silc_snprintf(t->notifies + len, sizeof(t->notifies) - len, "j%d",
+		  test_user(entry));
+    break;
+
+  case SILC_NOTIFY_TYPE_LEAVE:
+    entry = va_arg(va, SilcClientEntry);
+    silc_snprintf(t->notifies + len, sizeof(t->notifies) - len, "L%d",
+		  test_user(entry));
+    if (test_user(entry) == 3)
+      silc_client_close_connection(client, conn);
+    break;
+
+  default:
+    silc_snprintf(t->notifies + len, sizeof(t->notifies) - len, "?%d",
+		  type);
+    break;
+  }
+  va_end(va);
+}
+
+static void test_command(SilcClient client, SilcClientConnection conn,
+			 SilcBool success, SilcCommand command,
+			 SilcStatus status, SilcUInt32 argc,
+			 unsigned char **argv)
+{
+}
+
+static void test_command_reply(SilcClient client, SilcClientConnection conn,
+			       SilcCommand command, SilcStatus status,
+			       SilcStatus error, va_list ap)
+{
+}
+
+static void test_get_auth_method(SilcClient client, SilcClientConnection conn,
+				 char *hostname, SilcUInt16 port,
+				 SilcAuthMethod auth_method,
+				 SilcGetAuthMeth completion, void *context)
+{
+  completion(SILC_AUTH_NONE, NULL, 0, context);
+}
+
+static void test_verify_public_key(SilcClient client,
+				   SilcClientConnection conn,
+				   SilcConnectionType conn_type,
+				   SilcPublicKey public_key,
+				   SilcVerifyPublicKey completion,
+				   void *context)
+{
+  completion(FALSE, context);
+}
+
+static void test_ask_passphrase(SilcClient client, SilcClientConnection conn,
+				SilcAskPassphrase completion, void *context)
+{
+  completion(NULL, 0, context);
+}
+
+static void test_key_agreement(SilcClient client, SilcClientConnection conn,
+			       SilcClientEntry client_entry,
+			       const char *hostname, SilcUInt16 protocol,
+			       SilcUInt16 port)
+{
+}
+
+static void test_ftp(SilcClient client, SilcClientConnection conn,
+		     SilcClientEntry client_entry, SilcUInt32 session_id,
+		     const char *hostname, SilcUInt16 port)
+{
+}
+
+static SilcClientOperations ops = {
+  test_say,
+  test_channel_message,
+  test_private_message,
+  test_notify,
+  test_command,
+  test_command_reply,
+  test_get_auth_method,
+  test_verify_public_key,
+  test_ask_passphrase,
+  test_key_agreement,
+  test_ftp
+};
+
+/* Server thread */
+
+SILC_TASK_CALLBACK(server_started)
+{
+  Test t = context;
+  t->server_running = TRUE;
+  if (t->joins)
+    server_joins(schedule, app_context, type, fd, context);
+}
+
+static void *server_thread(void *context)
+{
+  Test t = context;
+  silc_schedule(t->schedule);
+  return NULL;
+}
+
+/* Runs client against the fake server until the connection is closed */
+
+static SilcBool test_run(Test t)
+{
+  SilcClientParams params;
+  SilcThread thread;
+  SilcBool leaked = FALSE;
+  int i, sv[2], size = 1024 * 1024;
+
+  /* The server writes its replies in bursts, so give them room */
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    return FALSE;
+  setsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  silc_net_set_socket_nonblock(sv[0]);
+  silc_net_set_socket_nonblock(sv[1]);
+  t->fd = sv[0];
+
+  t->schedule = silc_schedule_init(0, NULL);
+  t->rng = silc_rng_alloc();
+  if (!t->schedule || !t->rng)
+    return FALSE;
+  silc_rng_init(t->rng);
+  t->engine = silc_packet_engine_start(t->rng, TRUE, &server_cbs, t);
+  if (!t->engine)
+    return FALSE;
+  t->stream = silc_packet_stream_create(t->engine, t->schedule,
+					silc_fd_stream_create(sv[1]));
+  if (!t->stream)
+    return FALSE;
+  silc_packet_set_context(t->stream, t);
+  silc_schedule_task_add_timeout(t->schedule, server_started, t, 0, 0);
+  thread = silc_thread_create(server_thread, t, TRUE);
+  if (!thread)
+    return FALSE;
+
+  memset(&params, 0, sizeof(params));
+  params.dont_register_crypto_library = TRUE;
+  t->client = silc_client_alloc(&ops, &params, t, NULL);
+  if (t->client && silc_client_init(t->client, "test", "localhost", "Test",
+				    test_running, t))
+    silc_client_run(t->client);
+
+  silc_schedule_stop(t->schedule);
+  silc_schedule_wakeup(t->schedule);
+  silc_thread_wait(thread, NULL);
+
+  silc_packet_stream_destroy(t->stream);
+  silc_packet_engine_stop(t->engine);
+  silc_schedule_uninit(t->schedule);
+  silc_rng_free(t->rng);
+
+  /* The connection is deleted, only the test may reference its users */
+  for (i = 1; i <= JOINERS; i++) {
+    if (!t->joiners[i])
+      continue;
+    if (silc_atomic_get_int32(&t->joiners[i]->internal.refcnt) != 1) {
+      fprintf(stderr, "User %d was not released\n", i);
+      leaked = TRUE;
+      continue;
+    }
+    silc_client_del_client_entry(t->client, NULL, t->joiners[i]);
+  }
+
+  if (t->client)
+    silc_client_free(t->client);
+  return t->disconnected && !leaked;
+}
+
+/* USERS reply of a large channel.  The last user leaves while the users
+   are being added, and must not be on the channel afterwards. */
+
+static SilcBool test_users(void)
+{
+  struct TestStruct ctx;
+  Test t = &ctx;
+
+  memset(&ctx, 0, sizeof(ctx));
+  t->leave = TRUE;
+  if (!test_run(t))
+    return FALSE;
+
+  if (t->replies != 1 || t->status != SILC_STATUS_OK) {
+    fprintf(stderr, "USERS failed: %s\n", silc_get_status_message(t->status));
+    return FALSE;
+  }
+  if (t->users != USERS - 1) {
+    fprintf(stderr, "USERS: %d users on channel, expected %d\n",
+	    t->users, USERS - 1);
+    return FALSE;
+  }
+
+  fprintf(stdout, "USERS of %d users: %.1f ms, longest %.2f ms without "
+	  "returning to scheduler\n", USERS, t->latency / 1000.0,
+	  t->stall / 1000.0);
+  return TRUE;
+}
+
+/* Connection is closed while USERS reply is being processed.  The reply
+   fails and the connection is closed cleanly. */
+
+static SilcBool test_users_closed(SilcBool resolving)
+{
+  struct TestStruct ctx;
+  Test t = &ctx;
+
+  memset(&ctx, 0, sizeof(ctx));
+  t->close_resolving = resolving;
+  t->close_adding = !resolving;
+  if (!test_run(t))
+    return FALSE;
+
+  if (t->replies != 1 || t->status == SILC_STATUS_OK) {
+    fprintf(stderr, "USERS did not fail when connection was closed\n");
+    return FALSE;
+  }
+
+  fprintf(stdout, "USERS with connection closed while %s: %s\n",
+	  resolving ? "resolving" : "adding users",
+	  silc_get_status_message(t->status));
+  return TRUE;
+}
+
+/* Users resolved by ID at the same time are queried with one WHOIS, one
+   Client ID each.  Every caller gets only the client it resolved, or error
+   if it does not exist.  If the WHOIS cannot be sent they all get error. */
+
+static SilcBool test_resolve_batch(SilcBool send_fail)
+{
+  struct TestStruct ctx;
+  Test t = &ctx;
+  TestResolve *r;
+  int i;
+
+  memset(&ctx, 0, sizeof(ctx));
+  t->resolve = TRUE;
+  t->send_fail = send_fail;
+  if (!test_run(t))
+    return FALSE;
+
+  if (t->resolves_done != RESOLVES) {
+    fprintf(stderr, "Resolving: %d of %d callers completed\n",
+	    t->resolves_done, (int)RESOLVES);
+    return FALSE;
+  }
+  if (t->whois != !send_fail ||
+      t->whois_ids != (send_fail ? 0 : RESOLVE_IDS)) {
+    fprintf(stderr, "Resolving: %d WHOIS of %d IDs sent\n", t->whois,
+	    t->whois_ids);
+    return FALSE;
+  }
+
+  for (i = 0; i < RESOLVES; i++) {
+    r = &t->resolves[i];
+    if (send_fail) {
+      if (r->status != SILC_STATUS_ERR_RESOURCE_LIMIT || r->clients)
+	break;
+    } else if (r->user >= NO_SUCH_USER) {
+      if (r->status != SILC_STATUS_ERR_NO_SUCH_CLIENT_ID || r->clients)
+	break;
+    } else if (r->status != SILC_STATUS_OK || r->clients != 1 || !r->own) {
+      break;
+    }
+  }
+  if (i < RESOLVES) {
+    fprintf(stderr, "Resolving user %d: %s, %d clients%s\n", r->user,
+	    silc_get_status_message(r->status), r->clients,
+	    r->clients && !r->own ? ", not the resolved one" : "");
+    return FALSE;
+  }
+
+  if (send_fail)
+    fprintf(stdout, "Resolving %d users with WHOIS not sent: %s\n",
+	    (int)RESOLVES,
+	    silc_get_status_message(SILC_STATUS_ERR_RESOURCE_LIMIT));
+  else
+    fprintf(stdout, "Resolving %d users: %d WHOIS of %d IDs\n",
+	    (int)RESOLVES, t->whois, t->whois_ids);
+  return TRUE;
+}
+
+/* Channel messages with channel key and private keys.  Old style MAC is
+   accepted with channel key, but with private keys only if requested.
+   Private key whose MAC matches but that cannot decrypt the message is
+   skipped. */
+
+static SilcBool test_channel_messages(void)
+{
+  struct TestStruct ctx;
+  Test t = &ctx;
+  SilcUInt32 expected;
+  int i;
+
+  memset(&ctx, 0, sizeof(ctx));
+  t->messages = TRUE;
+  if (!test_run(t))
+    return FALSE;
+
+  expected = (1 << MESSAGES) - 1;
+  expected &= ~(1 << MESSAGE_PRIVATE_OLD_MAC);
+  for (i = 0; i < MESSAGES; i++) {
+    if ((t->received ^ expected) & (1 << i)) {
+      fprintf(stderr, "Channel message %d was %sreceived\n", i,
+	      t->received & (1 << i) ? "" : "not ");
+      return FALSE;
+    }
+    if (t->keys[i] != (i < MESSAGE_PRIVATE ? NULL : t->key) &&
+	(expected & (1 << i))) {
+      fprintf(stderr, "Channel message %d was decrypted with wrong key\n",
+	      i);
+      return FALSE;
+    }
+  }
+
+  fprintf(stdout, "Channel messages: %d of %d received\n",
+	  MESSAGES - 1, MESSAGES);
+  return TRUE;
+}
+
+/* JOINs in batch notify mode.  JOINs received at once are delivered in
+   one JOIN_MANY before the LEAVE that follows them.  JOINs received after
+   the connection was closed are not delivered, and are freed with the
+   connection. */
+
+static SilcBool test_batch_joins(void)
+{
+  struct TestStruct ctx;
+  Test t = &ctx;
+
+  memset(&ctx, 0, sizeof(ctx));
+  t->joins = TRUE;
+  if (!test_run(t))
+    return FALSE;
+
+  if (strcmp(t->notifies, JOINS_RECEIVED)) {
+    fprintf(stderr, "Notifies received: %s, expected %s\n", t->notifies,
+	    JOINS_RECEIVED);
+    return FALSE;
+  }
+  if (t->joined_wrong) {
+    fprintf(stderr, "JOIN_MANY was delivered after LEAVE\n");
+    return FALSE;
+  }
+
+  fprintf(stdout, "Batched JOINs: %s\n", t->notifies);
+  return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*client*,*command*");
+  }
+
+  silc_cipher_register_default();
+  silc_pkcs_register_default();
+  silc_hash_register_default();
+  silc_hmac_register_default();
+
+  /* Writes to connection closed for writing fail */
+  signal(SIGPIPE, SIG_IGN);
+
+  SILC_LOG_DEBUG(("USERS reply"));
+  if (!test_users())
+    goto err;
+
+  SILC_LOG_DEBUG(("USERS reply, connection closed while resolving"));
+  if (!test_users_closed(TRUE))
+    goto err;
+
+  SILC_LOG_DEBUG(("USERS reply, connection closed while adding"));
+  if (!test_users_closed(FALSE))
+    goto err;
+
+  SILC_LOG_DEBUG(("Resolving users by ID"));
+  if (!test_resolve_batch(FALSE))
+    goto err;
+
+  SILC_LOG_DEBUG(("Resolving users by ID, WHOIS not sent"));
+  if (!test_resolve_batch(TRUE))
+    goto err;
+
+  SILC_LOG_DEBUG(("Channel messages"));
+  if (!test_channel_messages())
+    goto err;
+
+  SILC_LOG_DEBUG(("Batched JOIN notifies"));
+  if (!test_batch_joins())
+    goto err;
+
+  success = TRUE;
+
+ err:
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
@@ -0,0 +1,335 @@
+/* File transfer receiving tests.  The file transfer code is compiled in
+   here, so that the receiving session can be run against SFTP servers
+   over local socket pairs, without SILC server and key exchange. */
+
+#include "../client_ftp.c"
+#include <sys/socket.h>
+#include <signal.h>
+
+/* Size of the served file, not a multiple of the read length */
+#define FILE_SIZE (4 * 1024 * 1024 + 12345)
+
+/* Number of transfer connections */
+#define STREAMS 4
+
+typedef struct TestStruct {
+  SilcSchedule schedule;
+  SilcSFTPFilesystem fs;
+  struct SilcClientStruct client;
+  SilcClientFtpSession session;
+  SilcSFTP servers[STREAMS];
+  SilcStream server_streams[STREAMS];
+  SilcStream client_streams[STREAMS];
+  int servers_count;
+  SilcBool drop;		/* Drop one connection during transfer */
+  SilcBool stalled;
+  SilcBool drop_started;
+  SilcUInt32 dropped;		/* Reads outstanding in dropped connection */
+  SilcBool done;
+  SilcBool error;
+} *Test;
+
+static void server_error(SilcSFTP sftp, SilcSFTPStatus status, void *context)
+{
+  SILC_LOG_DEBUG(("Server error %d", status));
+}
+
+/* Starts SFTP server on one end of new socket pair and returns the other
+   end.  SFTP expects one packet per read, like from SILC packet stream, so
+   use socket that keeps the packet boundaries. */
+
+static SilcStream test_connect(Test t)
+{
+  SilcStream ss;
+  int sv[2], i;
+
+  if (t->servers_count == STREAMS ||
+      socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0)
+    return NULL;
+  silc_net_set_socket_nonblock(sv[0]);
+  silc_net_set_socket_nonblock(sv[1]);
+
+  ss = silc_fd_stream_create(sv[1]);
+  if (!ss)
+    return NULL;
+  i = t->servers_count++;
+  t->server_streams[i] = ss;
+  t->servers[i] = silc_sftp_server_start(ss, t->schedule, server_error, t,
+					 t->fs);
+  if (!t->servers[i])
+    return NULL;
+
+  t->client_streams[i] = silc_fd_stream_create(sv[0]);
+  return t->client_streams[i];
+}
+
+/* Drops the connection that stopped responding, as if it was closed */
+
+SILC_TASK_CALLBACK(test_drop)
+{
+  Test t = context;
+  SilcClientFtpSession session = t->session;
+  SilcClientFtpStream stream;
+
+  silc_list_start(session->streams);
+  while ((stream = silc_list_get(session->streams)))
+    if (stream->stream == t->client_streams[1])
+      break;
+  if (!stream)
+    return;
+
+  SILC_LOG_DEBUG(("Dropping connection with %d reads outstanding",
+		  stream->read_pending));
+  t->dropped = stream->read_pending;
+  silc_client_ftp_stream_close(stream);
+}
+
+static void test_monitor(SilcClient client,
+			 SilcClientConnection conn,
+			 SilcClientMonitorStatus status,
+			 SilcClientFileError error,
+			 SilcUInt64 offset,
+			 SilcUInt64 filesize,
+			 SilcClientEntry client_entry,
+			 SilcUInt32 session_id,
+			 const char *filepath,
+			 void *context)
+{
+  Test t = context;
+
+  if (status == SILC_CLIENT_FILE_MONITOR_ERROR) {
+    fprintf(stderr, "Transfer failed: error %d\n", error);
+    t->error = TRUE;
+    silc_schedule_stop(t->schedule);
+    return;
+  }
+
+  if (status != SILC_CLIENT_FILE_MONITOR_RECEIVE)
+    return;
+
+  if (offset == filesize) {
+    t->done = TRUE;
+    silc_schedule_stop(t->schedule);
+    return;
+  }
+
+  if (!t->drop)
+    return;
+
+  /* Once all connections are reading, one of them stops responding.  Its
+     reads stay outstanding while the others go on reading. */
+  if (!t->stalled && offset >= filesize / 4) {
+    t->stalled = TRUE;
+    silc_stream_set_notifier(t->server_streams[1], t->schedule, NULL, NULL);
+  }
+
+  /* Later it is dropped, and the reads must be sent again to the others */
+  if (!t->drop_started && offset >= filesize / 2) {
+    t->drop_started = TRUE;
+    silc_schedule_task_add_timeout(t->schedule, test_drop, t, 0, 1);
+  }
+}
+
+/* Opens the file in the primary connection, and then opens the additional
+   connections, as connecting to the sender would */
+
+static void test_open_handle(SilcSFTP sftp, SilcSFTPStatus status,
+			     SilcSFTPHandle handle, void *context)
+{
+  SilcClientFtpSession session = context;
+  Test t = session->monitor_context;
+  SilcClientFtpStream stream;
+  int i;
+
+  silc_client_ftp_open_handle(sftp, status, handle, session);
+  if (status != SILC_SFTP_STATUS_OK)
+    return;
+
+  for (i = 1; i < STREAMS; i++) {
+    stream = silc_calloc(1, sizeof(*stream));
+    if (!stream)
+      break;
+    stream->session = session;
+    stream->stream = test_connect(t);
+    if (stream->stream)
+      stream->sftp = silc_sftp_client_start(stream->stream, t->schedule,
+					    silc_client_ftp_stream_version,
+					    silc_client_ftp_error, stream);
+    if (!stream->sftp) {
+      if (stream->stream)
+	silc_stream_destroy(stream->stream);
+      silc_free(stream);
+      break;
+    }
+    silc_list_add(session->streams, stream);
+  }
+}
+
+static void test_version(SilcSFTP sftp, SilcSFTPStatus status,
+			 SilcSFTPVersion version, void *context)
+{
+  SilcSFTPAttributesStruct attr;
+
+  memset(&attr, 0, sizeof(attr));
+  silc_sftp_open(sftp, "data", SILC_SFTP_FXF_READ, &attr,
+		 test_open_handle, context);
+}
+
+/* Receives the file over STREAMS connections and compares it with the
+   original `data'.  If `drop' is TRUE one of the additional connections
+   is closed during the transfer. */
+
+static SilcBool test_receive(SilcSFTPFilesystem fs, const char *path,
+			     const unsigned char *data, SilcBool drop)
+{
+  struct TestStruct ctx;
+  Test t = &ctx;
+  SilcClientFtpSession session;
+  unsigned char *recv;
+  SilcUInt32 recv_len;
+  SilcBool success = FALSE;
+  int i;
+
+  memset(&ctx, 0, sizeof(ctx));
+  t->fs = fs;
+  t->drop = drop;
+  t->schedule = silc_schedule_init(0, NULL);
+  if (!t->schedule)
+    return FALSE;
+  t->client.schedule = t->schedule;
+  t->client.internal = silc_calloc(1, sizeof(*t->client.internal));
+  if (!t->client.internal)
+    return FALSE;
+  t->client.internal->ftp_sessions = silc_dlist_init();
+
+  /* Session as silc_client_file_receive sets it up */
+  session = silc_calloc(1, sizeof(*session));
+  if (!session)
+    return FALSE;
+  t->session = session;
+  session->client = &t->client;
+  session->filepath = strdup(path);
+  session->remote_file = strdup("data");
+  session->filesize = FILE_SIZE;
+  session->monitor = test_monitor;
+  session->monitor_context = t;
+  session->read_window_max = SILC_CLIENT_FTP_READ_WINDOW;
+  session->params.ftp_streams = STREAMS;
+  silc_list_init(session->streams, struct SilcClientFtpStreamStruct, next);
+  silc_list_init(session->read_free, struct SilcClientFtpReadStruct, next);
+  silc_dlist_add(t->client.internal->ftp_sessions, session);
+
+  unlink(path);
+  session->stream = test_connect(t);
+  if (!session->stream)
+    goto out;
+  session->sftp = silc_sftp_client_start(session->stream, t->schedule,
+					 test_version, silc_client_ftp_error,
+					 session);
+  if (!session->sftp)
+    goto out;
+
+  silc_schedule(t->schedule);
+
+  if (t->error || !t->done) {
+    fprintf(stderr, "Transfer did not complete\n");
+    goto out;
+  }
+  if (drop && !t->dropped) {
+    fprintf(stderr, "Dropped connection had no reads outstanding\n");
+    goto out;
+  }
+  if (!session->read_done || !session->chunks ||
+      session->tree_fetched != session->chunks_count) {
+    fprintf(stderr, "File was not verified with tree hash\n");
+    goto out;
+  }
+
+  /* The file must be complete */
+  recv = (unsigned char *)silc_file_readfile(path, &recv_len);
+  if (!recv || recv_len != FILE_SIZE || memcmp(recv, data, FILE_SIZE)) {
+    fprintf(stderr, "Received file differs from the original\n");
+    silc_free(recv);
+    goto out;
+  }
+  silc_free(recv);
+
+  fprintf(stdout, "%d connections%s: received %d bytes",
+	  STREAMS, drop ? ", one dropped" : "", FILE_SIZE);
+  if (drop)
+    fprintf(stdout, ", %d reads sent again", t->dropped);
+  fprintf(stdout, "\n");
+  success = TRUE;
+
+ out:
+  silc_client_ftp_session_free(session);
+  for (i = 0; i < t->servers_count; i++) {
+    if (t->servers[i])
+      silc_sftp_server_shutdown(t->servers[i]);
+    silc_stream_destroy(t->server_streams[i]);
+  }
+  silc_dlist_uninit(t->client.internal->ftp_sessions);
+  silc_free(t->client.internal);
+  silc_schedule_uninit(t->schedule);
+  unlink(path);
+  return success;
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  SilcSFTPFilesystem fs = NULL;
+  char src[64], dst[64], url[80];
+  unsigned char *data = NULL;
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*ftp*");
+  }
+
+  /* Writes to the dropped connection fail */
+  signal(SIGPIPE, SIG_IGN);
+
+  silc_hash_register_default();
+
+  /* File served from the memory filesystem */
+  silc_snprintf(src, sizeof(src), "/tmp/test_ftp.%d", getpid());
+  silc_snprintf(dst, sizeof(dst), "/tmp/test_ftp.%d.recv", getpid());
+  silc_snprintf(url, sizeof(url), "file://%s", src);
+  data = silc_malloc(FILE_SIZE);
+  if (!data)
+    goto err;
+  for (i = 0; i < FILE_SIZE; i++)
+    data[i] = (i * 7) ^ (i >> 13);
+  if (silc_file_writefile(src, (const char *)data, FILE_SIZE) < 0)
+    goto err;
+
+  fs = silc_sftp_fs_memory_alloc(SILC_SFTP_FS_PERM_READ);
+  if (!fs)
+    goto err;
+  if (!silc_sftp_fs_memory_add_file(fs, NULL, SILC_SFTP_FS_PERM_READ,
+				    "data", url))
+    goto err;
+
+  SILC_LOG_DEBUG(("Receive over %d connections", STREAMS));
+  if (!test_receive(fs, dst, data, FALSE))
+    goto err;
+
+  SILC_LOG_DEBUG(("Receive over %d connections, one dropped", STREAMS));
+  if (!test_receive(fs, dst, data, TRUE))
+    goto err;
+
+  success = TRUE;
+
+ err:
+  if (fs)
+    silc_sftp_fs_memory_free(fs);
+  silc_free(data);
+  unlink(src);
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
@@ -48,6 +48,45 @@ typedef struct {
   SilcID *rid;
 } SilcMessageEncode;
 
+/* Default number of signature verification threads */
+#define SILC_MESSAGE_VERIFY_THREADS 2
+
+/* Maximum number of signatures verified in one batch */
+#define SILC_MESSAGE_VERIFY_BATCH 64
+
+/* Signature verification request */
+typedef struct SilcMessageVerifyStruct {
+  struct SilcMessageVerifyStruct *next;
+  SilcAsyncOperationStruct op;		/* Operation for aborting */
+  SilcMessageVerifyCb callback;		/* Result callback */
+  void *context;			/* Callback context */
+  SilcBuffer data;			/* Signed data */
+  unsigned char *sign_data;		/* Signature */
+  SilcUInt32 sign_len;
+  SilcAuthResult result;		/* Verification result */
+  unsigned int aborted : 1;		/* Request was aborted */
+} *SilcMessageVerify;
+
+/* Batch of signatures verified with same public key in one thread */
+typedef struct SilcMessageVerifyBatchStruct {
+  struct SilcMessageVerifyBatchStruct *next;
+  SilcMessageVerifier verifier;
+  SilcSchedule schedule;		/* Scheduler for results */
+  SilcPublicKey public_key;		/* Copy of the public key */
+  SilcHash hash;			/* Thread's own hash context */
+  SilcList requests;			/* Verification requests */
+  SilcThread thread;			/* Worker thread, NULL if none */
+} *SilcMessageVerifyBatch;
+
+/* Message signature verifier context */
+struct SilcMessageVerifierStruct {
+  SilcSchedule schedule;		/* Scheduler for results */
+  SilcList batches;			/* Queued batches */
+  SilcList running;			/* Batches being verified */
+  SilcUInt32 max_threads;		/* Maximum number of threads */
+  unsigned int scheduled : 1;		/* Start task is scheduled */
+};
+
 
 /************************* Static utility functions *************************/
 
@@ -262,6 +301,52 @@ silc_message_signed_payload_encode(const unsigned char *message_payload,
 
 /***************************** Payload parsing ******************************/
 
+/* Checks the MAC of the Message Payload without decrypting it.  The old
+   style MAC, computed without the IDs, is accepted only if `old_mac' is
+   TRUE. */
+
+SilcBool silc_message_payload_check_mac(const unsigned char *data,
+					SilcUInt32 data_len,
+					SilcHmac hmac,
+					const unsigned char *sender_id,
+					SilcUInt32 sender_id_len,
+					const unsigned char *receiver_id,
+					SilcUInt32 receiver_id_len,
+					SilcBool old_mac)
+{
+  SilcUInt32 mac_len;
+  unsigned char mac[32];
+
+  mac_len = silc_hmac_len(hmac);
+  if (silc_unlikely(data_len < mac_len))
+    return FALSE;
+
+  SILC_LOG_DEBUG(("Checking message MAC"));
+  silc_hmac_init(hmac);
+  silc_hmac_update(hmac, data, data_len - mac_len);
+  silc_hmac_update(hmac, sender_id, sender_id_len);
+  silc_hmac_update(hmac, receiver_id, receiver_id_len);
+  silc_hmac_final(hmac, mac, &mac_len);
+  if (silc_likely(!memcmp(data + (data_len - mac_len), mac, mac_len)))
+    return TRUE;
+
+  if (!old_mac) {
+    SILC_LOG_DEBUG(("Message MAC does not match"));
+    return FALSE;
+  }
+
+  /* Check for old style message MAC */
+  silc_hmac_init(hmac);
+  silc_hmac_update(hmac, data, data_len - mac_len);
+  silc_hmac_final(hmac, mac, &mac_len);
+  if (silc_unlikely(memcmp(data + (data_len - mac_len), mac, mac_len))) {
+    SILC_LOG_DEBUG(("Message MAC does not match"));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 /* Decrypts the Message Payload. The `data' is the actual Message Payload. */
 
 SilcBool silc_message_payload_decrypt(unsigned char *data,
@@ -278,7 +363,7 @@ SilcBool silc_message_payload_decrypt(unsigned char *data,
 {
   SilcUInt32 mac_len, iv_len = 0, block_len;
   SilcUInt16 len, totlen;
-  unsigned char mac[32], *ivp;
+  unsigned char *ivp;
 
   mac_len = silc_hmac_len(hmac);
   block_len = silc_cipher_get_block_len(cipher);
@@ -292,27 +377,15 @@ SilcBool silc_message_payload_decrypt(unsigned char *data,
     return FALSE;
 
   if (silc_likely(check_mac)) {
-    /* Check the MAC of the message */
-    SILC_LOG_DEBUG(("Checking message MAC"));
-    silc_hmac_init(hmac);
-    silc_hmac_update(hmac, data, data_len - mac_len);
-    silc_hmac_update(hmac, sender_id, sender_id_len);
-    silc_hmac_update(hmac, receiver_id, receiver_id_len);
-    silc_hmac_final(hmac, mac, &mac_len);
-    if (silc_unlikely(memcmp(data + (data_len - mac_len), mac, mac_len))) {
-#if 1 /* Check for old style message MAC.  Remove this check at some point. */
-      silc_hmac_init(hmac);
-      silc_hmac_update(hmac, data, data_len - mac_len);
-      silc_hmac_final(hmac, mac, &mac_len);
-      if (silc_unlikely(memcmp(data + (data_len - mac_len), mac, mac_len))) {
-	SILC_LOG_DEBUG(("Message MAC does not match"));
-	return FALSE;
-      }
-#else
-      SILC_LOG_DEBUG(("Message MAC does not match"));
+    /* Check the MAC of the message.  Old style MAC is accepted here for
+       compatibility. */
+    if (silc_unlikely(!silc_message_payload_check_mac(data, data_len, hmac,
+						      sender_id,
+						      sender_id_len,
+						      receiver_id,
+						      receiver_id_len,
+						      TRUE)))
       return FALSE;
-#endif /* 0 */
-    }
     SILC_LOG_DEBUG(("MAC is Ok"));
   }
 
@@ -367,6 +440,33 @@ silc_message_payload_parse(unsigned char *payload,
 			   SilcStack stack,
 			   SilcBool no_allocation,
 			   SilcMessagePayload message)
+{
+  return silc_message_payload_parse_ext(payload, payload_len,
+					private_message, static_key,
+					cipher, hmac, sender_id,
+					sender_id_len, receiver_id,
+					receiver_id_len, stack,
+					no_allocation, message, TRUE);
+}
+
+/* Parses Message Payload.  The MAC is checked only if `check_mac' is
+   TRUE. */
+
+SilcMessagePayload
+silc_message_payload_parse_ext(unsigned char *payload,
+			       SilcUInt32 payload_len,
+			       SilcBool private_message,
+			       SilcBool static_key,
+			       SilcCipher cipher,
+			       SilcHmac hmac,
+			       unsigned char *sender_id,
+			       SilcUInt32 sender_id_len,
+			       unsigned char *receiver_id,
+			       SilcUInt32 receiver_id_len,
+			       SilcStack stack,
+			       SilcBool no_allocation,
+			       SilcMessagePayload message,
+			       SilcBool check_mac)
 {
   SilcBufferStruct buffer;
   SilcMessagePayload newp = NULL;
@@ -383,7 +483,7 @@ silc_message_payload_parse(unsigned char *payload,
 				       private_message, static_key,
 				       cipher, hmac, sender_id,
 				       sender_id_len, receiver_id,
-				       receiver_id_len, TRUE);
+				       receiver_id_len, check_mac);
     if (silc_unlikely(ret == FALSE))
       return NULL;
   }
@@ -700,22 +800,24 @@ unsigned char *silc_message_get_mac(SilcMessagePayload payload)
   return payload->mac;
 }
 
-/* Verify the signature in SILC_MESSAGE_FLAG_SIGNED Payload */
+/* Encodes the data that was signed in SILC_MESSAGE_FLAG_SIGNED Payload */
 
-SilcAuthResult silc_message_signed_verify(SilcMessagePayload message,
-					  SilcPublicKey remote_public_key,
-					  SilcHash hash)
+static SilcBuffer silc_message_signed_data(SilcMessagePayload message)
 {
-  int ret = SILC_AUTH_FAILED;
   SilcBuffer sign, tmp;
   SilcMessageSignedPayload sig = &message->sig;
-
-  if (!(message->flags & SILC_MESSAGE_FLAG_SIGNED) ||
-      !sig->sign_len || !remote_public_key || !hash)
-    return ret;
-
-  /* Generate the signature verification data, the Message Payload */
-  tmp = silc_buffer_alloc_size(6 + message->data_len + message->pad_len);
+  SilcStack stack;
+
+  /* Generate the signature verification data, the Message Payload.  It
+     is needed only temporarily so allocate it from the default stack. */
+  stack = silc_stack_get_global();
+  silc_stack_push(stack, NULL);
+  tmp = silc_buffer_salloc_size(stack, 6 + message->data_len +
+				message->pad_len);
+  if (!tmp) {
+    silc_stack_pop(stack);
+    return NULL;
+  }
   silc_buffer_format(tmp,
 		     SILC_STR_UI_SHORT(message->flags),
 		     SILC_STR_UI_SHORT(message->data_len),
@@ -727,8 +829,28 @@ SilcAuthResult silc_message_signed_verify(SilcMessagePayload message,
 					 sig->pk_data, sig->pk_len,
 					 sig->pk_type);
   silc_buffer_clear(tmp);
-  silc_buffer_free(tmp);
+  if (!stack)
+    silc_buffer_free(tmp);
+  silc_stack_pop(stack);
+
+  return sign;
+}
+
+/* Verify the signature in SILC_MESSAGE_FLAG_SIGNED Payload */
+
+SilcAuthResult silc_message_signed_verify(SilcMessagePayload message,
+					  SilcPublicKey remote_public_key,
+					  SilcHash hash)
+{
+  int ret = SILC_AUTH_FAILED;
+  SilcBuffer sign;
+  SilcMessageSignedPayload sig = &message->sig;
+
+  if (!(message->flags & SILC_MESSAGE_FLAG_SIGNED) ||
+      !sig->sign_len || !remote_public_key || !hash)
+    return ret;
 
+  sign = silc_message_signed_data(message);
   if (!sign)
     return ret;
 
@@ -751,6 +873,273 @@ SilcAuthResult silc_message_signed_verify(SilcMessagePayload message,
   return ret;
 }
 
+/* Frees verification request */
+
+static void silc_message_verify_free(SilcMessageVerify verify)
+{
+  silc_buffer_clear(verify->data);
+  silc_buffer_free(verify->data);
+  silc_free(verify->sign_data);
+  silc_free(verify);
+}
+
+/* Frees verification batch and its requests */
+
+static void silc_message_verify_batch_free(SilcMessageVerifyBatch batch)
+{
+  SilcMessageVerify verify;
+
+  silc_list_start(batch->requests);
+  while ((verify = silc_list_get(batch->requests)))
+    silc_message_verify_free(verify);
+
+  silc_pkcs_public_key_free(batch->public_key);
+  silc_hash_free(batch->hash);
+  silc_free(batch);
+}
+
+/* Verifies all signatures in the batch.  Called in worker thread. */
+
+static void silc_message_verify_batch(SilcMessageVerifyBatch batch)
+{
+  SilcMessageVerify verify;
+
+  SILC_LOG_DEBUG(("Verifying %d signatures",
+		  silc_list_count(batch->requests)));
+
+  silc_list_start(batch->requests);
+  while ((verify = silc_list_get(batch->requests)))
+    verify->result = (silc_pkcs_verify(batch->public_key, verify->sign_data,
+				       verify->sign_len,
+				       silc_buffer_data(verify->data),
+				       silc_buffer_len(verify->data),
+				       batch->hash) ?
+		      SILC_AUTH_OK : SILC_AUTH_FAILED);
+}
+
+static void silc_message_verifier_start(SilcMessageVerifier verifier);
+
+/* Batch has been verified.  Deliver the results to the callers. */
+
+SILC_TASK_CALLBACK(silc_message_verify_done)
+{
+  SilcMessageVerifyBatch batch = context;
+  SilcMessageVerifier verifier = batch->verifier;
+  SilcMessageVerify verify;
+
+  if (batch->thread)
+    silc_thread_wait(batch->thread, NULL);
+  silc_list_del(verifier->running, batch);
+
+  silc_list_start(batch->requests);
+  while ((verify = silc_list_get(batch->requests)))
+    if (!verify->aborted)
+      verify->callback(verify->result, verify->context);
+
+  silc_message_verify_batch_free(batch);
+
+  /* Start next batches */
+  silc_message_verifier_start(verifier);
+}
+
+/* Worker thread verifying one batch */
+
+static void *silc_message_verify_thread(void *context)
+{
+  SilcMessageVerifyBatch batch = context;
+
+  silc_message_verify_batch(batch);
+
+  /* Deliver results through the scheduler */
+  silc_schedule_task_add_timeout(batch->schedule, silc_message_verify_done,
+				 batch, 0, 0);
+  silc_schedule_wakeup(batch->schedule);
+
+  return NULL;
+}
+
+/* Starts queued batches in worker threads */
+
+static void silc_message_verifier_start(SilcMessageVerifier verifier)
+{
+  SilcMessageVerifyBatch batch;
+
+  while (silc_list_count(verifier->running) < verifier->max_threads) {
+    silc_list_start(verifier->batches);
+    batch = silc_list_get(verifier->batches);
+    if (!batch)
+      break;
+
+    silc_list_del(verifier->batches, batch);
+    silc_list_add(verifier->running, batch);
+
+#ifdef SILC_THREADS
+    batch->thread = silc_thread_create(silc_message_verify_thread, batch,
+				       TRUE);
+    if (batch->thread)
+      continue;
+#endif /* SILC_THREADS */
+
+    /* Threads not available, verify here */
+    silc_message_verify_batch(batch);
+    silc_schedule_task_add_timeout(batch->schedule, silc_message_verify_done,
+				   batch, 0, 0);
+  }
+}
+
+/* Verifications are started from the scheduler so that messages received
+   around the same time can be batched together. */
+
+SILC_TASK_CALLBACK(silc_message_verifier_start_task)
+{
+  SilcMessageVerifier verifier = context;
+
+  verifier->scheduled = FALSE;
+  silc_message_verifier_start(verifier);
+}
+
+/* Abort callback for verification request */
+
+static void silc_message_verify_abort(SilcAsyncOperation op, void *context)
+{
+  SilcMessageVerify verify = context;
+  verify->aborted = TRUE;
+}
+
+/* Allocate message signature verifier */
+
+SilcMessageVerifier silc_message_verifier_alloc(SilcSchedule schedule,
+						SilcUInt32 max_threads)
+{
+  SilcMessageVerifier verifier;
+
+  if (!schedule)
+    return NULL;
+
+  verifier = silc_calloc(1, sizeof(*verifier));
+  if (!verifier)
+    return NULL;
+
+  verifier->schedule = schedule;
+  verifier->max_threads = (max_threads ? max_threads :
+			   SILC_MESSAGE_VERIFY_THREADS);
+  silc_list_init(verifier->batches, struct SilcMessageVerifyBatchStruct,
+		 next);
+  silc_list_init(verifier->running, struct SilcMessageVerifyBatchStruct,
+		 next);
+
+  return verifier;
+}
+
+/* Free message signature verifier */
+
+void silc_message_verifier_free(SilcMessageVerifier verifier)
+{
+  SilcMessageVerifyBatch batch;
+
+  if (!verifier)
+    return;
+
+  silc_schedule_task_del_by_context(verifier->schedule, verifier);
+
+  silc_list_start(verifier->batches);
+  while ((batch = silc_list_get(verifier->batches)))
+    silc_message_verify_batch_free(batch);
+
+  /* Wait for running verifications */
+  silc_list_start(verifier->running);
+  while ((batch = silc_list_get(verifier->running))) {
+    if (batch->thread)
+      silc_thread_wait(batch->thread, NULL);
+    silc_schedule_task_del_by_context(verifier->schedule, batch);
+    silc_message_verify_batch_free(batch);
+  }
+
+  silc_free(verifier);
+}
+
+/* Verify the signature in SILC_MESSAGE_FLAG_SIGNED Payload asynchronously */
+
+SilcAsyncOperation
+silc_message_signed_verify_async(SilcMessageVerifier verifier,
+				 SilcMessagePayload message,
+				 SilcPublicKey remote_public_key,
+				 SilcHash hash,
+				 SilcMessageVerifyCb callback,
+				 void *context)
+{
+  SilcMessageSignedPayload sig = &message->sig;
+  SilcMessageVerifyBatch batch;
+  SilcMessageVerify verify;
+
+  if (!verifier || !(message->flags & SILC_MESSAGE_FLAG_SIGNED) ||
+      !sig->sign_len || !remote_public_key || !hash)
+    goto err;
+
+  verify = silc_calloc(1, sizeof(*verify));
+  if (!verify)
+    goto err;
+  verify->callback = callback;
+  verify->context = context;
+  verify->sign_data = silc_memdup(sig->sign_data, sig->sign_len);
+  verify->sign_len = sig->sign_len;
+  verify->data = silc_message_signed_data(message);
+  if (!verify->sign_data || !verify->data) {
+    if (verify->data)
+      silc_buffer_free(verify->data);
+    silc_free(verify->sign_data);
+    silc_free(verify);
+    goto err;
+  }
+
+  /* Add to a queued batch with same public key */
+  silc_list_start(verifier->batches);
+  while ((batch = silc_list_get(verifier->batches)))
+    if (silc_list_count(batch->requests) < SILC_MESSAGE_VERIFY_BATCH &&
+	!strcmp(silc_hash_get_name(batch->hash), silc_hash_get_name(hash)) &&
+	silc_pkcs_public_key_compare(batch->public_key, remote_public_key))
+      break;
+
+  if (!batch) {
+    batch = silc_calloc(1, sizeof(*batch));
+    if (!batch) {
+      silc_message_verify_free(verify);
+      goto err;
+    }
+    batch->verifier = verifier;
+    batch->schedule = verifier->schedule;
+    silc_list_init(batch->requests, struct SilcMessageVerifyStruct, next);
+
+    /* The worker thread uses its own copies of the key and hash */
+    batch->public_key = silc_pkcs_public_key_copy(remote_public_key);
+    if (!batch->public_key ||
+	!silc_hash_alloc(silc_hash_get_name(hash), &batch->hash)) {
+      if (batch->public_key)
+	silc_pkcs_public_key_free(batch->public_key);
+      silc_free(batch);
+      silc_message_verify_free(verify);
+      goto err;
+    }
+
+    silc_list_add(verifier->batches, batch);
+  }
+
+  silc_list_add(batch->requests, verify);
+  silc_async_init(&verify->op, silc_message_verify_abort, NULL, verify);
+
+  if (!verifier->scheduled) {
+    silc_schedule_task_add_timeout(verifier->schedule,
+				   silc_message_verifier_start_task,
+				   verifier, 0, 0);
+    verifier->scheduled = TRUE;
+  }
+
+  return &verify->op;
+
+ err:
+  return NULL;
+}
+
 /* Return the public key from the payload */
 
 SilcPublicKey
@@ -775,3 +1164,30 @@ silc_message_signed_get_public_key(SilcMessagePayload payload,
 
   return pk;
 }
+
+/* Return the signature from the payload */
+
+const unsigned char *
+silc_message_signed_get_signature(SilcMessagePayload payload,
+				  SilcUInt32 *sign_len)
+{
+  SilcMessageSignedPayload sig = &payload->sig;
+
+  if (!(payload->flags & SILC_MESSAGE_FLAG_SIGNED) || !sig->sign_data)
+    return NULL;
+
+  if (sign_len)
+    *sign_len = sig->sign_len;
+
+  return sig->sign_data;
+}
+
+/* Return the signed data from the payload */
+
+SilcBuffer silc_message_signed_get_data(SilcMessagePayload payload)
+{
+  if (!(payload->flags & SILC_MESSAGE_FLAG_SIGNED) || !payload->sig.sign_data)
+    return NULL;
+
+  return silc_message_signed_data(payload);
+}
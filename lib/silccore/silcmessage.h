@@ -84,6 +84,44 @@ typedef SilcUInt16 SilcMessageFlags;
 #define SILC_MESSAGE_FLAG_PRIVATE     0x2000	  /* to 0x8000 */
 /***/
 
+/****f* silccore/SilcMessageAPI/silc_message_payload_check_mac
+ *
+ * SYNOPSIS
+ *
+ *    SilcBool silc_message_payload_check_mac(const unsigned char *data,
+ *                                            SilcUInt32 data_len,
+ *                                            SilcHmac hmac,
+ *                                            const unsigned char *sender_id,
+ *                                            SilcUInt32 sender_id_len,
+ *                                            const unsigned char *receiver_id,
+ *                                            SilcUInt32 receiver_id_len,
+ *                                            SilcBool old_mac);
+ *
+ * DESCRIPTION
+ *
+ *    Checks the MAC of the encrypted Message Payload indicated by `data'
+ *    without decrypting it.  Returns TRUE if the MAC is valid.  This can
+ *    be used to find the correct key for the message when there are many
+ *    keys to choose from, before decrypting the message with
+ *    silc_message_payload_parse_ext.
+ *
+ *    The `sender_id' and `receiver_id' are the IDs from the packet header
+ *    of the packet where this message payload was received.  If `old_mac'
+ *    is TRUE the old style MAC, computed without the IDs, is accepted too.
+ *    The old style MAC is used by SILC Toolkit versions older than 1.1.
+ *    Checking it requires computing the MAC twice when the MAC does not
+ *    match.
+ *
+ ***/
+SilcBool silc_message_payload_check_mac(const unsigned char *data,
+					SilcUInt32 data_len,
+					SilcHmac hmac,
+					const unsigned char *sender_id,
+					SilcUInt32 sender_id_len,
+					const unsigned char *receiver_id,
+					SilcUInt32 receiver_id_len,
+					SilcBool old_mac);
+
 /****f* silccore/SilcMessageAPI/silc_message_payload_decrypt
  *
  * SYNOPSIS
@@ -194,6 +232,49 @@ silc_message_payload_parse(unsigned char *payload,
 			   SilcBool no_allocation,
 			   SilcMessagePayload message);
 
+/****f* silccore/SilcMessageAPI/silc_message_payload_parse_ext
+ *
+ * SYNOPSIS
+ *
+ *    SilcMessagePayload
+ *    silc_message_payload_parse_ext(unsigned char *payload,
+ *                                   SilcUInt32 payload_len,
+ *                                   SilcBool private_message,
+ *                                   SilcBool static_key,
+ *                                   SilcCipher cipher,
+ *                                   SilcHmac hmac,
+ *                                   unsigned char *sender_id,
+ *                                   SilcUInt32 sender_id_len,
+ *                                   unsigned char *receiver_id,
+ *                                   SilcUInt32 receiver_id_len,
+ *                                   SilcStack stack,
+ *                                   SilcBool no_allocation,
+ *                                   SilcMessagePayload message,
+ *                                   SilcBool check_mac);
+ *
+ * DESCRIPTION
+ *
+ *    Same as silc_message_payload_parse but the MAC is checked only if
+ *    `check_mac' is TRUE.  Set it to FALSE if the MAC was already checked
+ *    with silc_message_payload_check_mac.
+ *
+ ***/
+SilcMessagePayload
+silc_message_payload_parse_ext(unsigned char *payload,
+			       SilcUInt32 payload_len,
+			       SilcBool private_message,
+			       SilcBool static_key,
+			       SilcCipher cipher,
+			       SilcHmac hmac,
+			       unsigned char *sender_id,
+			       SilcUInt32 sender_id_len,
+			       unsigned char *receiver_id,
+			       SilcUInt32 receiver_id_len,
+			       SilcStack stack,
+			       SilcBool no_allocation,
+			       SilcMessagePayload message,
+			       SilcBool check_mac);
+
 /****f* silccore/SilcMessageAPI/silc_message_payload_encrypt
  *
  * SYNOPSIS
@@ -382,6 +463,114 @@ SilcAuthResult silc_message_signed_verify(SilcMessagePayload message,
 					  SilcPublicKey remote_public_key,
 					  SilcHash hash);
 
+/****s* silccore/SilcMessageAPI/SilcMessageVerifier
+ *
+ * NAME
+ *
+ *    typedef struct SilcMessageVerifierStruct *SilcMessageVerifier;
+ *
+ * DESCRIPTION
+ *
+ *    The message signature verifier context.  It is used to verify
+ *    message signatures asynchronously with the
+ *    silc_message_signed_verify_async.  It is allocated with the
+ *    silc_message_verifier_alloc and freed with the
+ *    silc_message_verifier_free.
+ *
+ ***/
+typedef struct SilcMessageVerifierStruct *SilcMessageVerifier;
+
+/****f* silccore/SilcMessageAPI/SilcMessageVerifyCb
+ *
+ * SYNOPSIS
+ *
+ *    typedef void (*SilcMessageVerifyCb)(SilcAuthResult result,
+ *                                        void *context);
+ *
+ * DESCRIPTION
+ *
+ *    Callback function given as argument to the
+ *    silc_message_signed_verify_async.  The `result' is SILC_AUTH_OK
+ *    if the signature was verified successfully.
+ *
+ ***/
+typedef void (*SilcMessageVerifyCb)(SilcAuthResult result, void *context);
+
+/****f* silccore/SilcMessageAPI/silc_message_verifier_alloc
+ *
+ * SYNOPSIS
+ *
+ *    SilcMessageVerifier
+ *    silc_message_verifier_alloc(SilcSchedule schedule,
+ *                                SilcUInt32 max_threads);
+ *
+ * DESCRIPTION
+ *
+ *    Allocates message signature verifier.  The signatures are verified
+ *    in at most `max_threads' threads at a time, and the results are
+ *    delivered through the `schedule'.  If `max_threads' is zero a
+ *    default value is used.  If threads are not supported the signatures
+ *    are verified in the scheduler, but still asynchronously.  Returns
+ *    NULL on error.
+ *
+ ***/
+SilcMessageVerifier silc_message_verifier_alloc(SilcSchedule schedule,
+						SilcUInt32 max_threads);
+
+/****f* silccore/SilcMessageAPI/silc_message_verifier_free
+ *
+ * SYNOPSIS
+ *
+ *    void silc_message_verifier_free(SilcMessageVerifier verifier);
+ *
+ * DESCRIPTION
+ *
+ *    Frees the message signature verifier.  The callbacks of pending
+ *    verifications will not be called.  This waits for the signatures
+ *    that are being verified currently in threads.
+ *
+ ***/
+void silc_message_verifier_free(SilcMessageVerifier verifier);
+
+/****f* silccore/SilcMessageAPI/silc_message_signed_verify_async
+ *
+ * SYNOPSIS
+ *
+ *    SilcAsyncOperation
+ *    silc_message_signed_verify_async(SilcMessageVerifier verifier,
+ *                                     SilcMessagePayload message,
+ *                                     SilcPublicKey remote_public_key,
+ *                                     SilcHash hash,
+ *                                     SilcMessageVerifyCb callback,
+ *                                     void *context);
+ *
+ * DESCRIPTION
+ *
+ *    Same as silc_message_signed_verify but verifies the signature
+ *    asynchronously in a worker thread.  The `callback' is called with
+ *    the result later from the scheduler given to the
+ *    silc_message_verifier_alloc.  Messages that are verified with the
+ *    same public key around the same time are verified together in one
+ *    thread.
+ *
+ *    The `message', `remote_public_key' and `hash' are not used after
+ *    this function returns and the caller may free them.  Returns NULL
+ *    without calling the `callback' if the message is not signed or the
+ *    verification could not be started, for example when out of memory.
+ *    The caller should then verify the message with the function
+ *    silc_message_signed_verify.  The returned operation can be used to
+ *    abort the verification, in which case the `callback' will not be
+ *    called.
+ *
+ ***/
+SilcAsyncOperation
+silc_message_signed_verify_async(SilcMessageVerifier verifier,
+				 SilcMessagePayload message,
+				 SilcPublicKey remote_public_key,
+				 SilcHash hash,
+				 SilcMessageVerifyCb callback,
+				 void *context);
+
 /****f* silccore/SilcMessageAPI/silc_message_signed_get_public_key
  *
  * SYNOPSIS
@@ -405,6 +594,43 @@ silc_message_signed_get_public_key(SilcMessagePayload payload,
 				   const unsigned char **pk_data,
 				   SilcUInt32 *pk_data_len);
 
+/****f* silccore/SilcMessageAPI/silc_message_signed_get_signature
+ *
+ * SYNOPSIS
+ *
+ *    const unsigned char *
+ *    silc_message_signed_get_signature(SilcMessagePayload payload,
+ *                                      SilcUInt32 *sign_len);
+ *
+ * DESCRIPTION
+ *
+ *    Returns the raw signature data from the message payload and its
+ *    length into `sign_len', or NULL if the message is not signed.  The
+ *    caller must not free the returned pointer.
+ *
+ ***/
+const unsigned char *
+silc_message_signed_get_signature(SilcMessagePayload payload,
+				  SilcUInt32 *sign_len);
+
+/****f* silccore/SilcMessageAPI/silc_message_signed_get_data
+ *
+ * SYNOPSIS
+ *
+ *    SilcBuffer
+ *    silc_message_signed_get_data(SilcMessagePayload payload);
+ *
+ * DESCRIPTION
+ *
+ *    Returns the data the signature of the message payload was computed
+ *    over: the Message Payload including the padding, followed by the
+ *    public key from the SILC_MESSAGE_FLAG_SIGNED Payload.  Returns NULL
+ *    if the message is not signed.  The caller must free the returned
+ *    buffer.
+ *
+ ***/
+SilcBuffer silc_message_signed_get_data(SilcMessagePayload payload);
+
 #include "silcmessage_i.h"
 
 #endif /* SILCMESSAGE_H */
@@ -45,6 +45,9 @@ struct SilcPacketEngineStruct {
   SilcList streams;			 /* All streams in engine */
   SilcList packet_pool;       		 /* Free list for received packets */
   SilcHashTable udp_remote;		 /* UDP remote streams, or NULL */
+  SilcBufferProgramStruct header;	 /* Compiled packet header format */
+  SilcBufferProgramStruct header_start;	 /* Compiled header parser, start */
+  SilcBufferProgramStruct header_ids;	 /* Compiled header parser, IDs */
   unsigned int local_is_router    : 1;
 };
 
@@ -93,6 +96,48 @@ struct SilcPacketStreamStruct {
   unsigned int udp         : 1;          /* UDP remote stream */
 };
 
+/* The SILC packet header, with optional IV and sequence number, padding
+   and the packet data.  See silc_packet_send_raw. */
+static const SilcBufferParamType silc_packet_header_spec[] = {
+  SILC_PARAM_DATA,			 /* IV */
+  SILC_PARAM_DATA,			 /* Sequence number */
+  SILC_PARAM_UI16_SHORT,		 /* Payload length */
+  SILC_PARAM_UI8_CHAR,			 /* Flags */
+  SILC_PARAM_UI8_CHAR,			 /* Packet type */
+  SILC_PARAM_UI8_CHAR,			 /* Padding length */
+  SILC_PARAM_UI8_CHAR,			 /* Reserved */
+  SILC_PARAM_UI8_CHAR,			 /* Source ID length */
+  SILC_PARAM_UI8_CHAR,			 /* Destination ID length */
+  SILC_PARAM_UI8_CHAR,			 /* Source ID type */
+  SILC_PARAM_DATA,			 /* Source ID */
+  SILC_PARAM_UI8_CHAR,			 /* Destination ID type */
+  SILC_PARAM_DATA,			 /* Destination ID */
+  SILC_PARAM_DATA,			 /* Padding */
+  SILC_PARAM_DATA,			 /* Data */
+  SILC_PARAM_END
+};
+
+/* Start of the received SILC packet header, up to the source ID type.
+   See silc_packet_parse. */
+static const SilcBufferParamType silc_packet_header_start_spec[] = {
+  SILC_PARAM_ADVANCE,
+  SILC_PARAM_OFFSET,			 /* Length, flags, type, padlen, rsv */
+  SILC_PARAM_UI8_CHAR,			 /* Source ID length */
+  SILC_PARAM_UI8_CHAR,			 /* Destination ID length */
+  SILC_PARAM_UI8_CHAR,			 /* Source ID type */
+  SILC_PARAM_END
+};
+
+/* Rest of the received SILC packet header, IDs and padding */
+static const SilcBufferParamType silc_packet_header_ids_spec[] = {
+  SILC_PARAM_ADVANCE,
+  SILC_PARAM_DATA,			 /* Source ID */
+  SILC_PARAM_UI8_CHAR,			 /* Destination ID type */
+  SILC_PARAM_DATA,			 /* Destination ID */
+  SILC_PARAM_OFFSET,			 /* Padding */
+  SILC_PARAM_END
+};
+
 /* Initial size of stream buffers */
 #define SILC_PACKET_DEFAULT_SIZE  1024
 
@@ -568,6 +613,18 @@ silc_packet_engine_start(SilcRng rng, SilcBool router,
     return NULL;
   }
 
+  /* Compile the packet header formats */
+  if (!silc_buffer_program_compile(&engine->header,
+				   silc_packet_header_spec) ||
+      !silc_buffer_program_compile(&engine->header_start,
+				   silc_packet_header_start_spec) ||
+      !silc_buffer_program_compile(&engine->header_ids,
+				   silc_packet_header_ids_spec)) {
+    silc_hash_table_free(engine->contexts);
+    silc_free(engine);
+    return NULL;
+  }
+
   engine->rng = rng;
   engine->local_is_router = router;
   engine->callbacks = callbacks;
@@ -1548,6 +1605,7 @@ static inline SilcBool silc_packet_send_raw(SilcPacketStream stream,
   int i, enclen, truelen, padlen = 0, ivlen = 0, psnlen = 0;
   SilcBool ctr;
   SilcBufferStruct packet;
+  SilcBufferArg args[15];
 
   SILC_LOG_DEBUG(("Sending packet %s (%d) flags %d, src %d dst %d, "
 		  "data len %d", silc_get_packet_name(type), stream->send_psn,
@@ -1645,24 +1703,29 @@ static inline SilcBool silc_packet_send_raw(SilcPacketStream stream,
   SILC_PUT32_MSB(stream->send_psn, psn);
 
   /* Create the packet.  This creates the SILC header, adds padding, and
-     the actual packet data. */
-  i = silc_buffer_format(&packet,
-			 SILC_STR_DATA(iv, ivlen),
-			 SILC_STR_DATA(psn, psnlen),
-			 SILC_STR_UI_SHORT(truelen),
-			 SILC_STR_UI_CHAR(flags),
-			 SILC_STR_UI_CHAR(type),
-			 SILC_STR_UI_CHAR(padlen),
-			 SILC_STR_UI_CHAR(0),
-			 SILC_STR_UI_CHAR(src_id_len),
-			 SILC_STR_UI_CHAR(dst_id_len),
-			 SILC_STR_UI_CHAR(src_id_type),
-			 SILC_STR_DATA(src_id, src_id_len),
-			 SILC_STR_UI_CHAR(dst_id_type),
-			 SILC_STR_DATA(dst_id, dst_id_len),
-			 SILC_STR_DATA(tmppad, padlen),
-			 SILC_STR_DATA(data, data_len),
-			 SILC_STR_END);
+     the actual packet data.  The format is silc_packet_header_spec. */
+  args[0].data.data = iv;
+  args[0].data.len = ivlen;
+  args[1].data.data = psn;
+  args[1].data.len = psnlen;
+  args[2].ui = truelen;
+  args[3].ui = flags;
+  args[4].ui = type;
+  args[5].ui = padlen;
+  args[6].ui = 0;
+  args[7].ui = src_id_len;
+  args[8].ui = dst_id_len;
+  args[9].ui = src_id_type;
+  args[10].data.data = src_id;
+  args[10].data.len = src_id_len;
+  args[11].ui = dst_id_type;
+  args[12].data.data = dst_id;
+  args[12].data.len = dst_id_len;
+  args[13].data.data = tmppad;
+  args[13].data.len = padlen;
+  args[14].data.data = data;
+  args[14].data.len = data_len;
+  i = silc_buffer_program_format(&stream->sc->engine->header, &packet, args);
   if (silc_unlikely(i < 0)) {
     SILC_LOG_ERROR(("Error encoding outgoing packet"));
     silc_mutex_unlock(stream->lock);
@@ -1950,18 +2013,18 @@ static inline SilcBool silc_packet_parse(SilcPacket packet)
   SilcBuffer buffer = &packet->buffer;
   SilcUInt8 padlen = (SilcUInt8)buffer->data[4];
   SilcUInt8 src_id_len, dst_id_len, src_id_type, dst_id_type;
+  SilcPacketEngine engine = packet->stream->sc->engine;
+  SilcBufferArg args[4];
   int ret;
 
   SILC_LOG_DEBUG(("Parsing incoming packet"));
 
   /* Parse the buffer.  This parses the SILC header of the packet. */
-  ret = silc_buffer_unformat(buffer,
-			     SILC_STR_ADVANCE,
-			     SILC_STR_OFFSET(6),
-			     SILC_STR_UI_CHAR(&src_id_len),
-			     SILC_STR_UI_CHAR(&dst_id_len),
-			     SILC_STR_UI_CHAR(&src_id_type),
-			     SILC_STR_END);
+  args[0].offset = 6;
+  args[1].ptr = &src_id_len;
+  args[2].ptr = &dst_id_len;
+  args[3].ptr = &src_id_type;
+  ret = silc_buffer_program_unformat(&engine->header_start, buffer, args);
   if (silc_unlikely(ret == -1)) {
     if (!packet->stream->udp &&
 	!silc_socket_stream_is_udp(packet->stream->stream, NULL))
@@ -1978,13 +2041,13 @@ static inline SilcBool silc_packet_parse(SilcPacket packet)
     return FALSE;
   }
 
-  ret = silc_buffer_unformat(buffer,
-			     SILC_STR_ADVANCE,
-			     SILC_STR_DATA(&packet->src_id, src_id_len),
-			     SILC_STR_UI_CHAR(&dst_id_type),
-			     SILC_STR_DATA(&packet->dst_id, dst_id_len),
-			     SILC_STR_OFFSET(padlen),
-			     SILC_STR_END);
+  args[0].ret_data.data = &packet->src_id;
+  args[0].ret_data.len = src_id_len;
+  args[1].ptr = &dst_id_type;
+  args[2].ret_data.data = &packet->dst_id;
+  args[2].ret_data.len = dst_id_len;
+  args[3].offset = padlen;
+  ret = silc_buffer_program_unformat(&engine->header_ids, buffer, args);
   if (silc_unlikely(ret == -1)) {
     if (!packet->stream->udp &&
 	!silc_socket_stream_is_udp(packet->stream->stream, NULL))
@@ -161,6 +161,7 @@ SilcBool silc_rsa_generate_keys(SilcUInt32 bits, SilcMPInt *p, SilcMPInt *q,
   pubkey->bits = privkey->bits;
   silc_mp_set(&pubkey->n, &privkey->n);
   silc_mp_set(&pubkey->e, &privkey->e);
+  pubkey->ctx = silc_mp_mod_context_alloc(&pubkey->n);
 
   return TRUE;
 }
@@ -171,7 +172,10 @@ SilcBool silc_rsa_public_operation(RsaPublicKey *key, SilcMPInt *src,
 				   SilcMPInt *dst)
 {
   /* dst = src ^ e mod n */
-  silc_mp_pow_mod(dst, src, &key->e, &key->n);
+  if (key->ctx)
+    silc_mp_pow_mod_ctx(dst, src, &key->e, key->ctx);
+  else
+    silc_mp_pow_mod(dst, src, &key->e, &key->n);
   return TRUE;
 }
 
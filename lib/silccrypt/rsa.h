@@ -25,6 +25,7 @@ typedef struct {
   int bits;			/* bits in key */
   SilcMPInt n;			/* modulus */
   SilcMPInt e;			/* public exponent */
+  SilcMPModContext ctx;		/* modulus context, may be NULL */
 } RsaPublicKey;
 
 /* RSA Private Key */
@@ -183,41 +183,45 @@ SilcBool silc_pkcs1_generate_key(SilcUInt32 keylen,
 				 void **ret_private_key)
 {
   SilcUInt32 prime_bits = keylen / 2;
-  SilcMPInt p, q;
+  SilcMPInt pq[2];
   SilcBool found = FALSE;
 
   if (keylen < 768 || keylen > 16384)
     return FALSE;
 
-  silc_mp_init(&p);
-  silc_mp_init(&q);
+  silc_mp_init(&pq[0]);
+  silc_mp_init(&pq[1]);
 
   /* Find p and q */
   while (!found) {
-    silc_math_gen_prime(&p, prime_bits, FALSE, rng);
-    silc_math_gen_prime(&q, prime_bits, FALSE, rng);
-    if ((silc_mp_cmp(&p, &q)) != 0)
+    if (!silc_math_gen_primes(pq, 2, prime_bits, rng)) {
+      silc_mp_uninit(&pq[0]);
+      silc_mp_uninit(&pq[1]);
+      return FALSE;
+    }
+    if ((silc_mp_cmp(&pq[0], &pq[1])) != 0)
       found = TRUE;
   }
 
   /* If p is smaller than q, switch them */
-  if ((silc_mp_cmp(&p, &q)) > 0) {
+  if ((silc_mp_cmp(&pq[0], &pq[1])) > 0) {
     SilcMPInt hlp;
     silc_mp_init(&hlp);
 
-    silc_mp_set(&hlp, &p);
-    silc_mp_set(&p, &q);
-    silc_mp_set(&q, &hlp);
+    silc_mp_set(&hlp, &pq[0]);
+    silc_mp_set(&pq[0], &pq[1]);
+    silc_mp_set(&pq[1], &hlp);
 
     silc_mp_uninit(&hlp);
   }
 
   /* Generate the actual keys */
-  if (!silc_rsa_generate_keys(keylen, &p, &q, ret_public_key, ret_private_key))
+  if (!silc_rsa_generate_keys(keylen, &pq[0], &pq[1], ret_public_key,
+			      ret_private_key))
     return FALSE;
 
-  silc_mp_uninit(&p);
-  silc_mp_uninit(&q);
+  silc_mp_uninit(&pq[0]);
+  silc_mp_uninit(&pq[1]);
 
   return TRUE;
 }
@@ -257,6 +261,9 @@ int silc_pkcs1_import_public_key(unsigned char *key,
   /* Set key length */
   pubkey->bits = ((silc_mp_sizeinbase(&pubkey->n, 2) + 7) / 8) * 8;
 
+  /* Cache modulus values for the public key operation */
+  pubkey->ctx = silc_mp_mod_context_alloc(&pubkey->n);
+
   silc_asn1_free(asn1);
 
   return key_len;
@@ -325,6 +332,7 @@ void *silc_pkcs1_public_key_copy(void *public_key)
   silc_mp_set(&new_key->n, &key->n);
   silc_mp_set(&new_key->e, &key->e);
   new_key->bits = key->bits;
+  new_key->ctx = silc_mp_mod_context_alloc(&new_key->n);
 
   return new_key;
 }
@@ -353,6 +361,7 @@ void silc_pkcs1_public_key_free(void *public_key)
 
   silc_mp_uninit(&key->n);
   silc_mp_uninit(&key->e);
+  silc_mp_mod_context_free(key->ctx);
   silc_free(key);
 }
 
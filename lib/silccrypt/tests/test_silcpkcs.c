@@ -0,0 +1,131 @@
+/* RSA key generation, signing and verification tests and benchmark */
+
+#include "silc.h"
+
+/* Key sizes, key generations, and signatures and verifications measured */
+static const struct {
+  int bits;
+  int keys;
+  int signs;
+  int verifies;
+} sizes[] = {
+  { 2048, 20, 100, 2000 },
+  { 4096, 5, 20, 500 },
+};
+
+/* Generates `keys' keys of `bits' bits and prints the average time.
+   Then signs and verifies with the last key and prints the rates.
+   Signatures of other data and changed signatures must not verify. */
+
+static SilcBool bench(SilcRng rng, SilcHash hash, int bits, int keys,
+		      int signs, int verifies)
+{
+  SilcPublicKey public_key = NULL;
+  SilcPrivateKey private_key = NULL;
+  unsigned char data[64], sig[1024];
+  SilcUInt32 sig_len;
+  SilcInt64 usec;
+  double sign_rate, verify_rate;
+  int i;
+
+  usec = silc_time_usec();
+  for (i = 0; i < keys; i++) {
+    if (public_key) {
+      silc_pkcs_public_key_free(public_key);
+      silc_pkcs_private_key_free(private_key);
+    }
+    if (!silc_pkcs_silc_generate_key("rsa", bits, "UN=test, HN=localhost",
+				     rng, &public_key, &private_key))
+      return FALSE;
+    if (silc_pkcs_public_key_get_len(public_key) != bits ||
+	silc_pkcs_private_key_get_len(private_key) != bits) {
+      fprintf(stderr, "RSA-%d: generated key is %d bits\n", bits,
+	      silc_pkcs_public_key_get_len(public_key));
+      return FALSE;
+    }
+  }
+  usec = silc_time_usec() - usec;
+  fprintf(stdout, "RSA-%d: key generation %.0f ms\n", bits,
+	  usec / 1000.0 / keys);
+
+  memset(data, 0x5a, sizeof(data));
+
+  usec = silc_time_usec();
+  for (i = 0; i < signs; i++) {
+    if (!silc_pkcs_sign(private_key, data, sizeof(data), sig, sizeof(sig),
+			&sig_len, TRUE, hash))
+      return FALSE;
+  }
+  sign_rate = signs * 1000000.0 / (silc_time_usec() - usec);
+
+  usec = silc_time_usec();
+  for (i = 0; i < verifies; i++) {
+    if (!silc_pkcs_verify(public_key, sig, sig_len, data, sizeof(data),
+			  hash)) {
+      fprintf(stderr, "RSA-%d: signature did not verify\n", bits);
+      return FALSE;
+    }
+  }
+  verify_rate = verifies * 1000000.0 / (silc_time_usec() - usec);
+
+  fprintf(stdout, "RSA-%d: %.1f signs/sec (%.2f ms), "
+	  "%.0f verifies/sec (%.3f ms)\n", bits,
+	  sign_rate, 1000.0 / sign_rate, verify_rate, 1000.0 / verify_rate);
+
+  data[10] ^= 0x01;
+  if (silc_pkcs_verify(public_key, sig, sig_len, data, sizeof(data), hash)) {
+    fprintf(stderr, "RSA-%d: signature verified with other data\n", bits);
+    return FALSE;
+  }
+  data[10] ^= 0x01;
+  sig[sig_len / 2] ^= 0x80;
+  if (silc_pkcs_verify(public_key, sig, sig_len, data, sizeof(data), hash)) {
+    fprintf(stderr, "RSA-%d: changed signature verified\n", bits);
+    return FALSE;
+  }
+
+  silc_pkcs_public_key_free(public_key);
+  silc_pkcs_private_key_free(private_key);
+  return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  SilcRng rng = NULL;
+  SilcHash hash = NULL;
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*crypt*,*pkcs*,*rsa*");
+  }
+
+  silc_pkcs_register_default();
+  silc_hash_register_default();
+
+  rng = silc_rng_alloc();
+  if (!rng)
+    goto err;
+  silc_rng_init(rng);
+  if (!silc_hash_alloc("sha1", &hash))
+    goto err;
+
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    if (!bench(rng, hash, sizes[i].bits, sizes[i].keys, sizes[i].signs,
+	       sizes[i].verifies))
+      goto err;
+
+  success = TRUE;
+
+ err:
+  if (hash)
+    silc_hash_free(hash);
+  if (rng)
+    silc_rng_free(rng);
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
@@ -185,6 +185,48 @@ void silc_mp_pow_mod_ui(SilcMPInt *dst, SilcMPInt *mp1, SilcUInt32 exp,
   mpz_powm_ui(dst, mp1, exp, mod);
 }
 
+/* GMP does its own Montgomery setup internally, the context only keeps
+   the modulus. */
+
+struct SilcMPModContextStruct {
+  MP_INT mod;
+};
+
+SilcMPModContext silc_mp_mod_context_alloc(SilcMPInt *mod)
+{
+  SilcMPModContext ctx;
+
+  if (mpz_cmp_ui(mod, 1) <= 0 || !mpz_odd_p(mod))
+    return NULL;
+
+  ctx = silc_calloc(1, sizeof(*ctx));
+  if (!ctx)
+    return NULL;
+
+  mpz_init_set(&ctx->mod, mod);
+  return ctx;
+}
+
+void silc_mp_mod_context_free(SilcMPModContext ctx)
+{
+  if (!ctx)
+    return;
+  mpz_clear(&ctx->mod);
+  silc_free(ctx);
+}
+
+SilcBool silc_mp_mod_context_set_base(SilcMPModContext ctx, SilcMPInt *base,
+				      SilcUInt32 exp_bits)
+{
+  return FALSE;
+}
+
+void silc_mp_pow_mod_ctx(SilcMPInt *dst, SilcMPInt *mp1, SilcMPInt *exp,
+			 SilcMPModContext ctx)
+{
+  mpz_powm(dst, mp1, exp, &ctx->mod);
+}
+
 void silc_mp_gcd(SilcMPInt *dst, SilcMPInt *mp1, SilcMPInt *mp2)
 {
   mpz_gcd(dst, mp1, mp2);
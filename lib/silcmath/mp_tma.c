@@ -196,6 +196,392 @@ void silc_mp_pow_mod_ui(SilcMPInt *dst, SilcMPInt *mp1, SilcUInt32 exp,
   silc_mp_uninit(&tmp);
 }
 
+/* Modular exponentiation context.  The values are kept in Montgomery
+   form, and the reduction is done the same way tma_mp_exptmod_fast does
+   it, but the Montgomery setup is done only once per modulus. */
+
+#ifdef MP_LOW_MEM
+#define SILC_MP_TAB_SIZE 32
+#else
+#define SILC_MP_TAB_SIZE 256
+#endif /* MP_LOW_MEM */
+
+/* Number of teeth in fixed-base comb, table has 2^teeth entries */
+#define SILC_MP_COMB_TEETH 8
+
+typedef int (*SilcMPRedux)(tma_mp_int *a, tma_mp_int *m, tma_mp_digit mp);
+
+struct SilcMPModContextStruct {
+  tma_mp_int mod;			/* Modulus */
+  tma_mp_int one;			/* R mod m, one in Montgomery form */
+  tma_mp_int r2;			/* R^2 mod m */
+  tma_mp_digit rho;			/* Montgomery reduction constant */
+  SilcMPRedux redux;			/* Montgomery reduction */
+  tma_mp_int base;			/* Fixed base */
+  tma_mp_int *comb;			/* Fixed-base comb table */
+  int spacing;				/* Exponent bits per comb tooth */
+};
+
+/* Converts `a' to Montgomery form into `c' */
+
+static int silc_mp_ctx_to_mont(SilcMPModContext ctx, tma_mp_int *a,
+			       tma_mp_int *c)
+{
+  int err;
+
+  if (a->sign == MP_NEG || tma_mp_cmp_mag(a, &ctx->mod) != MP_LT)
+    err = tma_mp_mod(a, &ctx->mod, c);
+  else
+    err = tma_mp_copy(a, c);
+  if (err != MP_OKAY)
+    return err;
+
+  if ((err = tma_mp_mul(c, &ctx->r2, c)) != MP_OKAY)
+    return err;
+  return ctx->redux(c, &ctx->mod, ctx->rho);
+}
+
+/* Montgomery multiplication c = a * b / R mod m */
+
+static inline int silc_mp_ctx_mul(SilcMPModContext ctx, tma_mp_int *a,
+				  tma_mp_int *b, tma_mp_int *c)
+{
+  int err;
+  if ((err = tma_mp_mul(a, b, c)) != MP_OKAY)
+    return err;
+  return ctx->redux(c, &ctx->mod, ctx->rho);
+}
+
+/* Montgomery squaring c = a * a / R mod m */
+
+static inline int silc_mp_ctx_sqr(SilcMPModContext ctx, tma_mp_int *a,
+				  tma_mp_int *c)
+{
+  int err;
+  if ((err = tma_mp_sqr(a, c)) != MP_OKAY)
+    return err;
+  return ctx->redux(c, &ctx->mod, ctx->rho);
+}
+
+/* Returns bit `n' of `a' */
+
+static inline int silc_mp_ctx_bit(tma_mp_int *a, int n)
+{
+  int d = n / DIGIT_BIT;
+  if (d >= a->used)
+    return 0;
+  return (int)((a->dp[d] >> (n % DIGIT_BIT)) & 1);
+}
+
+/* Computes Y = G ** X mod m with left-to-right sliding window.  Same as
+   tma_mp_exptmod_fast but with cached Montgomery values. */
+
+static int silc_mp_ctx_exptmod(SilcMPModContext ctx, tma_mp_int *G,
+			       tma_mp_int *X, tma_mp_int *Y)
+{
+  tma_mp_int M[SILC_MP_TAB_SIZE], res;
+  tma_mp_digit buf;
+  int err, bitbuf, bitcpy, bitcnt, mode, digidx, x, y, winsize;
+
+  /* find window size */
+  x = tma_mp_count_bits(X);
+  if (x <= 7)
+    winsize = 2;
+  else if (x <= 36)
+    winsize = 3;
+  else if (x <= 140)
+    winsize = 4;
+  else if (x <= 450)
+    winsize = 5;
+  else if (x <= 1303)
+    winsize = 6;
+  else if (x <= 3529)
+    winsize = 7;
+  else
+    winsize = 8;
+#ifdef MP_LOW_MEM
+  if (winsize > 5)
+    winsize = 5;
+#endif /* MP_LOW_MEM */
+
+  /* init first cell and the second half of the table */
+  if ((err = tma_mp_init(&M[1])) != MP_OKAY)
+    return err;
+  for (x = 1 << (winsize - 1); x < (1 << winsize); x++) {
+    if ((err = tma_mp_init(&M[x])) != MP_OKAY) {
+      for (y = 1 << (winsize - 1); y < x; y++)
+	tma_mp_clear(&M[y]);
+      tma_mp_clear(&M[1]);
+      return err;
+    }
+  }
+  if ((err = tma_mp_init_copy(&res, &ctx->one)) != MP_OKAY)
+    goto out_m;
+
+  /* M[1] = G * R mod m */
+  if ((err = silc_mp_ctx_to_mont(ctx, G, &M[1])) != MP_OKAY)
+    goto out;
+
+  /* M[1 << (winsize - 1)] by squaring M[1] (winsize - 1) times */
+  if ((err = tma_mp_copy(&M[1], &M[1 << (winsize - 1)])) != MP_OKAY)
+    goto out;
+  for (x = 0; x < (winsize - 1); x++)
+    if ((err = silc_mp_ctx_sqr(ctx, &M[1 << (winsize - 1)],
+			       &M[1 << (winsize - 1)])) != MP_OKAY)
+      goto out;
+
+  /* upper table */
+  for (x = (1 << (winsize - 1)) + 1; x < (1 << winsize); x++)
+    if ((err = silc_mp_ctx_mul(ctx, &M[x - 1], &M[1], &M[x])) != MP_OKAY)
+      goto out;
+
+  mode = 0;
+  bitcnt = 1;
+  buf = 0;
+  digidx = X->used - 1;
+  bitcpy = 0;
+  bitbuf = 0;
+
+  for (;;) {
+    /* grab next digit as required */
+    if (--bitcnt == 0) {
+      if (digidx == -1)
+	break;
+      buf = X->dp[digidx--];
+      bitcnt = (int)DIGIT_BIT;
+    }
+
+    /* next msb from the exponent */
+    y = (tma_mp_digit)(buf >> (DIGIT_BIT - 1)) & 1;
+    buf <<= (tma_mp_digit)1;
+
+    /* skip leading zero bits */
+    if (mode == 0 && y == 0)
+      continue;
+
+    /* zero bit outside window, square */
+    if (mode == 1 && y == 0) {
+      if ((err = silc_mp_ctx_sqr(ctx, &res, &res)) != MP_OKAY)
+	goto out;
+      continue;
+    }
+
+    /* add bit to the window */
+    bitbuf |= (y << (winsize - ++bitcpy));
+    mode = 2;
+
+    if (bitcpy == winsize) {
+      /* window is filled, square and multiply */
+      for (x = 0; x < winsize; x++)
+	if ((err = silc_mp_ctx_sqr(ctx, &res, &res)) != MP_OKAY)
+	  goto out;
+      if ((err = silc_mp_ctx_mul(ctx, &res, &M[bitbuf], &res)) != MP_OKAY)
+	goto out;
+
+      bitcpy = 0;
+      bitbuf = 0;
+      mode = 1;
+    }
+  }
+
+  /* if bits remain then square/multiply */
+  if (mode == 2 && bitcpy > 0) {
+    for (x = 0; x < bitcpy; x++) {
+      if ((err = silc_mp_ctx_sqr(ctx, &res, &res)) != MP_OKAY)
+	goto out;
+      bitbuf <<= 1;
+      if ((bitbuf & (1 << winsize)) != 0)
+	if ((err = silc_mp_ctx_mul(ctx, &res, &M[1], &res)) != MP_OKAY)
+	  goto out;
+    }
+  }
+
+  /* out of Montgomery form */
+  if ((err = ctx->redux(&res, &ctx->mod, ctx->rho)) != MP_OKAY)
+    goto out;
+
+  tma_mp_exch(&res, Y);
+  err = MP_OKAY;
+
+ out:
+  tma_mp_clear(&res);
+ out_m:
+  tma_mp_clear(&M[1]);
+  for (x = 1 << (winsize - 1); x < (1 << winsize); x++)
+    tma_mp_clear(&M[x]);
+  return err;
+}
+
+/* Computes Y = base ** X mod m with the fixed-base comb.  Bit k of each
+   of the comb teeth, `spacing' bits apart in the exponent, selects the
+   table entry to multiply with. */
+
+static int silc_mp_ctx_comb(SilcMPModContext ctx, tma_mp_int *X,
+			    tma_mp_int *Y)
+{
+  tma_mp_int res;
+  int err, i, j, k, started = 0;
+
+  if ((err = tma_mp_init_copy(&res, &ctx->one)) != MP_OKAY)
+    return err;
+
+  for (k = ctx->spacing - 1; k >= 0; k--) {
+    if (started)
+      if ((err = silc_mp_ctx_sqr(ctx, &res, &res)) != MP_OKAY)
+	goto out;
+
+    for (i = 0, j = 0; j < SILC_MP_COMB_TEETH; j++)
+      i |= silc_mp_ctx_bit(X, j * ctx->spacing + k) << j;
+
+    if (i) {
+      if ((err = silc_mp_ctx_mul(ctx, &res, &ctx->comb[i], &res)) != MP_OKAY)
+	goto out;
+      started = 1;
+    }
+  }
+
+  /* out of Montgomery form */
+  if ((err = ctx->redux(&res, &ctx->mod, ctx->rho)) != MP_OKAY)
+    goto out;
+
+  tma_mp_exch(&res, Y);
+
+ out:
+  tma_mp_clear(&res);
+  return err;
+}
+
+SilcMPModContext silc_mp_mod_context_alloc(SilcMPInt *mod)
+{
+  SilcMPModContext ctx;
+
+  /* Montgomery reduction needs odd modulus */
+  if (mod->sign == MP_NEG || tma_mp_isodd(mod) != MP_YES ||
+      tma_mp_cmp_d(mod, 1) != MP_GT)
+    return NULL;
+
+  ctx = silc_calloc(1, sizeof(*ctx));
+  if (!ctx)
+    return NULL;
+
+  if (tma_mp_init_multi(&ctx->mod, &ctx->one, &ctx->r2, &ctx->base,
+			NULL) != MP_OKAY) {
+    silc_free(ctx);
+    return NULL;
+  }
+
+  if (tma_mp_copy(mod, &ctx->mod) != MP_OKAY ||
+      tma_mp_montgomery_setup(&ctx->mod, &ctx->rho) != MP_OKAY ||
+      tma_mp_montgomery_calc_normalization(&ctx->one, &ctx->mod) != MP_OKAY ||
+      tma_mp_mulmod(&ctx->one, &ctx->one, &ctx->mod, &ctx->r2) != MP_OKAY) {
+    silc_mp_mod_context_free(ctx);
+    return NULL;
+  }
+
+  /* pick the comba reduction if possible */
+  if (((ctx->mod.used * 2 + 1) < MP_WARRAY) &&
+      ctx->mod.used < (1 << ((CHAR_BIT * sizeof(tma_mp_word)) -
+			     (2 * DIGIT_BIT))))
+    ctx->redux = fast_tma_mp_montgomery_reduce;
+  else
+    ctx->redux = tma_mp_montgomery_reduce;
+
+  return ctx;
+}
+
+void silc_mp_mod_context_free(SilcMPModContext ctx)
+{
+  int i;
+
+  if (!ctx)
+    return;
+
+  if (ctx->comb) {
+    for (i = 1; i < (1 << SILC_MP_COMB_TEETH); i++)
+      tma_mp_clear(&ctx->comb[i]);
+    silc_free(ctx->comb);
+  }
+  tma_mp_clear_multi(&ctx->mod, &ctx->one, &ctx->r2, &ctx->base, NULL);
+  silc_free(ctx);
+}
+
+SilcBool silc_mp_mod_context_set_base(SilcMPModContext ctx, SilcMPInt *base,
+				      SilcUInt32 exp_bits)
+{
+  tma_mp_int *comb;
+  int i, j;
+
+  if (ctx->comb || !exp_bits)
+    return FALSE;
+
+  comb = silc_calloc(1 << SILC_MP_COMB_TEETH, sizeof(*comb));
+  if (!comb)
+    return FALSE;
+  for (i = 1; i < (1 << SILC_MP_COMB_TEETH); i++) {
+    if (tma_mp_init(&comb[i]) != MP_OKAY) {
+      while (--i > 0)
+	tma_mp_clear(&comb[i]);
+      silc_free(comb);
+      return FALSE;
+    }
+  }
+
+  ctx->spacing = (exp_bits + SILC_MP_COMB_TEETH - 1) / SILC_MP_COMB_TEETH;
+  if (tma_mp_copy(base, &ctx->base) != MP_OKAY ||
+      silc_mp_ctx_to_mont(ctx, base, &comb[1]) != MP_OKAY)
+    goto err;
+
+  /* comb[1 << j] = base ** (2 ** (j * spacing)) */
+  for (j = 1; j < SILC_MP_COMB_TEETH; j++) {
+    if (tma_mp_copy(&comb[1 << (j - 1)], &comb[1 << j]) != MP_OKAY)
+      goto err;
+    for (i = 0; i < ctx->spacing; i++)
+      if (silc_mp_ctx_sqr(ctx, &comb[1 << j], &comb[1 << j]) != MP_OKAY)
+	goto err;
+  }
+
+  /* Rest of the entries are products of the above */
+  for (i = 3; i < (1 << SILC_MP_COMB_TEETH); i++) {
+    if (!(i & (i - 1)))
+      continue;
+    if (silc_mp_ctx_mul(ctx, &comb[i & (i - 1)], &comb[i & -i],
+			&comb[i]) != MP_OKAY)
+      goto err;
+  }
+
+  ctx->comb = comb;
+  return TRUE;
+
+ err:
+  for (i = 1; i < (1 << SILC_MP_COMB_TEETH); i++)
+    tma_mp_clear(&comb[i]);
+  silc_free(comb);
+  return FALSE;
+}
+
+void silc_mp_pow_mod_ctx(SilcMPInt *dst, SilcMPInt *mp1, SilcMPInt *exp,
+			 SilcMPModContext ctx)
+{
+  if (exp->sign == MP_NEG) {
+    (void)tma_mp_exptmod(mp1, exp, &ctx->mod, dst);
+    return;
+  }
+
+  if (tma_mp_iszero(exp)) {
+    tma_mp_set(dst, 1);
+    return;
+  }
+
+  if (ctx->comb &&
+      tma_mp_count_bits(exp) <= ctx->spacing * SILC_MP_COMB_TEETH &&
+      tma_mp_cmp(mp1, &ctx->base) == MP_EQ) {
+    (void)silc_mp_ctx_comb(ctx, exp, dst);
+    return;
+  }
+
+  (void)silc_mp_ctx_exptmod(ctx, mp1, exp, dst);
+}
+
 void silc_mp_gcd(SilcMPInt *dst, SilcMPInt *mp1, SilcMPInt *mp2)
 {
   (void)tma_mp_gcd(mp1, mp2, dst);
@@ -42,9 +42,10 @@
  * DESCRIPTION
  *
  *    Find appropriate prime. It generates a number by taking random bytes.
- *    It then tests the number that it's not divisible by any of the small
- *    primes and then it performs Fermat's prime test. I thank Rieks Joosten
- *    (r.joosten@pijnenburg.nl) for such a good help with prime tests.
+ *    It then searches upwards from the number for one that is not divisible
+ *    by any of the small primes and that passes Miller-Rabin test. I thank
+ *    Rieks Joosten (r.joosten@pijnenburg.nl) for such a good help with
+ *    prime tests.
  *
  *    If argument verbose is TRUE this will display some status information
  *    about the progress of generation.  If the `rng' is NULL then global
@@ -55,6 +56,25 @@
 SilcBool silc_math_gen_prime(SilcMPInt *prime, SilcUInt32 bits,
 			     SilcBool verbose, SilcRng rng);
 
+/****f* silcmath/SilcMathAPI/silc_math_gen_primes
+ *
+ * SYNOPSIS
+ *
+ *    SilcBool silc_math_gen_primes(SilcMPInt *primes, SilcUInt32 num_primes,
+ *                                  SilcUInt32 bits, SilcRng rng);
+ *
+ * DESCRIPTION
+ *
+ *    Same as silc_math_gen_prime but finds `num_primes' primes of `bits'
+ *    bits into the initialized `primes' array.  If threads are supported
+ *    each prime is searched in its own thread, for example p and q of an
+ *    RSA key are found concurrently.  The `rng' is used only from the
+ *    calling thread.  If the `rng' is NULL then global RNG is used.
+ *
+ ***/
+SilcBool silc_math_gen_primes(SilcMPInt *primes, SilcUInt32 num_primes,
+			      SilcUInt32 bits, SilcRng rng);
+
 /****f* silcmath/SilcMathAPI/silc_math_prime_test
  *
  * SYNOPSIS
@@ -507,6 +507,93 @@ void silc_mp_pow_mod(SilcMPInt *dst, SilcMPInt *mp1, SilcMPInt *exp,
 void silc_mp_pow_mod_ui(SilcMPInt *dst, SilcMPInt *mp1, SilcUInt32 exp,
 			SilcMPInt *mod);
 
+/****s* silcmath/SilcMPAPI/SilcMPModContext
+ *
+ * NAME
+ *
+ *    typedef struct SilcMPModContextStruct *SilcMPModContext;
+ *
+ * DESCRIPTION
+ *
+ *    Modular exponentiation context for one fixed modulus.  It caches
+ *    the values the exponentiation needs for the modulus, and optionally
+ *    a precomputed table for a fixed base, so that they are not computed
+ *    again for each exponentiation.  It is useful when many
+ *    exponentiations are done with the same modulus, like with a fixed
+ *    Diffie-Hellman group or an RSA public key.  The context is read-only
+ *    after it has been set up and may be used by several threads.  It is
+ *    allocated with silc_mp_mod_context_alloc.
+ *
+ ***/
+typedef struct SilcMPModContextStruct *SilcMPModContext;
+
+/****f* silcmath/SilcMPAPI/silc_mp_mod_context_alloc
+ *
+ * SYNOPSIS
+ *
+ *    SilcMPModContext silc_mp_mod_context_alloc(SilcMPInt *mod);
+ *
+ * DESCRIPTION
+ *
+ *    Allocates modular exponentiation context for the modulus `mod'.  The
+ *    modulus must be odd.  Returns NULL on error or if the modulus is not
+ *    suitable, in which case silc_mp_pow_mod should be used instead.
+ *
+ ***/
+SilcMPModContext silc_mp_mod_context_alloc(SilcMPInt *mod);
+
+/****f* silcmath/SilcMPAPI/silc_mp_mod_context_free
+ *
+ * SYNOPSIS
+ *
+ *    void silc_mp_mod_context_free(SilcMPModContext ctx);
+ *
+ * DESCRIPTION
+ *
+ *    Frees the modular exponentiation context.
+ *
+ ***/
+void silc_mp_mod_context_free(SilcMPModContext ctx);
+
+/****f* silcmath/SilcMPAPI/silc_mp_mod_context_set_base
+ *
+ * SYNOPSIS
+ *
+ *    SilcBool silc_mp_mod_context_set_base(SilcMPModContext ctx,
+ *                                          SilcMPInt *base,
+ *                                          SilcUInt32 exp_bits);
+ *
+ * DESCRIPTION
+ *
+ *    Precomputes a fixed-base comb table for the `base' into the context
+ *    `ctx'.  After this silc_mp_pow_mod_ctx computes powers of `base'
+ *    with exponents of at most `exp_bits' bits considerably faster.  The
+ *    precomputation costs about as much as one exponentiation, and the
+ *    table takes 255 times the size of the modulus in memory.  This may
+ *    be called only once for a context, before it is used.  Returns
+ *    FALSE on error.
+ *
+ ***/
+SilcBool silc_mp_mod_context_set_base(SilcMPModContext ctx, SilcMPInt *base,
+				      SilcUInt32 exp_bits);
+
+/****f* silcmath/SilcMPAPI/silc_mp_pow_mod_ctx
+ *
+ * SYNOPSIS
+ *
+ *    void silc_mp_pow_mod_ctx(SilcMPInt *dst, SilcMPInt *mp1,
+ *                             SilcMPInt *exp, SilcMPModContext ctx);
+ *
+ * DESCRIPTION
+ *
+ *    Compute (`mp1' ** `exp') mod `mod' and save the result to `dst',
+ *    where `mod' is the modulus of the context `ctx'.  This is same as
+ *    silc_mp_pow_mod but uses the values cached in the context.
+ *
+ ***/
+void silc_mp_pow_mod_ctx(SilcMPInt *dst, SilcMPInt *mp1, SilcMPInt *exp,
+			 SilcMPModContext ctx);
+
 /****f* silcmath/SilcMPAPI/silc_mp_modinv
  *
  * SYNOPSIS
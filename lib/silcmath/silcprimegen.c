@@ -186,97 +186,186 @@ static SilcUInt32 primetable[] =
 };
 
 
-/* Find appropriate prime. It generates a number by taking random bytes.
-   It then tests the number that it's not divisible by any of the small
-   primes and then it performs Fermat's prime test. I thank Rieks Joosten
-   (r.joosten@pijnenburg.nl) for such a good help with prime tests.
+/* Number of odd candidates sieved at a time */
+#define SILC_PRIME_SIEVE_SIZE 4096
 
-   If argument verbose is TRUE this will display some status information
-   about the progress of generation. */
+/* Candidates are sieved with all odd primes below this.  This is well past
+   the primetable[] since the native sieve makes each prime very cheap,
+   and every doubling of the limit saves some Miller-Rabin tests. */
+#define SILC_PRIME_SIEVE_LIMIT 65536
 
-SilcBool silc_math_gen_prime(SilcMPInt *prime, SilcUInt32 bits,
-			     SilcBool verbose, SilcRng rng)
+/* Returns the odd primes below SILC_PRIME_SIEVE_LIMIT in `primes', using
+   the sieve of Erastosthenes described above.  Returns their number, or 0
+   on error. */
+
+static SilcUInt32 silc_math_sieve_primes(SilcUInt32 **primes)
 {
-  unsigned char *numbuf = NULL;
-  SilcUInt32 i, b, k;
-  SilcUInt32 *spmods;
-  SilcMPInt r, base, tmp, tmp2, oprime;
-  SilcBool valid = FALSE;
+  unsigned char *composite;
+  SilcUInt32 i, j, n = 0;
+
+  /* composite[i] tells whether 2i + 1 is composite */
+  composite = silc_calloc(SILC_PRIME_SIEVE_LIMIT / 2, sizeof(*composite));
+  *primes = silc_calloc(SILC_PRIME_SIEVE_LIMIT / 4, sizeof(**primes));
+  if (!composite || !*primes) {
+    silc_free(composite);
+    silc_free(*primes);
+    return 0;
+  }
 
-  silc_mp_init(&r);
-  silc_mp_init(&base);
-  silc_mp_init(&tmp);
-  silc_mp_init(&tmp2);
-  silc_mp_init(&oprime);
+  for (i = 1; i < SILC_PRIME_SIEVE_LIMIT / 2; i++) {
+    if (composite[i])
+      continue;
+    (*primes)[n++] = 2 * i + 1;
+    for (j = 2 * i * (i + 1); j < SILC_PRIME_SIEVE_LIMIT / 2; j += 2 * i + 1)
+      composite[j] = 1;
+  }
 
-  silc_mp_set_ui(&base, 2);
+  silc_free(composite);
+  return n;
+}
 
-  SILC_LOG_DEBUG(("Generating new prime"));
+/* Number of Miller-Rabin rounds for error probability below 2^-80 for
+   random candidates of `bits' bits (HAC, table 4.4). */
+
+static SilcUInt32 silc_math_prime_rounds(SilcUInt32 bits)
+{
+  if (bits >= 1300)
+    return 2;
+  if (bits >= 850)
+    return 3;
+  if (bits >= 650)
+    return 4;
+  if (bits >= 550)
+    return 5;
+  if (bits >= 450)
+    return 6;
+  if (bits >= 400)
+    return 7;
+  if (bits >= 350)
+    return 8;
+  if (bits >= 300)
+    return 9;
+  if (bits >= 250)
+    return 12;
+  if (bits >= 200)
+    return 15;
+  if (bits >= 150)
+    return 18;
+  return 27;
+}
+
+/* Miller-Rabin test for odd `n' using the small primes as bases.  The
+   first round with base 2 weeds out practically all composites. */
 
-  while (valid == FALSE) {
-    /* Get random number */
-    if (rng)
-      numbuf = silc_rng_get_rn_data(rng, (bits / 8));
+static SilcBool silc_math_miller_rabin(SilcMPInt *n, SilcUInt32 rounds)
+{
+  SilcMPModContext ctx;
+  SilcMPInt d, nm1, a, y;
+  SilcUInt32 i, j, s;
+  SilcBool ret = TRUE;
+
+  silc_mp_init(&d);
+  silc_mp_init(&nm1);
+  silc_mp_init(&a);
+  silc_mp_init(&y);
+
+  /* n - 1 = d * 2^s */
+  silc_mp_sub_ui(&nm1, n, 1);
+  silc_mp_set(&d, &nm1);
+  for (s = 0; !(silc_mp_get_ui(&d) & 1); s++)
+    silc_mp_div_2exp(&d, &d, 1);
+
+  ctx = NULL;
+
+  for (i = 0; i < rounds && primetable[i] != 0 && ret; i++) {
+    silc_mp_set_ui(&a, primetable[i]);
+
+    /* Composites rarely get past the first round, so the cached
+       Montgomery values are worth computing only for the later ones */
+    if (i == 1)
+      ctx = silc_mp_mod_context_alloc(n);
+    if (ctx)
+      silc_mp_pow_mod_ctx(&y, &a, &d, ctx);
     else
-      numbuf = silc_rng_global_get_rn_data((bits / 8));
-    if (!numbuf)
-      return FALSE;
+      silc_mp_pow_mod(&y, &a, &d, n);
+    if (silc_mp_cmp_ui(&y, 1) == 0 || silc_mp_cmp(&y, &nm1) == 0)
+      continue;
+
+    for (j = 1; j < s; j++) {
+      silc_mp_mul(&y, &y, &y);
+      silc_mp_mod(&y, &y, n);
+      if (silc_mp_cmp(&y, &nm1) == 0 || silc_mp_cmp_ui(&y, 1) == 0)
+	break;
+    }
+    if (silc_mp_cmp(&y, &nm1) != 0)
+      ret = FALSE;
+  }
+
+  silc_mp_mod_context_free(ctx);
+  silc_mp_uninit(&d);
+  silc_mp_uninit(&nm1);
+  silc_mp_uninit(&a);
+  silc_mp_uninit(&y);
+
+  return ret;
+}
+
+/* Searches for a prime upwards from the odd number `prime'.  The
+   candidates are sieved with the small primes a window at a time using
+   native integers; only what survives the sieve is given to Miller-Rabin.
+   Returns FALSE if no prime was found before the search went past `bits'
+   bits. */
+
+static SilcBool silc_math_prime_search(SilcMPInt *prime, SilcUInt32 bits,
+				       SilcBool verbose)
+{
+  unsigned char sieve[SILC_PRIME_SIEVE_SIZE];
+  SilcUInt32 *primes, *spmods, i, k, p, r, rounds, nprimes;
+  SilcMPInt tmp, cand;
+  SilcBool found = FALSE;
+
+  nprimes = silc_math_sieve_primes(&primes);
+  if (!nprimes)
+    return FALSE;
+  spmods = silc_calloc(nprimes, sizeof(*spmods));
+  if (!spmods) {
+    silc_free(primes);
+    return FALSE;
+  }
+
+  silc_mp_init(&tmp);
+  silc_mp_init(&cand);
+
+  rounds = silc_math_prime_rounds(bits);
+
+  /* Init modulo table with the prime candidate and the small primes */
+  for (i = 0; i < nprimes; i++) {
+    silc_mp_mod_ui(&tmp, prime, primes[i]);
+    spmods[i] = silc_mp_get_ui(&tmp);
+  }
 
-    /* Convert into MP and set the size */
-    silc_mp_bin2mp(numbuf, (bits / 8), prime);
-    silc_mp_mod_2exp(prime, prime, bits);
-
-    /* Empty buffer */
-    memset(numbuf, 0, (bits / 8));
-    silc_free(numbuf);
-
-    /* Set highest bit */
-    silc_mp_set_ui(&tmp, 1);
-    silc_mp_mul_2exp(&tmp, &tmp, bits - 1);
-    silc_mp_or(prime, prime, &tmp);
-
-    /* Number could be even number, so we'll make it odd. */
-    silc_mp_set_ui(&tmp, 1);
-    silc_mp_or(prime, prime, &tmp);
-
-    /* Init modulo table with the prime candidate and the primes
-       in the primetable. */
-    spmods = silc_calloc(1, sizeof(primetable) * sizeof(SilcUInt32));
-    for (i = 0; primetable[i] != 0; i++) {
-      silc_mp_mod_ui(&tmp, prime, primetable[i]);
-      spmods[i] = silc_mp_get_ui(&tmp);
+  while (!found) {
+    /* Sieve offsets k, where candidate is prime + 2k.  For each small
+       prime mark every k for which spmods + 2k == 0 (mod p). */
+    memset(sieve, 0, sizeof(sieve));
+    for (i = 0; i < nprimes; i++) {
+      p = primes[i];
+      r = spmods[i] ? p - spmods[i] : 0;
+      if (r & 1)
+	r += p;
+      for (k = r / 2; k < SILC_PRIME_SIEVE_SIZE; k += p)
+	sieve[k] = 1;
     }
 
-    /* k is added by 2, this way we skip all even numbers (prime is odd). */
-    silc_mp_set(&oprime, prime);
-    for (k = 0;; k += 2) {
-      silc_mp_add_ui(&oprime, prime, k);
-
-      /* See if the prime has a divisor in primetable[].
-       * If it has then it's a composite. We add k to the
-       * original modulo value, k is added by 2 on every roll.
-       * This way we don't have to re-init the whole table if
-       * the number is composite.
-       */
-      for (b = 0; b < i; b++) {
-	silc_mp_set_ui(&tmp2, spmods[b]);
-	silc_mp_add_ui(&tmp2, &tmp2, k);
-	silc_mp_mod_ui(&tmp, &tmp2, primetable[b]);
-
-	/* If mod is 0, the number is composite */
-	if (silc_mp_cmp_ui(&tmp, 0) == 0)
-	  break;
-      }
-      if (b < i)
+    for (k = 0; k < SILC_PRIME_SIEVE_SIZE; k++) {
+      if (sieve[k])
 	continue;
 
-      /* Passed the quick test. */
+      silc_mp_add_ui(&cand, prime, k * 2);
+      if (silc_mp_sizeinbase(&cand, 2) > bits)
+	goto out;
 
-      /* Does the prime pass the Fermat's prime test.
-       * r = 2 ^ p mod p, if r == 2, then p is probably a prime.
-       */
-      silc_mp_pow_mod(&r, &base, &oprime, &oprime);
-      if (silc_mp_cmp_ui(&r, 2) != 0) {
+      if (!silc_math_miller_rabin(&cand, rounds)) {
 	if (verbose) {
 	  printf(".");
 	  fflush(stdout);
@@ -284,38 +373,158 @@ SilcBool silc_math_gen_prime(SilcMPInt *prime, SilcUInt32 bits,
 	continue;
       }
 
-      /* Passed the Fermat's test. And I don't think
-       * we have to do more tests. If anyone wants to do more
-       * tests, MP library has probability of prime test:
-       *
-       * if (silc_mp_probab_prime_p(prime, 25))
-       *     break;                          found a probable prime
-       *
-       * However, this is very slow.
-       */
-      /* XXX: this could be done if some argument, say strict_primes, is
-	 TRUE when we are willing to spend more time on the prime test and
-	 to get, perhaps, better primes. */
-      silc_mp_set(prime, &oprime);
+      silc_mp_set(prime, &cand);
+      found = TRUE;
       break;
     }
-
-    /* Check highest bit */
-    silc_mp_div_2exp(&tmp, prime, bits - 1);
-    if (silc_mp_get_ui(&tmp) == 1) {
-      valid = TRUE;
+    if (found)
       break;
-    }
+
+    /* Move to next window */
+    silc_mp_add_ui(prime, prime, SILC_PRIME_SIEVE_SIZE * 2);
+    for (i = 0; i < nprimes; i++)
+      spmods[i] = (spmods[i] + SILC_PRIME_SIEVE_SIZE * 2) % primes[i];
   }
 
+ out:
+  silc_free(primes);
   silc_free(spmods);
-  silc_mp_uninit(&r);
-  silc_mp_uninit(&base);
   silc_mp_uninit(&tmp);
-  silc_mp_uninit(&tmp2);
-  silc_mp_uninit(&oprime);
+  silc_mp_uninit(&cand);
+  return found;
+}
+
+/* Sets random odd number with highest bit set to `prime' */
+
+static SilcBool silc_math_prime_start(SilcMPInt *prime, SilcUInt32 bits,
+				      SilcRng rng)
+{
+  unsigned char *numbuf;
+  SilcUInt32 len = (bits + 7) / 8;
+  SilcMPInt tmp;
+
+  /* Get random number */
+  if (rng)
+    numbuf = silc_rng_get_rn_data(rng, len);
+  else
+    numbuf = silc_rng_global_get_rn_data(len);
+  if (!numbuf)
+    return FALSE;
 
-  return valid;
+  /* Convert into MP and set the size */
+  silc_mp_bin2mp(numbuf, len, prime);
+  silc_mp_mod_2exp(prime, prime, bits);
+
+  /* Empty buffer */
+  memset(numbuf, 0, len);
+  silc_free(numbuf);
+
+  /* Set highest bit */
+  silc_mp_init(&tmp);
+  silc_mp_set_ui(&tmp, 1);
+  silc_mp_mul_2exp(&tmp, &tmp, bits - 1);
+  silc_mp_or(prime, prime, &tmp);
+
+  /* Number could be even number, so we'll make it odd. */
+  silc_mp_set_ui(&tmp, 1);
+  silc_mp_or(prime, prime, &tmp);
+  silc_mp_uninit(&tmp);
+
+  return TRUE;
+}
+
+/* Find appropriate prime. It generates a number by taking random bytes.
+   It then searches upwards from it for a number that is not divisible by
+   any of the small primes and that passes Miller-Rabin test. I thank
+   Rieks Joosten (r.joosten@pijnenburg.nl) for such a good help with prime
+   tests.
+
+   If argument verbose is TRUE this will display some status information
+   about the progress of generation. */
+
+SilcBool silc_math_gen_prime(SilcMPInt *prime, SilcUInt32 bits,
+			     SilcBool verbose, SilcRng rng)
+{
+  SILC_LOG_DEBUG(("Generating new prime"));
+
+  do {
+    if (!silc_math_prime_start(prime, bits, rng))
+      return FALSE;
+  } while (!silc_math_prime_search(prime, bits, verbose));
+
+  return TRUE;
+}
+
+/* Prime search context for silc_math_gen_primes */
+typedef struct {
+  SilcMPInt *prime;
+  SilcUInt32 bits;
+  SilcThread thread;
+  SilcBool found;
+} SilcMathPrimeSearch;
+
+static void *silc_math_prime_thread(void *context)
+{
+  SilcMathPrimeSearch *search = context;
+  search->found = silc_math_prime_search(search->prime, search->bits, FALSE);
+  return NULL;
+}
+
+/* Finds `num_primes' primes concurrently.  The random starting points are
+   taken in the calling thread since the RNG is not thread safe. */
+
+SilcBool silc_math_gen_primes(SilcMPInt *primes, SilcUInt32 num_primes,
+			      SilcUInt32 bits, SilcRng rng)
+{
+  SilcMathPrimeSearch *search;
+  SilcUInt32 i, left = num_primes;
+
+  SILC_LOG_DEBUG(("Generating %d new primes", num_primes));
+
+  search = silc_calloc(num_primes, sizeof(*search));
+  if (!search)
+    return FALSE;
+
+  while (left) {
+    for (i = 0; i < num_primes; i++) {
+      if (search[i].found)
+	continue;
+      search[i].prime = &primes[i];
+      search[i].bits = bits;
+      if (!silc_math_prime_start(&primes[i], bits, rng)) {
+	silc_free(search);
+	return FALSE;
+      }
+    }
+
+    /* Search in worker threads, the last one in this thread */
+    for (i = 0; i < num_primes; i++) {
+      if (search[i].found)
+	continue;
+#ifdef SILC_THREADS
+      if (--left) {
+	search[i].thread = silc_thread_create(silc_math_prime_thread,
+					      &search[i], TRUE);
+	if (search[i].thread)
+	  continue;
+      }
+#endif /* SILC_THREADS */
+      silc_math_prime_thread(&search[i]);
+    }
+
+    left = 0;
+    for (i = 0; i < num_primes; i++) {
+      if (search[i].thread) {
+	silc_thread_wait(search[i].thread, NULL);
+	search[i].thread = NULL;
+      }
+      if (!search[i].found)
+	left++;
+    }
+  }
+
+  silc_free(search);
+  return TRUE;
 }
 
 /* Performs primality testings for given number. Returns TRUE if the
@@ -0,0 +1,144 @@
+/* Modular exponentiation tests.  Bases that are multiples of the modulus
+   make products of zero in Montgomery multiplication, which must give
+   zero and not leave the destination as it was. */
+
+#include "silc.h"
+
+/* Modulus sizes in bits, and exponentiations per size */
+static const int sizes[] = { 256, 512, 1024, 2048, 3072, 4096 };
+#define ROUNDS 4
+
+/* Sets `mp' to random odd number of `bits' bits */
+
+static void random_odd(SilcRng rng, SilcMPInt *mp, int bits)
+{
+  unsigned char *data;
+
+  data = silc_rng_get_rn_data(rng, bits / 8);
+  data[0] |= 0x80;
+  data[bits / 8 - 1] |= 0x01;
+  silc_mp_bin2mp(data, bits / 8, mp);
+  silc_free(data);
+}
+
+/* Checks that `mp' is `ui' after `what' */
+
+static SilcBool check(SilcMPInt *mp, SilcUInt32 ui, const char *what,
+		      int bits)
+{
+  if (!silc_mp_cmp_ui(mp, ui))
+    return TRUE;
+  fprintf(stderr, "%s with %d bit modulus is not %d\n", what, bits, ui);
+  return FALSE;
+}
+
+static SilcBool test_pow_mod(SilcRng rng, int bits)
+{
+  SilcMPInt mod, base, exp, dst, tmp;
+  SilcMPModContext ctx;
+  SilcBool success = FALSE;
+  int i;
+
+  silc_mp_init(&mod);
+  silc_mp_init(&base);
+  silc_mp_init(&exp);
+  silc_mp_init(&dst);
+  silc_mp_init(&tmp);
+
+  for (i = 0; i < ROUNDS; i++) {
+    random_odd(rng, &mod, bits);
+    random_odd(rng, &exp, bits);
+
+    /* Zero base */
+    silc_mp_set_ui(&base, 0);
+    silc_mp_set_ui(&dst, 12345);
+    silc_mp_pow_mod(&dst, &base, &exp, &mod);
+    if (!check(&dst, 0, "0 ** e mod m", bits))
+      goto out;
+
+    /* The modulus and its multiple as base */
+    silc_mp_set_ui(&dst, 12345);
+    silc_mp_pow_mod(&dst, &mod, &exp, &mod);
+    if (!check(&dst, 0, "m ** e mod m", bits))
+      goto out;
+    silc_mp_mul_ui(&base, &mod, 3);
+    silc_mp_set_ui(&dst, 12345);
+    silc_mp_pow_mod(&dst, &base, &exp, &mod);
+    if (!check(&dst, 0, "3m ** e mod m", bits))
+      goto out;
+
+    /* The same with cached modulus */
+    ctx = silc_mp_mod_context_alloc(&mod);
+    if (ctx) {
+      silc_mp_set_ui(&dst, 12345);
+      silc_mp_pow_mod_ctx(&dst, &base, &exp, ctx);
+      silc_mp_mod_context_free(ctx);
+      if (!check(&dst, 0, "3m ** e mod m, cached modulus", bits))
+	goto out;
+    }
+
+    /* Base larger than modulus is reduced first */
+    silc_mp_add_ui(&base, &mod, 2);
+    silc_mp_pow_mod(&dst, &base, &exp, &mod);
+    silc_mp_set_ui(&base, 2);
+    silc_mp_pow_mod(&tmp, &base, &exp, &mod);
+    if (silc_mp_cmp(&dst, &tmp)) {
+      fprintf(stderr, "(m + 2) ** e mod m with %d bit modulus is not "
+	      "2 ** e mod m\n", bits);
+      goto out;
+    }
+  }
+
+  /* Product of zeros */
+  silc_mp_set_ui(&base, 0);
+  silc_mp_set_ui(&dst, 12345);
+  silc_mp_mul(&dst, &base, &base);
+  if (!check(&dst, 0, "0 * 0", bits))
+    goto out;
+
+  success = TRUE;
+
+ out:
+  silc_mp_uninit(&mod);
+  silc_mp_uninit(&base);
+  silc_mp_uninit(&exp);
+  silc_mp_uninit(&dst);
+  silc_mp_uninit(&tmp);
+  return success;
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  SilcRng rng;
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*math*,*mp*");
+  }
+
+  silc_hash_register_default();
+
+  rng = silc_rng_alloc();
+  if (!rng)
+    goto err;
+  silc_rng_init(rng);
+
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    SILC_LOG_DEBUG(("%d bit modulus", sizes[i]));
+    if (!test_pow_mod(rng, sizes[i]))
+      goto err;
+  }
+
+  success = TRUE;
+
+ err:
+  if (rng)
+    silc_rng_free(rng);
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
@@ -426,8 +426,11 @@ int fast_s_tma_mp_mul_digs (tma_mp_int * a, tma_mp_int * b, tma_mp_int * c, int
 
   /* number of output digits to produce */
   pa = MIN(digs, a->used + b->used);
-  if (!pa)
-    return MP_VAL;
+  if (!pa) {
+    /* product of zeros (or no digits wanted) */
+    tma_mp_zero(c);
+    return MP_OKAY;
+  }
 
   /* clear the carry */
   _W = 0;
@@ -533,8 +536,10 @@ int fast_s_tma_mp_mul_high_digs (tma_mp_int * a, tma_mp_int * b, tma_mp_int * c,
 
   /* number of output digits to produce */
   pa = a->used + b->used;
-  if (!pa)
-    return MP_VAL;
+  if (!pa) {
+    tma_mp_zero(c);
+    return MP_OKAY;
+  }
 
   _W = 0;
   for (ix = digs; ix < pa; ix++) {
@@ -37,6 +37,13 @@ typedef struct SilcSFTPRequestStruct {
   SilcSFTPPacket type;
 } *SilcSFTPRequest;
 
+/* Initial and maximum size of the request table, powers of two */
+#define SILC_SFTP_REQUEST_TABLE_SIZE 32
+#define SILC_SFTP_REQUEST_TABLE_MAX 16384
+
+/* Maximum number of free request contexts kept for reuse */
+#define SILC_SFTP_REQUEST_FREE_MAX 64
+
 /* SFTP client context */
 typedef struct {
   SilcStream stream;
@@ -44,7 +51,10 @@ typedef struct {
   SilcSFTPVersionCallback version;
   SilcSFTPErrorCallback error;
   void *context;
-  SilcList requests;
+  SilcSFTPRequest *requests;		/* Outstanding requests by ID */
+  SilcUInt32 requests_size;		/* Size of table, power of two */
+  SilcUInt32 requests_count;		/* Number of outstanding requests */
+  SilcList free_requests;		/* Free request contexts */
   SilcBuffer packet;
   SilcUInt32 id;
 } *SilcSFTPClient;
@@ -96,11 +106,13 @@ static void silc_sftp_handle_get(SilcSFTPHandle handle,
   *data_len = handle->data_len;
 }
 
-/* Generic routine to send SFTP packet to the SFTP server. */
+/* Generic routine to send SFTP packet to the SFTP server.  Returns FALSE
+   if the packet could not be encoded.  Write errors are delivered to the
+   error callback. */
 
-static void silc_sftp_send_packet(SilcSFTPClient sftp,
-				  SilcSFTPPacket type,
-				  SilcUInt32 len, ...)
+static SilcBool silc_sftp_send_packet(SilcSFTPClient sftp,
+				      SilcSFTPPacket type,
+				      SilcUInt32 len, ...)
 {
   SilcBuffer tmp;
   va_list vp;
@@ -110,7 +122,7 @@ static void silc_sftp_send_packet(SilcSFTPClient sftp,
   tmp = silc_sftp_packet_encode_vp(type, sftp->packet, len, vp);
   va_end(vp);
   if (!tmp)
-    return;
+    return FALSE;
   sftp->packet = tmp;
 
   SILC_LOG_HEXDUMP(("SFTP packet to server"), sftp->packet->data,
@@ -125,21 +137,109 @@ static void silc_sftp_send_packet(SilcSFTPClient sftp,
       sftp->error((SilcSFTP)sftp, SILC_SFTP_STATUS_NO_CONNECTION,
 		  sftp->context);
       silc_buffer_reset(sftp->packet);
-      return;
+      return TRUE;
     }
     if (ret == 0) {
       sftp->error((SilcSFTP)sftp, SILC_SFTP_STATUS_EOF, sftp->context);
       silc_buffer_reset(sftp->packet);
-      return;
+      return TRUE;
     }
     if (ret == -1)
-      return;
+      return TRUE;
 
     silc_buffer_pull(sftp->packet, ret);
   }
 
   /* Clear packet */
   silc_buffer_reset(sftp->packet);
+
+  return TRUE;
+}
+
+/* Request IDs are allocated sequentially, so the outstanding requests
+   are indexed by the low bits of the ID.  If the slot of the next ID is
+   taken by a request still waiting for its reply, the ID is advanced to
+   the next free slot.  The table is grown only when it is full, and never
+   past SILC_SFTP_REQUEST_TABLE_MAX. */
+
+static SilcBool silc_sftp_request_table_grow(SilcSFTPClient sftp)
+{
+  SilcSFTPRequest *table, req;
+  SilcUInt32 size = sftp->requests_size << 1, i;
+
+  if (size > SILC_SFTP_REQUEST_TABLE_MAX) {
+    SILC_LOG_ERROR(("Too many outstanding SFTP requests"));
+    return FALSE;
+  }
+
+  SILC_LOG_DEBUG(("Growing request table to %d", size));
+
+  table = silc_calloc(size, sizeof(*table));
+  if (!table)
+    return FALSE;
+
+  /* IDs that differ in the low bits of the old size differ in the low
+     bits of the new size too, so the move cannot collide */
+  for (i = 0; i < sftp->requests_size; i++) {
+    req = sftp->requests[i];
+    if (req)
+      table[req->id & (size - 1)] = req;
+  }
+
+  silc_free(sftp->requests);
+  sftp->requests = table;
+  sftp->requests_size = size;
+
+  return TRUE;
+}
+
+/* Allocates new request, assigns it ID and adds it to the request table */
+
+static SilcSFTPRequest silc_sftp_request_alloc(SilcSFTPClient sftp,
+					       SilcSFTPPacket type,
+					       void *context)
+{
+  SilcSFTPRequest req;
+
+  if (sftp->requests_count == sftp->requests_size)
+    if (!silc_sftp_request_table_grow(sftp))
+      return NULL;
+
+  /* Table is not full, so a free slot is found */
+  while (sftp->requests[sftp->id & (sftp->requests_size - 1)])
+    sftp->id++;
+
+  silc_list_start(sftp->free_requests);
+  req = silc_list_get(sftp->free_requests);
+  if (req) {
+    silc_list_del(sftp->free_requests, req);
+    memset(req, 0, sizeof(*req));
+  } else {
+    req = silc_calloc(1, sizeof(*req));
+    if (!req)
+      return NULL;
+  }
+
+  req->id = sftp->id++;
+  req->type = type;
+  req->context = context;
+  sftp->requests[req->id & (sftp->requests_size - 1)] = req;
+  sftp->requests_count++;
+
+  return req;
+}
+
+/* Removes request from the request table and frees it */
+
+static void silc_sftp_request_free(SilcSFTPClient sftp, SilcSFTPRequest req)
+{
+  sftp->requests[req->id & (sftp->requests_size - 1)] = NULL;
+  sftp->requests_count--;
+
+  if (silc_list_count(sftp->free_requests) < SILC_SFTP_REQUEST_FREE_MAX)
+    silc_list_add(sftp->free_requests, req);
+  else
+    silc_free(req);
 }
 
 /* Finds request by request ID. */
@@ -151,11 +251,9 @@ static SilcSFTPRequest silc_sftp_find_request(SilcSFTPClient sftp,
 
   SILC_LOG_DEBUG(("Finding request ID: %d", id));
 
-  silc_list_start(sftp->requests);
-  while ((req = silc_list_get(sftp->requests)) != SILC_LIST_END) {
-    if (req->id == id)
-      return req;
-  }
+  req = sftp->requests[id & (sftp->requests_size - 1)];
+  if (req && req->id == id)
+    return req;
 
   SILC_LOG_DEBUG(("Unknown request ID %d", id));
 
@@ -318,8 +416,7 @@ static void silc_sftp_call_request(SilcSFTPClient sftp,
   }
 
   /* Remove this request */
-  silc_list_del(sftp->requests, req);
-  silc_free(req);
+  silc_sftp_request_free(sftp, req);
 
   va_end(vp);
 }
@@ -414,7 +511,13 @@ SilcSFTP silc_sftp_client_start(SilcStream stream,
   sftp->error = error_cb;
   sftp->context = context;
   sftp->schedule = schedule;
-  silc_list_init(sftp->requests, struct SilcSFTPRequestStruct, next);
+  silc_list_init(sftp->free_requests, struct SilcSFTPRequestStruct, next);
+  sftp->requests_size = SILC_SFTP_REQUEST_TABLE_SIZE;
+  sftp->requests = silc_calloc(sftp->requests_size, sizeof(*sftp->requests));
+  if (!sftp->requests) {
+    silc_free(sftp);
+    return NULL;
+  }
 
   /* We handle the stream now */
   silc_stream_set_notifier(stream, schedule, silc_sftp_client_io, sftp);
@@ -434,10 +537,22 @@ SilcSFTP silc_sftp_client_start(SilcStream stream,
 void silc_sftp_client_shutdown(SilcSFTP context)
 {
   SilcSFTPClient sftp = (SilcSFTPClient)context;
+  SilcSFTPRequest req;
+  SilcUInt32 i;
 
   silc_stream_set_notifier(sftp->stream, sftp->schedule, NULL, NULL);
   if (sftp->packet)
     silc_buffer_free(sftp->packet);
+
+  /* Free the request contexts.  Requests still waiting for reply are
+     freed without calling their callbacks. */
+  for (i = 0; i < sftp->requests_size; i++)
+    silc_free(sftp->requests[i]);
+  silc_free(sftp->requests);
+  silc_list_start(sftp->free_requests);
+  while ((req = silc_list_get(sftp->free_requests)))
+    silc_free(req);
+
   silc_free(sftp);
 }
 
@@ -684,28 +799,27 @@ void silc_sftp_open(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Open request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_OPEN, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_OPEN;
   req->handle = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   attrs_buf = silc_sftp_attr_encode(attrs);
-  if (!attrs_buf)
+  if (!attrs_buf) {
+    silc_sftp_request_free(client, req);
     return;
+  }
   len = 4 + 4 + strlen(filename) + 4 + silc_buffer_len(attrs_buf);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(filename)),
-			SILC_STR_UI32_STRING(filename),
-			SILC_STR_UI_INT(pflags),
-			SILC_STR_UI_XNSTRING(attrs_buf->data,
-					     silc_buffer_len(attrs_buf)),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(filename)),
+			     SILC_STR_UI32_STRING(filename),
+			     SILC_STR_UI_INT(pflags),
+			     SILC_STR_UI_XNSTRING(attrs_buf->data,
+						  silc_buffer_len(attrs_buf)),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 
   silc_buffer_free(attrs_buf);
 }
@@ -723,23 +837,22 @@ void silc_sftp_close(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Close request"));
 
-  req = silc_calloc(1, sizeof(*req));
-  if (!req)
+  req = silc_sftp_request_alloc(client, SILC_SFTP_CLOSE, context);
+  if (!req) {
+    silc_sftp_handle_delete(handle);
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_CLOSE;
+  }
   req->status = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   silc_sftp_handle_get(handle, &hdata, &hdata_len);
   len = 4 + 4 + hdata_len;
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(hdata_len),
-			SILC_STR_UI_XNSTRING(hdata, hdata_len),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(hdata_len),
+			     SILC_STR_UI_XNSTRING(hdata, hdata_len),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
   silc_sftp_handle_delete(handle);
 }
 
@@ -758,25 +871,22 @@ void silc_sftp_read(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Read request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_READ, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_READ;
   req->data = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   silc_sftp_handle_get(handle, &hdata, &hdata_len);
   len2 = 4 + 4 + hdata_len + 8 + 4;
 
-  silc_sftp_send_packet(client, req->type, len2,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(hdata_len),
-			SILC_STR_UI_XNSTRING(hdata, hdata_len),
-			SILC_STR_UI_INT64(offset),
-			SILC_STR_UI_INT(len),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len2,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(hdata_len),
+			     SILC_STR_UI_XNSTRING(hdata, hdata_len),
+			     SILC_STR_UI_INT64(offset),
+			     SILC_STR_UI_INT(len),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_write(SilcSFTP sftp,
@@ -795,26 +905,23 @@ void silc_sftp_write(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Write request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_WRITE, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_WRITE;
   req->status = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   silc_sftp_handle_get(handle, &hdata, &hdata_len);
   len = 4 + 4 + hdata_len + 8 + 4 + data_len;
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(hdata_len),
-			SILC_STR_UI_XNSTRING(hdata, hdata_len),
-			SILC_STR_UI_INT64(offset),
-			SILC_STR_UI_INT(data_len),
-			SILC_STR_UI_XNSTRING(data, data_len),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(hdata_len),
+			     SILC_STR_UI_XNSTRING(hdata, hdata_len),
+			     SILC_STR_UI_INT64(offset),
+			     SILC_STR_UI_INT(data_len),
+			     SILC_STR_UI_XNSTRING(data, data_len),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_remove(SilcSFTP sftp,
@@ -828,22 +935,19 @@ void silc_sftp_remove(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Remove request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_REMOVE, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_REMOVE;
   req->status = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   len = 4 + 4 + strlen(filename);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(filename)),
-			SILC_STR_UI32_STRING(filename),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(filename)),
+			     SILC_STR_UI32_STRING(filename),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_rename(SilcSFTP sftp,
@@ -858,24 +962,21 @@ void silc_sftp_rename(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Rename request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_RENAME, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_RENAME;
   req->status = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   len = 4 + 4 + strlen(oldname) + 4 + strlen(newname);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(oldname)),
-			SILC_STR_UI32_STRING(oldname),
-			SILC_STR_UI_INT(strlen(newname)),
-			SILC_STR_UI32_STRING(newname),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(oldname)),
+			     SILC_STR_UI32_STRING(oldname),
+			     SILC_STR_UI_INT(strlen(newname)),
+			     SILC_STR_UI32_STRING(newname),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_mkdir(SilcSFTP sftp,
@@ -891,27 +992,26 @@ void silc_sftp_mkdir(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Mkdir request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_MKDIR, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_MKDIR;
   req->status = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   attrs_buf = silc_sftp_attr_encode(attrs);
-  if (!attrs_buf)
+  if (!attrs_buf) {
+    silc_sftp_request_free(client, req);
     return;
+  }
   len = 4 + 4 + strlen(path) + silc_buffer_len(attrs_buf);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(path)),
-			SILC_STR_UI32_STRING(path),
-			SILC_STR_UI_XNSTRING(attrs_buf->data,
-					     silc_buffer_len(attrs_buf)),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(path)),
+			     SILC_STR_UI32_STRING(path),
+			     SILC_STR_UI_XNSTRING(attrs_buf->data,
+						  silc_buffer_len(attrs_buf)),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 
   silc_buffer_free(attrs_buf);
 }
@@ -927,22 +1027,19 @@ void silc_sftp_rmdir(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Rmdir request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_RMDIR, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_RMDIR;
   req->status = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   len = 4 + 4 + strlen(path);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(path)),
-			SILC_STR_UI32_STRING(path),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(path)),
+			     SILC_STR_UI32_STRING(path),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_opendir(SilcSFTP sftp,
@@ -956,22 +1053,19 @@ void silc_sftp_opendir(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Opendir request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_OPENDIR, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_OPENDIR;
   req->handle = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   len = 4 + 4 + strlen(path);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(path)),
-			SILC_STR_UI32_STRING(path),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(path)),
+			     SILC_STR_UI32_STRING(path),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_readdir(SilcSFTP sftp,
@@ -987,23 +1081,20 @@ void silc_sftp_readdir(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Readdir request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_READDIR, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_READDIR;
   req->name = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   silc_sftp_handle_get(handle, &hdata, &hdata_len);
   len = 4 + 4 + hdata_len;
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(hdata_len),
-			SILC_STR_UI_XNSTRING(hdata, hdata_len),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(hdata_len),
+			     SILC_STR_UI_XNSTRING(hdata, hdata_len),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_stat(SilcSFTP sftp,
@@ -1017,22 +1108,19 @@ void silc_sftp_stat(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Stat request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_STAT, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_STAT;
   req->attr = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   len = 4 + 4 + strlen(path);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(path)),
-			SILC_STR_UI32_STRING(path),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(path)),
+			     SILC_STR_UI32_STRING(path),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_lstat(SilcSFTP sftp,
@@ -1046,22 +1134,19 @@ void silc_sftp_lstat(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Lstat request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_LSTAT, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_LSTAT;
   req->attr = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   len = 4 + 4 + strlen(path);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(path)),
-			SILC_STR_UI32_STRING(path),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(path)),
+			     SILC_STR_UI32_STRING(path),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_fstat(SilcSFTP sftp,
@@ -1077,23 +1162,20 @@ void silc_sftp_fstat(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Fstat request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_FSTAT, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_FSTAT;
   req->attr = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   silc_sftp_handle_get(handle, &hdata, &hdata_len);
   len = 4 + 4 + hdata_len;
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(hdata_len),
-			SILC_STR_UI_XNSTRING(hdata, hdata_len),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(hdata_len),
+			     SILC_STR_UI_XNSTRING(hdata, hdata_len),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_setstat(SilcSFTP sftp,
@@ -1109,27 +1191,26 @@ void silc_sftp_setstat(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Setstat request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_SETSTAT, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_SETSTAT;
   req->status = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   attrs_buf = silc_sftp_attr_encode(attrs);
-  if (!attrs_buf)
+  if (!attrs_buf) {
+    silc_sftp_request_free(client, req);
     return;
+  }
   len = 4 + 4 + strlen(path) + silc_buffer_len(attrs_buf);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(path)),
-			SILC_STR_UI32_STRING(path),
-			SILC_STR_UI_XNSTRING(attrs_buf->data,
-					     silc_buffer_len(attrs_buf)),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(path)),
+			     SILC_STR_UI32_STRING(path),
+			     SILC_STR_UI_XNSTRING(attrs_buf->data,
+						  silc_buffer_len(attrs_buf)),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 
   silc_buffer_free(attrs_buf);
 }
@@ -1149,28 +1230,27 @@ void silc_sftp_fsetstat(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Fsetstat request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_FSETSTAT, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_FSETSTAT;
   req->status = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   silc_sftp_handle_get(handle, &hdata, &hdata_len);
   attrs_buf = silc_sftp_attr_encode(attrs);
-  if (!attrs_buf)
+  if (!attrs_buf) {
+    silc_sftp_request_free(client, req);
     return;
+  }
   len = 4 + 4 + hdata_len + silc_buffer_len(attrs_buf);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(hdata_len),
-			SILC_STR_UI_XNSTRING(hdata, hdata_len),
-			SILC_STR_UI_XNSTRING(attrs_buf->data,
-					     silc_buffer_len(attrs_buf)),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(hdata_len),
+			     SILC_STR_UI_XNSTRING(hdata, hdata_len),
+			     SILC_STR_UI_XNSTRING(attrs_buf->data,
+						  silc_buffer_len(attrs_buf)),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 
   silc_buffer_free(attrs_buf);
 }
@@ -1186,22 +1266,19 @@ void silc_sftp_readlink(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Readlink request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_READLINK, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_READLINK;
   req->name = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   len = 4 + 4 + strlen(path);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(path)),
-			SILC_STR_UI32_STRING(path),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(path)),
+			     SILC_STR_UI32_STRING(path),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_symlink(SilcSFTP sftp,
@@ -1216,24 +1293,21 @@ void silc_sftp_symlink(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Symlink request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_SYMLINK, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_SYMLINK;
   req->status = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   len = 4 + 4 + strlen(linkpath) + 4 + strlen(targetpath);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(linkpath)),
-			SILC_STR_UI32_STRING(linkpath),
-			SILC_STR_UI_INT(strlen(targetpath)),
-			SILC_STR_UI32_STRING(targetpath),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(linkpath)),
+			     SILC_STR_UI32_STRING(linkpath),
+			     SILC_STR_UI_INT(strlen(targetpath)),
+			     SILC_STR_UI32_STRING(targetpath),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_realpath(SilcSFTP sftp,
@@ -1247,22 +1321,19 @@ void silc_sftp_realpath(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Realpath request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_REALPATH, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_REALPATH;
   req->name = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   len = 4 + 4 + strlen(path);
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(path)),
-			SILC_STR_UI32_STRING(path),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(path)),
+			     SILC_STR_UI32_STRING(path),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
 
 void silc_sftp_extended(SilcSFTP sftp,
@@ -1278,21 +1349,18 @@ void silc_sftp_extended(SilcSFTP sftp,
 
   SILC_LOG_DEBUG(("Extended request"));
 
-  req = silc_calloc(1, sizeof(*req));
+  req = silc_sftp_request_alloc(client, SILC_SFTP_EXTENDED, context);
   if (!req)
     return;
-  req->id = client->id++;
-  req->type = SILC_SFTP_WRITE;
   req->extended = callback;
-  req->context = context;
-  silc_list_add(client->requests, req);
 
   len = 4 + 4 + strlen(request) + data_len;
 
-  silc_sftp_send_packet(client, req->type, len,
-			SILC_STR_UI_INT(req->id),
-			SILC_STR_UI_INT(strlen(request)),
-			SILC_STR_UI32_STRING(request),
-			SILC_STR_UI_XNSTRING(data, data_len),
-			SILC_STR_END);
+  if (!silc_sftp_send_packet(client, req->type, len,
+			     SILC_STR_UI_INT(req->id),
+			     SILC_STR_UI_INT(strlen(request)),
+			     SILC_STR_UI32_STRING(request),
+			     SILC_STR_UI_XNSTRING(data, data_len),
+			     SILC_STR_END))
+    silc_sftp_request_free(client, req);
 }
@@ -26,6 +26,17 @@
 
 #define DIR_SEPARATOR "/"
 
+/* Tree hash is computed at most this many bytes at a time from the
+   scheduler, so that hashing a large file does not block the sender. */
+#define MEMFS_TREE_STEP (4 * 1048576)
+
+/* Tree hash leaves of all files, computed and being computed, take at most
+   this much memory.  Trees of other files are dropped to make room. */
+#ifndef MEMFS_TREE_MEMORY
+#define MEMFS_TREE_MEMORY (4 * SILC_SFTP_TREE_HASH_MAX_TOTAL *		\
+			   SILC_SFTP_TREE_HASH_LEN)
+#endif /* !MEMFS_TREE_MEMORY */
+
 const struct SilcSFTPFilesystemOpsStruct silc_sftp_fs_memory;
 
 typedef struct MemFSEntryStruct {
@@ -36,6 +47,12 @@ typedef struct MemFSEntryStruct {
   SilcUInt32 created;	            /* Time of creation */
   char *name;                       /* Name of the entry */
   char *data;			    /* Data of the entry */
+  unsigned char *tree;		    /* Tree hash leaves and root */
+  SilcUInt64 tree_size;		    /* File size when tree was computed */
+  SilcInt64 tree_mtime;		    /* File mtime when tree was computed */
+  struct MemFSTreeStruct *tree_job; /* Tree hash computation in progress */
+  SilcUInt32 tree_count;	    /* Number of tree hash leaves */
+  SilcUInt32 tree_chunk;	    /* Tree hash chunk length */
   unsigned int directory : 1;	    /* Set if this is directory */
   unsigned int perm : 7;	    /* Permissions */
 } *MemFSEntry;
@@ -47,14 +64,45 @@ typedef struct {
   MemFSEntry entry;		    /* Filesystem entry */
 } *MemFSFileHandle;
 
+/* Tree hash request waiting for the tree hash computation */
+typedef struct MemFSTreeWaitStruct {
+  struct MemFSTreeWaitStruct *next;
+  SilcSFTP sftp;		    /* SFTP server */
+  SilcSFTPExtendedCallback callback; /* Reply callback */
+  void *callback_context;
+  SilcUInt32 first;		    /* First requested leaf */
+  SilcUInt32 count;		    /* Number of requested leaves */
+} *MemFSTreeWait;
+
+/* Tree hash computation of a file, done in steps from the scheduler */
+typedef struct MemFSTreeStruct {
+  struct MemFSTreeStruct *next;
+  struct MemFSStruct *fs;	    /* Filesystem */
+  MemFSEntry entry;		    /* File entry */
+  SilcSchedule schedule;	    /* Scheduler running the steps */
+  SilcHash hash;		    /* SHA-256 */
+  unsigned char *tree;		    /* Leaves and root being computed */
+  unsigned char *buf;		    /* Chunk buffer */
+  SilcUInt64 size;		    /* File size */
+  SilcInt64 mtime;		    /* File mtime */
+  SilcUInt64 count;		    /* Number of leaves */
+  SilcUInt64 next_leaf;		    /* Next leaf to compute */
+  SilcUInt32 chunk_len;		    /* Chunk length */
+  int fd;			    /* File descriptor */
+  SilcList waiters;		    /* Requests waiting for the tree */
+} *MemFSTree;
+
 /* Memory filesystem */
-typedef struct {
+typedef struct MemFSStruct {
   MemFSEntry root;		    /* Root of the filesystem hierarchy */
   SilcSFTPFSMemoryPerm root_perm;
   MemFSFileHandle *handles;	    /* Open file handles */
   SilcUInt32 handles_count;
+  SilcList trees;		    /* Tree hash computations */
 } *MemFS;
 
+static void memfs_tree_job_free(MemFSTree job, SilcSFTPStatus status);
+
 /* Generates absolute path from relative path that may include '.' and '..'
    in the path. */
 
@@ -123,8 +171,11 @@ static SilcBool memfs_del_entry(MemFSEntry entry, SilcBool check_perm)
   if (check_perm)
     return FALSE;
 
+  if (entry->tree_job)
+    memfs_tree_job_free(entry->tree_job, SILC_SFTP_STATUS_NO_SUCH_FILE);
   silc_free(entry->name);
   silc_free(entry->data);
+  silc_free(entry->tree);
 
   /* Delete all entries recursively under this entry */
   for (i = 0; i < entry->entry_count; i++) {
@@ -333,6 +384,7 @@ SilcSFTPFilesystem silc_sftp_fs_memory_alloc(SilcSFTPFSMemoryPerm perm)
     return NULL;
   }
 
+  silc_list_init(fs->trees, struct MemFSTreeStruct, next);
   fs->root->perm = perm;
   fs->root_perm = perm;
   fs->root->directory = TRUE;
@@ -361,11 +413,36 @@ SilcSFTPFilesystem silc_sftp_fs_memory_alloc(SilcSFTPFSMemoryPerm perm)
 void silc_sftp_fs_memory_free(SilcSFTPFilesystem fs)
 {
   MemFS memfs = (MemFS)fs->fs_context;
+  MemFSTree job;
+
+  silc_list_start(memfs->trees);
+  while ((job = silc_list_get(memfs->trees)))
+    memfs_tree_job_free(job, SILC_SFTP_STATUS_NO_CONNECTION);
 
   silc_free(memfs->root);
   silc_free(memfs);
 }
 
+/* Drops the tree hash replies pending for SFTP server `sftp' */
+
+void silc_sftp_fs_memory_server_stop(SilcSFTPFilesystem fs, SilcSFTP sftp)
+{
+  MemFS memfs = (MemFS)fs->fs_context;
+  MemFSTree job;
+  MemFSTreeWait wait;
+
+  silc_list_start(memfs->trees);
+  while ((job = silc_list_get(memfs->trees))) {
+    silc_list_start(job->waiters);
+    while ((wait = silc_list_get(job->waiters))) {
+      if (wait->sftp != sftp)
+	continue;
+      silc_list_del(job->waiters, wait);
+      silc_free(wait);
+    }
+  }
+}
+
 /* Adds a new directory to the memory filesystem. Returns the directory
    context that can be used to add for example files to the directory
    or new subdirectories under the directory. The `dir' is the parent
@@ -621,23 +698,19 @@ void memfs_read(void *context, SilcSFTP sftp,
 		void *callback_context)
 {
   MemFSFileHandle h = (MemFSFileHandle)handle;
-  unsigned char data[63488];
+  unsigned char buf[63488], *data;
   int ret;
 
-  if (len > 63488)
-    len = 63488;
+  if (len > sizeof(buf))
+    len = sizeof(buf);
 
-  ret = lseek(h->fd, (off_t)offset, SEEK_SET);
-  if (ret < 0) {
-    if (!ret)
-      (*callback)(sftp, SILC_SFTP_STATUS_EOF, NULL, 0, callback_context);
-    else
-      (*callback)(sftp, silc_sftp_map_errno(errno), NULL, 0, callback_context);
-    return;
-  }
+  /* Read directly to the reply packet if possible */
+  data = silc_sftp_server_data_area(sftp, len);
+  if (!data)
+    data = buf;
 
   /* Attempt to read */
-  ret = silc_file_read(h->fd, data, len);
+  ret = silc_file_pread(h->fd, data, len, offset);
   if (ret <= 0) {
     if (!ret)
       (*callback)(sftp, SILC_SFTP_STATUS_EOF, NULL, 0, callback_context);
@@ -1117,6 +1190,262 @@ void memfs_realpath(void *context, SilcSFTP sftp,
   (*callback)(sftp, SILC_SFTP_STATUS_FAILURE, NULL, callback_context);
 }
 
+/* Returns the size and modification time of file `entry' */
+
+static SilcBool memfs_tree_stat(MemFSEntry entry, SilcUInt64 *size,
+				SilcInt64 *mtime)
+{
+  struct stat stats;
+
+  if (stat(entry->data + 7, &stats) < 0)
+    return FALSE;
+  *size = stats.st_size;
+  *mtime = stats.st_mtime;
+  return TRUE;
+}
+
+/* Sends leaves [first, first + count) and the root of the tree hash of
+   `entry' to the requester. */
+
+static void memfs_tree_reply(MemFSEntry entry, SilcSFTP sftp,
+			     SilcUInt32 first, SilcUInt32 count,
+			     SilcSFTPExtendedCallback callback,
+			     void *callback_context)
+{
+  SilcBuffer reply;
+
+  if (first > entry->tree_count) {
+    (*callback)(sftp, SILC_SFTP_STATUS_FAILURE, NULL, 0, callback_context);
+    return;
+  }
+
+  if (count > SILC_SFTP_TREE_HASH_MAX_LEAVES)
+    count = SILC_SFTP_TREE_HASH_MAX_LEAVES;
+  if (count > entry->tree_count - first)
+    count = entry->tree_count - first;
+
+  reply = silc_buffer_alloc_size(16 + ((count + 1) * SILC_SFTP_TREE_HASH_LEN));
+  if (!reply) {
+    (*callback)(sftp, SILC_SFTP_STATUS_FAILURE, NULL, 0, callback_context);
+    return;
+  }
+  silc_buffer_format(reply,
+		     SILC_STR_UI_INT64(entry->tree_size),
+		     SILC_STR_UI_INT(entry->tree_count),
+		     SILC_STR_DATA(entry->tree + (entry->tree_count *
+						  SILC_SFTP_TREE_HASH_LEN),
+				   SILC_SFTP_TREE_HASH_LEN),
+		     SILC_STR_UI_INT(count),
+		     SILC_STR_DATA(entry->tree + (first *
+						  SILC_SFTP_TREE_HASH_LEN),
+				   count * SILC_SFTP_TREE_HASH_LEN),
+		     SILC_STR_END);
+
+  (*callback)(sftp, SILC_SFTP_STATUS_OK, silc_buffer_data(reply),
+	      silc_buffer_len(reply), callback_context);
+  silc_buffer_free(reply);
+}
+
+/* Frees the tree hash computation.  The waiting requests are replied
+   with `status'. */
+
+static void memfs_tree_job_free(MemFSTree job, SilcSFTPStatus status)
+{
+  MemFSTreeWait wait;
+
+  silc_schedule_task_del_by_context(job->schedule, job);
+  silc_list_del(job->fs->trees, job);
+  job->entry->tree_job = NULL;
+
+  silc_list_start(job->waiters);
+  while ((wait = silc_list_get(job->waiters))) {
+    (*wait->callback)(wait->sftp, status, NULL, 0, wait->callback_context);
+    silc_free(wait);
+  }
+
+  if (job->fd >= 0)
+    silc_file_close(job->fd);
+  if (job->hash)
+    silc_hash_free(job->hash);
+  silc_free(job->buf);
+  silc_free(job->tree);
+  silc_free(job);
+}
+
+/* Computes next MEMFS_TREE_STEP bytes of the tree hash.  When all leaves
+   have been computed the tree is saved to the entry and the waiting
+   requests are replied. */
+
+SILC_TASK_CALLBACK(memfs_tree_step)
+{
+  MemFSTree job = context;
+  MemFSEntry entry = job->entry;
+  MemFSTreeWait wait;
+  SilcUInt64 len, done = 0;
+
+  while (job->next_leaf < job->count && done < MEMFS_TREE_STEP) {
+    len = job->size - (job->next_leaf * job->chunk_len);
+    if (len > job->chunk_len)
+      len = job->chunk_len;
+    if (silc_file_pread(job->fd, job->buf, len,
+			job->next_leaf * job->chunk_len) != len) {
+      memfs_tree_job_free(job, SILC_SFTP_STATUS_FAILURE);
+      return;
+    }
+    silc_sftp_tree_hash_leaf(job->hash, job->buf, len,
+			     job->tree + (job->next_leaf *
+					  SILC_SFTP_TREE_HASH_LEN));
+    job->next_leaf++;
+    done += job->chunk_len;
+  }
+
+  if (job->next_leaf < job->count) {
+    /* Continue after other tasks have run */
+    silc_schedule_task_add_timeout(job->schedule, memfs_tree_step, job, 0, 0);
+    return;
+  }
+
+  if (!silc_sftp_tree_hash_root(job->hash, job->tree, job->count,
+				job->tree + (job->count *
+					     SILC_SFTP_TREE_HASH_LEN))) {
+    memfs_tree_job_free(job, SILC_SFTP_STATUS_FAILURE);
+    return;
+  }
+
+  SILC_LOG_DEBUG(("Tree hash computed, %llu leaves", job->count));
+
+  silc_free(entry->tree);
+  entry->tree = job->tree;
+  entry->tree_size = job->size;
+  entry->tree_mtime = job->mtime;
+  entry->tree_count = job->count;
+  entry->tree_chunk = job->chunk_len;
+  job->tree = NULL;
+
+  silc_list_start(job->waiters);
+  while ((wait = silc_list_get(job->waiters))) {
+    silc_list_del(job->waiters, wait);
+    memfs_tree_reply(entry, wait->sftp, wait->first, wait->count,
+		     wait->callback, wait->callback_context);
+    silc_free(wait);
+  }
+
+  memfs_tree_job_free(job, SILC_SFTP_STATUS_OK);
+}
+
+/* Returns the memory used by tree hashes of `entry' and the entries under
+   it.  Computed trees of files other than `keep' are freed if `drop' is
+   TRUE. */
+
+static SilcUInt64 memfs_tree_memory(MemFSEntry entry, MemFSEntry keep,
+				    SilcBool drop)
+{
+  SilcUInt64 used = 0;
+  int i;
+
+  if (entry->tree && entry != keep && drop) {
+    SILC_LOG_DEBUG(("Dropping tree hash of %s", entry->name));
+    silc_free(entry->tree);
+    entry->tree = NULL;
+    entry->tree_count = 0;
+  }
+  if (entry->tree)
+    used += (entry->tree_count + 1) * SILC_SFTP_TREE_HASH_LEN;
+  if (entry->tree_job)
+    used += (entry->tree_job->count + 1) * SILC_SFTP_TREE_HASH_LEN;
+
+  for (i = 0; i < entry->entry_count; i++)
+    if (entry->entry[i])
+      used += memfs_tree_memory(entry->entry[i], keep, drop);
+
+  return used;
+}
+
+/* Replies with the tree hash of file `entry' with `chunk_len' long chunks.
+   The tree is computed once and kept until the file size or modification
+   time changes.  The computation is done in steps from the scheduler and
+   the reply is sent once the tree is ready. */
+
+static void memfs_tree_hash(MemFS fs, MemFSEntry entry, SilcSFTP sftp,
+			    SilcUInt32 chunk_len, SilcUInt32 first,
+			    SilcUInt32 count,
+			    SilcSFTPExtendedCallback callback,
+			    void *callback_context)
+{
+  MemFSTree job = entry->tree_job;
+  MemFSTreeWait wait;
+  SilcUInt64 size;
+  SilcInt64 mtime;
+
+  if (!memfs_tree_stat(entry, &size, &mtime))
+    goto err;
+
+  if (entry->tree && entry->tree_chunk == chunk_len &&
+      entry->tree_size == size && entry->tree_mtime == mtime) {
+    memfs_tree_reply(entry, sftp, first, count, callback, callback_context);
+    return;
+  }
+
+  /* Start new computation, unless one for this file version is running */
+  if (job && (job->chunk_len != chunk_len || job->size != size ||
+	      job->mtime != mtime)) {
+    memfs_tree_job_free(job, SILC_SFTP_STATUS_FAILURE);
+    job = NULL;
+  }
+  if (!job) {
+    job = silc_calloc(1, sizeof(*job));
+    if (!job)
+      goto err;
+    job->fs = fs;
+    job->entry = entry;
+    job->schedule = silc_sftp_server_get_schedule(sftp);
+    job->size = size;
+    job->mtime = mtime;
+    job->chunk_len = chunk_len;
+    job->count = size ? (size + chunk_len - 1) / chunk_len : 1;
+    job->fd = -1;
+    silc_list_init(job->waiters, struct MemFSTreeWaitStruct, next);
+    silc_list_add(fs->trees, job);
+    entry->tree_job = job;
+
+    /* Drop trees of other files if the new tree does not fit */
+    if (job->count > SILC_SFTP_TREE_HASH_MAX_TOTAL ||
+	(memfs_tree_memory(fs->root, entry, FALSE) > MEMFS_TREE_MEMORY &&
+	 memfs_tree_memory(fs->root, entry, TRUE) > MEMFS_TREE_MEMORY)) {
+      SILC_LOG_DEBUG(("No memory for tree hash of %llu leaves", job->count));
+      memfs_tree_job_free(job, SILC_SFTP_STATUS_FAILURE);
+      goto err;
+    }
+
+    SILC_LOG_DEBUG(("Computing tree hash, %llu leaves", job->count));
+
+    job->tree = silc_malloc((job->count + 1) * SILC_SFTP_TREE_HASH_LEN);
+    job->buf = silc_malloc(chunk_len);
+    job->fd = silc_file_open(entry->data + 7, O_RDONLY);
+    if (!job->tree || !job->buf || job->fd < 0 ||
+	!silc_hash_alloc("sha256", &job->hash) ||
+	!silc_schedule_task_add_timeout(job->schedule, memfs_tree_step,
+					job, 0, 0)) {
+      memfs_tree_job_free(job, SILC_SFTP_STATUS_FAILURE);
+      goto err;
+    }
+  }
+
+  wait = silc_calloc(1, sizeof(*wait));
+  if (!wait)
+    goto err;
+  wait->sftp = sftp;
+  wait->callback = callback;
+  wait->callback_context = callback_context;
+  wait->first = first;
+  wait->count = count;
+  silc_list_add(job->waiters, wait);
+  return;
+
+ err:
+  (*callback)(sftp, SILC_SFTP_STATUS_FAILURE, NULL, 0, callback_context);
+}
+
 void memfs_extended(void *context, SilcSFTP sftp,
 		    const char *request,
 		    const unsigned char *data,
@@ -1124,9 +1453,50 @@ void memfs_extended(void *context, SilcSFTP sftp,
 		    SilcSFTPExtendedCallback callback,
 		    void *callback_context)
 {
-  /* Extended is not supported */
-  (*callback)(sftp, SILC_SFTP_STATUS_OP_UNSUPPORTED, NULL, 0,
-	      callback_context);
+  MemFS fs = (MemFS)context;
+  MemFSEntry entry;
+  SilcBufferStruct buf;
+  char *path = NULL;
+  SilcUInt32 chunk_len, first, count;
+
+  /* Only tree hash is supported */
+  if (strcmp(request, SILC_SFTP_EXTENDED_TREE_HASH)) {
+    (*callback)(sftp, SILC_SFTP_STATUS_OP_UNSUPPORTED, NULL, 0,
+		callback_context);
+    return;
+  }
+
+  silc_buffer_set(&buf, (unsigned char *)data, data_len);
+  if (silc_buffer_unformat(&buf,
+			   SILC_STR_UI32_STRING_ALLOC(&path),
+			   SILC_STR_UI_INT(&chunk_len),
+			   SILC_STR_UI_INT(&first),
+			   SILC_STR_UI_INT(&count),
+			   SILC_STR_END) < 0 ||
+      chunk_len < 1024 || chunk_len > 1048576) {
+    silc_free(path);
+    (*callback)(sftp, SILC_SFTP_STATUS_BAD_MESSAGE, NULL, 0,
+		callback_context);
+    return;
+  }
+
+  /* Find such file */
+  entry = memfs_find_entry_path(fs->root, path);
+  silc_free(path);
+  if (!entry) {
+    (*callback)(sftp, SILC_SFTP_STATUS_NO_SUCH_FILE, NULL, 0,
+		callback_context);
+    return;
+  }
+  if (entry->directory || !entry->data ||
+      !(entry->perm & SILC_SFTP_FS_PERM_READ)) {
+    (*callback)(sftp, SILC_SFTP_STATUS_PERMISSION_DENIED, NULL, 0,
+		callback_context);
+    return;
+  }
+
+  memfs_tree_hash(fs, entry, sftp, chunk_len, first, count, callback,
+		  callback_context);
 }
 
 const struct SilcSFTPFilesystemOpsStruct silc_sftp_fs_memory = {
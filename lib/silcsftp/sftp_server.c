@@ -38,23 +38,15 @@ typedef struct {
 
 static void silc_sftp_server_receive_process(SilcSFTP sftp, SilcBuffer buffer);
 
-/* General routine to send SFTP packet to the SFTP client. */
+/* Length of SILC_SFTP_DATA packet header preceding the data */
+#define SILC_SFTP_DATA_HDR_LEN (4 + 1 + 4 + 4)
 
-static void silc_sftp_send_packet(SilcSFTPServer sftp,
-				  SilcSFTPPacket type,
-				  SilcUInt32 len, ...)
+/* Sends the encoded packet in sftp->packet to the SFTP client. */
+
+static void silc_sftp_send_buffer(SilcSFTPServer sftp, SilcSFTPPacket type)
 {
-  SilcBuffer tmp;
-  va_list vp;
   int ret;
 
-  va_start(vp, len);
-  tmp = silc_sftp_packet_encode_vp(type, sftp->packet, len, vp);
-  va_end(vp);
-  if (!tmp)
-    return;
-  sftp->packet = tmp;
-
   SILC_LOG_HEXDUMP(("SFTP packet to client"), silc_buffer_data(sftp->packet),
 		   silc_buffer_len(sftp->packet));
 
@@ -84,6 +76,54 @@ static void silc_sftp_send_packet(SilcSFTPServer sftp,
   silc_buffer_reset(sftp->packet);
 }
 
+/* General routine to send SFTP packet to the SFTP client. */
+
+static void silc_sftp_send_packet(SilcSFTPServer sftp,
+				  SilcSFTPPacket type,
+				  SilcUInt32 len, ...)
+{
+  SilcBuffer tmp;
+  va_list vp;
+
+  va_start(vp, len);
+  tmp = silc_sftp_packet_encode_vp(type, sftp->packet, len, vp);
+  va_end(vp);
+  if (!tmp)
+    return;
+  sftp->packet = tmp;
+
+  silc_sftp_send_buffer(sftp, type);
+}
+
+/* Returns pointer to the packet buffer where filesystem may read `len'
+   bytes of data for SILC_SFTP_DATA reply.  When the same pointer is later
+   given to the data callback the data is not copied again.  Returns NULL
+   if previous packet is still being sent. */
+
+unsigned char *silc_sftp_server_data_area(SilcSFTP sftp, SilcUInt32 len)
+{
+  SilcSFTPServer server = (SilcSFTPServer)sftp;
+  SilcBuffer tmp;
+
+  if (!server->packet) {
+    server->packet = silc_buffer_alloc(SILC_SFTP_DATA_HDR_LEN + len);
+    if (!server->packet)
+      return NULL;
+  }
+
+  if (silc_buffer_headlen(server->packet) || silc_buffer_len(server->packet))
+    return NULL;
+
+  if (silc_buffer_truelen(server->packet) < SILC_SFTP_DATA_HDR_LEN + len) {
+    tmp = silc_buffer_realloc(server->packet, SILC_SFTP_DATA_HDR_LEN + len);
+    if (!tmp)
+      return NULL;
+    server->packet = tmp;
+  }
+
+  return server->packet->head + SILC_SFTP_DATA_HDR_LEN;
+}
+
 /* Handles stream I/O */
 
 static void silc_sftp_server_io(SilcStream stream, SilcStreamStatus status,
@@ -250,6 +290,22 @@ static void silc_sftp_server_data(SilcSFTP sftp,
     return;
   }
 
+  /* If the data was read to the packet buffer, add only the header */
+  if (server->packet &&
+      data == server->packet->head + SILC_SFTP_DATA_HDR_LEN &&
+      !silc_buffer_headlen(server->packet) &&
+      !silc_buffer_len(server->packet) &&
+      silc_buffer_truelen(server->packet) >=
+      SILC_SFTP_DATA_HDR_LEN + data_len) {
+    silc_buffer_pull_tail(server->packet, SILC_SFTP_DATA_HDR_LEN + data_len);
+    SILC_PUT32_MSB(8 + data_len, server->packet->data);
+    server->packet->data[4] = SILC_SFTP_DATA;
+    SILC_PUT32_MSB(id, server->packet->data + 5);
+    SILC_PUT32_MSB(data_len, server->packet->data + 9);
+    silc_sftp_send_buffer(server, SILC_SFTP_DATA);
+    return;
+  }
+
   silc_sftp_send_packet(server, SILC_SFTP_DATA, 8 + data_len,
 			SILC_STR_UI_INT(id),
 			SILC_STR_UI_INT(data_len),
@@ -342,7 +398,7 @@ static void silc_sftp_server_extended(SilcSFTP sftp,
     return;
   }
 
-  silc_sftp_send_packet(server, SILC_SFTP_EXTENDED, 4 + data_len,
+  silc_sftp_send_packet(server, SILC_SFTP_EXTENDED_REPLY, 4 + data_len,
 			SILC_STR_UI_INT(id),
 			SILC_STR_UI_XNSTRING(data, data_len),
 			SILC_STR_END);
@@ -378,6 +434,14 @@ SilcSFTP silc_sftp_server_start(SilcStream stream,
   return (SilcSFTP)server;
 }
 
+/* Returns the scheduler of the SFTP server */
+
+SilcSchedule silc_sftp_server_get_schedule(SilcSFTP sftp)
+{
+  SilcSFTPServer server = (SilcSFTPServer)sftp;
+  return server->schedule;
+}
+
 /* Shutdown's the SFTP server.  The caller is responsible of closing
    the associated socket connection.  The SFTP context is freed and is
    invalid after this function returns. */
@@ -389,6 +453,8 @@ void silc_sftp_server_shutdown(SilcSFTP sftp)
   SILC_LOG_DEBUG(("Stopping SFTP server %p", server));
 
   silc_stream_set_notifier(server->stream, server->schedule, NULL, NULL);
+  if (server->fs->fs == &silc_sftp_fs_memory)
+    silc_sftp_fs_memory_server_stop(server->fs, sftp);
   if (server->packet)
     silc_buffer_free(server->packet);
   silc_free(server);
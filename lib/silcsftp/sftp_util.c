@@ -504,3 +504,61 @@ SilcSFTPStatus silc_sftp_map_errno(int err)
 
   return ret;
 }
+
+/* Computes tree hash leaf from one chunk of file.  The leaves and the
+   inner nodes use different prefix byte so that they cannot be mixed. */
+
+SilcBool silc_sftp_tree_hash_leaf(SilcHash hash, const unsigned char *data,
+				  SilcUInt32 data_len, unsigned char *leaf)
+{
+  unsigned char prefix = 0x00;
+
+  if (silc_hash_len(hash) != SILC_SFTP_TREE_HASH_LEN)
+    return FALSE;
+
+  silc_hash_init(hash);
+  silc_hash_update(hash, &prefix, 1);
+  silc_hash_update(hash, data, data_len);
+  silc_hash_final(hash, leaf);
+
+  return TRUE;
+}
+
+/* Computes tree hash root from the leaves, one level at a time. */
+
+SilcBool silc_sftp_tree_hash_root(SilcHash hash, const unsigned char *leaves,
+				  SilcUInt32 count, unsigned char *root)
+{
+  unsigned char prefix = 0x01, *nodes;
+  SilcUInt32 i;
+
+  if (!count || silc_hash_len(hash) != SILC_SFTP_TREE_HASH_LEN)
+    return FALSE;
+
+  nodes = silc_memdup(leaves, count * SILC_SFTP_TREE_HASH_LEN);
+  if (!nodes)
+    return FALSE;
+
+  while (count > 1) {
+    for (i = 0; i + 1 < count; i += 2) {
+      silc_hash_init(hash);
+      silc_hash_update(hash, &prefix, 1);
+      silc_hash_update(hash, nodes + (i * SILC_SFTP_TREE_HASH_LEN),
+		       SILC_SFTP_TREE_HASH_LEN * 2);
+      silc_hash_final(hash, nodes + ((i / 2) * SILC_SFTP_TREE_HASH_LEN));
+    }
+
+    /* Node without pair moves up as is */
+    if (count & 1)
+      memmove(nodes + ((i / 2) * SILC_SFTP_TREE_HASH_LEN),
+	      nodes + (i * SILC_SFTP_TREE_HASH_LEN),
+	      SILC_SFTP_TREE_HASH_LEN);
+
+    count = (count + 1) / 2;
+  }
+
+  memcpy(root, nodes, SILC_SFTP_TREE_HASH_LEN);
+  silc_free(nodes);
+
+  return TRUE;
+}
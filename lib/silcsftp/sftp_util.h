@@ -73,6 +73,22 @@ SilcBuffer silc_sftp_packet_encode_vp(SilcSFTPPacket packet,
 				      SilcBuffer packet_buf, SilcUInt32 len, 
 				      va_list vp);
 
+/* Returns pointer to the SFTP server's packet buffer where `len' bytes of
+   data may be read for SILC_SFTP_DATA reply.  If the same pointer is given
+   to the data callback the data is sent without copying.  Returns NULL if
+   the buffer is not available. */
+unsigned char *silc_sftp_server_data_area(SilcSFTP sftp, SilcUInt32 len);
+
+/* Returns the scheduler of the SFTP server */
+SilcSchedule silc_sftp_server_get_schedule(SilcSFTP sftp);
+
+/* Memory filesystem operations */
+extern const struct SilcSFTPFilesystemOpsStruct silc_sftp_fs_memory;
+
+/* Called by the SFTP server when it is shutdown.  Drops the replies the
+   memory filesystem `fs' has pending for `sftp'. */
+void silc_sftp_fs_memory_server_stop(SilcSFTPFilesystem fs, SilcSFTP sftp);
+
 /* Decodes the SFTP packet data `data' and return the SFTP packet type.
    The payload of the packet is returned to the `payload' pointer. Returns
    NULL if error occurred during decoding. */
@@ -427,7 +427,8 @@ SilcSFTP silc_sftp_client_start(SilcStream stream,
  *
  *    Shutdown's the SFTP client.  The caller is responsible of closing
  *    the associated stream.  The SFTP context is freed and is invalid after
- *    this function returns.
+ *    this function returns.  Requests still waiting for reply are freed
+ *    and their callbacks are not called.
  *
  ***/
 void silc_sftp_client_shutdown(SilcSFTP sftp);
@@ -850,6 +851,89 @@ void silc_sftp_extended(SilcSFTP sftp,
 			SilcSFTPExtendedCallback callback,
 			void *context);
 
+/****d* silcsftp/SilcSFTPAPI/SILC_SFTP_EXTENDED_TREE_HASH
+ *
+ * NAME
+ *
+ *    #define SILC_SFTP_EXTENDED_TREE_HASH "sha256-tree@silcnet.org"
+ *
+ * DESCRIPTION
+ *
+ *    Extended request that returns SHA-256 tree hash of a file.  The file
+ *    is divided into chunks of equal length, the last chunk may be shorter.
+ *    Each chunk has a leaf hash, computed with silc_sftp_tree_hash_leaf,
+ *    and the leaves are combined into the root hash with function
+ *    silc_sftp_tree_hash_root.  The receiver of the file can verify each
+ *    chunk as it arrives and fetch again only the chunks that are corrupted.
+ *
+ *    The request data is encoded as follows:
+ *
+ *      string  path
+ *      uint32  chunk length
+ *      uint32  index of the first leaf to return
+ *      uint32  number of leaves to return
+ *
+ *    The reply data is encoded as follows:
+ *
+ *      uint64  file size
+ *      uint32  total number of leaves
+ *      byte[32] root hash
+ *      uint32  number of leaves returned
+ *      byte[32 * n] leaf hashes
+ *
+ *    At most SILC_SFTP_TREE_HASH_MAX_LEAVES leaves are returned in one
+ *    reply.  Empty file has one leaf, the hash of empty chunk.  A tree has
+ *    at most SILC_SFTP_TREE_HASH_MAX_TOTAL leaves, 8 MB of leaf hashes;
+ *    larger files need longer chunks.  The memory filesystem computes the
+ *    tree in steps from the scheduler and replies once it is ready.  The
+ *    tree is kept until the file size or modification time changes, or
+ *    until the memory is needed for the tree of another file.
+ *
+ ***/
+#define SILC_SFTP_EXTENDED_TREE_HASH "sha256-tree@silcnet.org"
+#define SILC_SFTP_TREE_HASH_LEN 32
+#define SILC_SFTP_TREE_HASH_MAX_LEAVES 1024
+#define SILC_SFTP_TREE_HASH_MAX_TOTAL 262144
+
+/****f* silcsftp/SilcSFTPAPI/silc_sftp_tree_hash_leaf
+ *
+ * SYNOPSIS
+ *
+ *    SilcBool silc_sftp_tree_hash_leaf(SilcHash hash,
+ *                                      const unsigned char *data,
+ *                                      SilcUInt32 data_len,
+ *                                      unsigned char *leaf);
+ *
+ * DESCRIPTION
+ *
+ *    Computes the leaf hash of one chunk `data' into `leaf', which must be
+ *    SILC_SFTP_TREE_HASH_LEN bytes.  The `hash' must be SHA-256.  Returns
+ *    FALSE if `hash' is not of correct length.
+ *
+ ***/
+SilcBool silc_sftp_tree_hash_leaf(SilcHash hash, const unsigned char *data,
+				  SilcUInt32 data_len, unsigned char *leaf);
+
+/****f* silcsftp/SilcSFTPAPI/silc_sftp_tree_hash_root
+ *
+ * SYNOPSIS
+ *
+ *    SilcBool silc_sftp_tree_hash_root(SilcHash hash,
+ *                                      const unsigned char *leaves,
+ *                                      SilcUInt32 count,
+ *                                      unsigned char *root);
+ *
+ * DESCRIPTION
+ *
+ *    Computes the root hash from `count' leaf hashes in `leaves' into
+ *    `root'.  Two adjacent nodes are combined into their parent node, and
+ *    a node without a pair is moved up to the next level as is.  The
+ *    `hash' must be SHA-256.  Returns FALSE on error.
+ *
+ ***/
+SilcBool silc_sftp_tree_hash_root(SilcHash hash, const unsigned char *leaves,
+				  SilcUInt32 count, unsigned char *root);
+
 
 /* SFTP Server Interface */
 
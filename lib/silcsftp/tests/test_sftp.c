@@ -0,0 +1,203 @@
+/* SFTP client request benchmark against the memory filesystem */
+
+#include "silc.h"
+#include "silcsftp.h"
+#include "silcsftp_fs.h"
+#include <sys/socket.h>
+#include <time.h>
+
+/* Size of the served file, size of one read and number of reads per
+   run */
+#define FILE_SIZE (1024 * 1024)
+#define READ_SIZE 512
+#define READS 100000
+
+typedef struct BenchStruct {
+  SilcSchedule schedule;
+  SilcSFTP client;
+  SilcSFTPHandle handle;
+  SilcUInt32 window;		/* Reads kept outstanding */
+  SilcUInt32 sent;
+  SilcUInt32 done;
+  SilcUInt64 offset;
+  SilcBool error;
+} *Bench;
+
+static void bench_read(Bench b);
+
+static void data_cb(SilcSFTP sftp, SilcSFTPStatus status,
+		    const unsigned char *data, SilcUInt32 data_len,
+		    void *context)
+{
+  Bench b = context;
+
+  if (status != SILC_SFTP_STATUS_OK || data_len != READ_SIZE) {
+    fprintf(stderr, "Read failed: status %d, %d bytes\n", status, data_len);
+    b->error = TRUE;
+    silc_schedule_stop(b->schedule);
+    return;
+  }
+
+  if (++b->done == READS) {
+    silc_schedule_stop(b->schedule);
+    return;
+  }
+  bench_read(b);
+}
+
+/* Sends next read request */
+
+static void bench_read(Bench b)
+{
+  if (b->sent == READS)
+    return;
+  b->sent++;
+  silc_sftp_read(b->client, b->handle, b->offset, READ_SIZE, data_cb, b);
+  b->offset = (b->offset + READ_SIZE) % FILE_SIZE;
+}
+
+static void open_cb(SilcSFTP sftp, SilcSFTPStatus status,
+		    SilcSFTPHandle handle, void *context)
+{
+  Bench b = context;
+  SilcUInt32 i;
+
+  if (status != SILC_SFTP_STATUS_OK) {
+    fprintf(stderr, "Open failed: status %d\n", status);
+    b->error = TRUE;
+    silc_schedule_stop(b->schedule);
+    return;
+  }
+
+  b->handle = handle;
+  for (i = 0; i < b->window; i++)
+    bench_read(b);
+}
+
+static void version_cb(SilcSFTP sftp, SilcSFTPStatus status,
+		       SilcSFTPVersion version, void *context)
+{
+  Bench b = context;
+  SilcSFTPAttributesStruct attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+  silc_sftp_open(sftp, "data", SILC_SFTP_FXF_READ, &attrs, open_cb, b);
+}
+
+static void error_cb(SilcSFTP sftp, SilcSFTPStatus status, void *context)
+{
+  Bench b = context;
+
+  fprintf(stderr, "Connection error %d\n", status);
+  b->error = TRUE;
+  silc_schedule_stop(b->schedule);
+}
+
+/* Reads READS blocks with `window' reads outstanding at a time and
+   prints the rate */
+
+static SilcBool bench(SilcSFTPFilesystem fs, SilcUInt32 window)
+{
+  struct BenchStruct ctx;
+  Bench b = &ctx;
+  SilcSchedule schedule;
+  SilcStream cs, ss;
+  SilcSFTP server;
+  int sv[2], size = 4 * 1024 * 1024;
+  clock_t start;
+  double t;
+
+  /* Stopped scheduler cannot be run again, so use new one for each run */
+  schedule = silc_schedule_init(0, NULL);
+  if (!schedule)
+    return FALSE;
+
+  /* SFTP expects one packet per read, like from SILC packet stream, so
+     use socket that keeps the packet boundaries */
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0)
+    return FALSE;
+  setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  setsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  silc_net_set_socket_nonblock(sv[0]);
+  silc_net_set_socket_nonblock(sv[1]);
+  cs = silc_fd_stream_create(sv[0]);
+  ss = silc_fd_stream_create(sv[1]);
+  if (!cs || !ss)
+    return FALSE;
+
+  memset(&ctx, 0, sizeof(ctx));
+  b->schedule = schedule;
+  b->window = window;
+
+  start = clock();
+  server = silc_sftp_server_start(ss, schedule, error_cb, b, fs);
+  b->client = silc_sftp_client_start(cs, schedule, version_cb, error_cb, b);
+  if (!server || !b->client)
+    return FALSE;
+  silc_schedule(schedule);
+  t = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  if (b->handle)
+    silc_sftp_close(b->client, b->handle, NULL, NULL);
+  silc_sftp_client_shutdown(b->client);
+  silc_sftp_server_shutdown(server);
+  silc_stream_destroy(cs);
+  silc_stream_destroy(ss);
+  silc_schedule_uninit(schedule);
+
+  if (b->error || b->done != READS)
+    return FALSE;
+
+  fprintf(stdout, "%5d reads outstanding: %.0f reads/sec\n", window,
+	  READS / t);
+  return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  SilcSFTPFilesystem fs = NULL;
+  static const SilcUInt32 windows[] = { 1, 16, 256, 1024 };
+  char path[64], url[80], *data;
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*sftp*");
+  }
+
+  /* File served from the memory filesystem */
+  silc_snprintf(path, sizeof(path), "/tmp/test_sftp.%d", getpid());
+  silc_snprintf(url, sizeof(url), "file://%s", path);
+  data = silc_calloc(FILE_SIZE, 1);
+  if (!data)
+    goto err;
+  if (silc_file_writefile(path, data, FILE_SIZE) < 0) {
+    silc_free(data);
+    goto err;
+  }
+  silc_free(data);
+
+  fs = silc_sftp_fs_memory_alloc(SILC_SFTP_FS_PERM_READ);
+  if (!fs)
+    goto err;
+  if (!silc_sftp_fs_memory_add_file(fs, NULL, SILC_SFTP_FS_PERM_READ,
+				    "data", url))
+    goto err;
+
+  for (i = 0; i < sizeof(windows) / sizeof(windows[0]); i++)
+    if (!bench(fs, windows[i]))
+      goto err;
+
+  success = TRUE;
+
+ err:
+  if (fs)
+    silc_sftp_fs_memory_free(fs);
+  unlink(path);
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
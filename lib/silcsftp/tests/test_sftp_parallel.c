@@ -0,0 +1,348 @@
+/* SFTP parallel session benchmark over a link with latency */
+
+#include "silc.h"
+#include "silcsftp.h"
+#include "silcsftp_fs.h"
+#include <sys/socket.h>
+
+/* Size of the served file, and read size and window per session as in
+   client file transfer */
+#define FILE_SIZE (64 * 1024 * 1024)
+#define READ_LEN 63488
+#define WINDOW 16
+
+/* Delay added to the replies, milliseconds */
+#define DELAY 25
+
+/* Maximum number of sessions */
+#define MAX_SESSIONS 8
+
+/* Stream that delays everything written to it by DELAY milliseconds
+   before writing it to the underlying stream */
+typedef struct {
+  const SilcStreamOps *ops;
+  SilcStream stream;
+  SilcSchedule schedule;
+  SilcStreamNotifier notifier;
+  void *notifier_context;
+} *DelayStream;
+
+/* Data waiting to be written */
+typedef struct {
+  DelayStream stream;
+  SilcUInt32 len;
+  unsigned char data[1];
+} *DelayData;
+
+typedef struct BenchStruct *Bench;
+
+/* One SFTP session */
+typedef struct {
+  Bench b;
+  SilcStream cs;
+  SilcStream ss;
+  SilcSFTP client;
+  SilcSFTP server;
+  SilcSFTPHandle handle;
+} *Session, SessionStruct;
+
+struct BenchStruct {
+  SilcSchedule schedule;
+  SessionStruct sessions[MAX_SESSIONS];
+  SilcUInt64 offset;		/* Next offset to request */
+  SilcUInt64 received;
+  SilcBool error;
+};
+
+SILC_TASK_CALLBACK(delay_write)
+{
+  DelayData d = context;
+  int ret;
+
+  ret = silc_stream_write(d->stream->stream, d->data, d->len);
+  if (ret == -1) {
+    /* Socket buffer is full, try again shortly */
+    silc_schedule_task_add_timeout(d->stream->schedule, delay_write, d,
+				   0, 1000);
+    return;
+  }
+  silc_free(d);
+}
+
+static int delay_read(SilcStream stream, unsigned char *buf,
+		      SilcUInt32 buf_len)
+{
+  DelayStream s = stream;
+  return silc_stream_read(s->stream, buf, buf_len);
+}
+
+static int delay_write_data(SilcStream stream, const unsigned char *data,
+			    SilcUInt32 data_len)
+{
+  DelayStream s = stream;
+  DelayData d;
+
+  d = silc_malloc(sizeof(*d) + data_len);
+  if (!d)
+    return -2;
+  d->stream = s;
+  d->len = data_len;
+  memcpy(d->data, data, data_len);
+  silc_schedule_task_add_timeout(s->schedule, delay_write, d,
+				 0, DELAY * 1000);
+  return data_len;
+}
+
+static SilcBool delay_close(SilcStream stream)
+{
+  DelayStream s = stream;
+  return silc_stream_close(s->stream);
+}
+
+static void delay_destroy(SilcStream stream)
+{
+  DelayStream s = stream;
+  silc_stream_destroy(s->stream);
+  silc_free(s);
+}
+
+/* Passes notifications of the underlying stream on with our stream */
+
+static void delay_io(SilcStream stream, SilcStreamStatus status,
+		     void *context)
+{
+  DelayStream s = context;
+  s->notifier(s, status, s->notifier_context);
+}
+
+static SilcBool delay_notifier(SilcStream stream, SilcSchedule schedule,
+			       SilcStreamNotifier callback, void *context)
+{
+  DelayStream s = stream;
+
+  s->notifier = callback;
+  s->notifier_context = context;
+  return silc_stream_set_notifier(s->stream, schedule,
+				  callback ? delay_io : NULL, s);
+}
+
+static SilcSchedule delay_get_schedule(SilcStream stream)
+{
+  DelayStream s = stream;
+  return s->schedule;
+}
+
+const SilcStreamOps delay_stream_ops =
+{
+  delay_read,
+  delay_write_data,
+  delay_close,
+  delay_destroy,
+  delay_notifier,
+  delay_get_schedule,
+};
+
+static SilcStream delay_stream_create(SilcStream stream,
+				      SilcSchedule schedule)
+{
+  DelayStream s;
+
+  s = silc_calloc(1, sizeof(*s));
+  if (!s)
+    return NULL;
+  s->ops = &delay_stream_ops;
+  s->stream = stream;
+  s->schedule = schedule;
+  return s;
+}
+
+static void session_read(Session s);
+
+static void data_cb(SilcSFTP sftp, SilcSFTPStatus status,
+		    const unsigned char *data, SilcUInt32 data_len,
+		    void *context)
+{
+  Session s = context;
+  Bench b = s->b;
+
+  if (status != SILC_SFTP_STATUS_OK) {
+    fprintf(stderr, "Read failed: status %d\n", status);
+    b->error = TRUE;
+    silc_schedule_stop(b->schedule);
+    return;
+  }
+
+  b->received += data_len;
+  if (b->received == FILE_SIZE) {
+    silc_schedule_stop(b->schedule);
+    return;
+  }
+  session_read(s);
+}
+
+/* Requests next chunk of the file on session `s' */
+
+static void session_read(Session s)
+{
+  Bench b = s->b;
+  SilcUInt32 len = READ_LEN;
+
+  if (b->offset == FILE_SIZE)
+    return;
+  if (FILE_SIZE - b->offset < len)
+    len = FILE_SIZE - b->offset;
+  silc_sftp_read(s->client, s->handle, b->offset, len, data_cb, s);
+  b->offset += len;
+}
+
+static void open_cb(SilcSFTP sftp, SilcSFTPStatus status,
+		    SilcSFTPHandle handle, void *context)
+{
+  Session s = context;
+  int i;
+
+  if (status != SILC_SFTP_STATUS_OK) {
+    fprintf(stderr, "Open failed: status %d\n", status);
+    s->b->error = TRUE;
+    silc_schedule_stop(s->b->schedule);
+    return;
+  }
+
+  s->handle = handle;
+  for (i = 0; i < WINDOW; i++)
+    session_read(s);
+}
+
+static void version_cb(SilcSFTP sftp, SilcSFTPStatus status,
+		       SilcSFTPVersion version, void *context)
+{
+  SilcSFTPAttributesStruct attrs;
+
+  memset(&attrs, 0, sizeof(attrs));
+  silc_sftp_open(sftp, "data", SILC_SFTP_FXF_READ, &attrs, open_cb, context);
+}
+
+static void error_cb(SilcSFTP sftp, SilcSFTPStatus status, void *context)
+{
+  Session s = context;
+  Bench b = s->b;
+
+  fprintf(stderr, "Connection error %d\n", status);
+  b->error = TRUE;
+  silc_schedule_stop(b->schedule);
+}
+
+/* Reads the file striped over `count' sessions and prints the rate */
+
+static SilcBool bench(SilcSFTPFilesystem fs, int count)
+{
+  struct BenchStruct ctx;
+  Bench b = &ctx;
+  Session s;
+  int i, sv[2], size = 4 * 1024 * 1024;
+  SilcInt64 start;
+  double t;
+
+  memset(&ctx, 0, sizeof(ctx));
+  b->schedule = silc_schedule_init(0, NULL);
+  if (!b->schedule)
+    return FALSE;
+
+  for (i = 0; i < count; i++) {
+    s = &b->sessions[i];
+    s->b = b;
+
+    /* SFTP expects one packet per read, like from SILC packet stream, so
+       use socket that keeps the packet boundaries */
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0)
+      return FALSE;
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    silc_net_set_socket_nonblock(sv[0]);
+    silc_net_set_socket_nonblock(sv[1]);
+    s->cs = silc_fd_stream_create(sv[0]);
+    s->ss = delay_stream_create(silc_fd_stream_create(sv[1]), b->schedule);
+    if (!s->cs || !s->ss)
+      return FALSE;
+  }
+
+  start = silc_time_usec();
+  for (i = 0; i < count; i++) {
+    s = &b->sessions[i];
+    s->server = silc_sftp_server_start(s->ss, b->schedule, error_cb, s, fs);
+    s->client = silc_sftp_client_start(s->cs, b->schedule, version_cb,
+				       error_cb, s);
+    if (!s->server || !s->client)
+      return FALSE;
+  }
+  silc_schedule(b->schedule);
+  t = (silc_time_usec() - start) / 1000000.0;
+
+  silc_schedule_task_del_by_callback(b->schedule, delay_write);
+  for (i = 0; i < count; i++) {
+    s = &b->sessions[i];
+    silc_sftp_client_shutdown(s->client);
+    silc_sftp_server_shutdown(s->server);
+    silc_stream_destroy(s->cs);
+    silc_stream_destroy(s->ss);
+  }
+  silc_schedule_uninit(b->schedule);
+
+  if (b->error || b->received != FILE_SIZE)
+    return FALSE;
+
+  fprintf(stdout, "%d session%s: %.2f seconds, %.1f MB/sec\n", count,
+	  count > 1 ? "s" : " ", t, FILE_SIZE / t / (1024 * 1024));
+  return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  SilcSFTPFilesystem fs = NULL;
+  char path[64], url[80], *data;
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*sftp*");
+  }
+
+  /* File served from the memory filesystem */
+  silc_snprintf(path, sizeof(path), "/tmp/test_sftp_parallel.%d", getpid());
+  silc_snprintf(url, sizeof(url), "file://%s", path);
+  data = silc_calloc(FILE_SIZE, 1);
+  if (!data)
+    goto err;
+  if (silc_file_writefile(path, data, FILE_SIZE) < 0) {
+    silc_free(data);
+    goto err;
+  }
+  silc_free(data);
+
+  fs = silc_sftp_fs_memory_alloc(SILC_SFTP_FS_PERM_READ);
+  if (!fs)
+    goto err;
+  if (!silc_sftp_fs_memory_add_file(fs, NULL, SILC_SFTP_FS_PERM_READ,
+				    "data", url))
+    goto err;
+
+  fprintf(stdout, "%d MB, %d reads of %d bytes per session, "
+	  "%d ms reply delay:\n", FILE_SIZE / (1024 * 1024), WINDOW,
+	  READ_LEN, DELAY);
+  for (i = 1; i <= MAX_SESSIONS; i *= 2)
+    if (!bench(fs, i))
+      goto err;
+
+  success = TRUE;
+
+ err:
+  if (fs)
+    silc_sftp_fs_memory_free(fs);
+  unlink(path);
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
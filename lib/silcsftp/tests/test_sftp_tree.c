@@ -0,0 +1,264 @@
+/* Tree hash tests against the memory filesystem.  The filesystem is
+   compiled in here with small tree hash memory, so that dropping the
+   trees of other files can be tested with small files. */
+
+#define MEMFS_TREE_MEMORY (40 * SILC_SFTP_TREE_HASH_LEN)
+#include "../sftp_fs_memory.c"
+#include <sys/socket.h>
+
+/* Tree hash chunk length, and the test files, 17 leaves each */
+#define CHUNK_LEN 1024
+#define FILE_SIZE (16 * CHUNK_LEN + 100)
+#define FILES 3
+
+typedef struct TestStruct {
+  SilcSchedule schedule;
+  SilcSFTPFilesystem fs;
+  SilcSFTP server;
+  SilcHash hash;
+  SilcSFTPStatus status;
+  SilcBool replied;
+  unsigned char *data;		/* Expected file content */
+  SilcUInt64 size;		/* Expected file size */
+  SilcBool verified;
+} *Test;
+
+/* Checks the reply against the leaf hashes and root of `t->data' */
+
+static void tree_reply(SilcSFTP sftp, SilcSFTPStatus status,
+		       const unsigned char *data, SilcUInt32 data_len,
+		       void *context)
+{
+  Test t = context;
+  SilcBufferStruct buf;
+  unsigned char *root, *leaves, *expected = NULL;
+  SilcUInt64 size;
+  SilcUInt32 total, count, len, i;
+
+  t->status = status;
+  t->replied = TRUE;
+  if (status != SILC_SFTP_STATUS_OK)
+    return;
+
+  silc_buffer_set(&buf, (unsigned char *)data, data_len);
+  if (silc_buffer_unformat(&buf,
+			   SILC_STR_UI_INT64(&size),
+			   SILC_STR_UI_INT(&total),
+			   SILC_STR_DATA(&root, SILC_SFTP_TREE_HASH_LEN),
+			   SILC_STR_UI_INT(&count),
+			   SILC_STR_END) < 0 ||
+      size != t->size || total != (size + CHUNK_LEN - 1) / CHUNK_LEN ||
+      count != total)
+    return;
+  silc_buffer_pull(&buf, 16 + SILC_SFTP_TREE_HASH_LEN);
+  if (silc_buffer_unformat(&buf,
+			   SILC_STR_DATA(&leaves,
+					 count * SILC_SFTP_TREE_HASH_LEN),
+			   SILC_STR_END) < 0)
+    return;
+
+  expected = silc_malloc((total + 1) * SILC_SFTP_TREE_HASH_LEN);
+  if (!expected)
+    return;
+  for (i = 0; i < total; i++) {
+    len = size - i * CHUNK_LEN < CHUNK_LEN ? size - i * CHUNK_LEN : CHUNK_LEN;
+    silc_sftp_tree_hash_leaf(t->hash, t->data + i * CHUNK_LEN, len,
+			     expected + i * SILC_SFTP_TREE_HASH_LEN);
+  }
+  silc_sftp_tree_hash_root(t->hash, expected, total,
+			   expected + total * SILC_SFTP_TREE_HASH_LEN);
+  t->verified = (!memcmp(leaves, expected, total * SILC_SFTP_TREE_HASH_LEN) &&
+		 !memcmp(root, expected + total * SILC_SFTP_TREE_HASH_LEN,
+			 SILC_SFTP_TREE_HASH_LEN));
+  silc_free(expected);
+}
+
+/* Requests the tree hash of file `name' and waits for the reply.  Returns
+   the reply status.  `data' is the expected content of `size' bytes. */
+
+static SilcSFTPStatus tree_hash(Test t, const char *name,
+				unsigned char *data, SilcUInt64 size)
+{
+  SilcBuffer buffer;
+
+  t->data = data;
+  t->size = size;
+  t->verified = FALSE;
+  t->replied = FALSE;
+
+  buffer = silc_buffer_alloc_size(16 + strlen(name));
+  if (!buffer)
+    return SILC_SFTP_STATUS_FAILURE;
+  silc_buffer_format(buffer,
+		     SILC_STR_UI_INT(strlen(name)),
+		     SILC_STR_UI32_STRING(name),
+		     SILC_STR_UI_INT(CHUNK_LEN),
+		     SILC_STR_UI_INT(0),
+		     SILC_STR_UI_INT(SILC_SFTP_TREE_HASH_MAX_LEAVES),
+		     SILC_STR_END);
+  t->fs->fs->sftp_extended(t->fs->fs_context, t->server,
+			   SILC_SFTP_EXTENDED_TREE_HASH,
+			   silc_buffer_data(buffer), silc_buffer_len(buffer),
+			   tree_reply, t);
+  silc_buffer_free(buffer);
+
+  /* Reply is sent from the scheduler once the tree is computed */
+  while (!t->replied)
+    silc_schedule_one(t->schedule, 0);
+
+  if (t->status == SILC_SFTP_STATUS_OK && !t->verified) {
+    fprintf(stderr, "Tree hash of %s is wrong\n", name);
+    return SILC_SFTP_STATUS_FAILURE;
+  }
+  return t->status;
+}
+
+/* Returns TRUE if file `name' has computed tree hash */
+
+static SilcBool has_tree(Test t, const char *name)
+{
+  MemFSEntry entry;
+
+  entry = memfs_find_entry_path(((MemFS)t->fs->fs_context)->root, name);
+  return entry && entry->tree;
+}
+
+static void server_error(SilcSFTP sftp, SilcSFTPStatus status, void *context)
+{
+}
+
+int main(int argc, char **argv)
+{
+  struct TestStruct ctx;
+  Test t = &ctx;
+  SilcBool success = FALSE;
+  unsigned char *data[FILES + 1];
+  char path[FILES + 2][64], url[80], name[8];
+  int i, fd, sv[2] = { -1, -1 };
+  SilcStream stream = NULL;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*sftp*");
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+  memset(data, 0, sizeof(data));
+  for (i = 0; i < FILES + 2; i++)
+    silc_snprintf(path[i], sizeof(path[i]), "/tmp/test_sftp_tree.%d.%d",
+		  getpid(), i);
+
+  silc_hash_register_default();
+  if (!silc_hash_alloc("sha256", &t->hash))
+    goto err;
+  t->schedule = silc_schedule_init(0, NULL);
+  if (!t->schedule)
+    goto err;
+  t->fs = silc_sftp_fs_memory_alloc(SILC_SFTP_FS_PERM_READ);
+  if (!t->fs)
+    goto err;
+
+  /* The server is only needed for its scheduler */
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0)
+    goto err;
+  stream = silc_fd_stream_create(sv[0]);
+  if (!stream)
+    goto err;
+  t->server = silc_sftp_server_start(stream, t->schedule, server_error, t,
+				     t->fs);
+  if (!t->server)
+    goto err;
+
+  /* Files of 17 leaves, and a file of 41 leaves, which does not fit in
+     the tree hash memory of 40 hashes */
+  for (i = 0; i < FILES + 1; i++) {
+    SilcUInt32 size = i < FILES ? FILE_SIZE : 40 * CHUNK_LEN + 1;
+    SilcUInt32 k;
+
+    data[i] = silc_malloc(size);
+    if (!data[i])
+      goto err;
+    for (k = 0; k < size; k++)
+      data[i][k] = (k * 7 + i) ^ (k >> 9);
+    if (silc_file_writefile(path[i], (char *)data[i], size) < 0)
+      goto err;
+    silc_snprintf(url, sizeof(url), "file://%s", path[i]);
+    silc_snprintf(name, sizeof(name), "%c", 'a' + i);
+    if (!silc_sftp_fs_memory_add_file(t->fs, NULL, SILC_SFTP_FS_PERM_READ,
+				      name, url))
+      goto err;
+  }
+
+  /* File with more leaves than any tree may have.  It is sparse and is
+     refused before it is read. */
+  fd = silc_file_open(path[FILES + 1], O_CREAT | O_WRONLY | O_TRUNC);
+  if (fd < 0 ||
+      ftruncate(fd, (SilcUInt64)SILC_SFTP_TREE_HASH_MAX_TOTAL * CHUNK_LEN +
+		1) < 0)
+    goto err;
+  silc_file_close(fd);
+  silc_snprintf(url, sizeof(url), "file://%s", path[FILES + 1]);
+  if (!silc_sftp_fs_memory_add_file(t->fs, NULL, SILC_SFTP_FS_PERM_READ,
+				    "huge", url))
+    goto err;
+
+  /* Two trees fit */
+  if (tree_hash(t, "a", data[0], FILE_SIZE) != SILC_SFTP_STATUS_OK ||
+      tree_hash(t, "b", data[1], FILE_SIZE) != SILC_SFTP_STATUS_OK ||
+      !has_tree(t, "a") || !has_tree(t, "b")) {
+    fprintf(stderr, "Could not compute two tree hashes\n");
+    goto err;
+  }
+
+  /* The third does not, and the others are dropped */
+  if (tree_hash(t, "c", data[2], FILE_SIZE) != SILC_SFTP_STATUS_OK ||
+      has_tree(t, "a") || has_tree(t, "b") || !has_tree(t, "c")) {
+    fprintf(stderr, "Trees of other files were not dropped\n");
+    goto err;
+  }
+
+  /* Dropped tree is computed again */
+  if (tree_hash(t, "a", data[0], FILE_SIZE) != SILC_SFTP_STATUS_OK ||
+      !has_tree(t, "a") || !has_tree(t, "c")) {
+    fprintf(stderr, "Dropped tree hash was not computed again\n");
+    goto err;
+  }
+
+  /* Tree larger than the memory fails even after dropping others */
+  if (tree_hash(t, "d", data[3], 40 * CHUNK_LEN + 1) == SILC_SFTP_STATUS_OK ||
+      has_tree(t, "d")) {
+    fprintf(stderr, "Tree hash larger than its memory was computed\n");
+    goto err;
+  }
+
+  if (tree_hash(t, "huge", NULL, (SilcUInt64)SILC_SFTP_TREE_HASH_MAX_TOTAL *
+		CHUNK_LEN + 1) == SILC_SFTP_STATUS_OK) {
+    fprintf(stderr, "Tree hash with too many leaves was computed\n");
+    goto err;
+  }
+
+  success = TRUE;
+
+ err:
+  if (t->server)
+    silc_sftp_server_shutdown(t->server);
+  if (stream)
+    silc_stream_destroy(stream);
+  if (sv[1] >= 0)
+    close(sv[1]);
+  if (t->fs)
+    silc_sftp_fs_memory_free(t->fs);
+  if (t->schedule)
+    silc_schedule_uninit(t->schedule);
+  if (t->hash)
+    silc_hash_free(t->hash);
+  for (i = 0; i < FILES + 1; i++)
+    silc_free(data[i]);
+  for (i = 0; i < FILES + 2; i++)
+    unlink(path[i]);
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
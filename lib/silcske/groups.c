@@ -69,6 +69,62 @@ const struct SilcSKEDiffieHellmanGroupDefStruct silc_ske_groups[] =
   { 0, NULL, NULL, NULL }
 };
 
+/* Modulus contexts of the groups.  They are created when the group is
+   used first time and they are shared by all users of the group.  The
+   lock is allocated once, when a group is used first time. */
+static SilcMPModContext silc_ske_group_ctx[sizeof(silc_ske_groups) /
+					   sizeof(silc_ske_groups[0])];
+static SilcMutex silc_ske_group_lock = NULL;
+#ifdef SILC_THREADS
+#if defined(SILC_HAVE_PTHREAD)
+static pthread_once_t silc_ske_group_once = PTHREAD_ONCE_INIT;
+#elif defined(SILC_WIN32)
+static LONG silc_ske_group_once = 0;
+#endif
+
+static void silc_ske_group_lock_init(void)
+{
+  silc_mutex_alloc(&silc_ske_group_lock);
+}
+#endif /* SILC_THREADS */
+
+/* Returns the modulus context for group `i'.  The context also has the
+   comb table for the generator. */
+
+static SilcMPModContext
+silc_ske_group_get_context(int i, SilcSKEDiffieHellmanGroup group)
+{
+  SilcMPModContext ctx;
+
+#if defined(SILC_THREADS) && defined(SILC_HAVE_PTHREAD)
+  pthread_once(&silc_ske_group_once, silc_ske_group_lock_init);
+#elif defined(SILC_THREADS) && defined(SILC_WIN32)
+  /* Other threads spin until the lock is ready */
+  if (InterlockedCompareExchange(&silc_ske_group_once, 1, 0) == 0) {
+    silc_ske_group_lock_init();
+    InterlockedExchange(&silc_ske_group_once, 2);
+  }
+  while (silc_ske_group_once != 2)
+    SleepEx(0, 0);
+#endif /* SILC_THREADS */
+
+  silc_mutex_lock(silc_ske_group_lock);
+
+  ctx = silc_ske_group_ctx[i];
+  if (!ctx) {
+    ctx = silc_mp_mod_context_alloc(&group->group);
+    if (ctx) {
+      silc_mp_mod_context_set_base(ctx, &group->generator,
+				   silc_mp_sizeinbase(&group->group_order, 2));
+      silc_ske_group_ctx[i] = ctx;
+    }
+  }
+
+  silc_mutex_unlock(silc_ske_group_lock);
+
+  return ctx;
+}
+
 /* Returns Diffie Hellman group by group number */
 
 SilcSKEStatus silc_ske_group_get_by_number(int number,
@@ -98,6 +154,7 @@ SilcSKEStatus silc_ske_group_get_by_number(int number,
     silc_mp_set_str(&group->group, silc_ske_groups[i].group, 16);
     silc_mp_set_str(&group->group_order, silc_ske_groups[i].group_order, 16);
     silc_mp_set_str(&group->generator, silc_ske_groups[i].generator, 16);
+    group->ctx = silc_ske_group_get_context(i, group);
 
     *ret = group;
   }
@@ -134,6 +191,7 @@ SilcSKEStatus silc_ske_group_get_by_name(const char *name,
     silc_mp_set_str(&group->group, silc_ske_groups[i].group, 16);
     silc_mp_set_str(&group->group_order, silc_ske_groups[i].group_order, 16);
     silc_mp_set_str(&group->generator, silc_ske_groups[i].generator, 16);
+    group->ctx = silc_ske_group_get_context(i, group);
 
     *ret = group;
   }
@@ -141,6 +199,17 @@ SilcSKEStatus silc_ske_group_get_by_name(const char *name,
   return SILC_SKE_STATUS_OK;
 }
 
+/* Computes dst = base ^ exp mod p in the group */
+
+void silc_ske_group_pow_mod(SilcSKEDiffieHellmanGroup group, SilcMPInt *dst,
+			    SilcMPInt *base, SilcMPInt *exp)
+{
+  if (group->ctx)
+    silc_mp_pow_mod_ctx(dst, base, exp, group->ctx);
+  else
+    silc_mp_pow_mod(dst, base, exp, &group->group);
+}
+
 /* Free group */
 
 void silc_ske_group_free(SilcSKEDiffieHellmanGroup group)
@@ -36,9 +36,14 @@ struct SilcSKEDiffieHellmanGroupStruct {
   SilcMPInt group;
   SilcMPInt group_order;
   SilcMPInt generator;
+  SilcMPModContext ctx;		/* Shared modulus context, may be NULL */
 };
 
 /* List of defined groups. */
 extern const struct SilcSKEDiffieHellmanGroupDefStruct silc_ske_groups[];
 
+/* Computes dst = base ^ exp mod p in the group */
+void silc_ske_group_pow_mod(SilcSKEDiffieHellmanGroup group, SilcMPInt *dst,
+			    SilcMPInt *base, SilcMPInt *exp);
+
 #endif
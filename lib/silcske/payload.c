@@ -267,7 +267,7 @@ SilcSKEStatus silc_ske_payload_ke_decode(SilcSKE ske,
 {
   SilcSKEStatus status = SILC_SKE_STATUS_ERROR;
   SilcSKEKEPayload payload;
-  unsigned char *x = NULL;
+  unsigned char *x;
   SilcUInt16 x_len;
   SilcUInt32 tot_len = 0, len2;
   int ret;
@@ -308,7 +308,7 @@ SilcSKEStatus silc_ske_payload_ke_decode(SilcSKE ske,
   ret = silc_buffer_unformat(buffer,
 			     SILC_STR_UI_XNSTRING_ALLOC(&payload->pk_data,
 							payload->pk_len),
-			     SILC_STR_UI16_NSTRING_ALLOC(&x, &x_len),
+			     SILC_STR_UI16_NSTRING(&x, &x_len),
 			     SILC_STR_UI16_NSTRING_ALLOC(&payload->sign_data,
 							 &payload->sign_len),
 			     SILC_STR_END);
@@ -345,8 +345,6 @@ SilcSKEStatus silc_ske_payload_ke_decode(SilcSKE ske,
   /* Decode the binary data to integer */
   silc_mp_init(&payload->x);
   silc_mp_bin2mp(x, x_len, &payload->x);
-  memset(x, 0, sizeof(x_len));
-  silc_free(x);
 
   /* Return the payload */
   *return_payload = payload;
@@ -356,7 +354,6 @@ SilcSKEStatus silc_ske_payload_ke_decode(SilcSKE ske,
  err:
   silc_free(payload->pk_data);
   silc_free(payload->sign_data);
-  silc_free(x);
   silc_free(payload);
   ske->status = status;
   return status;
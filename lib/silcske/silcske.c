@@ -1474,8 +1474,8 @@ SILC_FSM_STATE(silc_ske_st_initiator_phase2)
 
   /* Do the Diffie Hellman computation, e = g ^ x mod p */
   silc_mp_init(&payload->x);
-  silc_mp_pow_mod(&payload->x, &ske->prop->group->generator, x,
-		  &ske->prop->group->group);
+  silc_ske_group_pow_mod(ske->prop->group, &payload->x,
+			 &ske->prop->group->generator, x);
 
   /* Get public key */
   payload->pk_data = silc_pkcs_public_key_encode(ske->public_key, &pk_len);
@@ -1633,7 +1633,7 @@ SILC_FSM_STATE(silc_ske_st_initiator_phase3)
     goto err;
   }
   silc_mp_init(KEY);
-  silc_mp_pow_mod(KEY, &payload->x, ske->x, &ske->prop->group->group);
+  silc_ske_group_pow_mod(ske->prop->group, KEY, &payload->x, ske->x);
   ske->KEY = KEY;
 
   /* Decode the remote's public key */
@@ -2341,8 +2341,8 @@ SILC_FSM_STATE(silc_ske_st_responder_phase4)
 
   /* Do the Diffie Hellman computation, f = g ^ x mod p */
   silc_mp_init(&send_payload->x);
-  silc_mp_pow_mod(&send_payload->x, &ske->prop->group->generator, x,
-		  &ske->prop->group->group);
+  silc_ske_group_pow_mod(ske->prop->group, &send_payload->x,
+			 &ske->prop->group->generator, x);
 
   SILC_LOG_DEBUG(("Computing KEY = e ^ x mod p"));
 
@@ -2353,8 +2353,8 @@ SILC_FSM_STATE(silc_ske_st_responder_phase4)
     goto err;
   }
   silc_mp_init(KEY);
-  silc_mp_pow_mod(KEY, &ske->ke1_payload->x, ske->x,
-		  &ske->prop->group->group);
+  silc_ske_group_pow_mod(ske->prop->group, KEY, &ske->ke1_payload->x,
+			 ske->x);
   ske->KEY = KEY;
 
   /** Send KE2 payload */
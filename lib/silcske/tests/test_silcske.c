@@ -0,0 +1,244 @@
+/* SILC Key Exchange handshake tests and latency benchmark */
+
+#include "silc.h"
+#include <sys/socket.h>
+
+/* Number of handshakes measured */
+#define ROUNDS 100
+
+typedef struct BenchStruct {
+  SilcSchedule schedule;
+  SilcSKE ike;
+  SilcSKEKeyMaterial keymat[2];		/* Initiator's and responder's */
+  int done;
+  SilcBool error;
+  const char *group;
+} *Bench;
+
+static SilcRng rng;
+static SilcPacketEngine engine;
+static SilcPublicKey public_key;
+static SilcPrivateKey private_key;
+
+/* Packets that SKE does not take */
+
+static SilcBool packet_receive(SilcPacketEngine engine,
+			       SilcPacketStream stream,
+			       SilcPacket packet,
+			       void *callback_context,
+			       void *stream_context)
+{
+  return FALSE;
+}
+
+static void packet_eos(SilcPacketEngine engine, SilcPacketStream stream,
+		       void *callback_context, void *stream_context)
+{
+}
+
+static void packet_error(SilcPacketEngine engine, SilcPacketStream stream,
+			 SilcPacketError error, void *callback_context,
+			 void *stream_context)
+{
+  Bench b = stream_context;
+  fprintf(stderr, "Packet error: %s\n", silc_packet_error_string(error));
+  b->error = TRUE;
+  silc_schedule_stop(b->schedule);
+}
+
+static SilcPacketCallbacks packet_cbs =
+{
+  packet_receive, packet_eos, packet_error
+};
+
+/* Both ends accept the other's public key */
+
+static void verify_key(SilcSKE ske, SilcPublicKey public_key,
+		       void *context, SilcSKEVerifyCbCompletion completion,
+		       void *completion_context)
+{
+  completion(ske, SILC_SKE_STATUS_OK, completion_context);
+}
+
+static void completed(SilcSKE ske, SilcSKEStatus status,
+		      SilcSKESecurityProperties prop,
+		      SilcSKEKeyMaterial keymat,
+		      SilcSKERekeyMaterial rekey,
+		      void *context)
+{
+  Bench b = context;
+
+  silc_ske_free_rekey_material(rekey);
+  if (status != SILC_SKE_STATUS_OK) {
+    fprintf(stderr, "Key exchange failed: %s\n", silc_ske_map_status(status));
+    b->error = TRUE;
+    silc_schedule_stop(b->schedule);
+    return;
+  }
+
+  b->group = silc_ske_group_get_name(prop->group);
+  b->keymat[ske == b->ike ? 0 : 1] = keymat;
+  if (++b->done == 2)
+    silc_schedule_stop(b->schedule);
+}
+
+/* Returns TRUE if `init' and `resp' are the same session keys.  Both
+   ends have the keys named as the initiator uses them, and the responder
+   swaps them in silc_ske_set_keys. */
+
+static SilcBool same_keys(SilcSKEKeyMaterial init, SilcSKEKeyMaterial resp)
+{
+  return (init->enc_key_len == resp->enc_key_len &&
+	  init->hmac_key_len == resp->hmac_key_len &&
+	  init->iv_len == resp->iv_len &&
+	  !memcmp(init->send_enc_key, resp->send_enc_key,
+		  init->enc_key_len / 8) &&
+	  !memcmp(init->receive_enc_key, resp->receive_enc_key,
+		  init->enc_key_len / 8) &&
+	  !memcmp(init->send_hmac_key, resp->send_hmac_key,
+		  init->hmac_key_len) &&
+	  !memcmp(init->receive_hmac_key, resp->receive_hmac_key,
+		  init->hmac_key_len) &&
+	  !memcmp(init->send_iv, resp->send_iv, init->iv_len) &&
+	  !memcmp(init->receive_iv, resp->receive_iv, init->iv_len) &&
+	  memcmp(init->send_enc_key, init->receive_enc_key,
+		 init->enc_key_len / 8));
+}
+
+/* Runs one mutual authentication key exchange between initiator and
+   responder over a local socket pair.  Both ends must end up with the
+   same keys. */
+
+static SilcBool handshake(SilcUInt32 flags, const char **group)
+{
+  struct BenchStruct ctx;
+  Bench b = &ctx;
+  SilcSKEParamsStruct params;
+  SilcPacketStream is, rs;
+  SilcSKE ike, rke;
+  SilcBool success;
+  int sv[2];
+
+  memset(&ctx, 0, sizeof(ctx));
+  memset(&params, 0, sizeof(params));
+
+  /* Stopped scheduler cannot be run again, so use new one each time */
+  b->schedule = silc_schedule_init(0, NULL);
+  if (!b->schedule)
+    return FALSE;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    return FALSE;
+  silc_net_set_socket_nonblock(sv[0]);
+  silc_net_set_socket_nonblock(sv[1]);
+  is = silc_packet_stream_create(engine, b->schedule,
+				 silc_fd_stream_create(sv[0]));
+  rs = silc_packet_stream_create(engine, b->schedule,
+				 silc_fd_stream_create(sv[1]));
+  if (!is || !rs)
+    return FALSE;
+  silc_packet_set_context(is, b);
+  silc_packet_set_context(rs, b);
+
+  ike = silc_ske_alloc(rng, b->schedule, NULL, public_key, private_key, b);
+  rke = silc_ske_alloc(rng, b->schedule, NULL, public_key, private_key, b);
+  if (!ike || !rke)
+    return FALSE;
+  b->ike = ike;
+  silc_ske_set_callbacks(ike, verify_key, completed, b);
+  silc_ske_set_callbacks(rke, verify_key, completed, b);
+
+  params.version = "SILC-1.2-1.1.11 test_silcske";
+  params.flags = flags;
+  silc_ske_responder(rke, rs, &params);
+  silc_ske_initiator(ike, is, &params, NULL);
+  silc_schedule(b->schedule);
+
+  success = !b->error && b->done == 2;
+  if (success && !same_keys(b->keymat[0], b->keymat[1])) {
+    fprintf(stderr, "Initiator and responder have different keys\n");
+    success = FALSE;
+  }
+
+  silc_ske_free(ike);
+  silc_ske_free(rke);
+  silc_packet_stream_destroy(is);
+  silc_packet_stream_destroy(rs);
+  silc_schedule_uninit(b->schedule);
+
+  *group = b->group;
+  return success;
+}
+
+/* Prints the average time of one handshake, both ends */
+
+static SilcBool bench(int bits, SilcUInt32 flags)
+{
+  const char *group = NULL;
+  SilcInt64 usec;
+  int i;
+
+  usec = silc_time_usec();
+  for (i = 0; i < ROUNDS; i++)
+    if (!handshake(flags, &group))
+      return FALSE;
+  usec = silc_time_usec() - usec;
+
+  fprintf(stdout, "%d bit RSA keys, %s%s: %.2f ms per handshake\n", bits,
+	  group, flags & SILC_SKE_SP_FLAG_PFS ? ", PFS" : "",
+	  usec / 1000.0 / ROUNDS);
+  return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*ske*");
+  }
+
+  silc_cipher_register_default();
+  silc_pkcs_register_default();
+  silc_hash_register_default();
+  silc_hmac_register_default();
+
+  rng = silc_rng_alloc();
+  if (!rng)
+    goto err;
+  silc_rng_init(rng);
+
+  engine = silc_packet_engine_start(rng, FALSE, &packet_cbs, NULL);
+  if (!engine)
+    goto err;
+
+  /* Mutual authentication, as clients do.  Both ends use the same key;
+     only its operations matter here.  With smaller key the DH part is
+     larger share of the handshake. */
+  for (i = 1024; i <= 2048; i *= 2) {
+    if (!silc_pkcs_silc_generate_key("rsa", i, "UN=test, HN=localhost",
+				     rng, &public_key, &private_key))
+      goto err;
+    if (!bench(i, SILC_SKE_SP_FLAG_MUTUAL))
+      goto err;
+    if (!bench(i, SILC_SKE_SP_FLAG_MUTUAL | SILC_SKE_SP_FLAG_PFS))
+      goto err;
+    silc_pkcs_public_key_free(public_key);
+    silc_pkcs_private_key_free(private_key);
+  }
+
+  success = TRUE;
+
+ err:
+  if (engine)
+    silc_packet_engine_stop(engine);
+  if (rng)
+    silc_rng_free(rng);
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
@@ -240,7 +240,7 @@ int silc_buffer_sformat_vp(SilcStack stack, SilcBuffer dst, va_list ap)
 	int offst = va_arg(ap, int);
 	if (!offst)
 	  break;
-	if (offst > 1) {
+	if (offst > 0) {
 	  if (offst > silc_buffer_len(dst))
 	    goto fail;
 	  silc_buffer_pull(dst, offst);
@@ -650,7 +650,7 @@ int silc_buffer_sunformat_vp(SilcStack stack, SilcBuffer src, va_list ap)
 	int offst = va_arg(ap, int);
 	if (!offst)
 	  break;
-	if (offst > 1) {
+	if (offst > 0) {
 	  UNFORMAT_HAS_SPACE(src, offst);
 	  silc_buffer_pull(src, offst);
 	} else {
@@ -778,3 +778,214 @@ int silc_buffer_sstrformat(SilcStack stack, SilcBuffer dst, ...)
   va_end(va);
   return len;
 }
+
+
+/************************** Compiled formatting *****************************/
+
+/* Compiled operations */
+#define SILC_BUFFER_OP_UI8     0
+#define SILC_BUFFER_OP_UI16    1
+#define SILC_BUFFER_OP_UI32    2
+#define SILC_BUFFER_OP_UI64    3
+#define SILC_BUFFER_OP_DATA    4
+#define SILC_BUFFER_OP_OFFSET  5
+
+/* Compiles format specification */
+
+SilcBool silc_buffer_program_compile(SilcBufferProgram prog,
+				     const SilcBufferParamType *spec)
+{
+  unsigned char op;
+
+  memset(prog, 0, sizeof(*prog));
+
+  for (; *spec != SILC_PARAM_END; spec++) {
+    switch (*spec) {
+    case SILC_PARAM_SI8_CHAR:
+    case SILC_PARAM_UI8_CHAR:
+      op = SILC_BUFFER_OP_UI8;
+      prog->fixed_len += 1;
+      break;
+    case SILC_PARAM_SI16_SHORT:
+    case SILC_PARAM_UI16_SHORT:
+      op = SILC_BUFFER_OP_UI16;
+      prog->fixed_len += 2;
+      break;
+    case SILC_PARAM_SI32_INT:
+    case SILC_PARAM_UI32_INT:
+      op = SILC_BUFFER_OP_UI32;
+      prog->fixed_len += 4;
+      break;
+    case SILC_PARAM_SI64_INT:
+    case SILC_PARAM_UI64_INT:
+      op = SILC_BUFFER_OP_UI64;
+      prog->fixed_len += 8;
+      break;
+    case SILC_PARAM_DATA:
+    case SILC_PARAM_UI_XNSTRING:
+      op = SILC_BUFFER_OP_DATA;
+      prog->num_var++;
+      break;
+    case SILC_PARAM_OFFSET:
+      op = SILC_BUFFER_OP_OFFSET;
+      prog->num_var++;
+      break;
+    case SILC_PARAM_ADVANCE:
+      prog->advance = TRUE;
+      continue;
+    default:
+      SILC_LOG_DEBUG(("Buffer formatting type `%d' cannot be compiled",
+		      *spec));
+      return FALSE;
+    }
+
+    if (prog->num_ops >= SILC_BUFFER_PROGRAM_MAX) {
+      SILC_LOG_DEBUG(("Too long buffer format specification"));
+      return FALSE;
+    }
+    prog->ops[prog->num_ops++] = op;
+  }
+
+  return TRUE;
+}
+
+/* Returns the total length of the data `prog' formats or unformats with
+   `args', or -1 on error.  Data lengths are at same location in both
+   `data' and `ret_data' of the argument. */
+
+static inline int silc_buffer_program_len(SilcBufferProgram prog,
+					  const SilcBufferArg *args)
+{
+  SilcUInt32 len = prog->fixed_len;
+  int i;
+
+  if (!prog->num_var)
+    return len;
+
+  for (i = 0; i < prog->num_ops; i++) {
+    if (prog->ops[i] == SILC_BUFFER_OP_DATA) {
+      len += args[i].data.len;
+    } else if (prog->ops[i] == SILC_BUFFER_OP_OFFSET) {
+      if (silc_unlikely(args[i].offset < 0))
+	return -1;
+      len += args[i].offset;
+    }
+  }
+
+  if (silc_unlikely((int)len < 0))
+    return -1;
+
+  return len;
+}
+
+/* Formats buffer with compiled format.  The space is checked once before
+   anything is written. */
+
+int silc_buffer_program_format(SilcBufferProgram prog, SilcBuffer dst,
+			       const SilcBufferArg *args)
+{
+  unsigned char *p;
+  int i, len;
+
+  len = silc_buffer_program_len(prog, args);
+  if (silc_unlikely(len < 0))
+    goto fail;
+  if (silc_unlikely(!silc_buffer_enlarge(dst, len)))
+    goto fail;
+
+  p = dst->data;
+  for (i = 0; i < prog->num_ops; i++) {
+    switch (prog->ops[i]) {
+    case SILC_BUFFER_OP_UI8:
+      *p++ = (unsigned char)args[i].ui;
+      break;
+    case SILC_BUFFER_OP_UI16:
+      SILC_PUT16_MSB((SilcUInt16)args[i].ui, p);
+      p += 2;
+      break;
+    case SILC_BUFFER_OP_UI32:
+      SILC_PUT32_MSB((SilcUInt32)args[i].ui, p);
+      p += 4;
+      break;
+    case SILC_BUFFER_OP_UI64:
+      SILC_PUT64_MSB(args[i].ui, p);
+      p += 8;
+      break;
+    case SILC_BUFFER_OP_DATA:
+      if (args[i].data.data && args[i].data.len)
+	memcpy(p, args[i].data.data, args[i].data.len);
+      p += args[i].data.len;
+      break;
+    case SILC_BUFFER_OP_OFFSET:
+      p += args[i].offset;
+      break;
+    }
+  }
+
+  if (prog->advance)
+    silc_buffer_pull(dst, len);
+
+  return len;
+
+ fail:
+  SILC_LOG_DEBUG(("Error occured while formatting data"));
+  return -1;
+}
+
+/* Unformats buffer with compiled format.  The data length is checked once
+   before anything is read. */
+
+int silc_buffer_program_unformat(SilcBufferProgram prog, SilcBuffer src,
+				 const SilcBufferArg *args)
+{
+  unsigned char *p;
+  int i, len;
+
+  len = silc_buffer_program_len(prog, args);
+  if (silc_unlikely(len < 0 || len > silc_buffer_len(src)))
+    goto fail;
+
+  p = src->data;
+  for (i = 0; i < prog->num_ops; i++) {
+    switch (prog->ops[i]) {
+    case SILC_BUFFER_OP_UI8:
+      if (silc_likely(args[i].ptr))
+	*(SilcUInt8 *)args[i].ptr = p[0];
+      p++;
+      break;
+    case SILC_BUFFER_OP_UI16:
+      if (silc_likely(args[i].ptr))
+	SILC_GET16_MSB(*(SilcUInt16 *)args[i].ptr, p);
+      p += 2;
+      break;
+    case SILC_BUFFER_OP_UI32:
+      if (silc_likely(args[i].ptr))
+	SILC_GET32_MSB(*(SilcUInt32 *)args[i].ptr, p);
+      p += 4;
+      break;
+    case SILC_BUFFER_OP_UI64:
+      if (silc_likely(args[i].ptr))
+	SILC_GET64_MSB(*(SilcUInt64 *)args[i].ptr, p);
+      p += 8;
+      break;
+    case SILC_BUFFER_OP_DATA:
+      if (silc_likely(args[i].ret_data.len && args[i].ret_data.data))
+	*args[i].ret_data.data = p;
+      p += args[i].ret_data.len;
+      break;
+    case SILC_BUFFER_OP_OFFSET:
+      p += args[i].offset;
+      break;
+    }
+  }
+
+  if (prog->advance)
+    silc_buffer_pull(src, len);
+
+  return len;
+
+ fail:
+  SILC_LOG_DEBUG(("Error occured while unformatting buffer, len %d",
+		  silc_buffer_len(src)));
+  return -1;
+}
@@ -807,4 +807,151 @@ typedef enum {
  ***/
 #define SILC_STRFMT_END (void *)SILC_STR_END
 
+/****s* silcutil/SilcBufferFormatAPI/SilcBufferProgram
+ *
+ * NAME
+ *
+ *    typedef struct { ... } SilcBufferProgramStruct, *SilcBufferProgram;
+ *
+ * DESCRIPTION
+ *
+ *    Compiled buffer format.  A constant format specification, a
+ *    SilcBufferParamType array ending with SILC_PARAM_END, is compiled
+ *    once with silc_buffer_program_compile and can then be used to format
+ *    and unformat buffers with silc_buffer_program_format and
+ *    silc_buffer_program_unformat without interpreting a variable
+ *    argument list on every call.  This is meant for formats that are
+ *    encoded and decoded very often, such as packet headers.
+ *
+ *    The context is usually statically allocated or part of some other
+ *    structure.  It does not need to be freed.
+ *
+ ***/
+#define SILC_BUFFER_PROGRAM_MAX 32
+typedef struct SilcBufferProgramStruct {
+  unsigned char ops[SILC_BUFFER_PROGRAM_MAX]; /* Compiled operations */
+  SilcUInt16 num_ops;			      /* Number of operations */
+  SilcUInt16 fixed_len;			      /* Length of fixed fields */
+  unsigned int num_var  : 31;		      /* Number of variable fields */
+  unsigned int advance  : 1;		      /* SILC_PARAM_ADVANCE given */
+} SilcBufferProgramStruct, *SilcBufferProgram;
+
+/****s* silcutil/SilcBufferFormatAPI/SilcBufferArg
+ *
+ * NAME
+ *
+ *    typedef union { ... } SilcBufferArg;
+ *
+ * DESCRIPTION
+ *
+ *    Argument to compiled buffer format.  The arguments are given as an
+ *    array, one argument for each type in the format specification, in
+ *    the same order.  SILC_PARAM_ADVANCE and SILC_PARAM_END do not take
+ *    an argument.
+ *
+ *    Formatting:    `ui' for integer types, `data' for SILC_PARAM_DATA
+ *                   and SILC_PARAM_UI_XNSTRING, `offset' for
+ *                   SILC_PARAM_OFFSET.
+ *    Unformatting:  `ptr' for integer types, pointing to integer of the
+ *                   type's size, `ret_data' for SILC_PARAM_DATA and
+ *                   SILC_PARAM_UI_XNSTRING, `offset' for SILC_PARAM_OFFSET.
+ *                   The `ptr' and `ret_data.data' may be NULL.
+ *
+ * SOURCE
+ */
+typedef union {
+  SilcUInt64 ui;			/* Integer to format */
+  void *ptr;				/* Unformatted integer */
+  struct {
+    const unsigned char *data;		/* Data to format */
+    SilcUInt32 len;			/* Data length */
+  } data;
+  struct {
+    unsigned char **data;		/* Unformatted data pointer */
+    SilcUInt32 len;			/* Data length */
+  } ret_data;
+  int offset;				/* Offset, must not be negative */
+} SilcBufferArg;
+/***/
+
+/****f* silcutil/SilcBufferFormatAPI/silc_buffer_program_compile
+ *
+ * SYNOPSIS
+ *
+ *    SilcBool silc_buffer_program_compile(SilcBufferProgram prog,
+ *                                         const SilcBufferParamType *spec);
+ *
+ * DESCRIPTION
+ *
+ *    Compiles the format specification `spec' into `prog'.  The `spec'
+ *    is an array of types ending with SILC_PARAM_END.  Supported types
+ *    are the signed and unsigned integers, SILC_PARAM_DATA,
+ *    SILC_PARAM_UI_XNSTRING, SILC_PARAM_OFFSET and SILC_PARAM_ADVANCE.
+ *    Returns FALSE if the specification has unsupported types or is
+ *    too long.
+ *
+ * EXAMPLE
+ *
+ *    static const SilcBufferParamType header_spec[] = {
+ *      SILC_PARAM_UI16_SHORT,
+ *      SILC_PARAM_UI8_CHAR,
+ *      SILC_PARAM_DATA,
+ *      SILC_PARAM_END
+ *    };
+ *    SilcBufferProgramStruct header;
+ *    SilcBufferArg args[3];
+ *
+ *    silc_buffer_program_compile(&header, header_spec);
+ *    ...
+ *    args[0].ui = len;
+ *    args[1].ui = type;
+ *    args[2].data.data = data;
+ *    args[2].data.len = data_len;
+ *    if (silc_buffer_program_format(&header, buffer, args) < 0)
+ *      error;
+ *
+ ***/
+SilcBool silc_buffer_program_compile(SilcBufferProgram prog,
+				     const SilcBufferParamType *spec);
+
+/****f* silcutil/SilcBufferFormatAPI/silc_buffer_program_format
+ *
+ * SYNOPSIS
+ *
+ *    int silc_buffer_program_format(SilcBufferProgram prog,
+ *                                   SilcBuffer dst,
+ *                                   const SilcBufferArg *args);
+ *
+ * DESCRIPTION
+ *
+ *    Formats the buffer `dst' with the compiled format `prog' and
+ *    arguments `args'.  Returns -1 on error and the length of the
+ *    formatted data otherwise.  The buffer is enlarged if it does not
+ *    have enough space.  This is equivalent to calling silc_buffer_format
+ *    with the same types and arguments.
+ *
+ ***/
+int silc_buffer_program_format(SilcBufferProgram prog, SilcBuffer dst,
+			       const SilcBufferArg *args);
+
+/****f* silcutil/SilcBufferFormatAPI/silc_buffer_program_unformat
+ *
+ * SYNOPSIS
+ *
+ *    int silc_buffer_program_unformat(SilcBufferProgram prog,
+ *                                     SilcBuffer src,
+ *                                     const SilcBufferArg *args);
+ *
+ * DESCRIPTION
+ *
+ *    Unformats the buffer `src' with the compiled format `prog' into the
+ *    arguments `args'.  Returns -1 on error and the length of the
+ *    unformatted data otherwise.  Nothing is unformatted if the buffer
+ *    does not have enough data.  This is equivalent to calling
+ *    silc_buffer_unformat with the same types and arguments.
+ *
+ ***/
+int silc_buffer_program_unformat(SilcBufferProgram prog, SilcBuffer src,
+				 const SilcBufferArg *args);
+
 #endif	/* !SILCBUFFMT_H */
@@ -51,6 +51,36 @@ int silc_file_write(int fd, const char *buffer, SilcUInt32 len)
   return write(fd, (const void *)buffer, len);
 }
 
+/* Reads data from file descriptor `fd' at `offset' to `buf'.  Does not
+   change the file offset. */
+
+int silc_file_pread(int fd, unsigned char *buf, SilcUInt32 buf_len,
+		    SilcUInt64 offset)
+{
+#ifndef SILC_WIN32
+  return pread(fd, (void *)buf, buf_len, (off_t)offset);
+#else
+  if (_lseeki64(fd, offset, SEEK_SET) < 0)
+    return -1;
+  return read(fd, (void *)buf, buf_len);
+#endif /* !SILC_WIN32 */
+}
+
+/* Writes `buffer' of length of `len' to file descriptor `fd' at
+   `offset'.  Does not change the file offset. */
+
+int silc_file_pwrite(int fd, const char *buffer, SilcUInt32 len,
+		     SilcUInt64 offset)
+{
+#ifndef SILC_WIN32
+  return pwrite(fd, (const void *)buffer, len, (off_t)offset);
+#else
+  if (_lseeki64(fd, offset, SEEK_SET) < 0)
+    return -1;
+  return write(fd, (const void *)buffer, len);
+#endif /* !SILC_WIN32 */
+}
+
 /* Closes file descriptor */
 
 int silc_file_close(int fd)
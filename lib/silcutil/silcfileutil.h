@@ -87,6 +87,39 @@ int silc_file_read(int fd, unsigned char *buf, SilcUInt32 buf_len);
  ***/
 int silc_file_write(int fd, const char *buffer, SilcUInt32 len);
 
+/****f* silcutil/SilcFileUtilAPI/silc_file_pread
+ *
+ * SYNOPSIS
+ *
+ *    int silc_file_pread(int fd, unsigned char *buf, SilcUInt32 buf_len,
+ *                        SilcUInt64 offset);
+ *
+ * DESCRIPTION
+ *
+ *    Reads data from file descriptor `fd' starting from `offset' to `buf'.
+ *    On Unix the file offset is not changed and the call is safe to use
+ *    concurrently with the same file descriptor.
+ *
+ ***/
+int silc_file_pread(int fd, unsigned char *buf, SilcUInt32 buf_len,
+		    SilcUInt64 offset);
+
+/****f* silcutil/SilcFileUtilAPI/silc_file_pwrite
+ *
+ * SYNOPSIS
+ *
+ *    int silc_file_pwrite(int fd, const char *buffer, SilcUInt32 len,
+ *                         SilcUInt64 offset);
+ *
+ * DESCRIPTION
+ *
+ *    Writes `buffer' of length of `len' to file descriptor `fd' starting
+ *    from `offset'.  On Unix the file offset is not changed.
+ *
+ ***/
+int silc_file_pwrite(int fd, const char *buffer, SilcUInt32 len,
+		     SilcUInt64 offset);
+
 /****f* silcutil/SilcFileUtilAPI/silc_file_close
  *
  * SYNOPSIS
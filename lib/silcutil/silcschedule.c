@@ -537,6 +537,45 @@ void silc_schedule_set_notify(SilcSchedule schedule,
   schedule->notify_context = context;
 }
 
+/* Returns time left until the earliest timeout */
+
+SilcBool silc_schedule_get_timeout(SilcSchedule schedule,
+				   long *seconds, long *useconds)
+{
+  SilcTask t;
+  SilcTaskTimeout task;
+  struct timeval curtime;
+
+  *seconds = *useconds = 0;
+
+  SILC_SCHEDULE_LOCK(schedule);
+
+  /* First valid task in the task queue has the earliest timeout */
+  silc_list_start(schedule->timeout_queue);
+  while ((task = silc_list_get(schedule->timeout_queue))) {
+    t = (SilcTask)task;
+    if (silc_likely(t->valid))
+      break;
+  }
+  if (!task) {
+    SILC_SCHEDULE_UNLOCK(schedule);
+    return FALSE;
+  }
+
+  silc_gettimeofday(&curtime);
+  if (silc_compare_timeval(&task->timeout, &curtime) > 0) {
+    *seconds = task->timeout.tv_sec - curtime.tv_sec;
+    *useconds = task->timeout.tv_usec - curtime.tv_usec;
+    if (*useconds < 0) {
+      *seconds -= 1;
+      *useconds += 1000000L;
+    }
+  }
+
+  SILC_SCHEDULE_UNLOCK(schedule);
+  return TRUE;
+}
+
 /* Add new task to the scheduler */
 
 SilcTask silc_schedule_task_add(SilcSchedule schedule, SilcUInt32 fd,
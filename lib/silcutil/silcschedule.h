@@ -394,6 +394,26 @@ void *silc_schedule_get_context(SilcSchedule schedule);
 void silc_schedule_set_notify(SilcSchedule schedule,
 			      SilcTaskNotifyCb notify, void *context);
 
+/****f* silcutil/SilcScheduleAPI/silc_schedule_get_timeout
+ *
+ * SYNOPSIS
+ *
+ *    SilcBool silc_schedule_get_timeout(SilcSchedule schedule,
+ *                                       long *seconds, long *useconds);
+ *
+ * DESCRIPTION
+ *
+ *    Returns the time left until the earliest timeout task expires into
+ *    `seconds' and `useconds'.  Both are zero if some timeout task has
+ *    already expired.  Returns FALSE if there are no timeout tasks.  This
+ *    can be used with the notify callback to run the scheduler from an
+ *    external event loop, by calling silc_schedule_one when the timeout
+ *    expires.
+ *
+ ***/
+SilcBool silc_schedule_get_timeout(SilcSchedule schedule,
+				   long *seconds, long *useconds);
+
 /****f* silcutil/SilcScheduleAPI/silc_schedule_task_add_fd
  *
  * SYNOPSIS
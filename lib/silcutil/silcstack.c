@@ -21,58 +21,229 @@
 
 #include "silc.h"
 
+/* Allocates a stack block of `bsize' bytes.  Large blocks are mapped
+   directly from the system so that they can be backed with huge pages
+   and returned to the system when freed. */
+
+static SilcStackData silc_stack_block_alloc(SilcUInt32 bsize)
+{
+  SilcStackData data;
+  SilcUInt32 size = bsize + SILC_STACK_ALIGN(sizeof(*data),
+					     SILC_STACK_DEFAULT_ALIGN);
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+  if (bsize >= SILC_STACK_MMAP_SIZE) {
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+      madvise(data, size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+      data->bytes_left = bsize;
+      data->mapped = TRUE;
+      return data;
+    }
+  }
+#endif /* HAVE_SYS_MMAN_H && MAP_ANONYMOUS */
+
+  data = silc_malloc(size);
+  if (!data)
+    return NULL;
+  data->bytes_left = bsize;
+  data->mapped = FALSE;
+
+  return data;
+}
+
+/* Frees stack block of `bsize' bytes */
+
+static void silc_stack_block_free(SilcStackData data, SilcUInt32 bsize)
+{
+  if (!data)
+    return;
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+  if (data->mapped) {
+    munmap(data, bsize + SILC_STACK_ALIGN(sizeof(*data),
+					  SILC_STACK_DEFAULT_ALIGN));
+    return;
+  }
+#endif /* HAVE_SYS_MMAN_H && MAP_ANONYMOUS */
+
+  silc_free(data);
+}
+
+/* Resets the stack to its initial state, as returned by silc_stack_alloc.
+   Blocks larger than SILC_STACK_SPARE_BLOCK are freed. */
+
+static void silc_stack_reset(SilcStack stack)
+{
+  int i;
+
+  for (i = 0; i < SILC_STACK_BLOCK_NUM; i++) {
+    if (!stack->stack[i])
+      continue;
+    if (i > SILC_STACK_SPARE_BLOCK) {
+      silc_stack_block_free(stack->stack[i], SILC_STACK_BLOCK_SIZE(stack, i));
+      stack->stack[i] = NULL;
+      continue;
+    }
+    stack->stack[i]->bytes_left = SILC_STACK_BLOCK_SIZE(stack, i);
+  }
+
+  stack->frame = &stack->frames[0][0];
+  stack->frame->prev = NULL;
+  stack->frame->bytes_used = stack->stack_size;
+  stack->frame->sp = 1;
+  stack->frame->si = 0;
+}
+
+/* Frees the stack and all its memory */
+
+static void silc_stack_destroy(SilcStack stack)
+{
+  int i;
+
+  for (i = 0; i < stack->num_frames; i++)
+    silc_free(stack->frames[i]);
+  silc_free(stack->frames);
+  for (i = 0; i < SILC_STACK_BLOCK_NUM; i++)
+    silc_stack_block_free(stack->stack[i], SILC_STACK_BLOCK_SIZE(stack, i));
+  silc_free(stack);
+}
+
 /* Allocate the stack */
 
 SilcStack silc_stack_alloc(SilcUInt32 stack_size)
 {
-  SilcStack stack;
+  SilcStack stack, *prev;
+  SilcThreadTls tls;
+
+  stack_size = stack_size ? stack_size : SILC_STACK_DEFAULT_SIZE;
+
+  /* Reuse recently freed stack if one with same size is available */
+  tls = silc_thread_get_tls();
+  if (tls) {
+    for (prev = &tls->spare; *prev; prev = &(*prev)->next) {
+      if ((*prev)->stack_size != stack_size)
+	continue;
+      stack = *prev;
+      *prev = stack->next;
+      stack->next = NULL;
+      tls->num_spare--;
+      return stack;
+    }
+  }
 
   stack = silc_calloc(1, sizeof(*stack));
   if (!stack)
     return NULL;
 
-  stack->frames = silc_calloc(SILC_STACK_DEFAULT_NUM,
-			      sizeof(*stack->frames));
+  stack->frames = silc_calloc(1, sizeof(*stack->frames));
   if (!stack->frames) {
     silc_free(stack);
     return NULL;
   }
+  stack->frames[0] = silc_calloc(SILC_STACK_DEFAULT_NUM,
+				 sizeof(**stack->frames));
+  if (!stack->frames[0]) {
+    silc_free(stack->frames);
+    silc_free(stack);
+    return NULL;
+  }
+  stack->num_frames = 1;
 
   /* Create initial stack */
-  stack->stack_size = stack_size ? stack_size : SILC_STACK_DEFAULT_SIZE;
-  stack->stack[0] = silc_malloc(stack->stack_size +
-  				SILC_STACK_ALIGN(sizeof(*stack->stack[0]),
-  						 SILC_STACK_DEFAULT_ALIGN));
+  stack->stack_size = stack_size;
+  stack->stack[0] = silc_stack_block_alloc(stack->stack_size);
   if (!stack->stack[0]) {
+    silc_free(stack->frames[0]);
     silc_free(stack->frames);
     silc_free(stack);
     return NULL;
   }
-  stack->stack[0]->bytes_left = stack->stack_size;
 
   /* Use the allocated stack in first stack frame */
-  stack->frame = &stack->frames[0];
-  stack->frame->prev = NULL;
-  stack->frame->bytes_used = stack->stack_size;
-  stack->frame->sp = 1;
-  stack->frame->si = 0;
+  silc_stack_reset(stack);
 
   return stack;
 }
 
-/* Frees the stack and all allocated memory */
+/* Frees the stack and all allocated memory.  The stack is kept for
+   recycling in the calling thread if there is room for it. */
 
 void silc_stack_free(SilcStack stack)
 {
-  int i;
+  SilcThreadTls tls;
 
   if (!stack)
     return;
 
-  silc_free(stack->frames);
-  for (i = 0; i < SILC_STACK_BLOCK_NUM; i++)
-    silc_free(stack->stack[i]);
-  silc_free(stack);
+  tls = silc_thread_get_tls();
+  if (tls && tls->num_spare < SILC_STACK_SPARE_NUM &&
+      tls->stack != stack) {
+    silc_stack_reset(stack);
+    stack->next = tls->spare;
+    tls->spare = stack;
+    tls->num_spare++;
+    return;
+  }
+
+  silc_stack_destroy(stack);
+}
+
+/* Returns the calling thread's default stack */
+
+SilcStack silc_stack_get_global(void)
+{
+  SilcThreadTls tls = silc_thread_get_tls();
+
+  if (!tls)
+    return NULL;
+
+  if (!tls->stack) {
+    tls->stack = silc_stack_alloc(SILC_STACK_GLOBAL_SIZE);
+    tls->stack_alloc = TRUE;
+  }
+
+  return tls->stack;
+}
+
+/* Sets the calling thread's default stack */
+
+void silc_stack_set_global(SilcStack stack)
+{
+  SilcThreadTls tls = silc_thread_get_tls();
+
+  if (!tls)
+    return;
+
+  if (tls->stack && tls->stack_alloc) {
+    SilcStack old = tls->stack;
+    tls->stack = NULL;
+    silc_stack_free(old);
+  }
+
+  tls->stack = stack;
+  tls->stack_alloc = FALSE;
+}
+
+/* Frees the stacks of the thread-local context */
+
+void silc_stack_tls_uninit(SilcThreadTls tls)
+{
+  SilcStack stack;
+
+  if (tls->stack && tls->stack_alloc)
+    silc_stack_destroy(tls->stack);
+  tls->stack = NULL;
+
+  while (tls->spare) {
+    stack = tls->spare;
+    tls->spare = stack->next;
+    silc_stack_destroy(stack);
+  }
+  tls->num_spare = 0;
 }
 
 /* Push to next stack frame */
@@ -83,26 +254,27 @@ SilcUInt32 silc_stack_push(SilcStack stack, SilcStackFrame *frame)
     return 0;
 
   if (!frame) {
-    /* See if all frames are in use, and allocate SILC_STACK_DEFAULT_NUM
-       many new frames if needed. */
-    if (stack->frame->sp >= SILC_STACK_ALIGN(stack->frame->sp,
-					     SILC_STACK_DEFAULT_NUM)) {
-      int i = stack->frame->sp;
+    /* Pre-allocated frames are in blocks of SILC_STACK_DEFAULT_NUM frames.
+       The blocks never move in memory so pushing never needs to fix the
+       prev pointers of the frames. */
+    SilcUInt32 i = stack->frame->sp / SILC_STACK_DEFAULT_NUM;
+
+    if (silc_unlikely(i >= stack->num_frames)) {
+      SilcStackFrame **frames;
+
       SILC_LOG_DEBUG(("Allocating more stack frames"));
-      frame = silc_realloc(stack->frames,
-			   SILC_STACK_ALIGN(i + 1, SILC_STACK_DEFAULT_NUM) *
-			   sizeof(*stack->frames));
-      if (!frame)
+      frames = silc_realloc(stack->frames, (i + 1) * sizeof(*stack->frames));
+      if (!frames)
 	return 0;
-      stack->frames = frame;
-      stack->frame = &stack->frames[i - 1];
-
-      /* The prev pointers may become invalid in silc_realloc() */
-      for (i = 1; i < stack->frame->sp; i++)
-	stack->frames[i].prev = &stack->frames[i - 1];
+      stack->frames = frames;
+      stack->frames[i] = silc_calloc(SILC_STACK_DEFAULT_NUM,
+				     sizeof(**stack->frames));
+      if (!stack->frames[i])
+	return 0;
+      stack->num_frames = i + 1;
     }
 
-    frame = &stack->frames[stack->frame->sp];
+    frame = &stack->frames[i][stack->frame->sp % SILC_STACK_DEFAULT_NUM];
   }
 
   /* Push */
@@ -205,14 +377,11 @@ void *silc_stack_malloc(SilcStack stack, SilcUInt32 size, SilcBool aligned)
   /* Allocate the block if it doesn't exist yet */
   if (!stack->stack[si]) {
     SILC_ST_DEBUG(("Allocating new stack block, %d bytes", bsize2));
-    stack->stack[si] = silc_malloc(bsize2 +
-				   SILC_STACK_ALIGN(sizeof(**stack->stack),
-						    SILC_STACK_DEFAULT_ALIGN));
+    stack->stack[si] = silc_stack_block_alloc(bsize2);
     if (silc_unlikely(!stack->stack[si])) {
       SILC_STACK_STAT(stack, num_errors, 1);
       return NULL;
     }
-    stack->stack[si]->bytes_left = bsize2;
   }
 
   /* Now return memory from this new block.  It is guaranteed that in this
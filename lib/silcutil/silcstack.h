@@ -48,7 +48,10 @@
  *
  * The data stack is not thread-safe.  If the same stack context must be
  * used in multithreaded environment concurrency control must be employed.
- * Each thread should allocate their own SilcStack.
+ * Each thread should allocate their own SilcStack.  Each thread also has
+ * a default stack, returned by silc_stack_get_global, that routines may
+ * use for temporary allocations without the stack being given to them
+ * as argument.
  *
  ***/
 
@@ -119,7 +122,9 @@ SilcStack silc_stack_alloc(SilcUInt32 stack_size);
  * DESCRIPTION
  *
  *    Frees the data stack context.  The stack cannot be used anymore after
- *    this and all allocated memory are freed.
+ *    this and all allocated memory are freed.  A few recently freed stacks
+ *    are kept in the calling thread and they are reused by the next
+ *    silc_stack_alloc call with same `stack_size'.
  *
  ***/
 void silc_stack_free(SilcStack stack);
@@ -223,6 +228,54 @@ SilcUInt32 silc_stack_push(SilcStack stack, SilcStackFrame *frame);
  ***/
 SilcUInt32 silc_stack_pop(SilcStack stack);
 
+/****f* silcutil/SilcStackAPI/silc_stack_get_global
+ *
+ * SYNOPSIS
+ *
+ *    SilcStack silc_stack_get_global(void);
+ *
+ * DESCRIPTION
+ *
+ *    Returns the calling thread's default stack.  The stack is allocated
+ *    the first time this is called in the thread, unless it has been set
+ *    with silc_stack_set_global, and it is freed when the thread exits.
+ *    Returns NULL if system is out of memory.
+ *
+ *    The default stack is meant for temporary allocations in routines that
+ *    do not have a stack given to them.  Such routine must push the stack
+ *    before using it and pop it before returning, so that the memory is
+ *    not consumed and allocations made by the caller remain intact.
+ *
+ * EXAMPLE
+ *
+ *    SilcStack stack = silc_stack_get_global();
+ *
+ *    silc_stack_push(stack, NULL);
+ *    tmp = silc_smalloc(stack, len);
+ *    ...
+ *    silc_stack_pop(stack);
+ *
+ ***/
+SilcStack silc_stack_get_global(void);
+
+/****f* silcutil/SilcStackAPI/silc_stack_set_global
+ *
+ * SYNOPSIS
+ *
+ *    void silc_stack_set_global(SilcStack stack);
+ *
+ * DESCRIPTION
+ *
+ *    Sets the `stack' as the calling thread's default stack.  The stack
+ *    is not freed by the library, the caller must free it after it has
+ *    been unset by calling this function with NULL `stack'.  If the
+ *    previous default stack was allocated by silc_stack_get_global it is
+ *    freed.  This can be used to give the thread a larger default stack
+ *    than the library would allocate.
+ *
+ ***/
+void silc_stack_set_global(SilcStack stack);
+
 #include "silcstack_i.h"
 
 #endif /* SILCSTACK_H */
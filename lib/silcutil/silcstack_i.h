@@ -27,9 +27,22 @@
 /* The default stack size when stack is created */
 #define SILC_STACK_DEFAULT_SIZE       1024
 
-/* Number of pre-allocated stack frames */
+/* Number of pre-allocated stack frames.  Frames are allocated in blocks
+   of this many frames. */
 #define SILC_STACK_DEFAULT_NUM        8
 
+/* The size of the thread's default stack, see silc_stack_get_global */
+#define SILC_STACK_GLOBAL_SIZE        16384
+
+/* Stack blocks of this size and larger are mapped directly from the
+   system with mmap() and backed with huge pages when possible. */
+#define SILC_STACK_MMAP_SIZE          0x00200000
+
+/* Maximum number of freed stacks each thread keeps for recycling, and
+   the largest stack block that is kept in a recycled stack. */
+#define SILC_STACK_SPARE_NUM          4
+#define SILC_STACK_SPARE_BLOCK        4
+
 /* Default alignment */
 #define SILC_STACK_DEFAULT_ALIGN      sizeof(unsigned long)
 
@@ -41,6 +54,7 @@
 /* Stack frame data area */
 typedef struct SilcStackDataStruct {
   SilcUInt32 bytes_left;		      /* Free bytes in stack */
+  SilcUInt32 mapped;			      /* Block allocated with mmap() */
   /* Stack data area starts here */
 } *SilcStackData;
 
@@ -55,8 +69,10 @@ struct SilcStackFrameStruct {
 /* The SilcStack context */
 struct SilcStackStruct {
   SilcStackData stack[SILC_STACK_BLOCK_NUM];  /* Allocated stack blocks */
-  SilcStackFrame *frames;		      /* Allocated stack frames */
+  SilcStackFrame **frames;		      /* Allocated stack frame blocks */
   SilcStackFrame *frame;		      /* Current stack frame */
+  struct SilcStackStruct *next;		      /* Next recycled stack */
+  SilcUInt32 num_frames;		      /* Number of frame blocks */
   SilcUInt32 stack_size;		      /* Default stack size */
 };
 
@@ -67,7 +83,7 @@ struct SilcStackStruct {
 /* Computes the size of stack block si. */
 #define SILC_STACK_BLOCK_SIZE(stack, si)		\
   (((si) == 0) ? stack->stack_size :			\
-   SILC_STACK_DEFAULT_SIZE * (1L << ((si) - 1)) << 1);
+   SILC_STACK_DEFAULT_SIZE * (1L << ((si) - 1)) << 1)
 
 /* Returns a pointer to the data in the frame */
 #define SILC_STACK_DATA(stack, si, bsize)				  \
@@ -92,5 +108,9 @@ void *silc_stack_malloc(SilcStack stack, SilcUInt32 size, SilcBool aligned);
 void *silc_stack_realloc(SilcStack stack, SilcUInt32 old_size,
 			 void *ptr, SilcUInt32 size, SilcBool aligned);
 
+/* Frees the stacks of the thread-local context `tls'.  Called when the
+   thread exits. */
+struct SilcThreadTlsStruct;
+void silc_stack_tls_uninit(struct SilcThreadTlsStruct *tls);
 
 #endif /* SILCSTACK_I_H */
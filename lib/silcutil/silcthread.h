@@ -162,4 +162,43 @@ SilcBool silc_thread_wait(SilcThread thread, void **exit_value);
  ***/
 void silc_thread_yield(void);
 
+/****s* silcutil/SilcThreadAPI/SilcThreadTls
+ *
+ * NAME
+ *
+ *    typedef struct SilcThreadTlsStruct { ... } *SilcThreadTls;
+ *
+ * DESCRIPTION
+ *
+ *    Thread-local context of the SILC Toolkit.  Each thread has its own
+ *    context which is allocated when silc_thread_get_tls is called the
+ *    first time in that thread.  It is freed automatically when the thread
+ *    exits.  The context is used by the library internally, for example
+ *    it holds the thread's default SilcStack.  Application should not
+ *    access the fields directly.
+ *
+ ***/
+typedef struct SilcThreadTlsStruct {
+  SilcStack stack;			/* Thread's default stack */
+  SilcStack spare;			/* Recycled stacks */
+  SilcUInt32 num_spare;			/* Number of recycled stacks */
+  unsigned int stack_alloc : 1;		/* `stack' allocated by library */
+} *SilcThreadTls;
+
+/****f* silcutil/SilcThreadAPI/silc_thread_get_tls
+ *
+ * SYNOPSIS
+ *
+ *    SilcThreadTls silc_thread_get_tls(void);
+ *
+ * DESCRIPTION
+ *
+ *    Returns the thread-local context of the calling thread, allocating
+ *    it if it does not exist yet.  Returns NULL if system is out of
+ *    memory.  If the library is compiled without thread support this
+ *    returns the same context for all callers.
+ *
+ ***/
+SilcThreadTls silc_thread_get_tls(void);
+
 #endif
@@ -244,45 +244,187 @@ char *silc_format(char *fmt, ...)
   return strdup(buf);
 }
 
-/* Basic has function to hash strings. May be used with the SilcHashTable.
-   Note that this lowers the characters of the string (with tolower()) so
-   this is used usually with nicknames, channel and server names to provide
-   case insensitive keys. */
+/* String hashing uses SipHash-1-3 with a per-process key, so that the
+   bucket of a name cannot be predicted by a remote party feeding us
+   nicknames. */
+
+#define SILC_SIPROUND						\
+do {								\
+  v0 += v1; v1 = SILC_SIPROTL(v1, 13); v1 ^= v0;		\
+  v0 = SILC_SIPROTL(v0, 32);					\
+  v2 += v3; v3 = SILC_SIPROTL(v3, 16); v3 ^= v2;		\
+  v0 += v3; v3 = SILC_SIPROTL(v3, 21); v3 ^= v0;		\
+  v2 += v1; v1 = SILC_SIPROTL(v1, 17); v1 ^= v2;		\
+  v2 = SILC_SIPROTL(v2, 32);					\
+} while (0)
+#define SILC_SIPROTL(x, b) (SilcUInt64)(((x) << (b)) | ((x) >> (64 - (b))))
+
+/* Lower case ASCII letters of eight characters at once */
+#define SILC_HASH_TOLOWER(w)						\
+do {									\
+  SilcUInt64 __h = (w) & 0x7f7f7f7f7f7f7f7fULL;				\
+  (w) |= (((__h + 0x3f3f3f3f3f3f3f3fULL) &				\
+	   ~(__h + 0x2525252525252525ULL) & ~(w) &			\
+	   0x8080808080808080ULL) >> 2);				\
+} while (0)
+
+static SilcUInt64 silc_hash_key[2];
+#if defined(SILC_THREADS) && defined(SILC_HAVE_PTHREAD)
+static pthread_once_t silc_hash_key_once = PTHREAD_ONCE_INIT;
+static volatile SilcBool silc_hash_key_ready = FALSE;
+#elif defined(SILC_THREADS) && defined(SILC_WIN32)
+static LONG silc_hash_key_once = 0;
+#else
+static SilcBool silc_hash_key_once = FALSE;
+#endif /* SILC_THREADS */
 
-SilcUInt32 silc_hash_string(void *key, void *user_context)
+static SilcUInt32 silc_siphash(const unsigned char *data, SilcUInt32 len,
+			       const SilcUInt64 *key, SilcBool lower)
 {
-  char *s = (char *)key;
-  SilcUInt32 h = 0, g;
+  SilcUInt64 v0 = key[0] ^ 0x736f6d6570736575ULL;
+  SilcUInt64 v1 = key[1] ^ 0x646f72616e646f6dULL;
+  SilcUInt64 v2 = key[0] ^ 0x6c7967656e657261ULL;
+  SilcUInt64 v3 = key[1] ^ 0x7465646279746573ULL;
+  SilcUInt64 m;
+  const unsigned char *end = data + (len & ~7);
+
+  for (; data != end; data += 8) {
+    memcpy(&m, data, 8);
+    if (lower)
+      SILC_HASH_TOLOWER(m);
+    v3 ^= m;
+    SILC_SIPROUND;
+    v0 ^= m;
+  }
 
-  while (*s != '\0') {
-    h = (h << 4) + tolower((int)*s);
-    if ((g = h & 0xf0000000)) {
-      h = h ^ (g >> 24);
-      h = h ^ g;
+  /* Short tail is assembled by hand; memcpy of variable length is a
+     library call and costs as much as the rounds for a nickname. */
+  m = 0;
+  switch (len & 7) {
+  case 7:
+    m |= (SilcUInt64)data[6] << 48;
+    /* fall through */
+  case 6:
+    m |= (SilcUInt64)data[5] << 40;
+    /* fall through */
+  case 5:
+    m |= (SilcUInt64)data[4] << 32;
+    /* fall through */
+  case 4:
+    m |= (SilcUInt64)data[3] << 24;
+    /* fall through */
+  case 3:
+    m |= (SilcUInt64)data[2] << 16;
+    /* fall through */
+  case 2:
+    m |= (SilcUInt64)data[1] << 8;
+    /* fall through */
+  case 1:
+    m |= (SilcUInt64)data[0];
+  }
+  if (lower)
+    SILC_HASH_TOLOWER(m);
+  m |= (SilcUInt64)len << 56;
+  v3 ^= m;
+  SILC_SIPROUND;
+  v0 ^= m;
+
+  v2 ^= 0xff;
+  SILC_SIPROUND;
+  SILC_SIPROUND;
+  SILC_SIPROUND;
+
+  m = v0 ^ v1 ^ v2 ^ v3;
+  return (SilcUInt32)(m ^ (m >> 32));
+}
+
+/* Creates the per-process string hash key from /dev/urandom.  If it is
+   not available the key is derived from the current time, process ID and
+   the randomized load addresses of the process. */
+
+static void silc_hash_key_init(void)
+{
+  const SilcUInt64 fixed[2] = { 0x736f6d6570736575ULL,
+				 0x7465646279746573ULL };
+  SilcUInt64 seed[4];
+  int fd;
+
+  fd = silc_file_open("/dev/urandom", O_RDONLY);
+  if (fd >= 0) {
+    if (silc_file_read(fd, (unsigned char *)silc_hash_key,
+		       sizeof(silc_hash_key)) == sizeof(silc_hash_key)) {
+      silc_file_close(fd);
+      return;
     }
-    s++;
+    silc_file_close(fd);
   }
 
-  return h;
+  seed[0] = (SilcUInt64)silc_time_usec();
+  seed[1] = (SilcUInt64)getpid() ^ (SilcUInt64)(unsigned long)&silc_hash_key;
+  seed[2] = (SilcUInt64)(unsigned long)&seed;
+  seed[3] = (SilcUInt64)(unsigned long)memcmp;
+
+  silc_hash_key[0] = silc_siphash((unsigned char *)seed, 16, fixed, FALSE);
+  silc_hash_key[0] <<= 32;
+  silc_hash_key[0] |= silc_siphash((unsigned char *)seed, 32, fixed, FALSE);
+  silc_hash_key[1] = silc_siphash((unsigned char *)seed + 16, 16, fixed,
+				  FALSE);
+  silc_hash_key[1] <<= 32;
+  silc_hash_key[1] |= silc_siphash((unsigned char *)seed + 8, 24, fixed,
+				   FALSE);
 }
 
-/* Hash UTF-8 string */
+/* Returns the per-process string hash key.  The key is created once, and
+   all threads get the same key. */
 
-SilcUInt32 silc_hash_utf8_string(void *key, void *user_context)
+static const SilcUInt64 *silc_hash_get_key(void)
 {
-  unsigned char *s = (unsigned char *)key;
-  SilcUInt32 h = 0, g;
-
-  while (*s != '\0') {
-    h = (h << 4) + *s;
-    if ((g = h & 0xf0000000)) {
-      h = h ^ (g >> 24);
-      h = h ^ g;
+#if defined(SILC_THREADS) && defined(SILC_HAVE_PTHREAD)
+#if defined(__GNUC__) && (defined(SILC_I486) || defined(SILC_X86_64))
+  /* Stores are not reordered on x86, so a thread that sees the key ready
+     also sees the key.  This saves a pthread_once call for every hash. */
+  if (silc_likely(silc_hash_key_ready)) {
+    __asm __volatile("" : : : "memory");
+    return silc_hash_key;
+  }
+#endif /* __GNUC__ && (SILC_I486 || SILC_X86_64) */
+  pthread_once(&silc_hash_key_once, silc_hash_key_init);
+  silc_hash_key_ready = TRUE;
+#elif defined(SILC_THREADS) && defined(SILC_WIN32)
+  /* Other threads spin until the key is ready */
+  if (silc_unlikely(silc_hash_key_once != 2)) {
+    if (InterlockedCompareExchange(&silc_hash_key_once, 1, 0) == 0) {
+      silc_hash_key_init();
+      InterlockedExchange(&silc_hash_key_once, 2);
     }
-    s++;
+    while (silc_hash_key_once != 2)
+      SleepEx(0, 0);
+  }
+#else
+  if (silc_unlikely(!silc_hash_key_once)) {
+    silc_hash_key_init();
+    silc_hash_key_once = TRUE;
   }
+#endif /* SILC_THREADS */
 
-  return h;
+  return silc_hash_key;
+}
+
+/* Basic has function to hash strings. May be used with the SilcHashTable.
+   Note that this lowers the ASCII characters of the string so this is
+   used usually with nicknames, channel and server names to provide
+   case insensitive keys. */
+
+SilcUInt32 silc_hash_string(void *key, void *user_context)
+{
+  return silc_siphash(key, strlen(key), silc_hash_get_key(), TRUE);
+}
+
+/* Hash UTF-8 string */
+
+SilcUInt32 silc_hash_utf8_string(void *key, void *user_context)
+{
+  return silc_siphash(key, strlen(key), silc_hash_get_key(), FALSE);
 }
 
 /* Basic hash function to hash integers. May be used with the SilcHashTable. */
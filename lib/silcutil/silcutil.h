@@ -155,9 +155,10 @@ char *silc_format(char *fmt, ...);
  * DESCRIPTION
  *
  *    Basic has function to hash strings. May be used with the SilcHashTable.
- *    Note that this lowers the characters of the string (with tolower()) so
- *    this is used usually with nicknames, channel and server names to provide
- *    case insensitive keys.
+ *    Note that this lowers the ASCII characters of the string so this is
+ *    used usually with nicknames, channel and server names to provide case
+ *    insensitive keys.  The hash is SipHash-1-3 with a random per-process
+ *    key, and the values must not be stored or sent outside the process.
  *
  ***/
 SilcUInt32 silc_hash_string(void *key, void *user_context);
@@ -172,7 +173,8 @@ SilcUInt32 silc_hash_string(void *key, void *user_context);
  *
  *    Basic has function to hash UTF-8 strings. May be used with the
  *    SilcHashTable.  Used with identifier strings.  The key is
- *    expected to be casefolded.
+ *    expected to be casefolded.  Like silc_hash_string this uses a
+ *    per-process key.
  *
  ***/
 SilcUInt32 silc_hash_utf8_string(void *key, void *user_context);
@@ -0,0 +1,483 @@
+/* Compiled buffer format tests.  The compiled format must give the same
+   result as silc_buffer_format and silc_buffer_unformat.  Also measures
+   building and parsing SILC packet headers both ways. */
+
+#include "silc.h"
+
+/* The SILC packet header, as in silcpacket.c */
+static const SilcBufferParamType header_spec[] = {
+  SILC_PARAM_DATA,			 /* IV */
+  SILC_PARAM_DATA,			 /* Sequence number */
+  SILC_PARAM_UI16_SHORT,		 /* Payload length */
+  SILC_PARAM_UI8_CHAR,			 /* Flags */
+  SILC_PARAM_UI8_CHAR,			 /* Packet type */
+  SILC_PARAM_UI8_CHAR,			 /* Padding length */
+  SILC_PARAM_UI8_CHAR,			 /* Reserved */
+  SILC_PARAM_UI8_CHAR,			 /* Source ID length */
+  SILC_PARAM_UI8_CHAR,			 /* Destination ID length */
+  SILC_PARAM_UI8_CHAR,			 /* Source ID type */
+  SILC_PARAM_DATA,			 /* Source ID */
+  SILC_PARAM_UI8_CHAR,			 /* Destination ID type */
+  SILC_PARAM_DATA,			 /* Destination ID */
+  SILC_PARAM_DATA,			 /* Padding */
+  SILC_PARAM_DATA,			 /* Data */
+  SILC_PARAM_END
+};
+
+/* Received packet header, as silc_packet_parse parses it */
+static const SilcBufferParamType parse_spec[] = {
+  SILC_PARAM_ADVANCE,
+  SILC_PARAM_UI16_SHORT,		 /* Payload length */
+  SILC_PARAM_UI8_CHAR,			 /* Flags */
+  SILC_PARAM_UI8_CHAR,			 /* Packet type */
+  SILC_PARAM_UI8_CHAR,			 /* Padding length */
+  SILC_PARAM_OFFSET,			 /* Reserved */
+  SILC_PARAM_UI8_CHAR,			 /* Source ID length */
+  SILC_PARAM_UI8_CHAR,			 /* Destination ID length */
+  SILC_PARAM_UI8_CHAR,			 /* Source ID type */
+  SILC_PARAM_DATA,			 /* Source ID */
+  SILC_PARAM_UI8_CHAR,			 /* Destination ID type */
+  SILC_PARAM_DATA,			 /* Destination ID */
+  SILC_PARAM_OFFSET,			 /* Padding */
+  SILC_PARAM_END
+};
+
+/* All integer sizes, signed and unsigned */
+static const SilcBufferParamType int_spec[] = {
+  SILC_PARAM_SI8_CHAR,
+  SILC_PARAM_UI8_CHAR,
+  SILC_PARAM_SI16_SHORT,
+  SILC_PARAM_UI16_SHORT,
+  SILC_PARAM_SI32_INT,
+  SILC_PARAM_UI32_INT,
+  SILC_PARAM_SI64_INT,
+  SILC_PARAM_UI64_INT,
+  SILC_PARAM_UI_XNSTRING,
+  SILC_PARAM_END
+};
+
+/* Types that cannot be compiled */
+static const SilcBufferParamType bad_spec[] = {
+  SILC_PARAM_UI8_CHAR,
+  SILC_PARAM_UI8_STRING,
+  SILC_PARAM_END
+};
+
+/* Packet header fields */
+typedef struct {
+  unsigned char iv[16];
+  SilcUInt32 iv_len;
+  unsigned char psn[4];
+  SilcUInt32 psn_len;
+  SilcUInt16 len;
+  SilcUInt8 flags;
+  SilcUInt8 type;
+  SilcUInt8 padlen;
+  SilcUInt8 src_id_len;
+  SilcUInt8 dst_id_len;
+  SilcUInt8 src_id_type;
+  unsigned char src_id[32];
+  SilcUInt8 dst_id_type;
+  unsigned char dst_id[32];
+  unsigned char pad[16];
+  unsigned char data[256];
+  SilcUInt32 data_len;
+} Header;
+
+/* Fills the header fields from the number `n' */
+
+static void make_header(Header *h, int n)
+{
+  int i;
+
+  memset(h, 0, sizeof(*h));
+  h->iv_len = n & 1 ? 16 : 0;
+  h->psn_len = n & 2 ? 4 : 0;
+  h->flags = n * 3;
+  h->type = n % 40;
+  h->padlen = n % 16;
+  h->src_id_len = n & 4 ? 28 : 12;
+  h->dst_id_len = n & 8 ? 28 : 12;
+  h->src_id_type = 1 + n % 3;
+  h->dst_id_type = 1 + (n / 3) % 3;
+  h->data_len = (n * 37) % sizeof(h->data);
+  for (i = 0; i < sizeof(h->iv); i++)
+    h->iv[i] = n + i;
+  for (i = 0; i < sizeof(h->psn); i++)
+    h->psn[i] = n * i;
+  for (i = 0; i < sizeof(h->src_id); i++)
+    h->src_id[i] = 'a' + (n + i) % 26;
+  for (i = 0; i < sizeof(h->dst_id); i++)
+    h->dst_id[i] = 'A' + (n + i) % 26;
+  for (i = 0; i < h->data_len; i++)
+    h->data[i] = n ^ i;
+  h->len = 10 + h->src_id_len + h->dst_id_len + h->data_len;
+}
+
+/* Formats the header with silc_buffer_format */
+
+static int format_va(SilcBuffer buf, Header *h)
+{
+  return silc_buffer_format(buf,
+			    SILC_STR_DATA(h->iv, h->iv_len),
+			    SILC_STR_DATA(h->psn, h->psn_len),
+			    SILC_STR_UI_SHORT(h->len),
+			    SILC_STR_UI_CHAR(h->flags),
+			    SILC_STR_UI_CHAR(h->type),
+			    SILC_STR_UI_CHAR(h->padlen),
+			    SILC_STR_UI_CHAR(0),
+			    SILC_STR_UI_CHAR(h->src_id_len),
+			    SILC_STR_UI_CHAR(h->dst_id_len),
+			    SILC_STR_UI_CHAR(h->src_id_type),
+			    SILC_STR_DATA(h->src_id, h->src_id_len),
+			    SILC_STR_UI_CHAR(h->dst_id_type),
+			    SILC_STR_DATA(h->dst_id, h->dst_id_len),
+			    SILC_STR_DATA(h->pad, h->padlen),
+			    SILC_STR_DATA(h->data, h->data_len),
+			    SILC_STR_END);
+}
+
+/* Formats the header with compiled format */
+
+static int format_prog(SilcBufferProgram prog, SilcBuffer buf, Header *h)
+{
+  SilcBufferArg args[15];
+
+  args[0].data.data = h->iv;
+  args[0].data.len = h->iv_len;
+  args[1].data.data = h->psn;
+  args[1].data.len = h->psn_len;
+  args[2].ui = h->len;
+  args[3].ui = h->flags;
+  args[4].ui = h->type;
+  args[5].ui = h->padlen;
+  args[6].ui = 0;
+  args[7].ui = h->src_id_len;
+  args[8].ui = h->dst_id_len;
+  args[9].ui = h->src_id_type;
+  args[10].data.data = h->src_id;
+  args[10].data.len = h->src_id_len;
+  args[11].ui = h->dst_id_type;
+  args[12].data.data = h->dst_id;
+  args[12].data.len = h->dst_id_len;
+  args[13].data.data = h->pad;
+  args[13].data.len = h->padlen;
+  args[14].data.data = h->data;
+  args[14].data.len = h->data_len;
+  return silc_buffer_program_format(prog, buf, args);
+}
+
+/* Parsed packet header */
+typedef struct {
+  SilcUInt16 len;
+  SilcUInt8 flags;
+  SilcUInt8 type;
+  SilcUInt8 padlen;
+  SilcUInt8 src_id_len;
+  SilcUInt8 dst_id_len;
+  SilcUInt8 src_id_type;
+  SilcUInt8 dst_id_type;
+  unsigned char *src_id;
+  unsigned char *dst_id;
+} Parsed;
+
+/* Parses the header with silc_buffer_unformat.  The ID lengths and
+   padding length are known from earlier parsing of the packet. */
+
+static int parse_va(SilcBuffer buf, Parsed *p, Header *h)
+{
+  return silc_buffer_unformat(buf,
+			      SILC_STR_ADVANCE,
+			      SILC_STR_UI_SHORT(&p->len),
+			      SILC_STR_UI_CHAR(&p->flags),
+			      SILC_STR_UI_CHAR(&p->type),
+			      SILC_STR_UI_CHAR(&p->padlen),
+			      SILC_STR_OFFSET(1),
+			      SILC_STR_UI_CHAR(&p->src_id_len),
+			      SILC_STR_UI_CHAR(&p->dst_id_len),
+			      SILC_STR_UI_CHAR(&p->src_id_type),
+			      SILC_STR_DATA(&p->src_id, h->src_id_len),
+			      SILC_STR_UI_CHAR(&p->dst_id_type),
+			      SILC_STR_DATA(&p->dst_id, h->dst_id_len),
+			      SILC_STR_OFFSET(h->padlen),
+			      SILC_STR_END);
+}
+
+/* Parses the header with compiled format */
+
+static int parse_prog(SilcBufferProgram prog, SilcBuffer buf, Parsed *p,
+		      Header *h)
+{
+  SilcBufferArg args[12];
+
+  args[0].ptr = &p->len;
+  args[1].ptr = &p->flags;
+  args[2].ptr = &p->type;
+  args[3].ptr = &p->padlen;
+  args[4].offset = 1;
+  args[5].ptr = &p->src_id_len;
+  args[6].ptr = &p->dst_id_len;
+  args[7].ptr = &p->src_id_type;
+  args[8].ret_data.data = &p->src_id;
+  args[8].ret_data.len = h->src_id_len;
+  args[9].ptr = &p->dst_id_type;
+  args[10].ret_data.data = &p->dst_id;
+  args[10].ret_data.len = h->dst_id_len;
+  args[11].offset = h->padlen;
+  return silc_buffer_program_unformat(prog, buf, args);
+}
+
+/* Formats and parses `count' different headers both ways and checks that
+   the results are the same */
+
+static SilcBool test_header(SilcBufferProgram header,
+			    SilcBufferProgram parse, int count)
+{
+  SilcBuffer a, b;
+  Parsed pa, pb;
+  Header h;
+  int n, la, lb;
+
+  a = silc_buffer_alloc(0);
+  b = silc_buffer_alloc(0);
+  if (!a || !b)
+    return FALSE;
+
+  for (n = 0; n < count; n++) {
+    make_header(&h, n);
+    silc_buffer_reset(a);
+    silc_buffer_reset(b);
+    la = format_va(a, &h);
+    lb = format_prog(header, b, &h);
+    if (la < 0 || la != lb || silc_buffer_len(a) != silc_buffer_len(b) ||
+	memcmp(silc_buffer_data(a), silc_buffer_data(b), la)) {
+      fprintf(stderr, "Header %d formatted differently\n", n);
+      goto err;
+    }
+
+    /* Parse after IV and sequence number.  With SILC_STR_ADVANCE
+       silc_buffer_unformat returns 0 instead of the length. */
+    silc_buffer_pull(a, h.iv_len + h.psn_len);
+    silc_buffer_pull(b, h.iv_len + h.psn_len);
+    memset(&pa, 0, sizeof(pa));
+    memset(&pb, 0, sizeof(pb));
+    la = parse_va(a, &pa, &h);
+    lb = parse_prog(parse, b, &pb, &h);
+    if (la < 0 || lb != h.len - h.data_len + h.padlen ||
+	silc_buffer_len(a) != silc_buffer_len(b) ||
+	silc_buffer_len(a) != h.data_len ||
+	memcmp(silc_buffer_data(a), h.data, h.data_len)) {
+      fprintf(stderr, "Header %d parsed differently\n", n);
+      goto err;
+    }
+    if (pa.len != pb.len || pa.len != h.len ||
+	pa.flags != pb.flags || pa.flags != h.flags ||
+	pa.type != pb.type || pa.type != h.type ||
+	pa.padlen != pb.padlen || pa.padlen != h.padlen ||
+	pa.src_id_len != pb.src_id_len || pa.src_id_len != h.src_id_len ||
+	pa.dst_id_len != pb.dst_id_len || pa.dst_id_len != h.dst_id_len ||
+	pa.src_id_type != pb.src_id_type ||
+	pa.src_id_type != h.src_id_type ||
+	pa.dst_id_type != pb.dst_id_type ||
+	pa.dst_id_type != h.dst_id_type ||
+	memcmp(pa.src_id, h.src_id, h.src_id_len) ||
+	memcmp(pb.src_id, h.src_id, h.src_id_len) ||
+	memcmp(pa.dst_id, h.dst_id, h.dst_id_len) ||
+	memcmp(pb.dst_id, h.dst_id, h.dst_id_len)) {
+      fprintf(stderr, "Header %d fields parsed differently\n", n);
+      goto err;
+    }
+
+    /* Truncated header fails both ways and parses nothing */
+    silc_buffer_push(a, lb);
+    silc_buffer_push(b, lb);
+    silc_buffer_push_tail(a, silc_buffer_len(a) - (lb - 1));
+    silc_buffer_push_tail(b, silc_buffer_len(b) - (lb - 1));
+    memset(&pb, 0, sizeof(pb));
+    if (parse_va(a, &pa, &h) != -1 || parse_prog(parse, b, &pb, &h) != -1 ||
+	pb.len || silc_buffer_len(b) != lb - 1) {
+      fprintf(stderr, "Truncated header %d was parsed\n", n);
+      goto err;
+    }
+  }
+
+  silc_buffer_free(a);
+  silc_buffer_free(b);
+  return TRUE;
+
+ err:
+  silc_buffer_free(a);
+  silc_buffer_free(b);
+  return FALSE;
+}
+
+/* Checks integer types and sign extension of both ways */
+
+static SilcBool test_ints(SilcBufferProgram prog)
+{
+  unsigned char a[64], b[64], *xa, *xb;
+  SilcBufferStruct ba, bb;
+  SilcBufferArg args[9];
+  char c1, c2;
+  unsigned char uc1, uc2;
+  SilcInt16 s1, s2;
+  SilcUInt16 us1, us2;
+  SilcInt32 i1, i2;
+  SilcUInt32 ui1, ui2;
+  SilcInt64 l1, l2;
+  SilcUInt64 ul1, ul2;
+
+  silc_buffer_set(&ba, a, sizeof(a));
+  silc_buffer_set(&bb, b, sizeof(b));
+  memset(a, 0, sizeof(a));
+  memset(b, 0xff, sizeof(b));
+  if (silc_buffer_format(&ba,
+			 SILC_STR_UI_CHAR(-2),
+			 SILC_STR_UI_CHAR(0xfe),
+			 SILC_STR_SI_SHORT(-3),
+			 SILC_STR_UI_SHORT(0xfffd),
+			 SILC_STR_SI_INT(-4),
+			 SILC_STR_UI_INT(0xfffffffc),
+			 SILC_STR_SI_INT64(-5),
+			 SILC_STR_UI_INT64(0xfffffffffffffffbULL),
+			 SILC_STR_UI_XNSTRING("abc", 3),
+			 SILC_STR_END) != 33)
+    return FALSE;
+  args[0].ui = (SilcUInt8)-2;
+  args[1].ui = 0xfe;
+  args[2].ui = (SilcUInt16)-3;
+  args[3].ui = 0xfffd;
+  args[4].ui = (SilcUInt32)-4;
+  args[5].ui = 0xfffffffc;
+  args[6].ui = (SilcUInt64)-5;
+  args[7].ui = 0xfffffffffffffffbULL;
+  args[8].data.data = (unsigned char *)"abc";
+  args[8].data.len = 3;
+  if (silc_buffer_program_format(prog, &bb, args) != 33 ||
+      memcmp(a, b, 33) || b[33] != 0xff) {
+    fprintf(stderr, "Integers formatted differently\n");
+    return FALSE;
+  }
+
+  if (silc_buffer_unformat(&ba,
+			   SILC_STR_UI_CHAR(&c1),
+			   SILC_STR_UI_CHAR(&uc1),
+			   SILC_STR_SI_SHORT(&s1),
+			   SILC_STR_UI_SHORT(&us1),
+			   SILC_STR_SI_INT(&i1),
+			   SILC_STR_UI_INT(&ui1),
+			   SILC_STR_SI_INT64(&l1),
+			   SILC_STR_UI_INT64(&ul1),
+			   SILC_STR_UI_XNSTRING(&xa, 3),
+			   SILC_STR_END) != 33)
+    return FALSE;
+  args[0].ptr = &c2;
+  args[1].ptr = &uc2;
+  args[2].ptr = &s2;
+  args[3].ptr = &us2;
+  args[4].ptr = &i2;
+  args[5].ptr = &ui2;
+  args[6].ptr = &l2;
+  args[7].ptr = &ul2;
+  args[8].ret_data.data = &xb;
+  args[8].ret_data.len = 3;
+  if (silc_buffer_program_unformat(prog, &bb, args) != 33 ||
+      c1 != c2 || c2 != -2 || uc1 != uc2 || uc2 != 0xfe ||
+      s1 != s2 || s2 != -3 || us1 != us2 || us2 != 0xfffd ||
+      i1 != i2 || i2 != -4 || ui1 != ui2 || ui2 != 0xfffffffc ||
+      l1 != l2 || l2 != -5 || ul1 != ul2 ||
+      ul2 != 0xfffffffffffffffbULL ||
+      xa - a != xb - b || memcmp(xb, "abc", 3)) {
+    fprintf(stderr, "Integers unformatted differently\n");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Measures building and parsing `count' packet headers both ways */
+
+static void speed(SilcBufferProgram header, SilcBufferProgram parse,
+		  int count)
+{
+  Header h[16];
+  Parsed p;
+  unsigned char data[512];
+  SilcBufferStruct buf;
+  SilcInt64 usec;
+  double t[4];
+  int i, k;
+
+  for (i = 0; i < 16; i++) {
+    make_header(&h[i], i);
+    h[i].data_len = 32;
+  }
+
+  for (k = 0; k < 4; k++) {
+    usec = silc_time_usec();
+    for (i = 0; i < count; i++) {
+      silc_buffer_set(&buf, data, sizeof(data));
+      switch (k) {
+      case 0:
+	format_va(&buf, &h[i & 15]);
+	break;
+      case 1:
+	format_prog(header, &buf, &h[i & 15]);
+	break;
+      case 2:
+	parse_va(&buf, &p, &h[i & 15]);
+	break;
+      case 3:
+	parse_prog(parse, &buf, &p, &h[i & 15]);
+	break;
+      }
+    }
+    t[k] = (silc_time_usec() - usec) * 1000.0 / count;
+  }
+
+  fprintf(stdout, "Build header: silc_buffer_format %.1f ns, "
+	  "compiled %.1f ns\n", t[0], t[1]);
+  fprintf(stdout, "Parse header: silc_buffer_unformat %.1f ns, "
+	  "compiled %.1f ns\n", t[2], t[3]);
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  SilcBufferProgramStruct header, parse, ints, bad;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*buf*");
+  }
+
+  if (!silc_buffer_program_compile(&header, header_spec) ||
+      !silc_buffer_program_compile(&parse, parse_spec) ||
+      !silc_buffer_program_compile(&ints, int_spec)) {
+    fprintf(stderr, "Could not compile format\n");
+    goto err;
+  }
+  if (silc_buffer_program_compile(&bad, bad_spec)) {
+    fprintf(stderr, "Format with string was compiled\n");
+    goto err;
+  }
+
+  SILC_LOG_DEBUG(("Packet headers"));
+  if (!test_header(&header, &parse, 1000))
+    goto err;
+
+  SILC_LOG_DEBUG(("Integers"));
+  if (!test_ints(&ints))
+    goto err;
+
+  speed(&header, &parse, 2000000);
+
+  success = TRUE;
+
+ err:
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
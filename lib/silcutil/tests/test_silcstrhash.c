@@ -0,0 +1,226 @@
+/* String hash tests and speed and distribution benchmark.  The hashes
+   are compared with the ELF hash they replaced. */
+
+#include "silc.h"
+
+/* Number of nicknames in the corpus */
+#define NICKS 20000
+
+static char *nicks[NICKS];
+
+/* The ELF hash silc_hash_string used before SipHash */
+
+static SilcUInt32 elf_hash(void *key, void *user_context)
+{
+  char *s = (char *)key;
+  SilcUInt32 h = 0, g;
+
+  while (*s != '\0') {
+    h = (h << 4) + tolower((int)*s);
+    if ((g = h & 0xf0000000)) {
+      h = h ^ (g >> 24);
+      h = h ^ g;
+    }
+    s++;
+  }
+
+  return h;
+}
+
+/* Creates nicknames the way people pick them: a name, maybe with a
+   common decoration, number or away suffix.  Many share long prefixes
+   and differ only at the end. */
+
+static void make_nicks(void)
+{
+  static const char *first[] = {
+    "pekka", "Priikone", "tomi", "Jari", "mika", "sami", "juha", "ville",
+    "anna", "Maria", "laura", "kati", "alice", "bob", "carol", "dave",
+    "eve", "mallory", "trent", "zebra", "nick", "guest", "user", "silc",
+  };
+  static const char *mid[] = {
+    "", "_", "__", "^", "-", "`", "[m]", "x", "The", "Dr",
+  };
+  static const char *suffix[] = {
+    "", "|away", "|afk", "|work", "_", "^^", "-", "2", "|zzz", "[home]",
+  };
+  char tmp[64];
+  int i;
+
+  for (i = 0; i < NICKS; i++) {
+    silc_snprintf(tmp, sizeof(tmp), "%s%s%s", first[i % 24],
+		  mid[(i / 24) % 10], suffix[(i / 240) % 10]);
+    if (i / 2400)
+      silc_snprintf(tmp + strlen(tmp), sizeof(tmp) - strlen(tmp), "%d",
+		    i / 2400);
+    nicks[i] = strdup(tmp);
+  }
+}
+
+/* Hashes the corpus into `buckets' buckets with modulo, like SilcHashTable
+   does, or with mask when `buckets' is power of two.  Prints the average
+   length of a successful lookup and what a uniform hash would give. */
+
+static void distribution(const char *name, SilcHashFunction hash,
+			 SilcUInt32 buckets, SilcBool mask)
+{
+  SilcUInt32 *count, i, h, max = 0;
+  double probes = 0, ideal;
+
+  count = silc_calloc(buckets, sizeof(*count));
+  if (!count)
+    return;
+
+  for (i = 0; i < NICKS; i++) {
+    h = hash(nicks[i], NULL);
+    h = mask ? h & (buckets - 1) : h % buckets;
+    count[h]++;
+  }
+  for (i = 0; i < buckets; i++) {
+    probes += (double)count[i] * (count[i] + 1) / 2;
+    if (count[i] > max)
+      max = count[i];
+  }
+  probes /= NICKS;
+  ideal = 1 + (NICKS - 1) / (2.0 * buckets);
+
+  fprintf(stdout, "%s, %6d buckets (%s): lookup %.3f (ideal %.3f), "
+	  "longest chain %d\n", name, buckets, mask ? "mask" : "mod",
+	  probes, ideal, max);
+  silc_free(count);
+}
+
+/* Lowers ASCII letters of `src' into `dst', like tolower() in C locale */
+
+static void ascii_lower(char *dst, const char *src)
+{
+  for (; *src; src++, dst++)
+    *dst = (*src >= 'A' && *src <= 'Z') ? *src + 32 : *src;
+  *dst = '\0';
+}
+
+/* Checks that silc_hash_string folds exactly the ASCII letters.  It must
+   give the same value for any case of a key, and the same value as
+   silc_hash_utf8_string of the lowered key.  Every byte value is tried
+   at every position of keys up to three words long, so that both the
+   word loop and the tail are covered. */
+
+static SilcBool check(void)
+{
+  char key[32], upper[32], lower[32];
+  int len, pos, c, i;
+
+  for (i = 0; i < NICKS; i++) {
+    ascii_lower(lower, nicks[i]);
+    for (c = 0; nicks[i][c]; c++)
+      upper[c] = toupper((int)nicks[i][c]);
+    upper[c] = '\0';
+    if (silc_hash_string(nicks[i], NULL) != silc_hash_string(lower, NULL) ||
+	silc_hash_string(upper, NULL) != silc_hash_string(lower, NULL) ||
+	silc_hash_utf8_string(lower, NULL) != silc_hash_string(upper, NULL)) {
+      fprintf(stderr, "Cases of `%s' hash differently\n", nicks[i]);
+      return FALSE;
+    }
+  }
+
+  for (len = 1; len <= 24; len++) {
+    memset(key, 'q', len);
+    key[len] = '\0';
+    for (pos = 0; pos < len; pos++) {
+      for (c = 1; c < 256; c++) {
+	key[pos] = c;
+	ascii_lower(lower, key);
+	if (silc_hash_string(key, NULL) !=
+	    silc_hash_utf8_string(lower, NULL)) {
+	  fprintf(stderr, "Byte 0x%02x at %d of %d byte key is folded "
+		  "wrong\n", c, pos, len);
+	  return FALSE;
+	}
+      }
+      key[pos] = 'q';
+    }
+  }
+
+  /* Only letters are folded, and UTF-8 keys are not folded */
+  if (silc_hash_string("nick[]", NULL) == silc_hash_string("nick{}", NULL) ||
+      silc_hash_string("nick\xc3\x84", NULL) ==
+      silc_hash_string("nick\xc3\xa4", NULL) ||
+      silc_hash_utf8_string("Nick", NULL) ==
+      silc_hash_utf8_string("nick", NULL)) {
+    fprintf(stderr, "Characters other than ASCII letters are folded\n");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Prints hashing rate of `hash' over the corpus and a long key */
+
+static void speed(const char *name, SilcHashFunction hash)
+{
+  char longkey[257];
+  SilcUInt32 sum = 0;
+  SilcInt64 usec;
+  int i, k;
+
+  usec = silc_time_usec();
+  for (k = 0; k < 100; k++)
+    for (i = 0; i < NICKS; i++)
+      sum += hash(nicks[i], NULL);
+  usec = silc_time_usec() - usec;
+  fprintf(stdout, "%s, nicknames: %.1f ns/key\n", name,
+	  usec * 1000.0 / (100.0 * NICKS));
+
+  memset(longkey, 'a', sizeof(longkey) - 1);
+  longkey[sizeof(longkey) - 1] = '\0';
+  usec = silc_time_usec();
+  for (k = 0; k < 1000000; k++) {
+    longkey[k & 0xff] = 'a' + (k & 7);
+    sum += hash(longkey, NULL);
+  }
+  usec = silc_time_usec() - usec;
+  fprintf(stdout, "%s, 256 byte key: %.1f ns/key%s\n", name,
+	  usec / 1000.0, sum ? "" : " ");
+}
+
+int main(int argc, char **argv)
+{
+  SilcBool success = FALSE;
+  int i;
+
+  if (argc > 1 && !strcmp(argv[1], "-d")) {
+    silc_log_debug(TRUE);
+    silc_log_quick(TRUE);
+    silc_log_set_debug_string("*util*");
+  }
+
+  make_nicks();
+
+  SILC_LOG_DEBUG(("Case folding"));
+  if (!check())
+    goto err;
+
+  speed("ELF hash", elf_hash);
+  speed("silc_hash_string", silc_hash_string);
+  speed("silc_hash_utf8_string", silc_hash_utf8_string);
+
+  /* SilcHashTable with auto rehash has 10993 buckets for the corpus.
+     Masking with 4096 shows how well the low bits are mixed. */
+  distribution("ELF hash", elf_hash, 10993, FALSE);
+  distribution("ELF hash", elf_hash, 4096, TRUE);
+  distribution("silc_hash_string", silc_hash_string, 10993, FALSE);
+  distribution("silc_hash_string", silc_hash_string, 4096, TRUE);
+  distribution("silc_hash_utf8_string", silc_hash_utf8_string, 10993, FALSE);
+  distribution("silc_hash_utf8_string", silc_hash_utf8_string, 4096, TRUE);
+
+  success = TRUE;
+
+ err:
+  for (i = 0; i < NICKS; i++)
+    silc_free(nicks[i]);
+
+  SILC_LOG_DEBUG(("Testing was %s", success ? "SUCCESS" : "FAILURE"));
+  fprintf(stderr, "Testing was %s\n", success ? "SUCCESS" : "FAILURE");
+
+  return !success;
+}
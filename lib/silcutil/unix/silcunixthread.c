@@ -106,6 +106,52 @@ void silc_thread_yield(void)
 #endif /* SILC_THREADS */
 }
 
+#ifdef SILC_THREADS
+static pthread_key_t silc_thread_tls_key;
+static pthread_once_t silc_thread_tls_once = PTHREAD_ONCE_INIT;
+
+/* Called by pthread when thread exits.  Frees the thread-local context. */
+
+static void silc_thread_tls_destructor(void *context)
+{
+  SilcThreadTls tls = context;
+  silc_stack_tls_uninit(tls);
+  silc_free(tls);
+}
+
+static void silc_thread_tls_init(void)
+{
+  pthread_key_create(&silc_thread_tls_key, silc_thread_tls_destructor);
+}
+#endif /* SILC_THREADS */
+
+SilcThreadTls silc_thread_get_tls(void)
+{
+#ifdef SILC_THREADS
+  SilcThreadTls tls;
+
+  pthread_once(&silc_thread_tls_once, silc_thread_tls_init);
+
+  tls = pthread_getspecific(silc_thread_tls_key);
+  if (tls)
+    return tls;
+
+  tls = silc_calloc(1, sizeof(*tls));
+  if (!tls)
+    return NULL;
+
+  if (pthread_setspecific(silc_thread_tls_key, tls)) {
+    silc_free(tls);
+    return NULL;
+  }
+
+  return tls;
+#else
+  static struct SilcThreadTlsStruct tls;
+  return &tls;
+#endif /* SILC_THREADS */
+}
+
 /***************************** SILC Mutex API *******************************/
 
 /* SILC Mutex structure */
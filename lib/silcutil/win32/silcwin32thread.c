@@ -33,6 +33,8 @@ typedef struct {
 } *SilcWin32Thread;
 
 static DWORD silc_thread_tls;
+static DWORD silc_thread_tls_index = TLS_OUT_OF_INDEXES;
+static LONG silc_thread_tls_once = 0;
 
 /* Actual routine that is called by WIN32 when the thread is created.
    We will call the start_func from here. When this returns the thread
@@ -87,6 +89,16 @@ void silc_thread_exit(void *exit_value)
 {
 #ifdef SILC_THREADS
   SilcWin32Thread thread = TlsGetValue(silc_thread_tls);
+  SilcThreadTls tls = NULL;
+
+  /* Free thread-local context */
+  if (silc_thread_tls_index != TLS_OUT_OF_INDEXES)
+    tls = TlsGetValue(silc_thread_tls_index);
+  if (tls) {
+    TlsSetValue(silc_thread_tls_index, NULL);
+    silc_stack_tls_uninit(tls);
+    silc_free(tls);
+  }
 
   if (thread) {
     /* If the thread is waitable the memory is freed only in silc_thread_wait
@@ -153,6 +165,37 @@ void silc_thread_yield(void)
 #endif /* SILC_THREADS */
 }
 
+SilcThreadTls silc_thread_get_tls(void)
+{
+#ifdef SILC_THREADS
+  SilcThreadTls tls;
+
+  /* Allocate the index once.  Other threads spin until it is ready. */
+  if (InterlockedCompareExchange(&silc_thread_tls_once, 1, 0) == 0) {
+    silc_thread_tls_index = TlsAlloc();
+    InterlockedExchange(&silc_thread_tls_once, 2);
+  }
+  while (silc_thread_tls_once != 2)
+    SleepEx(0, 0);
+  if (silc_thread_tls_index == TLS_OUT_OF_INDEXES)
+    return NULL;
+
+  tls = TlsGetValue(silc_thread_tls_index);
+  if (tls)
+    return tls;
+
+  tls = silc_calloc(1, sizeof(*tls));
+  if (!tls)
+    return NULL;
+  TlsSetValue(silc_thread_tls_index, tls);
+
+  return tls;
+#else
+  static struct SilcThreadTlsStruct tls;
+  return &tls;
+#endif /* SILC_THREADS */
+}
+
 
 /***************************** SILC Mutex API *******************************/
 